@@ -0,0 +1,492 @@
+#include <stdio.h>
+#include "apu.h"
+#include "audio.h"
+#include "ring.h"
+
+#define APU_QUEUE_MASK  (APU_QUEUE_SIZE - 1U)
+#define APU_SEQ_CLOCKS  8192 /* CPU clocks per 512 Hz frame sequencer step */
+#define APU_ULTRASONIC  20000.0
+
+/* register offsets from 0xFF10 */
+#define NR10 0x00
+#define NR30 0x0A
+#define NR50 0x14
+#define NR51 0x15
+#define NR52 0x16
+#define WAVE_RAM 0x20
+
+typedef struct
+{
+    Uint32 at; /* audio clock frame */
+    Uint8 reg;
+    Uint8 value;
+} ApuWrite;
+
+typedef struct
+{
+    bool enabled;
+    bool dac;
+    int length;
+    bool length_enable;
+
+    int volume;
+    int env_period;
+    int env_timer;
+    bool env_up;
+
+    Uint16 freq;
+    Uint32 phase;
+    Uint32 inc;      /* one waveform cycle is 2^32 */
+    bool ultrasonic; /* above hearing: output the waveform's mean instead */
+    int duty;
+
+    /* channel 1 */
+    int sweep_timer;
+    bool sweep_enabled;
+    Uint16 shadow;
+
+    /* channel 3 */
+    int wave_shift;
+
+    /* channel 4 */
+    Uint16 lfsr;
+    bool narrow;
+    Uint32 noise_inc; /* LFSR steps per output frame, 16.16 fixed point */
+    Uint32 noise_acc;
+    float noise_out;
+} ApuChannel;
+
+typedef struct
+{
+    Uint8 regs[0x30]; /* 0xFF10-0xFF3F */
+    ApuChannel ch[4];
+    bool power;
+    Uint32 seq_acc;   /* CPU clocks, 16.16 fixed point */
+    int seq_step;
+    float cap_left;   /* DC-blocking capacitor, like the hardware's */
+    float cap_right;
+} Apu;
+
+static const Uint8 duty_table[4] = { 0x01, 0x81, 0x87, 0x7E }; /* 12.5%, 25%, 50%, 75% */
+static const float duty_mean[4] = { -0.75f, -0.5f, 0.0f, 0.5f };
+
+/* game thread -> audio thread */
+static ApuWrite write_slots[APU_QUEUE_SIZE];
+static SpscRing writes = { (Uint8 *)write_slots, APU_QUEUE_SIZE, sizeof(ApuWrite) };
+static SDL_AtomicU32 clock_published;
+static SDL_AtomicU32 gain_bits;
+
+/* audio thread */
+static Apu apu;
+static Uint32 apu_clock;
+static bool apu_booted;
+
+
+/* register side effects */
+static Uint16 channel_freq(int n)
+{
+    return (Uint16)(apu.regs[n * 5 + 3] | ((apu.regs[n * 5 + 4] & 7) << 8));
+}
+
+static void update_pitch(int n)
+{
+    ApuChannel *c = &apu.ch[n];
+    /* pulse cycles are 8 steps of (2048 - f) * 4 clocks, wave cycles 32 steps of (2048 - f) * 2 */
+    double hz = (n == 2 ? 65536.0 : 131072.0) / (2048 - c->freq);
+
+    c->inc = (Uint32)(Uint64)(hz / AUDIO_SAMPLE_RATE * 4294967296.0);
+    c->ultrasonic = hz > APU_ULTRASONIC;
+}
+
+static void update_noise(void)
+{
+    ApuChannel *c = &apu.ch[3];
+    Uint8 v = apu.regs[3 * 5 + 3];
+    int shift = v >> 4;
+    double divisor = (v & 7) ? (double)(v & 7) : 0.5;
+    double hz = shift >= 14 ? 0.0 : 262144.0 / divisor / (double)(1 << shift);
+
+    c->narrow = (v & 8) != 0;
+    c->noise_inc = (Uint32)(hz / AUDIO_SAMPLE_RATE * 65536.0);
+}
+
+/* next sweep frequency, disabling channel 1 on overflow */
+static Uint16 sweep_next(void)
+{
+    ApuChannel *c = &apu.ch[0];
+    Uint16 delta = c->shadow >> (apu.regs[NR10] & 7);
+    int next = (apu.regs[NR10] & 8) ? c->shadow - delta : c->shadow + delta;
+
+    if (next > 2047) {
+        c->enabled = false;
+    }
+    return (Uint16)SDL_clamp(next, 0, 2047);
+}
+
+static void trigger(int n)
+{
+    ApuChannel *c = &apu.ch[n];
+    Uint8 env = apu.regs[n * 5 + 2];
+
+    c->enabled = c->dac;
+    if (c->length == 0) {
+        c->length = n == 2 ? 256 : 64;
+    }
+    c->volume = env >> 4;
+    c->env_period = env & 7;
+    c->env_up = (env & 8) != 0;
+    c->env_timer = c->env_period ? c->env_period : 8;
+
+    switch (n) {
+    case 0: {
+        int period = (apu.regs[NR10] >> 4) & 7;
+        c->shadow = c->freq;
+        c->sweep_timer = period ? period : 8;
+        c->sweep_enabled = period != 0 || (apu.regs[NR10] & 7) != 0;
+        if (apu.regs[NR10] & 7) {
+            sweep_next();
+        }
+        break;
+    }
+    case 2:
+        c->phase = 0;
+        break;
+    case 3:
+        c->lfsr = 0x7FFF;
+        c->noise_acc = 0;
+        break;
+    }
+}
+
+static void write_register(Uint8 reg, Uint8 value)
+{
+    int index, n;
+    ApuChannel *c;
+
+    if (reg < 0x10 || reg > 0x3F) {
+        return;
+    }
+    index = reg - 0x10;
+    if (index >= WAVE_RAM) {
+        apu.regs[index] = value;
+        return;
+    }
+    if (index == NR52) {
+        if (!(value & 0x80)) {
+            SDL_memset(apu.regs, 0, WAVE_RAM);
+            SDL_zeroa(apu.ch);
+        }
+        apu.power = (value & 0x80) != 0;
+        apu.regs[NR52] = value & 0x80;
+        return;
+    }
+    if (!apu.power || index > NR51) {
+        return;
+    }
+    apu.regs[index] = value;
+    if (index >= NR50) {
+        return;
+    }
+
+    n = index / 5;
+    c = &apu.ch[n];
+    switch (index % 5) {
+    case 0:
+        if (n == 2) {
+            c->dac = (value & 0x80) != 0;
+            c->enabled = c->enabled && c->dac;
+        }
+        break;
+    case 1:
+        if (n == 2) {
+            c->length = 256 - value;
+        } else {
+            c->length = 64 - (value & 63);
+            c->duty = value >> 6;
+        }
+        break;
+    case 2:
+        if (n == 2) {
+            c->wave_shift = (value >> 5) & 3;
+        } else {
+            c->dac = (value & 0xF8) != 0;
+            c->enabled = c->enabled && c->dac;
+        }
+        break;
+    case 3:
+        if (n == 3) {
+            update_noise();
+        } else {
+            c->freq = channel_freq(n);
+            update_pitch(n);
+        }
+        break;
+    case 4:
+        if (n != 3) {
+            c->freq = channel_freq(n);
+            update_pitch(n);
+        }
+        c->length_enable = (value & 0x40) != 0;
+        if (value & 0x80) {
+            trigger(n);
+        }
+        break;
+    }
+}
+
+
+/* frame sequencer: length at 256 Hz, sweep at 128 Hz, envelope at 64 Hz */
+static void clock_sequencer(void)
+{
+    int n;
+
+    for (n = 0; n < 4; n++) {
+        ApuChannel *c = &apu.ch[n];
+
+        if (!(apu.seq_step & 1) && c->length_enable && c->length > 0 && --c->length == 0) {
+            c->enabled = false;
+        }
+        if (apu.seq_step == 7 && n != 2 && c->env_period && --c->env_timer <= 0) {
+            c->env_timer = c->env_period;
+            if (c->env_up && c->volume < 15) {
+                c->volume++;
+            } else if (!c->env_up && c->volume > 0) {
+                c->volume--;
+            }
+        }
+    }
+
+    if (apu.seq_step == 2 || apu.seq_step == 6) {
+        ApuChannel *c = &apu.ch[0];
+        int period = (apu.regs[NR10] >> 4) & 7;
+
+        if (--c->sweep_timer <= 0) {
+            c->sweep_timer = period ? period : 8;
+            if (c->sweep_enabled && period) {
+                Uint16 next = sweep_next();
+                if (c->enabled && (apu.regs[NR10] & 7)) {
+                    c->shadow = c->freq = next;
+                    apu.regs[3] = (Uint8)next;
+                    apu.regs[4] = (Uint8)((apu.regs[4] & ~7) | (next >> 8));
+                    update_pitch(0);
+                    sweep_next();
+                }
+            }
+        }
+    }
+    apu.seq_step = (apu.seq_step + 1) & 7;
+}
+
+static float render_pulse(ApuChannel *c)
+{
+    float level = (float)c->volume * (1.0f / 15.0f);
+    float out;
+
+    if (c->ultrasonic) {
+        out = duty_mean[c->duty];
+    } else {
+        out = (duty_table[c->duty] >> (c->phase >> 29)) & 1 ? 1.0f : -1.0f;
+    }
+    c->phase += c->inc;
+    return out * level;
+}
+
+static float render_wave(ApuChannel *c)
+{
+    static const float shift_gain[4] = { 0.0f, 1.0f, 0.5f, 0.25f };
+    Uint32 step = c->phase >> 27;
+    Uint8 byte = apu.regs[WAVE_RAM + step / 2];
+    int sample = (step & 1) ? byte & 15 : byte >> 4;
+    float out = c->ultrasonic ? 0.0f : ((float)sample - 7.5f) * (1.0f / 7.5f);
+
+    c->phase += c->inc;
+    return out * shift_gain[c->wave_shift];
+}
+
+static float render_noise(ApuChannel *c)
+{
+    int steps, high = 0, i;
+
+    c->noise_acc += c->noise_inc;
+    steps = (int)(c->noise_acc >> 16);
+    c->noise_acc &= 0xFFFF;
+
+    /* average over the LFSR steps that fall inside this frame */
+    for (i = 0; i < steps; i++) {
+        Uint16 bit = (c->lfsr ^ (c->lfsr >> 1)) & 1;
+        c->lfsr = (Uint16)((c->lfsr >> 1) | (bit << 14));
+        if (c->narrow) {
+            c->lfsr = (Uint16)((c->lfsr & ~0x40) | (bit << 6));
+        }
+        high += !(c->lfsr & 1);
+    }
+    if (steps > 0) {
+        c->noise_out = (float)(high * 2 - steps) / (float)steps;
+    }
+    return c->noise_out * (float)c->volume * (1.0f / 15.0f);
+}
+
+static void render_span(float *out, int frames, float gain)
+{
+    const Uint32 seq_inc = (Uint32)((Uint64)APU_CLOCK_HZ * 65536 / AUDIO_SAMPLE_RATE);
+    const Uint8 pan = apu.regs[NR51];
+    const float left_gain = (float)(((apu.regs[NR50] >> 4) & 7) + 1) * (0.25f / 8.0f) * gain;
+    const float right_gain = (float)((apu.regs[NR50] & 7) + 1) * (0.25f / 8.0f) * gain;
+    int i, n;
+
+    for (i = 0; i < frames; i++) {
+        float left = 0.0f, right = 0.0f;
+
+        apu.seq_acc += seq_inc;
+        if (apu.seq_acc >= (Uint32)APU_SEQ_CLOCKS << 16) {
+            apu.seq_acc -= (Uint32)APU_SEQ_CLOCKS << 16;
+            clock_sequencer();
+        }
+
+        for (n = 0; n < 4; n++) {
+            ApuChannel *c = &apu.ch[n];
+            float s;
+
+            if (!c->enabled) {
+                continue;
+            }
+            s = n == 2 ? render_wave(c) : n == 3 ? render_noise(c) : render_pulse(c);
+            if (pan & (0x10 << n)) {
+                left += s;
+            }
+            if (pan & (0x01 << n)) {
+                right += s;
+            }
+        }
+
+        left *= left_gain;
+        right *= right_gain;
+        out[i * 2] += left - apu.cap_left;
+        out[i * 2 + 1] += right - apu.cap_right;
+        apu.cap_left = left - (left - apu.cap_left) * 0.996f;
+        apu.cap_right = right - (right - apu.cap_right) * 0.996f;
+    }
+}
+
+void apu_render(float *out, int frames)
+{
+    const ApuWrite *w;
+    float gain;
+    Uint32 bits = SDL_GetAtomicU32(&gain_bits);
+    int i = 0;
+
+    if (!apu_booted) {
+        /* the state the boot ROM leaves behind */
+        write_register(0x26, 0x80);
+        write_register(0x24, 0x77);
+        write_register(0x25, 0xF3);
+        apu_booted = true;
+    }
+    SDL_memcpy(&gain, &bits, sizeof(gain));
+
+    while (i < frames) {
+        int next = frames;
+
+        /* apply every write that is due, then render up to the next one */
+        while ((w = (const ApuWrite *)ring_peek(&writes)) != NULL) {
+            Sint32 due = (Sint32)(w->at - (apu_clock + (Uint32)i));
+            if (due > 0) {
+                next = (int)SDL_min((Sint32)frames, (Sint32)i + due);
+                break;
+            }
+            write_register(w->reg, w->value);
+            ring_consume(&writes);
+        }
+        if (apu.power) {
+            render_span(out + i * AUDIO_CHANNELS, next - i, gain);
+        }
+        i = next;
+    }
+    apu_clock += (Uint32)frames;
+    SDL_SetAtomicU32(&clock_published, apu_clock);
+}
+
+
+/* javascript bridge logic */
+static bool queue_write(Uint32 at, Uint8 reg, Uint8 value)
+{
+    ApuWrite w;
+
+    w.at = at;
+    w.reg = reg;
+    w.value = value;
+    return audio_is_running() && ring_push(&writes, &w);
+}
+
+/* apu.now() -> the audio clock, in frames at apu.rate */
+static duk_ret_t native_apu_now(duk_context *ctx)
+{
+    duk_push_uint(ctx, SDL_GetAtomicU32(&clock_published));
+    return 1;
+}
+
+/* apu.write(reg, value, at): `at` defaults to as soon as possible */
+static duk_ret_t native_apu_write(duk_context *ctx)
+{
+    Uint8 reg = (Uint8)(duk_require_uint(ctx, 0) & 0xFF);
+    Uint8 value = (Uint8)duk_require_uint(ctx, 1);
+    Uint32 at = duk_get_uint_default(ctx, 2, SDL_GetAtomicU32(&clock_published));
+
+    duk_push_boolean(ctx, queue_write(at, reg, value));
+    return 1;
+}
+
+/*
+ * apu.sequence(bytes, at, framesPerTick) queues pattern data: triples of
+ * (ticks to wait, register, value). Returns how many triples were queued so
+ * the rest can be resubmitted once the queue has drained.
+ */
+static duk_ret_t native_apu_sequence(duk_context *ctx)
+{
+    duk_size_t size, i;
+    const Uint8 *data = (const Uint8 *)duk_require_buffer_data(ctx, 0, &size);
+    Uint32 at = duk_require_uint(ctx, 1);
+    Uint32 frames_per_tick = duk_require_uint(ctx, 2);
+
+    for (i = 0; i + 3 <= size; i += 3) {
+        at += data[i] * frames_per_tick;
+        if (!queue_write(at, data[i + 1], data[i + 2])) {
+            break;
+        }
+    }
+    duk_push_uint(ctx, (duk_uint_t)(i / 3));
+    return 1;
+}
+
+static duk_ret_t native_apu_volume(duk_context *ctx)
+{
+    float gain = SDL_max((float)duk_require_number(ctx, 0), 0.0f);
+    Uint32 bits;
+
+    SDL_memcpy(&bits, &gain, sizeof(bits));
+    SDL_SetAtomicU32(&gain_bits, bits);
+    return 0;
+}
+
+static const duk_function_list_entry apu_functions[] = {
+    { "now", native_apu_now, 0 },
+    { "write", native_apu_write, 3 },
+    { "sequence", native_apu_sequence, 3 },
+    { "volume", native_apu_volume, 1 },
+    { NULL, NULL, 0 }
+};
+
+void apu_bind(duk_context *ctx)
+{
+    float gain = 1.0f;
+    Uint32 bits;
+
+    SDL_memcpy(&bits, &gain, sizeof(bits));
+    SDL_SetAtomicU32(&gain_bits, bits);
+
+    duk_push_object(ctx);
+    duk_put_function_list(ctx, -1, apu_functions);
+    duk_push_int(ctx, AUDIO_SAMPLE_RATE);
+    duk_put_prop_string(ctx, -2, "rate");
+    duk_put_global_string(ctx, "apu");
+}
@@ -0,0 +1,23 @@
+#ifndef APU_H
+#define APU_H
+
+#include <SDL3/SDL.h>
+#include "duktape/duktape.h"
+
+/* synth config */
+#define APU_CLOCK_HZ     4194304
+#define APU_QUEUE_SIZE   4096U /* must be a power of two */
+
+/*
+ * Game Boy style sound generator: two pulse channels (one with sweep), a
+ * 32-step wave channel and an LFSR noise channel, programmed through the
+ * NR10-NR52 registers and wave RAM at their usual 0xFF10-0xFF3F addresses.
+ *
+ * Scripts queue register writes stamped with an audio clock time (in output
+ * frames); the audio thread applies each write at exactly that frame while
+ * rendering, so timing does not depend on the game's frame rate.
+ */
+void apu_render(float *out, int frames); /* audio thread */
+void apu_bind(duk_context *ctx);
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef ATLAS_H
+#define ATLAS_H
+
+#include <SDL3/SDL.h>
+#include "pack.h"
+
+/*
+ * Texture atlas ("TJSA"), written by tools/atlas.c next to its page images.
+ * All fields are little endian.
+ *
+ *   AtlasHeader
+ *   AtlasPage pages[pages]
+ *   AtlasRegion regions[regions]
+ *   Uint32 table[table_size]        region index + 1, 0 for an empty slot
+ *   names                           NUL terminated, pages and regions point into them
+ *
+ * The table is an open addressing hash of the region names built offline:
+ * a name starts probing at pack_hash(name, 0) & (table_size - 1), table_size
+ * is a power of two and at most half full. Page names are image files
+ * relative to the atlas file's directory.
+ */
+#define ATLAS_MAGIC   "TJSA"
+#define ATLAS_VERSION 1
+
+typedef struct
+{
+    char magic[4];
+    Uint32 version;
+    Uint32 pages;
+    Uint32 regions;
+    Uint32 table_size;
+    Uint32 names_size;
+} AtlasHeader;
+
+typedef struct
+{
+    Uint32 name;
+    Uint16 width;
+    Uint16 height;
+} AtlasPage;
+
+typedef struct
+{
+    Uint32 name;
+    Uint16 page;
+    Uint16 x, y, w, h;
+    Uint16 reserved;
+    float u0, v0, u1, v1;
+} AtlasRegion;
+
+#endif
@@ -0,0 +1,574 @@
+#include <math.h>
+#include <stdio.h>
+#include "apu.h"
+#include "audio.h"
+#include "music.h"
+#include "pack.h"
+#include "ring.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#define AUDIO_UNITY_STEP ((Uint64)1 << 32)
+
+typedef enum
+{
+    AUDIO_CMD_PLAY,
+    AUDIO_CMD_STOP,
+    AUDIO_CMD_SET,
+    AUDIO_CMD_STOP_ALL,
+    AUDIO_CMD_MASTER
+} AudioCommandType;
+
+#define AUDIO_SET_GAIN  0x1U
+#define AUDIO_SET_PAN   0x2U
+#define AUDIO_SET_PITCH 0x4U
+
+typedef struct
+{
+    Uint8 type;
+    Uint8 flags;
+    Uint8 loop;
+    Uint16 sound;
+    Uint32 handle;
+    float gain;
+    float pan;
+    float pitch;
+} AudioCommand;
+
+typedef struct
+{
+    Uint32 handle; /* 0 when the voice is free */
+    Uint32 serial; /* start order, used to steal the oldest voice */
+    const Sound *sound;
+    Uint64 pos;    /* 32.32 fixed point frame position */
+    Uint64 step;   /* 32.32 fixed point advance per output frame */
+    float gain;
+    float pan;
+    float left;
+    float right;
+    bool loop;
+} Voice;
+
+static SDL_AudioStream *audio_stream;
+static bool audio_started; /* the SDL audio subsystem, which a machine may not have */
+static SpscRing queue;
+static AudioCommand queue_slots[AUDIO_QUEUE_SIZE];
+
+/* owned by the game thread; a slot is filled before any command refers to it */
+static Sound sounds[AUDIO_MAX_SOUNDS];
+static int sound_count;
+static Uint32 next_handle;
+
+/* owned by the audio thread */
+static Voice voices[AUDIO_MAX_VOICES];
+static Uint32 voice_serial;
+static float master_gain = 1.0f;
+static float mix_buffer[AUDIO_CHUNK_FRAMES * AUDIO_CHANNELS];
+
+
+/* the queue drops commands when full rather than stall the game thread */
+static bool queue_push(const AudioCommand *cmd)
+{
+    return audio_stream && ring_push(&queue, cmd);
+}
+
+
+/* mixing kernels: accumulate `frames` source frames into interleaved stereo */
+static void mix_mono(float *out, const float *src, int frames, float left, float right)
+{
+    int i = 0;
+#if defined(__SSE2__)
+    const __m128 g = _mm_setr_ps(left, right, left, right);
+    for (; i + 4 <= frames; i += 4) {
+        __m128 s = _mm_loadu_ps(src + i);
+        __m128 lo = _mm_mul_ps(_mm_unpacklo_ps(s, s), g);
+        __m128 hi = _mm_mul_ps(_mm_unpackhi_ps(s, s), g);
+        _mm_storeu_ps(out + i * 2, _mm_add_ps(_mm_loadu_ps(out + i * 2), lo));
+        _mm_storeu_ps(out + i * 2 + 4, _mm_add_ps(_mm_loadu_ps(out + i * 2 + 4), hi));
+    }
+#elif defined(__ARM_NEON)
+    for (; i + 4 <= frames; i += 4) {
+        float32x4_t s = vld1q_f32(src + i);
+        float32x4x2_t o = vld2q_f32(out + i * 2);
+        o.val[0] = vmlaq_n_f32(o.val[0], s, left);
+        o.val[1] = vmlaq_n_f32(o.val[1], s, right);
+        vst2q_f32(out + i * 2, o);
+    }
+#endif
+    for (; i < frames; i++) {
+        out[i * 2] += src[i] * left;
+        out[i * 2 + 1] += src[i] * right;
+    }
+}
+
+static void mix_stereo(float *out, const float *src, int frames, float left, float right)
+{
+    int i = 0;
+#if defined(__SSE2__)
+    const __m128 g = _mm_setr_ps(left, right, left, right);
+    for (; i + 2 <= frames; i += 2) {
+        __m128 s = _mm_mul_ps(_mm_loadu_ps(src + i * 2), g);
+        _mm_storeu_ps(out + i * 2, _mm_add_ps(_mm_loadu_ps(out + i * 2), s));
+    }
+#elif defined(__ARM_NEON)
+    for (; i + 4 <= frames; i += 4) {
+        float32x4x2_t s = vld2q_f32(src + i * 2);
+        float32x4x2_t o = vld2q_f32(out + i * 2);
+        o.val[0] = vmlaq_n_f32(o.val[0], s.val[0], left);
+        o.val[1] = vmlaq_n_f32(o.val[1], s.val[1], right);
+        vst2q_f32(out + i * 2, o);
+    }
+#endif
+    for (; i < frames; i++) {
+        out[i * 2] += src[i * 2] * left;
+        out[i * 2 + 1] += src[i * 2 + 1] * right;
+    }
+}
+
+/* applies the master gain and clips to [-1, 1] in place */
+static void mix_finish(float *out, int samples, float gain)
+{
+    int i = 0;
+#if defined(__SSE2__)
+    const __m128 g = _mm_set1_ps(gain);
+    const __m128 lo = _mm_set1_ps(-1.0f);
+    const __m128 hi = _mm_set1_ps(1.0f);
+    for (; i + 4 <= samples; i += 4) {
+        __m128 s = _mm_mul_ps(_mm_loadu_ps(out + i), g);
+        _mm_storeu_ps(out + i, _mm_min_ps(_mm_max_ps(s, lo), hi));
+    }
+#elif defined(__ARM_NEON)
+    const float32x4_t lo = vdupq_n_f32(-1.0f);
+    const float32x4_t hi = vdupq_n_f32(1.0f);
+    for (; i + 4 <= samples; i += 4) {
+        float32x4_t s = vmulq_n_f32(vld1q_f32(out + i), gain);
+        vst1q_f32(out + i, vminq_f32(vmaxq_f32(s, lo), hi));
+    }
+#endif
+    for (; i < samples; i++) {
+        out[i] = SDL_clamp(out[i] * gain, -1.0f, 1.0f);
+    }
+}
+
+/* linear interpolation for voices that are pitched or sit between frames */
+static int mix_resampled(Voice *v, float *out, int frames)
+{
+    const Sound *s = v->sound;
+    int i;
+
+    for (i = 0; i < frames; i++) {
+        Uint32 frame = (Uint32)(v->pos >> 32);
+        Uint32 next = frame + 1;
+        float t = (float)(v->pos & 0xFFFFFFFFU) * (1.0f / 4294967296.0f);
+
+        if (frame >= s->frames) {
+            break;
+        }
+        if (next >= s->frames) {
+            next = v->loop ? 0 : frame;
+        }
+        if (s->channels == 1) {
+            float a = s->samples[frame];
+            float x = a + (s->samples[next] - a) * t;
+            out[i * 2] += x * v->left;
+            out[i * 2 + 1] += x * v->right;
+        } else {
+            float l = s->samples[frame * 2];
+            float r = s->samples[frame * 2 + 1];
+            out[i * 2] += (l + (s->samples[next * 2] - l) * t) * v->left;
+            out[i * 2 + 1] += (r + (s->samples[next * 2 + 1] - r) * t) * v->right;
+        }
+        v->pos += v->step;
+    }
+    return i;
+}
+
+static void mix_voice(Voice *v, float *out, int frames)
+{
+    const Sound *s = v->sound;
+
+    while (frames > 0 && v->handle != 0) {
+        int n;
+
+        if (v->step == AUDIO_UNITY_STEP && (v->pos & 0xFFFFFFFFU) == 0) {
+            Uint32 frame = (Uint32)(v->pos >> 32);
+            n = (int)SDL_min((Uint32)frames, s->frames - frame);
+            if (s->channels == 1) {
+                mix_mono(out, s->samples + frame, n, v->left, v->right);
+            } else {
+                mix_stereo(out, s->samples + (size_t)frame * 2, n, v->left, v->right);
+            }
+            v->pos += (Uint64)n << 32;
+        } else {
+            n = mix_resampled(v, out, frames);
+        }
+        out += n * AUDIO_CHANNELS;
+        frames -= n;
+
+        if ((v->pos >> 32) >= s->frames) {
+            if (v->loop) {
+                v->pos -= (Uint64)s->frames << 32;
+            } else {
+                v->handle = 0;
+            }
+        }
+    }
+}
+
+
+/* voice state, audio thread only */
+static void voice_update_gains(Voice *v)
+{
+    if (v->sound->channels == 1) {
+        /* equal-power pan */
+        float angle = (v->pan + 1.0f) * (SDL_PI_F / 4.0f);
+        v->left = v->gain * cosf(angle);
+        v->right = v->gain * sinf(angle);
+    } else {
+        /* balance */
+        v->left = v->gain * SDL_min(1.0f, 1.0f - v->pan);
+        v->right = v->gain * SDL_min(1.0f, 1.0f + v->pan);
+    }
+}
+
+static Uint64 pitch_to_step(float pitch)
+{
+    return (Uint64)((double)SDL_clamp(pitch, 1.0f / 16.0f, 16.0f) * 4294967296.0);
+}
+
+static Voice *find_voice(Uint32 handle)
+{
+    int i;
+    for (i = 0; i < AUDIO_MAX_VOICES; i++) {
+        if (voices[i].handle == handle) {
+            return &voices[i];
+        }
+    }
+    return NULL;
+}
+
+static Voice *alloc_voice(void)
+{
+    Voice *oldest = &voices[0];
+    int i;
+
+    for (i = 0; i < AUDIO_MAX_VOICES; i++) {
+        if (voices[i].handle == 0) {
+            return &voices[i];
+        }
+        if ((Sint32)(voices[i].serial - oldest->serial) < 0) {
+            oldest = &voices[i];
+        }
+    }
+    return oldest;
+}
+
+static void run_command(const AudioCommand *cmd)
+{
+    Voice *v;
+    int i;
+
+    switch (cmd->type) {
+    case AUDIO_CMD_PLAY:
+        v = alloc_voice();
+        v->handle = cmd->handle;
+        v->serial = voice_serial++;
+        v->sound = &sounds[cmd->sound];
+        v->pos = 0;
+        v->step = pitch_to_step(cmd->pitch);
+        v->gain = cmd->gain;
+        v->pan = cmd->pan;
+        v->loop = cmd->loop != 0;
+        voice_update_gains(v);
+        break;
+    case AUDIO_CMD_STOP:
+        if ((v = find_voice(cmd->handle)) != NULL) {
+            v->handle = 0;
+        }
+        break;
+    case AUDIO_CMD_SET:
+        if ((v = find_voice(cmd->handle)) != NULL) {
+            if (cmd->flags & AUDIO_SET_GAIN) {
+                v->gain = cmd->gain;
+            }
+            if (cmd->flags & AUDIO_SET_PAN) {
+                v->pan = cmd->pan;
+            }
+            if (cmd->flags & AUDIO_SET_PITCH) {
+                v->step = pitch_to_step(cmd->pitch);
+            }
+            voice_update_gains(v);
+        }
+        break;
+    case AUDIO_CMD_STOP_ALL:
+        for (i = 0; i < AUDIO_MAX_VOICES; i++) {
+            voices[i].handle = 0;
+        }
+        break;
+    case AUDIO_CMD_MASTER:
+        master_gain = cmd->gain;
+        break;
+    }
+}
+
+static void SDLCALL audio_callback(void *userdata, SDL_AudioStream *stream, int additional_amount, int total_amount)
+{
+    const int frame_size = (int)sizeof(float) * AUDIO_CHANNELS;
+    int frames = (additional_amount + frame_size - 1) / frame_size;
+    AudioCommand cmd;
+    int i;
+
+    while (ring_pop(&queue, &cmd)) {
+        run_command(&cmd);
+    }
+
+    while (frames > 0) {
+        int n = SDL_min(frames, AUDIO_CHUNK_FRAMES);
+
+        SDL_memset(mix_buffer, 0, sizeof(float) * n * AUDIO_CHANNELS);
+        for (i = 0; i < AUDIO_MAX_VOICES; i++) {
+            if (voices[i].handle != 0) {
+                mix_voice(&voices[i], mix_buffer, n);
+            }
+        }
+        music_render(mix_buffer, n);
+        apu_render(mix_buffer, n);
+        mix_finish(mix_buffer, n * AUDIO_CHANNELS, master_gain);
+        SDL_PutAudioStreamData(stream, mix_buffer, n * frame_size);
+        frames -= n;
+    }
+}
+
+
+/* javascript bridge logic */
+static float get_option(duk_context *ctx, duk_idx_t idx, const char *key, float def, bool *found)
+{
+    float value = def;
+
+    if (duk_is_object(ctx, idx) && duk_get_prop_string(ctx, idx, key)) {
+        value = (float)duk_require_number(ctx, -1);
+        if (found) {
+            *found = true;
+        }
+    }
+    if (duk_is_object(ctx, idx)) {
+        duk_pop(ctx);
+    }
+    return value;
+}
+
+bool audio_decode(SDL_IOStream *src, Sound *sound)
+{
+    SDL_AudioSpec src_spec, dst_spec;
+    Uint8 *wav, *data;
+    Uint32 wav_len;
+    int data_len;
+    bool ok;
+
+    if (!SDL_LoadWAV_IO(src, true, &src_spec, &wav, &wav_len)) {
+        return false;
+    }
+
+    dst_spec.format = SDL_AUDIO_F32;
+    dst_spec.channels = src_spec.channels > 1 ? 2 : 1;
+    dst_spec.freq = AUDIO_SAMPLE_RATE;
+    ok = SDL_ConvertAudioSamples(&src_spec, wav, (int)wav_len, &dst_spec, &data, &data_len);
+    SDL_free(wav);
+    if (!ok) {
+        return false;
+    }
+    if (data_len < (int)sizeof(float) * dst_spec.channels) {
+        SDL_free(data);
+        return SDL_SetError("no samples");
+    }
+
+    sound->samples = (float *)data;
+    sound->channels = dst_spec.channels;
+    sound->frames = (Uint32)data_len / (Uint32)(sizeof(float) * dst_spec.channels);
+    return true;
+}
+
+int audio_add_sound(const Sound *sound)
+{
+    if (sound_count == AUDIO_MAX_SOUNDS) {
+        SDL_free(sound->samples);
+        return -1;
+    }
+    sounds[sound_count] = *sound;
+    return sound_count++;
+}
+
+static duk_ret_t native_audio_load(duk_context *ctx)
+{
+    const char *path = duk_require_string(ctx, 0);
+    Sound sound;
+    size_t size;
+    void *data;
+    bool ok;
+
+    if (sound_count == AUDIO_MAX_SOUNDS) {
+        return duk_error(ctx, DUK_ERR_RANGE_ERROR, "too many sounds (max %d)", AUDIO_MAX_SOUNDS);
+    }
+    data = pack_load_file(path, &size);
+    ok = data && audio_decode(SDL_IOFromConstMem(data, size), &sound);
+    SDL_free(data);
+    if (!ok) {
+        return duk_error(ctx, DUK_ERR_ERROR, "Couldn't load %s: %s", path, SDL_GetError());
+    }
+    duk_push_int(ctx, audio_add_sound(&sound));
+    return 1;
+}
+
+/* audio.play(id, { gain, pan, pitch, loop }) -> handle, or 0 if dropped */
+static duk_ret_t native_audio_play(duk_context *ctx)
+{
+    int id = duk_require_int(ctx, 0);
+    AudioCommand cmd;
+
+    if (id < 0 || id >= sound_count) {
+        return duk_error(ctx, DUK_ERR_RANGE_ERROR, "invalid sound id %d", id);
+    }
+    if (++next_handle == 0) {
+        next_handle = 1;
+    }
+
+    SDL_zero(cmd);
+    cmd.type = AUDIO_CMD_PLAY;
+    cmd.sound = (Uint16)id;
+    cmd.handle = next_handle;
+    cmd.gain = get_option(ctx, 1, "gain", 1.0f, NULL);
+    cmd.pan = SDL_clamp(get_option(ctx, 1, "pan", 0.0f, NULL), -1.0f, 1.0f);
+    cmd.pitch = get_option(ctx, 1, "pitch", 1.0f, NULL);
+    if (duk_is_object(ctx, 1) && duk_get_prop_string(ctx, 1, "loop")) {
+        cmd.loop = duk_to_boolean(ctx, -1) ? 1 : 0;
+    }
+
+    duk_push_uint(ctx, queue_push(&cmd) ? cmd.handle : 0);
+    return 1;
+}
+
+static duk_ret_t native_audio_set(duk_context *ctx)
+{
+    AudioCommand cmd;
+    bool found;
+
+    SDL_zero(cmd);
+    cmd.type = AUDIO_CMD_SET;
+    cmd.handle = duk_require_uint(ctx, 0);
+    found = false;
+    cmd.gain = get_option(ctx, 1, "gain", 1.0f, &found);
+    cmd.flags |= found ? AUDIO_SET_GAIN : 0;
+    found = false;
+    cmd.pan = SDL_clamp(get_option(ctx, 1, "pan", 0.0f, &found), -1.0f, 1.0f);
+    cmd.flags |= found ? AUDIO_SET_PAN : 0;
+    found = false;
+    cmd.pitch = get_option(ctx, 1, "pitch", 1.0f, &found);
+    cmd.flags |= found ? AUDIO_SET_PITCH : 0;
+
+    duk_push_boolean(ctx, queue_push(&cmd));
+    return 1;
+}
+
+static duk_ret_t native_audio_stop(duk_context *ctx)
+{
+    AudioCommand cmd;
+
+    SDL_zero(cmd);
+    cmd.type = AUDIO_CMD_STOP;
+    cmd.handle = duk_require_uint(ctx, 0);
+    duk_push_boolean(ctx, queue_push(&cmd));
+    return 1;
+}
+
+static duk_ret_t native_audio_stop_all(duk_context *ctx)
+{
+    AudioCommand cmd;
+
+    SDL_zero(cmd);
+    cmd.type = AUDIO_CMD_STOP_ALL;
+    duk_push_boolean(ctx, queue_push(&cmd));
+    return 1;
+}
+
+static duk_ret_t native_audio_volume(duk_context *ctx)
+{
+    AudioCommand cmd;
+
+    SDL_zero(cmd);
+    cmd.type = AUDIO_CMD_MASTER;
+    cmd.gain = SDL_max((float)duk_require_number(ctx, 0), 0.0f);
+    duk_push_boolean(ctx, queue_push(&cmd));
+    return 1;
+}
+
+static const duk_function_list_entry audio_functions[] = {
+    { "load", native_audio_load, 1 },
+    { "play", native_audio_play, 2 },
+    { "set", native_audio_set, 2 },
+    { "stop", native_audio_stop, 1 },
+    { "stopAll", native_audio_stop_all, 0 },
+    { "volume", native_audio_volume, 1 },
+    { NULL, NULL, 0 }
+};
+
+void audio_bind(duk_context *ctx)
+{
+    duk_push_object(ctx);
+    duk_put_function_list(ctx, -1, audio_functions);
+    duk_put_global_string(ctx, "audio");
+}
+
+
+/* Standard Routines and Interfaces. */
+bool audio_init(void)
+{
+    SDL_AudioSpec spec;
+
+    ring_init(&queue, queue_slots, AUDIO_QUEUE_SIZE, sizeof(AudioCommand));
+
+    if (!SDL_InitSubSystem(SDL_INIT_AUDIO)) {
+        SDL_Log("Couldn't initialize audio: %s", SDL_GetError());
+        return false;
+    }
+    audio_started = true;
+
+    spec.format = SDL_AUDIO_F32;
+    spec.channels = AUDIO_CHANNELS;
+    spec.freq = AUDIO_SAMPLE_RATE;
+
+    audio_stream = SDL_OpenAudioDeviceStream(SDL_AUDIO_DEVICE_DEFAULT_PLAYBACK, &spec, audio_callback, NULL);
+    if (!audio_stream) {
+        SDL_Log("Couldn't open audio device: %s", SDL_GetError());
+        return false;
+    }
+    SDL_ResumeAudioStreamDevice(audio_stream);
+    return true;
+}
+
+bool audio_is_running(void)
+{
+    return audio_stream != NULL;
+}
+
+void audio_quit(void)
+{
+    int i;
+
+    /* destroying the stream stops the callback before the sounds go away */
+    if (audio_stream) {
+        SDL_DestroyAudioStream(audio_stream);
+        audio_stream = NULL;
+    }
+    if (audio_started) {
+        SDL_QuitSubSystem(SDL_INIT_AUDIO);
+        audio_started = false;
+    }
+    for (i = 0; i < sound_count; i++) {
+        SDL_free(sounds[i].samples);
+    }
+    sound_count = 0;
+}
@@ -0,0 +1,41 @@
+#ifndef AUDIO_H
+#define AUDIO_H
+
+#include <SDL3/SDL.h>
+#include "duktape/duktape.h"
+
+/* mixer config */
+#define AUDIO_SAMPLE_RATE   48000
+#define AUDIO_CHANNELS      2
+#define AUDIO_CHUNK_FRAMES  512
+#define AUDIO_MAX_VOICES    32
+#define AUDIO_MAX_SOUNDS    256
+#define AUDIO_QUEUE_SIZE    256U /* must be a power of two */
+
+typedef struct
+{
+    float *samples; /* interleaved, `channels` floats per frame, at AUDIO_SAMPLE_RATE */
+    Uint32 frames;
+    int channels;
+} Sound;
+
+/*
+ * The mixer runs entirely on SDL's audio thread. The game thread never
+ * touches voice state directly: every script call is turned into a command
+ * and pushed through a single-producer/single-consumer ring that the audio
+ * callback drains before mixing each block.
+ */
+bool audio_init(void);
+bool audio_is_running(void);
+void audio_quit(void);
+void audio_bind(duk_context *ctx);
+
+/*
+ * audio_decode() turns a WAV stream into a Sound and is safe on any thread;
+ * it closes src. audio_add_sound() hands the samples to the mixer, must be
+ * called on the game thread, and returns the sound id or -1 when full.
+ */
+bool audio_decode(SDL_IOStream *src, Sound *sound);
+int audio_add_sound(const Sound *sound);
+
+#endif
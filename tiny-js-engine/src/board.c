@@ -0,0 +1,674 @@
+#include "board.h"
+
+/*
+ * The board's state, in one Duktape buffer: this header, then the words,
+ * then with BOARD_FREE_LIST the free set: the free cells in no order, and
+ * for every cell where it is in that list.
+ */
+typedef struct
+{
+    Uint32 width, height;
+    Uint32 bits;
+    Uint32 lanes;  /* cells a word */
+    Uint32 stride; /* words a row */
+    Uint32 flags;
+    Uint32 free_count;
+    Uint32 reserved;
+    Uint64 ones;       /* 1 in every lane */
+    Uint64 high;       /* the top bit of every lane */
+    Uint64 last_lanes; /* the lanes of a row's last word that are on the board */
+    Uint64 rng;        /* SDL_rand_r() state */
+} Board;
+
+#define NOT_FREE 0xFFFFFFFFu
+
+static Uint64 *board_words(Board *b)
+{
+    return (Uint64 *)(b + 1);
+}
+
+static Uint32 *free_cells(Board *b)
+{
+    return (Uint32 *)(board_words(b) + (size_t)b->stride * b->height);
+}
+
+static Uint32 *free_slots(Board *b)
+{
+    return free_cells(b) + (size_t)b->width * b->height;
+}
+
+static Uint64 cell_mask(const Board *b)
+{
+    return ((Uint64)1 << b->bits) - 1;
+}
+
+/* the bits of lanes [first, last) */
+static Uint64 lane_mask(const Board *b, Uint32 first, Uint32 last)
+{
+    const Uint64 below_last = last * b->bits >= 64 ? ~(Uint64)0 : ((Uint64)1 << (last * b->bits)) - 1;
+
+    return below_last & ~(((Uint64)1 << (first * b->bits)) - 1);
+}
+
+static int popcount(Uint64 v)
+{
+    v = v - ((v >> 1) & 0x5555555555555555ull);
+    v = (v & 0x3333333333333333ull) + ((v >> 2) & 0x3333333333333333ull);
+    v = (v + (v >> 4)) & 0x0f0f0f0f0f0f0f0full;
+    return (int)((v * 0x0101010101010101ull) >> 56);
+}
+
+/* the top bit of every lane of w that holds the value `repeated` is in every lane */
+static Uint64 matching_lanes(const Board *b, Uint64 w, Uint64 repeated)
+{
+    const Uint64 low = b->high - b->ones; /* all but the top bit of every lane */
+    const Uint64 x = w ^ repeated;
+
+    return ~(((x & low) + low) | x) & b->high;
+}
+
+static Uint32 get_cell(Board *b, Uint32 x, Uint32 y)
+{
+    const Uint64 w = board_words(b)[y * b->stride + x / b->lanes];
+
+    return (Uint32)((w >> (x % b->lanes * b->bits)) & cell_mask(b));
+}
+
+/*
+ * O(1) either way: a cell leaving swaps the last free cell into its slot.
+ * Script may have written b.data without a refresh(), so the list can be
+ * out of step with the words; a cell already listed or already gone is
+ * left alone rather than trusted.
+ */
+static void add_free(Board *b, Uint32 cell)
+{
+    if (free_slots(b)[cell] != NOT_FREE) {
+        return;
+    }
+    free_cells(b)[b->free_count] = cell;
+    free_slots(b)[cell] = b->free_count++;
+}
+
+static void remove_free(Board *b, Uint32 cell)
+{
+    Uint32 *cells = free_cells(b), *slots = free_slots(b);
+    const Uint32 slot = slots[cell];
+    Uint32 last;
+
+    if (slot == NOT_FREE) {
+        return;
+    }
+    last = cells[--b->free_count];
+
+    cells[slot] = last;
+    slots[last] = slot;
+    slots[cell] = NOT_FREE;
+}
+
+/* adds and removes the cells of word k of row y that went from 0 to something or back */
+static void track_free(Board *b, Uint32 y, Uint32 k, Uint64 before, Uint64 after)
+{
+    const Uint64 on_board = k == b->stride - 1 ? b->last_lanes : ~(Uint64)0;
+    const Uint64 now_free = matching_lanes(b, after, 0) & on_board;
+    Uint64 changed, bit;
+    Uint32 cell;
+
+    for (changed = (matching_lanes(b, before, 0) & on_board) ^ now_free; changed; changed &= changed - 1) {
+        bit = changed & (~changed + 1);
+        cell = y * b->width + k * b->lanes + (Uint32)popcount(bit - 1) / b->bits;
+        if (now_free & bit) {
+            add_free(b, cell);
+        } else {
+            remove_free(b, cell);
+        }
+    }
+}
+
+/*
+ * Writes a word of the board, keeping the free list in step; the bulk
+ * operations do the same inline. The lanes that changed between free and
+ * not are found a word at a time, and only those cells are touched.
+ */
+static void store(Board *b, Uint32 y, Uint32 k, Uint64 w)
+{
+    Uint64 *word = &board_words(b)[(size_t)y * b->stride + k];
+
+    if (b->flags & BOARD_FREE_LIST) {
+        track_free(b, y, k, *word, w);
+    }
+    *word = w;
+}
+
+/* refills the free set from the words, after script wrote b.data */
+static void rebuild_free(Board *b)
+{
+    const Uint32 cells = b->width * b->height;
+    Uint32 *list = free_cells(b), *slots = free_slots(b);
+    Uint32 i;
+
+    b->free_count = 0;
+    for (i = 0; i < cells; i++) {
+        if (get_cell(b, i % b->width, i / b->width) == 0) {
+            list[b->free_count] = i;
+            slots[i] = b->free_count++;
+        } else {
+            slots[i] = NOT_FREE;
+        }
+    }
+}
+
+static void set_cell(Board *b, Uint32 x, Uint32 y, Uint32 v)
+{
+    const Uint64 w = board_words(b)[y * b->stride + x / b->lanes];
+    const Uint32 shift = x % b->lanes * b->bits;
+
+    store(b, y, x / b->lanes, (w & ~(cell_mask(b) << shift)) | ((Uint64)v << shift));
+}
+
+/* a rectangle clipped to the board; false if nothing is left of it */
+typedef struct
+{
+    Uint32 x0, y0, x1, y1;
+} Rect;
+
+static bool clip(const Board *b, Sint64 x, Sint64 y, Sint64 w, Sint64 h, Rect *r)
+{
+    const Sint64 x1 = SDL_min(x + w, (Sint64)b->width), y1 = SDL_min(y + h, (Sint64)b->height);
+
+    x = SDL_max(x, 0);
+    y = SDL_max(y, 0);
+    if (x >= x1 || y >= y1) {
+        return false;
+    }
+    r->x0 = (Uint32)x;
+    r->y0 = (Uint32)y;
+    r->x1 = (Uint32)x1;
+    r->y1 = (Uint32)y1;
+    return true;
+}
+
+/* the words of each row a rectangle covers, and the lanes of the first and last of them that it does */
+typedef struct
+{
+    Uint32 first, last;
+    Uint64 first_mask, last_mask;
+} Span;
+
+static void span_of(const Board *b, const Rect *r, Span *s)
+{
+    s->first = r->x0 / b->lanes;
+    s->last = (r->x1 - 1) / b->lanes;
+    s->first_mask = lane_mask(b, r->x0 % b->lanes, b->lanes);
+    s->last_mask = lane_mask(b, 0, (r->x1 - 1) % b->lanes + 1);
+}
+
+static Uint64 span_mask(const Span *s, Uint32 k)
+{
+    return (k == s->first ? s->first_mask : ~(Uint64)0) & (k == s->last ? s->last_mask : ~(Uint64)0);
+}
+
+static void fill(Board *b, const Rect *r, Uint32 v)
+{
+    const Uint64 repeated = b->ones * v;
+    const bool tracked = (b->flags & BOARD_FREE_LIST) != 0;
+    Uint64 *row, mask, w;
+    Uint32 y, k;
+    Span s;
+
+    span_of(b, r, &s);
+    for (y = r->y0; y < r->y1; y++) {
+        row = board_words(b) + (size_t)y * b->stride;
+        for (k = s.first; k <= s.last; k++) {
+            mask = span_mask(&s, k);
+            w = (row[k] & ~mask) | (repeated & mask);
+            if (tracked) {
+                track_free(b, y, k, row[k], w);
+            }
+            row[k] = w;
+        }
+    }
+}
+
+static Uint32 count(Board *b, const Rect *r, Uint32 v)
+{
+    const Uint64 repeated = b->ones * v;
+    const Uint64 *row;
+    Uint32 y, k, n = 0;
+    Span s;
+
+    span_of(b, r, &s);
+    for (y = r->y0; y < r->y1; y++) {
+        row = board_words(b) + (size_t)y * b->stride;
+        for (k = s.first; k <= s.last; k++) {
+            n += (Uint32)popcount(matching_lanes(b, row[k], repeated) & span_mask(&s, k));
+        }
+    }
+    return n;
+}
+
+/* the index of the nth cell (from 0) holding v, row by row, or -1 */
+static Sint32 find(Board *b, Uint32 v, Uint32 n)
+{
+    const Uint64 repeated = b->ones * v;
+    const Uint64 *row;
+    Uint64 found;
+    Uint32 y, k, c;
+    Rect all;
+    Span s;
+
+    all.x0 = all.y0 = 0;
+    all.x1 = b->width;
+    all.y1 = b->height;
+    span_of(b, &all, &s);
+    for (y = 0; y < b->height; y++) {
+        row = board_words(b) + (size_t)y * b->stride;
+        for (k = 0; k < b->stride; k++) {
+            found = matching_lanes(b, row[k], repeated) & span_mask(&s, k);
+            c = (Uint32)popcount(found);
+            if (n >= c) {
+                n -= c;
+                continue;
+            }
+            while (n--) {
+                found &= found - 1;
+            }
+            /* the lowest bit left is the top of the lane we want */
+            c = (Uint32)popcount((found & (~found + 1)) - 1) / b->bits;
+            return (Sint32)(y * b->width + k * b->lanes + c);
+        }
+    }
+    return -1;
+}
+
+/* reads count cells of row y from x on, walking lanes rather than dividing for each */
+static void read_run(Board *b, Uint32 x, Uint32 y, Uint32 count, Uint8 *values)
+{
+    const Uint64 *word = board_words(b) + (size_t)y * b->stride + x / b->lanes;
+    const Uint64 mask = cell_mask(b);
+    Uint32 lane = x % b->lanes, i;
+    Uint64 w = *word;
+
+    for (i = 0; i < count; i++) {
+        values[i] = (Uint8)((w >> (lane * b->bits)) & mask);
+        if (++lane == b->lanes && i + 1 < count) {
+            lane = 0;
+            w = *++word;
+        }
+    }
+}
+
+static void write_run(Board *b, Uint32 x, Uint32 y, Uint32 count, const Uint8 *values)
+{
+    const Uint64 *row = board_words(b) + (size_t)y * b->stride;
+    const Uint64 mask = cell_mask(b);
+    Uint32 k = x / b->lanes, lane = x % b->lanes, i;
+    Uint64 w = row[k];
+
+    for (i = 0; i < count; i++) {
+        w = (w & ~(mask << (lane * b->bits))) | ((Uint64)values[i] << (lane * b->bits));
+        if (++lane == b->lanes && i + 1 < count) {
+            store(b, y, k, w);
+            lane = 0;
+            w = row[++k];
+        }
+    }
+    store(b, y, k, w);
+}
+
+/*
+ * Copies a w x h block from (sx, sy) on src to (dx, dy) on dst; the two can
+ * be the same board and overlap. When the block sits at the same lane in
+ * its words on both, whole words are copied under masks, otherwise each
+ * row goes a cell at a time through a buffer.
+ */
+static void copy(Board *dst, Board *src, Sint64 sx, Sint64 sy, Sint64 w, Sint64 h, Sint64 dx, Sint64 dy)
+{
+    static Uint8 values[BOARD_MAX_SIDE];
+    const bool tracked = (dst->flags & BOARD_FREE_LIST) != 0;
+    const Uint64 *from;
+    Uint64 *to, mask, word;
+    Uint32 i, y, k;
+    Sint32 step, row, rows;
+    Sint64 shift;
+    Rect r;
+    Span s;
+
+    /* clip to the source, then to the destination, keeping the two in step */
+    if (sx < 0) { w += sx; dx -= sx; sx = 0; }
+    if (sy < 0) { h += sy; dy -= sy; sy = 0; }
+    if (dx < 0) { w += dx; sx -= dx; dx = 0; }
+    if (dy < 0) { h += dy; sy -= dy; dy = 0; }
+    w = SDL_min(w, SDL_min((Sint64)src->width - sx, (Sint64)dst->width - dx));
+    h = SDL_min(h, SDL_min((Sint64)src->height - sy, (Sint64)dst->height - dy));
+    if (w <= 0 || h <= 0) {
+        return;
+    }
+
+    /* rows go bottom up when moving a block down its own board */
+    rows = (Sint32)h;
+    step = (src == dst && dy > sy) ? -1 : 1;
+    for (row = step > 0 ? 0 : rows - 1; row >= 0 && row < rows; row += step) {
+        y = (Uint32)(dy + row);
+        if ((Uint32)sx % src->lanes == (Uint32)dx % dst->lanes) {
+            r.x0 = (Uint32)dx;
+            r.x1 = (Uint32)(dx + w);
+            shift = (Sint64)((Uint32)sx / src->lanes) - (Sint64)((Uint32)dx / dst->lanes);
+            from = board_words(src) + (size_t)(sy + row) * src->stride;
+            to = board_words(dst) + (size_t)y * dst->stride;
+            span_of(dst, &r, &s);
+            /* right to left when moving a block right along its own row */
+            for (i = 0; i <= s.last - s.first; i++) {
+                k = (src == dst && dx > sx) ? s.last - i : s.first + i;
+                mask = span_mask(&s, k);
+                word = (to[k] & ~mask) | (from[k + shift] & mask);
+                if (tracked) {
+                    track_free(dst, y, k, to[k], word);
+                }
+                to[k] = word;
+            }
+        } else {
+            read_run(src, (Uint32)sx, (Uint32)(sy + row), (Uint32)w, values);
+            write_run(dst, (Uint32)dx, y, (Uint32)w, values);
+        }
+    }
+}
+
+/* javascript bridge logic */
+
+static Board *get_board(duk_context *ctx, duk_idx_t idx)
+{
+    Board *b = NULL;
+    duk_size_t size;
+
+    if (!duk_is_object(ctx, idx)) {
+        return NULL;
+    }
+    if (duk_get_prop_string(ctx, idx, DUK_HIDDEN_SYMBOL("board"))) {
+        b = (Board *)duk_get_buffer(ctx, -1, &size);
+        if (size < sizeof(Board)) {
+            b = NULL;
+        }
+    }
+    duk_pop(ctx);
+    return b;
+}
+
+bool board_cells(duk_context *ctx, duk_idx_t idx, BoardCells *cells)
+{
+    Board *b = get_board(ctx, idx);
+
+    if (!b) {
+        return false;
+    }
+    cells->words = board_words(b);
+    cells->width = b->width;
+    cells->height = b->height;
+    cells->bits = b->bits;
+    cells->lanes = b->lanes;
+    cells->stride = b->stride;
+    return true;
+}
+
+static Board *require_this(duk_context *ctx)
+{
+    Board *b;
+
+    duk_push_this(ctx);
+    b = get_board(ctx, -1);
+    if (!b) {
+        (void)duk_error(ctx, DUK_ERR_TYPE_ERROR, "not a board");
+    }
+    duk_pop(ctx);
+    return b;
+}
+
+static Uint32 require_value(duk_context *ctx, duk_idx_t idx, const Board *b)
+{
+    const duk_uint_t v = duk_require_uint(ctx, idx);
+
+    if (v > cell_mask(b)) {
+        (void)duk_error(ctx, DUK_ERR_RANGE_ERROR, "a %d bit cell can't hold %u", (int)b->bits, (unsigned)v);
+    }
+    return (Uint32)v;
+}
+
+/* the rectangle at args idx..idx+3, the whole board if they're left out */
+static bool require_rect(duk_context *ctx, duk_idx_t idx, const Board *b, Rect *r)
+{
+    return clip(b, (Sint64)duk_opt_number(ctx, idx, 0), (Sint64)duk_opt_number(ctx, idx + 1, 0),
+                (Sint64)duk_opt_number(ctx, idx + 2, b->width), (Sint64)duk_opt_number(ctx, idx + 3, b->height), r);
+}
+
+static void require_cell(duk_context *ctx, const Board *b, Uint32 *x, Uint32 *y)
+{
+    const duk_int_t cx = duk_require_int(ctx, 0), cy = duk_require_int(ctx, 1);
+
+    if (cx < 0 || cy < 0 || (Uint32)cx >= b->width || (Uint32)cy >= b->height) {
+        (void)duk_error(ctx, DUK_ERR_RANGE_ERROR, "no such cell: %d, %d", (int)cx, (int)cy);
+    }
+    *x = (Uint32)cx;
+    *y = (Uint32)cy;
+}
+
+/*
+ * board.create(width, height, bits, flags) makes an empty board of 1-8 bit
+ * cells. board.data is a Uint8Array over its words, little endian, for
+ * saving and loading. flags: board.FREE_LIST.
+ */
+static duk_ret_t native_board_create(duk_context *ctx)
+{
+    const int width = duk_require_int(ctx, 0), height = duk_require_int(ctx, 1);
+    const int bits = duk_opt_int(ctx, 2, 1);
+    const Uint32 flags = duk_opt_uint(ctx, 3, 0) & BOARD_FREE_LIST;
+    size_t words, size;
+    Board *b;
+    Uint32 i;
+
+    if (width < 1 || height < 1 || width > BOARD_MAX_SIDE || height > BOARD_MAX_SIDE) {
+        return duk_error(ctx, DUK_ERR_RANGE_ERROR, "boards are 1-%d cells a side", BOARD_MAX_SIDE);
+    }
+    if (bits < 1 || bits > 8) {
+        return duk_error(ctx, DUK_ERR_RANGE_ERROR, "cells must be 1-8 bits");
+    }
+    duk_push_object(ctx);
+    duk_push_heap_stash(ctx);
+    duk_get_prop_string(ctx, -1, "board");
+    duk_set_prototype(ctx, -3);
+    duk_pop(ctx);
+
+    words = (size_t)height * (((size_t)width + 64 / (size_t)bits - 1) / (64 / (size_t)bits));
+    size = sizeof(Board) + words * sizeof(Uint64);
+    if (flags & BOARD_FREE_LIST) {
+        size += (size_t)width * (size_t)height * 2 * sizeof(Uint32);
+    }
+    b = (Board *)duk_push_fixed_buffer(ctx, size);
+    b->width = (Uint32)width;
+    b->height = (Uint32)height;
+    b->bits = (Uint32)bits;
+    b->lanes = 64 / (Uint32)bits;
+    b->stride = (b->width + b->lanes - 1) / b->lanes;
+    b->flags = flags;
+    b->ones = 0;
+    for (i = 0; i < b->lanes; i++) {
+        b->ones |= (Uint64)1 << (i * b->bits);
+    }
+    b->high = b->ones << (b->bits - 1);
+    b->last_lanes = lane_mask(b, 0, b->width - (b->stride - 1) * b->lanes);
+    b->rng = SDL_rand_bits() | (Uint64)SDL_rand_bits() << 32;
+    if (flags & BOARD_FREE_LIST) {
+        rebuild_free(b);
+    }
+    duk_push_buffer_object(ctx, -1, sizeof(Board), words * sizeof(Uint64), DUK_BUFOBJ_UINT8ARRAY);
+    duk_put_prop_string(ctx, -3, "data");
+    duk_put_prop_string(ctx, -2, DUK_HIDDEN_SYMBOL("board"));
+
+    duk_push_uint(ctx, b->width);
+    duk_put_prop_string(ctx, -2, "width");
+    duk_push_uint(ctx, b->height);
+    duk_put_prop_string(ctx, -2, "height");
+    duk_push_uint(ctx, b->bits);
+    duk_put_prop_string(ctx, -2, "bits");
+    return 1;
+}
+
+static duk_ret_t native_board_get(duk_context *ctx)
+{
+    Board *b = require_this(ctx);
+    Uint32 x, y;
+
+    require_cell(ctx, b, &x, &y);
+    duk_push_uint(ctx, get_cell(b, x, y));
+    return 1;
+}
+
+static duk_ret_t native_board_set(duk_context *ctx)
+{
+    Board *b = require_this(ctx);
+    const Uint32 v = require_value(ctx, 2, b);
+    Uint32 x, y;
+
+    require_cell(ctx, b, &x, &y);
+    set_cell(b, x, y, v);
+    return 0;
+}
+
+/* b.fill(value, x, y, w, h) sets every cell of the rectangle, or of the board */
+static duk_ret_t native_board_fill(duk_context *ctx)
+{
+    Board *b = require_this(ctx);
+    const Uint32 v = require_value(ctx, 0, b);
+    Rect r;
+
+    if (require_rect(ctx, 1, b, &r)) {
+        fill(b, &r, v);
+    }
+    return 0;
+}
+
+/* b.count(value, x, y, w, h) counts the cells holding value in the rectangle, or on the board */
+static duk_ret_t native_board_count(duk_context *ctx)
+{
+    Board *b = require_this(ctx);
+    const Uint32 v = require_value(ctx, 0, b);
+    Rect r;
+
+    duk_push_uint(ctx, require_rect(ctx, 1, b, &r) ? count(b, &r, v) : 0);
+    return 1;
+}
+
+/* b.find(value, n) returns y * width + x of the nth cell holding value, row by row from 0, or -1 */
+static duk_ret_t native_board_find(duk_context *ctx)
+{
+    Board *b = require_this(ctx);
+    const Uint32 v = require_value(ctx, 0, b);
+
+    duk_push_int(ctx, find(b, v, duk_opt_uint(ctx, 1, 0)));
+    return 1;
+}
+
+/* b.copy(src, sx, sy, w, h, dx, dy) copies a block of src, a board with cells as wide, onto this one */
+static duk_ret_t native_board_copy(duk_context *ctx)
+{
+    Board *b = require_this(ctx);
+    Board *src = get_board(ctx, 0);
+
+    if (!src || src->bits != b->bits) {
+        return duk_error(ctx, DUK_ERR_TYPE_ERROR, "can only copy from a board of %d bit cells", (int)b->bits);
+    }
+    copy(b, src, (Sint64)duk_require_number(ctx, 1), (Sint64)duk_require_number(ctx, 2),
+         (Sint64)duk_require_number(ctx, 3), (Sint64)duk_require_number(ctx, 4),
+         (Sint64)duk_require_number(ctx, 5), (Sint64)duk_require_number(ctx, 6));
+    return 0;
+}
+
+static Board *require_free_list(duk_context *ctx)
+{
+    Board *b = require_this(ctx);
+
+    if (!(b->flags & BOARD_FREE_LIST)) {
+        (void)duk_error(ctx, DUK_ERR_TYPE_ERROR, "board has no free list, make it with board.FREE_LIST");
+    }
+    return b;
+}
+
+/* b.freeCount() is how many cells hold 0 */
+static duk_ret_t native_board_free_count(duk_context *ctx)
+{
+    duk_push_uint(ctx, require_free_list(ctx)->free_count);
+    return 1;
+}
+
+/* b.freeCell(i) returns y * width + x of entry i of the free set, which reorders as cells come and go */
+static duk_ret_t native_board_free_cell(duk_context *ctx)
+{
+    Board *b = require_free_list(ctx);
+    const duk_uint_t i = duk_require_uint(ctx, 0);
+
+    if (i >= b->free_count) {
+        return duk_error(ctx, DUK_ERR_RANGE_ERROR, "only %u free cells", (unsigned)b->free_count);
+    }
+    duk_push_uint(ctx, free_cells(b)[i]);
+    return 1;
+}
+
+/* b.randomFree() returns y * width + x of a free cell picked with the board's generator, or -1 if it's full */
+static duk_ret_t native_board_random_free(duk_context *ctx)
+{
+    Board *b = require_free_list(ctx);
+
+    if (b->free_count == 0) {
+        duk_push_int(ctx, -1);
+    } else {
+        duk_push_uint(ctx, free_cells(b)[SDL_rand_r(&b->rng, (Sint32)b->free_count)]);
+    }
+    return 1;
+}
+
+/* b.seed(n) restarts the board's generator from a 32-bit seed, so the same moves place things in the same cells */
+static duk_ret_t native_board_seed(duk_context *ctx)
+{
+    require_free_list(ctx)->rng = duk_require_uint(ctx, 0);
+    return 0;
+}
+
+/* b.refresh() rebuilds the free set after script wrote to b.data */
+static duk_ret_t native_board_refresh(duk_context *ctx)
+{
+    rebuild_free(require_free_list(ctx));
+    return 0;
+}
+
+static const duk_function_list_entry board_methods[] = {
+    { "get", native_board_get, 2 },
+    { "set", native_board_set, 3 },
+    { "fill", native_board_fill, 5 },
+    { "count", native_board_count, 5 },
+    { "find", native_board_find, 2 },
+    { "copy", native_board_copy, 7 },
+    { "freeCount", native_board_free_count, 0 },
+    { "freeCell", native_board_free_cell, 1 },
+    { "randomFree", native_board_random_free, 0 },
+    { "seed", native_board_seed, 1 },
+    { "refresh", native_board_refresh, 0 },
+    { NULL, NULL, 0 }
+};
+
+static const duk_number_list_entry board_constants[] = {
+    { "FREE_LIST", BOARD_FREE_LIST },
+    { NULL, 0.0 }
+};
+
+void board_bind(duk_context *ctx)
+{
+    duk_push_heap_stash(ctx);
+    duk_push_object(ctx);
+    duk_put_function_list(ctx, -1, board_methods);
+    duk_put_prop_string(ctx, -2, "board");
+    duk_pop(ctx);
+
+    duk_push_object(ctx);
+    duk_push_c_function(ctx, native_board_create, 4);
+    duk_put_prop_string(ctx, -2, "create");
+    duk_put_number_list(ctx, -1, board_constants);
+    duk_put_global_string(ctx, "board");
+}
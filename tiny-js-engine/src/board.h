@@ -0,0 +1,42 @@
+#ifndef BOARD_H
+#define BOARD_H
+
+#include <SDL3/SDL.h>
+#include "duktape/duktape.h"
+
+/* board config */
+#define BOARD_MAX_SIDE 4096 /* cells a side */
+
+/* board.create() flags */
+#define BOARD_FREE_LIST 0x1 /* keep the set of cells holding 0, for picking one at random in O(1) */
+
+/*
+ * Boards are grids of small values packed into 64 bit words, for puzzle
+ * and snake style games that keep a few bits of state per cell. A cell of
+ * `bits` bits sits in one of 64 / bits lanes of a word and never straddles
+ * two, low lanes first, and every row starts on a new word. Fill, count and
+ * find work a word at a time, with the lanes of a value repeated across the
+ * word: XOR against it leaves the matching lanes zero, and those are found
+ * in every lane at once with an add and two masks. This isn't the packing
+ * sight.* takes in a byte buffer, so they take the board itself instead,
+ * through board_cells().
+ *
+ * With BOARD_FREE_LIST a board also keeps its free (0) cells in a dense
+ * list plus each cell's slot in it, so adding, removing and picking one at
+ * random are all O(1) however full the board is. Writes compare the zero
+ * lanes of each word before and after and only touch the cells that
+ * changed.
+ */
+void board_bind(duk_context *ctx);
+
+/* a board's layout, for other modules to read its cells in place */
+typedef struct
+{
+    const Uint64 *words; /* row y starts at words[y * stride] */
+    Uint32 width, height;
+    Uint32 bits, lanes, stride;
+} BoardCells;
+
+bool board_cells(duk_context *ctx, duk_idx_t idx, BoardCells *cells); /* false if it isn't a board */
+
+#endif
@@ -0,0 +1,457 @@
+#include <stdio.h>
+#include "coro.h"
+#include "jobs.h"
+
+#define CORO_INDEX_BITS 20
+#define CORO_INDEX_MASK ((1U << CORO_INDEX_BITS) - 1U)
+#define CORO_GEN_MASK   0xFFFU
+#define CORO_NONE       (-1)
+#define CORO_RUN        CORO_BUCKETS /* list of actors resuming this frame */
+#define CORO_RESERVED   (CORO_BUCKETS + 1)
+
+typedef enum
+{
+    CORO_FREE,
+    CORO_LIST,     /* list head: a wake bucket, the run list or a signal */
+    CORO_SLEEPING, /* in a wake bucket */
+    CORO_WAITING,  /* on a signal's list */
+    CORO_READY,    /* on the run list */
+    CORO_RUNNING
+} CoroState;
+
+/*
+ * Actors and list heads share one pool, and every list is circular with its
+ * head as the sentinel, so unlinking an actor never needs to know which list
+ * it is on.
+ */
+typedef struct
+{
+    Sint32 next; /* list links, next is the free list while free */
+    Sint32 prev;
+    Uint32 wake; /* frame to resume on while sleeping */
+    Uint16 gen;  /* bumped on free so stale ids never match */
+    Uint8 state;
+    bool has_value; /* a signal left a value in stash.coroValues */
+} CoroNode;
+
+static CoroNode *pool;
+static Sint32 pool_size;
+static Sint32 free_list = CORO_NONE;
+static Uint32 frame;
+static bool dispatching;
+static int actor_count;
+
+static const char coro_source[] =
+    "(function (global) {\n"
+    "  var Thread = Duktape.Thread;\n"
+    "  global.wait = function (frames) { Thread.yield(frames === undefined ? 1 : +frames); };\n"
+    "  global.waitUntil = function (signal) {\n"
+    "    if (typeof signal !== 'object' || signal === null) throw new TypeError('waitUntil() needs a coro.signal()');\n"
+    "    return Thread.yield(signal);\n"
+    "  };\n"
+    "  return {\n"
+    "    spawn: function (fn, args) { return new Thread(function () { fn.apply(null, args); return null; }); },\n"
+    "    resume: function (thread, value) { return Thread.resume(thread, value); }\n"
+    "  };\n"
+    "})(this)";
+
+
+/* node pool */
+static Uint32 node_id(Sint32 index)
+{
+    return ((Uint32)pool[index].gen << CORO_INDEX_BITS) | (Uint32)index;
+}
+
+static Sint32 node_lookup(Uint32 id, bool list)
+{
+    Sint32 index = (Sint32)(id & CORO_INDEX_MASK);
+
+    if (index < CORO_RESERVED || index >= pool_size || pool[index].state == CORO_FREE ||
+        (pool[index].state == CORO_LIST) != list || pool[index].gen != id >> CORO_INDEX_BITS) {
+        return CORO_NONE;
+    }
+    return index;
+}
+
+static Sint32 node_alloc(void)
+{
+    Sint32 index;
+
+    if (free_list == CORO_NONE) {
+        Sint32 size = pool_size ? pool_size * 2 : 1024;
+        CoroNode *pool_;
+
+        if (size > CORO_MAX) {
+            return CORO_NONE;
+        }
+        pool_ = (CoroNode *)SDL_realloc(pool, sizeof(CoroNode) * size);
+        if (!pool_) {
+            return CORO_NONE;
+        }
+        pool = pool_;
+        for (index = size - 1; index >= pool_size; index--) {
+            pool[index].state = CORO_FREE;
+            pool[index].gen = 1;
+            pool[index].next = free_list;
+            free_list = index;
+        }
+        pool_size = size;
+    }
+    index = free_list;
+    free_list = pool[index].next;
+    pool[index].has_value = false;
+    return index;
+}
+
+static void node_free(Sint32 index)
+{
+    CoroNode *n = &pool[index];
+
+    n->gen = (Uint16)((n->gen & CORO_GEN_MASK) == CORO_GEN_MASK ? 1 : n->gen + 1);
+    n->state = CORO_FREE;
+    n->next = free_list;
+    free_list = index;
+}
+
+
+/* lists */
+static void list_init(Sint32 head)
+{
+    pool[head].state = CORO_LIST;
+    pool[head].next = pool[head].prev = head;
+}
+
+static void list_append(Sint32 head, Sint32 index, CoroState state)
+{
+    CoroNode *n = &pool[index];
+
+    n->state = (Uint8)state;
+    n->next = head;
+    n->prev = pool[head].prev;
+    pool[n->prev].next = index;
+    pool[head].prev = index;
+}
+
+static void list_unlink(Sint32 index)
+{
+    CoroNode *n = &pool[index];
+
+    pool[n->prev].next = n->next;
+    pool[n->next].prev = n->prev;
+}
+
+/* first frame a newly woken actor may run on; never the one being dispatched */
+static Uint32 next_frame(void)
+{
+    return dispatching ? frame + 1 : frame;
+}
+
+static void sleep_until(Sint32 index, Uint32 wake)
+{
+    pool[index].wake = wake;
+    list_append((Sint32)(wake % CORO_BUCKETS), index, CORO_SLEEPING);
+}
+
+/* drops the actor's thread; it is collected once nothing else refers to it */
+static void actor_free(duk_context *ctx, Sint32 index)
+{
+    if (pool[index].state != CORO_RUNNING) {
+        list_unlink(index);
+    }
+    duk_push_heap_stash(ctx);
+    duk_get_prop_string(ctx, -1, "coroActors");
+    duk_del_prop_index(ctx, -1, (duk_uarridx_t)index);
+    if (pool[index].has_value) {
+        duk_get_prop_string(ctx, -2, "coroValues");
+        duk_del_prop_index(ctx, -1, (duk_uarridx_t)index);
+        duk_pop(ctx);
+    }
+    duk_pop_2(ctx);
+    node_free(index);
+    actor_count--;
+}
+
+/* wakes everything waiting on a signal, handing each the value on top of the stack */
+static int signal_wake(duk_context *ctx, Sint32 signal)
+{
+    bool has_value = !duk_is_undefined(ctx, -1);
+    int woken = 0;
+
+    duk_push_heap_stash(ctx);
+    duk_get_prop_string(ctx, -1, "coroValues");
+    while (pool[signal].next != signal) {
+        Sint32 index = pool[signal].next;
+
+        list_unlink(index);
+        if (has_value) {
+            duk_dup(ctx, -3);
+            duk_put_prop_index(ctx, -2, (duk_uarridx_t)index);
+        }
+        pool[index].has_value = has_value;
+        sleep_until(index, next_frame());
+        woken++;
+    }
+    duk_pop_2(ctx);
+    return woken;
+}
+
+
+/* dispatch */
+
+/* where an actor goes after it yields: [... result] */
+static void actor_yielded(duk_context *ctx, Sint32 index)
+{
+    Sint32 signal = CORO_NONE;
+
+    if (duk_is_number(ctx, -1)) {
+        double frames = duk_get_number(ctx, -1);
+
+        if (!(frames >= 1.0)) {
+            frames = 1.0;
+        }
+        sleep_until(index, frame + (Uint32)SDL_min(frames, (double)0x7FFFFFFF));
+        return;
+    }
+    if (duk_is_null(ctx, -1)) {
+        actor_free(ctx, index); /* returned */
+        return;
+    }
+    if (duk_is_object(ctx, -1)) {
+        duk_get_prop_string(ctx, -1, DUK_HIDDEN_SYMBOL("signal"));
+        if (duk_is_number(ctx, -1)) {
+            signal = node_lookup(duk_get_uint(ctx, -1), true);
+        }
+        duk_pop(ctx);
+    }
+    if (signal == CORO_NONE) {
+        fprintf(stderr, "Error in coroutine: waitUntil() needs a coro.signal()\n");
+        actor_free(ctx, index);
+        return;
+    }
+    list_append(signal, index, CORO_WAITING);
+}
+
+void coro_dispatch(duk_context *ctx)
+{
+    const Sint32 bucket = (Sint32)(frame % CORO_BUCKETS);
+    Sint32 index;
+
+    if (!pool) {
+        return;
+    }
+
+    /* sleepers a whole number of wraps away stay in the bucket */
+    index = pool[bucket].next;
+    while (index != bucket) {
+        Sint32 next = pool[index].next;
+
+        if (pool[index].wake == frame) {
+            list_unlink(index);
+            list_append(CORO_RUN, index, CORO_READY);
+        }
+        index = next;
+    }
+    if (pool[CORO_RUN].next == CORO_RUN) {
+        frame++;
+        return;
+    }
+
+    dispatching = true;
+    duk_push_heap_stash(ctx);
+    duk_get_prop_string(ctx, -1, "coro");
+    duk_get_prop_string(ctx, -1, "resume");
+    duk_get_prop_string(ctx, -3, "coroActors");
+    duk_get_prop_string(ctx, -4, "coroValues");
+
+    /* [... stash coro resume actors values] */
+    while ((index = pool[CORO_RUN].next) != CORO_RUN) {
+        Uint32 id = node_id(index);
+
+        list_unlink(index);
+        pool[index].state = CORO_RUNNING;
+        duk_dup(ctx, -3);
+        duk_get_prop_index(ctx, -3, (duk_uarridx_t)index);
+        if (pool[index].has_value) {
+            pool[index].has_value = false;
+            duk_get_prop_index(ctx, -3, (duk_uarridx_t)index);
+            duk_del_prop_index(ctx, -4, (duk_uarridx_t)index);
+        } else {
+            duk_push_undefined(ctx);
+        }
+
+        /* the pool may grow during the call, and the actor may stop itself */
+        if (duk_pcall(ctx, 2) != 0) {
+            fprintf(stderr, "Error in coroutine: %s\n", duk_safe_to_string(ctx, -1));
+            if ((index = node_lookup(id, false)) != CORO_NONE) {
+                actor_free(ctx, index);
+            }
+        } else if ((index = node_lookup(id, false)) != CORO_NONE) {
+            actor_yielded(ctx, index);
+        }
+        duk_pop(ctx);
+        jobs_drain(ctx);
+    }
+    duk_pop_n(ctx, 5);
+    dispatching = false;
+    frame++;
+}
+
+
+/* javascript bridge logic */
+
+/* coro.start(fn, ...args) -> actor id; the actor first runs at the next dispatch */
+static duk_ret_t native_coro_start(duk_context *ctx)
+{
+    duk_idx_t nargs = duk_get_top(ctx);
+    Sint32 index;
+    duk_idx_t i;
+
+    duk_require_function(ctx, 0);
+    index = node_alloc();
+    if (index == CORO_NONE) {
+        return duk_error(ctx, DUK_ERR_RANGE_ERROR, "too many coroutines");
+    }
+
+    duk_push_heap_stash(ctx);
+    duk_get_prop_string(ctx, -1, "coroActors");
+    duk_get_prop_string(ctx, -2, "coro");
+    duk_get_prop_string(ctx, -1, "spawn");
+    duk_dup(ctx, 0);
+    duk_push_array(ctx);
+    for (i = 1; i < nargs; i++) {
+        duk_dup(ctx, i);
+        duk_put_prop_index(ctx, -2, (duk_uarridx_t)(i - 1));
+    }
+    if (duk_pcall(ctx, 2) != 0) {
+        node_free(index);
+        return duk_throw(ctx);
+    }
+    duk_put_prop_index(ctx, -3, (duk_uarridx_t)index);
+
+    sleep_until(index, next_frame());
+    actor_count++;
+    duk_push_uint(ctx, node_id(index));
+    return 1;
+}
+
+static duk_ret_t native_coro_stop(duk_context *ctx)
+{
+    Sint32 index;
+
+    if (!duk_is_number(ctx, 0)) {
+        return 0;
+    }
+    index = node_lookup(duk_get_uint(ctx, 0), false);
+    if (index != CORO_NONE) {
+        actor_free(ctx, index);
+    }
+    return 0;
+}
+
+static duk_ret_t native_coro_count(duk_context *ctx)
+{
+    duk_push_int(ctx, actor_count);
+    return 1;
+}
+
+static duk_ret_t native_signal_finalizer(duk_context *ctx)
+{
+    Sint32 signal;
+
+    if (!pool || !duk_get_prop_string(ctx, 0, DUK_HIDDEN_SYMBOL("signal"))) {
+        return 0;
+    }
+    signal = node_lookup(duk_get_uint(ctx, -1), true);
+    if (signal != CORO_NONE) {
+        /* waiters keep their signal alive, so this only happens at shutdown */
+        duk_push_undefined(ctx);
+        signal_wake(ctx, signal);
+        node_free(signal);
+    }
+    return 0;
+}
+
+/* coro.signal() -> an object actors can waitUntil() on */
+static duk_ret_t native_coro_signal(duk_context *ctx)
+{
+    Sint32 signal = node_alloc();
+
+    if (signal == CORO_NONE) {
+        return duk_error(ctx, DUK_ERR_RANGE_ERROR, "too many signals");
+    }
+    list_init(signal);
+
+    duk_push_object(ctx);
+    duk_push_heap_stash(ctx);
+    duk_get_prop_string(ctx, -1, "coroSignal");
+    duk_set_prototype(ctx, -3);
+    duk_pop(ctx);
+    duk_push_uint(ctx, node_id(signal));
+    duk_put_prop_string(ctx, -2, DUK_HIDDEN_SYMBOL("signal"));
+    duk_push_c_function(ctx, native_signal_finalizer, 1);
+    duk_set_finalizer(ctx, -2);
+    return 1;
+}
+
+/* signal.fire(value) wakes every actor waiting on it and returns how many */
+static duk_ret_t native_signal_fire(duk_context *ctx)
+{
+    Sint32 signal;
+
+    duk_set_top(ctx, 1);
+    duk_push_this(ctx);
+    if (!duk_get_prop_string(ctx, -1, DUK_HIDDEN_SYMBOL("signal")) ||
+        (signal = node_lookup(duk_get_uint(ctx, -1), true)) == CORO_NONE) {
+        return duk_error(ctx, DUK_ERR_TYPE_ERROR, "not a signal");
+    }
+    duk_dup(ctx, 0);
+    duk_push_int(ctx, signal_wake(ctx, signal));
+    return 1;
+}
+
+static const duk_function_list_entry coro_functions[] = {
+    { "start", native_coro_start, DUK_VARARGS },
+    { "stop", native_coro_stop, 1 },
+    { "count", native_coro_count, 0 },
+    { "signal", native_coro_signal, 0 },
+    { NULL, NULL, 0 }
+};
+
+void coro_bind(duk_context *ctx)
+{
+    Sint32 i;
+
+    for (i = 0; i < CORO_RESERVED; i++) {
+        node_alloc();
+        list_init(i);
+    }
+    frame = 0;
+
+    duk_push_heap_stash(ctx);
+    if (duk_peval_string(ctx, coro_source) != 0) {
+        fprintf(stderr, "Error installing coroutines: %s\n", duk_safe_to_string(ctx, -1));
+    }
+    duk_put_prop_string(ctx, -2, "coro");
+    duk_push_object(ctx);
+    duk_put_prop_string(ctx, -2, "coroActors");
+    duk_push_object(ctx);
+    duk_put_prop_string(ctx, -2, "coroValues");
+    duk_push_object(ctx);
+    duk_push_c_function(ctx, native_signal_fire, 1);
+    duk_put_prop_string(ctx, -2, "fire");
+    duk_put_prop_string(ctx, -2, "coroSignal");
+    duk_pop(ctx);
+
+    duk_push_object(ctx);
+    duk_put_function_list(ctx, -1, coro_functions);
+    duk_put_global_string(ctx, "coro");
+}
+
+void coro_quit(void)
+{
+    SDL_free(pool);
+    pool = NULL;
+    pool_size = 0;
+    free_list = CORO_NONE;
+    actor_count = 0;
+}
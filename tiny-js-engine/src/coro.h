@@ -0,0 +1,22 @@
+#ifndef CORO_H
+#define CORO_H
+
+#include <SDL3/SDL.h>
+#include "duktape/duktape.h"
+
+/* wake list config: one bucket per frame, actors further out wrap around */
+#define CORO_BUCKETS 256
+#define CORO_MAX     (1 << 20)
+
+/*
+ * Script coroutines ("actors") on Duktape threads. coro.start(fn) runs fn on
+ * its own thread; inside it wait(frames) and waitUntil(signal) yield back to
+ * the host. Sleeping actors sit in a bucketed wake list and actors waiting on
+ * a signal sit on that signal's list, so coro_dispatch() only touches the
+ * actors that are due this frame.
+ */
+void coro_bind(duk_context *ctx);
+void coro_dispatch(duk_context *ctx);
+void coro_quit(void);
+
+#endif
@@ -0,0 +1,224 @@
+#include "ecs.h"
+#include "gfx.h"
+
+/* the columns, one block; script sees all but free_ids and live */
+typedef struct
+{
+    float x[ECS_MAX_ENTITIES], y[ECS_MAX_ENTITIES];
+    float vx[ECS_MAX_ENTITIES], vy[ECS_MAX_ENTITIES];
+    Sint32 sprite[ECS_MAX_ENTITIES];
+    Uint32 flags[ECS_MAX_ENTITIES];
+    Uint32 matches[ECS_MAX_ENTITIES]; /* the last query's ids */
+    Uint32 free_ids[ECS_MAX_ENTITIES];
+    Uint32 live[ECS_MAX_ENTITIES / 32]; /* which ids are alive; the ALIVE flag only mirrors this */
+} Columns;
+
+static Columns *columns;
+static Uint32 top;        /* ids ever handed out; queries scan up to here */
+static Uint32 free_count; /* destroyed ids waiting for reuse */
+static Uint32 alive;
+
+#define IS_LIVE(id) (columns->live[(id) >> 5] & (1u << ((id) & 31)))
+
+/* ids matching every bit of `all` and none of `none`, in id order */
+static Uint32 query(Uint32 all, Uint32 none, Uint32 *out)
+{
+    const Uint32 *flags = columns->flags;
+    Uint32 i, n = 0;
+
+    for (i = 0; i < top; i++) {
+        const Uint32 f = flags[i];
+
+        if ((f & all) == all && !(f & none) && IS_LIVE(i)) {
+            out[n++] = i;
+        }
+    }
+    return n;
+}
+
+static void clear_entities(void)
+{
+    if (columns) {
+        SDL_memset(columns->flags, 0, top * sizeof(Uint32));
+        SDL_memset(columns->live, 0, sizeof(columns->live));
+    }
+    top = free_count = alive = 0;
+}
+
+/* javascript bridge logic */
+
+static Uint32 require_entity(duk_context *ctx, duk_idx_t idx)
+{
+    const duk_int_t id = duk_require_int(ctx, idx);
+
+    if (id < 0 || (Uint32)id >= top || !IS_LIVE(id)) {
+        (void)duk_error(ctx, DUK_ERR_RANGE_ERROR, "no such entity: %d", (int)id);
+    }
+    return (Uint32)id;
+}
+
+/* ecs.spawn(flags) returns a new id with its components zeroed and no sprite; ids are reused once destroyed */
+static duk_ret_t native_ecs_spawn(duk_context *ctx)
+{
+    const Uint32 flags = duk_opt_uint(ctx, 0, 0);
+    Uint32 id;
+
+    if (free_count > 0) {
+        id = columns->free_ids[--free_count];
+    } else if (top < ECS_MAX_ENTITIES) {
+        id = top++;
+    } else {
+        return duk_error(ctx, DUK_ERR_RANGE_ERROR, "more than %d entities", ECS_MAX_ENTITIES);
+    }
+    columns->x[id] = columns->y[id] = 0.0f;
+    columns->vx[id] = columns->vy[id] = 0.0f;
+    columns->sprite[id] = -1;
+    columns->flags[id] = flags | ECS_ALIVE;
+    columns->live[id >> 5] |= 1u << (id & 31);
+    alive++;
+    duk_push_uint(ctx, id);
+    return 1;
+}
+
+static duk_ret_t native_ecs_destroy(duk_context *ctx)
+{
+    const Uint32 id = require_entity(ctx, 0);
+
+    columns->flags[id] = 0;
+    columns->live[id >> 5] &= ~(1u << (id & 31));
+    /* a live id is never on the free list, so this holds at most top ids */
+    if (free_count < ECS_MAX_ENTITIES) {
+        columns->free_ids[free_count++] = id;
+    }
+    alive--;
+    return 0;
+}
+
+static duk_ret_t native_ecs_clear(duk_context *ctx)
+{
+    (void)ctx;
+    clear_entities();
+    return 0;
+}
+
+static duk_ret_t native_ecs_count(duk_context *ctx)
+{
+    duk_push_uint(ctx, alive);
+    return 1;
+}
+
+/*
+ * ecs.query(all, none) writes the ids of the live entities with every flag
+ * in `all` and none in `none` to ecs.matches, in id order, and returns how
+ * many there are. The next query overwrites them.
+ */
+static duk_ret_t native_ecs_query(duk_context *ctx)
+{
+    duk_push_uint(ctx, query(duk_opt_uint(ctx, 0, 0), duk_opt_uint(ctx, 1, 0), columns->matches));
+    return 1;
+}
+
+/* ecs.integrate(dt) moves everything with a position and a velocity by velocity * dt */
+static duk_ret_t native_ecs_integrate(duk_context *ctx)
+{
+    const float dt = (float)duk_require_number(ctx, 0);
+    const Uint32 *flags = columns->flags;
+    const Uint32 want = ECS_POSITION | ECS_VELOCITY;
+    Uint32 i;
+
+    for (i = 0; i < top; i++) {
+        if ((flags[i] & want) == want && IS_LIVE(i)) {
+            columns->x[i] += columns->vx[i] * dt;
+            columns->y[i] += columns->vy[i] * dt;
+        }
+    }
+    return 0;
+}
+
+/*
+ * ecs.draw(offsetX, offsetY) draws the sprite of everything with a position
+ * and one, in id order. Sprites that aren't a loaded region are skipped.
+ */
+static duk_ret_t native_ecs_draw(duk_context *ctx)
+{
+    const float ox = (float)duk_opt_number(ctx, 0, 0.0), oy = (float)duk_opt_number(ctx, 1, 0.0);
+    const Uint32 *flags = columns->flags;
+    const Uint32 want = ECS_POSITION | ECS_SPRITE;
+    Uint32 i, drawn = 0;
+    float w, h;
+    int texture;
+
+    for (i = 0; i < top; i++) {
+        if ((flags[i] & want) == want && IS_LIVE(i) && gfx_region_info(columns->sprite[i], &w, &h, &texture)) {
+            gfx_draw_region(columns->sprite[i], columns->x[i] - ox, columns->y[i] - oy, 1.0f, 1.0f);
+            drawn++;
+        }
+    }
+    duk_push_uint(ctx, drawn);
+    return 1;
+}
+
+static const duk_function_list_entry ecs_functions[] = {
+    { "spawn", native_ecs_spawn, 1 },
+    { "destroy", native_ecs_destroy, 1 },
+    { "clear", native_ecs_clear, 0 },
+    { "count", native_ecs_count, 0 },
+    { "query", native_ecs_query, 2 },
+    { "integrate", native_ecs_integrate, 1 },
+    { "draw", native_ecs_draw, 2 },
+    { NULL, NULL, 0 }
+};
+
+static const duk_number_list_entry ecs_constants[] = {
+    { "ALIVE", ECS_ALIVE },
+    { "POSITION", ECS_POSITION },
+    { "VELOCITY", ECS_VELOCITY },
+    { "SPRITE", ECS_SPRITE },
+    { "USER", ECS_USER },
+    { "MAX_ENTITIES", ECS_MAX_ENTITIES },
+    { NULL, 0.0 }
+};
+
+/* puts a typed array over one column on the ecs object, which is under the buffer on the stack */
+static void put_column(duk_context *ctx, const void *column, duk_uint_t type, const char *name)
+{
+    duk_push_buffer_object(ctx, -1, (duk_size_t)((const Uint8 *)column - (const Uint8 *)columns),
+                           ECS_MAX_ENTITIES * 4, type);
+    duk_put_prop_string(ctx, -3, name);
+}
+
+void ecs_bind(duk_context *ctx)
+{
+    if (!columns) {
+        columns = (Columns *)SDL_calloc(1, sizeof(Columns));
+        if (!columns) {
+            SDL_Log("Couldn't allocate entities: %s", SDL_GetError());
+            return;
+        }
+    }
+    clear_entities();
+
+    duk_push_object(ctx);
+    duk_put_function_list(ctx, -1, ecs_functions);
+    duk_put_number_list(ctx, -1, ecs_constants);
+
+    /* the columns stay where they are until ecs_quit, so script can view them in place */
+    duk_push_external_buffer(ctx);
+    duk_config_buffer(ctx, -1, columns, offsetof(Columns, free_ids));
+    put_column(ctx, columns->x, DUK_BUFOBJ_FLOAT32ARRAY, "x");
+    put_column(ctx, columns->y, DUK_BUFOBJ_FLOAT32ARRAY, "y");
+    put_column(ctx, columns->vx, DUK_BUFOBJ_FLOAT32ARRAY, "vx");
+    put_column(ctx, columns->vy, DUK_BUFOBJ_FLOAT32ARRAY, "vy");
+    put_column(ctx, columns->sprite, DUK_BUFOBJ_INT32ARRAY, "sprite");
+    put_column(ctx, columns->flags, DUK_BUFOBJ_UINT32ARRAY, "flags");
+    put_column(ctx, columns->matches, DUK_BUFOBJ_UINT32ARRAY, "matches");
+    duk_pop(ctx);
+    duk_put_global_string(ctx, "ecs");
+}
+
+void ecs_quit(void)
+{
+    SDL_free(columns);
+    columns = NULL;
+    top = free_count = alive = 0;
+}
@@ -0,0 +1,29 @@
+#ifndef ECS_H
+#define ECS_H
+
+#include <SDL3/SDL.h>
+#include "duktape/duktape.h"
+
+/* ecs config */
+#define ECS_MAX_ENTITIES 65536
+
+/* ecs.flags bits; the top 16 are the game's own tags */
+#define ECS_ALIVE    0x1
+#define ECS_POSITION 0x2
+#define ECS_VELOCITY 0x4
+#define ECS_SPRITE   0x8
+#define ECS_USER     0x10000
+
+/*
+ * Entities as a structure of arrays: every component is a column with one
+ * slot per entity id, kept in native memory and handed to script as typed
+ * arrays over external buffers, so ecs.x[id] is a plain array read with no
+ * object behind it and nothing for the collector to trace. ecs.query()
+ * scans the flags column once and writes the matching ids, densely, into
+ * ecs.matches, and the built in systems (integrate, draw) run the same
+ * loops in C.
+ */
+void ecs_bind(duk_context *ctx); /* bind after gfx */
+void ecs_quit(void);             /* after the heap is gone, script's views point into the columns */
+
+#endif
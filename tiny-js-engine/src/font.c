@@ -0,0 +1,573 @@
+#include "font.h"
+#include "gfx.h"
+#include "image.h"
+#include "mapfile.h"
+#include "pack.h"
+#include "textbuf.h"
+
+#define FONT_MAX_PAGES 16
+
+typedef struct
+{
+    Uint32 codepoint;
+    Uint16 x, y, w, h; /* on its page */
+    Sint16 xoffset, yoffset, xadvance;
+    Uint16 page;
+    Uint16 cache_x, cache_y;
+    Uint32 epoch; /* the cache position is valid while this is cache_epoch */
+} Glyph;
+
+typedef struct
+{
+    Uint64 pair; /* first << 32 | second, 0 for an empty slot */
+    int amount;
+} Kerning;
+
+typedef struct
+{
+    Uint8 *pixels; /* RGBA32 */
+    int w, h;
+} FontPage;
+
+typedef struct
+{
+    Glyph *glyphs;
+    Uint32 *glyph_table; /* open addressing on the codepoint, glyph index + 1 */
+    Uint32 glyph_mask;
+    Kerning *kernings;
+    Uint32 kerning_mask;
+    FontPage pages[FONT_MAX_PAGES];
+    int page_count;
+    const Glyph *fallback; /* drawn for codepoints the font lacks */
+    int line_height;
+} Font;
+
+static SDL_Texture *cache;
+static Uint32 cache_epoch = 1;
+static int shelf_x, shelf_y, shelf_h;
+static Font fonts[FONT_MAX];
+static int font_count;
+
+static Uint32 hash_u32(Uint32 v)
+{
+    v *= 0x9E3779B1U;
+    return v ^ (v >> 16);
+}
+
+static Uint32 table_mask(Uint32 count)
+{
+    Uint32 size = 2;
+
+    while (size < 2 * count) {
+        size *= 2;
+    }
+    return size - 1;
+}
+
+static Glyph *find_glyph(const Font *f, Uint32 codepoint)
+{
+    Uint32 slot = hash_u32(codepoint) & f->glyph_mask;
+
+    while (f->glyph_table[slot] != 0) {
+        Glyph *g = &f->glyphs[f->glyph_table[slot] - 1];
+        if (g->codepoint == codepoint) {
+            return g;
+        }
+        slot = (slot + 1) & f->glyph_mask;
+    }
+    return (Glyph *)f->fallback;
+}
+
+static int kerning(const Font *f, Uint32 first, Uint32 second)
+{
+    const Uint64 pair = ((Uint64)first << 32) | second;
+    Uint32 slot;
+
+    if (!f->kernings || first == 0) {
+        return 0;
+    }
+    slot = hash_u32(first ^ hash_u32(second)) & f->kerning_mask;
+    while (f->kernings[slot].pair != 0) {
+        if (f->kernings[slot].pair == pair) {
+            return f->kernings[slot].amount;
+        }
+        slot = (slot + 1) & f->kerning_mask;
+    }
+    return 0;
+}
+
+static bool drawable(const Glyph *g)
+{
+    return g && g->w > 0 && g->h > 0;
+}
+
+
+/* loading */
+
+/* the integer after `key=` on a BMFont line, or def */
+static int field(const char *line, const char *key, int def)
+{
+    const size_t n = SDL_strlen(key);
+    const char *p = line;
+
+    while ((p = SDL_strstr(p, key)) != NULL) {
+        if ((p == line || p[-1] == ' ' || p[-1] == '\t') && p[n] == '=') {
+            return (int)SDL_strtol(p + n + 1, NULL, 10);
+        }
+        p += n;
+    }
+    return def;
+}
+
+/* a page's file name, relative to the font; PNG pages are read from their .qoi siblings */
+static char *page_path(const char *font_path, const char *line)
+{
+    const char *slash = SDL_strrchr(font_path, '/');
+    const int dir_len = slash ? (int)(slash - font_path) + 1 : 0;
+    const char *name = SDL_strstr(line, "file=\"");
+    const char *end, *ext;
+    char *path;
+
+    if (!name) {
+        return NULL;
+    }
+    name += 6;
+    end = SDL_strchr(name, '"');
+    if (!end) {
+        return NULL;
+    }
+    ext = end - 4 >= name && SDL_strncasecmp(end - 4, ".png", 4) == 0 ? ".qoi" : "";
+    if (SDL_asprintf(&path, "%.*s%.*s%s", dir_len, font_path, (int)(end - name) - (*ext ? 4 : 0), name, ext) < 0) {
+        return NULL;
+    }
+    return path;
+}
+
+static bool load_page(FontPage *page, const char *path)
+{
+    MappedFile mf;
+    bool ok;
+
+    if (!map_file(path, &mf)) {
+        return false;
+    }
+    ok = image_info(mf.data, mf.size, &page->w, &page->h) &&
+         (page->pixels = (Uint8 *)SDL_malloc((size_t)page->w * page->h * 4)) != NULL &&
+         image_decode(mf.data, mf.size, page->pixels, page->w * 4);
+    unmap_file(&mf);
+    return ok;
+}
+
+static void free_font(Font *f)
+{
+    int i;
+
+    for (i = 0; i < f->page_count; i++) {
+        SDL_free(f->pages[i].pixels);
+    }
+    SDL_free(f->glyphs);
+    SDL_free(f->glyph_table);
+    SDL_free(f->kernings);
+    SDL_zerop(f);
+}
+
+static void add_kerning(Font *f, Uint32 first, Uint32 second, int amount)
+{
+    const Uint64 pair = ((Uint64)first << 32) | second;
+    Uint32 slot = hash_u32(first ^ hash_u32(second)) & f->kerning_mask;
+
+    if (first == 0 || amount == 0) {
+        return;
+    }
+    while (f->kernings[slot].pair != 0 && f->kernings[slot].pair != pair) {
+        slot = (slot + 1) & f->kerning_mask;
+    }
+    f->kernings[slot].pair = pair;
+    f->kernings[slot].amount = amount;
+}
+
+/* parses a BMFont text file; lines are split in place */
+static bool load_font(Font *f, const char *path)
+{
+    char *text = (char *)pack_load_file(path, NULL);
+    char *line, *next, *end;
+    Uint32 glyph_count = 0, kerning_count = 0, i;
+
+    SDL_zerop(f);
+    if (!text) {
+        return false;
+    }
+    end = text + SDL_strlen(text);
+    for (line = text; line; line = next) {
+        next = SDL_strchr(line, '\n');
+        if (next) {
+            *next++ = '\0';
+        }
+        glyph_count += SDL_strncmp(line, "char ", 5) == 0;
+        kerning_count += SDL_strncmp(line, "kerning ", 8) == 0;
+    }
+    if (glyph_count == 0) {
+        SDL_SetError("Not a BMFont text file: %s", path);
+        goto fail;
+    }
+
+    f->glyph_mask = table_mask(glyph_count);
+    f->glyphs = (Glyph *)SDL_calloc(glyph_count, sizeof(Glyph));
+    f->glyph_table = (Uint32 *)SDL_calloc(f->glyph_mask + 1, sizeof(Uint32));
+    if (kerning_count > 0) {
+        f->kerning_mask = table_mask(kerning_count);
+        f->kernings = (Kerning *)SDL_calloc(f->kerning_mask + 1, sizeof(Kerning));
+    }
+    if (!f->glyphs || !f->glyph_table || (kerning_count > 0 && !f->kernings)) {
+        goto fail;
+    }
+
+    glyph_count = 0;
+    for (line = text; line < end; line += SDL_strlen(line) + 1) {
+        if (SDL_strncmp(line, "common ", 7) == 0) {
+            f->line_height = field(line, "lineHeight", 0);
+        } else if (SDL_strncmp(line, "page ", 5) == 0) {
+            const int id = field(line, "id", -1);
+            char *file;
+            bool ok;
+
+            if (id != f->page_count || id >= FONT_MAX_PAGES) {
+                SDL_SetError("Unsupported page in %s", path);
+                goto fail;
+            }
+            file = page_path(path, line);
+            f->page_count++; /* so free_font frees a half loaded page too */
+            ok = file && load_page(&f->pages[id], file);
+            SDL_free(file);
+            if (!ok) {
+                goto fail;
+            }
+        } else if (SDL_strncmp(line, "char ", 5) == 0) {
+            Glyph *g = &f->glyphs[glyph_count];
+            const int id = field(line, "id", -1);
+            Uint32 slot;
+
+            if (id < 0) {
+                continue;
+            }
+            g->codepoint = (Uint32)id;
+            g->x = (Uint16)field(line, "x", 0);
+            g->y = (Uint16)field(line, "y", 0);
+            g->w = (Uint16)field(line, "width", 0);
+            g->h = (Uint16)field(line, "height", 0);
+            g->xoffset = (Sint16)field(line, "xoffset", 0);
+            g->yoffset = (Sint16)field(line, "yoffset", 0);
+            g->xadvance = (Sint16)field(line, "xadvance", 0);
+            g->page = (Uint16)field(line, "page", 0);
+
+            slot = hash_u32(g->codepoint) & f->glyph_mask;
+            while (f->glyph_table[slot] != 0 && f->glyphs[f->glyph_table[slot] - 1].codepoint != g->codepoint) {
+                slot = (slot + 1) & f->glyph_mask;
+            }
+            f->glyph_table[slot] = ++glyph_count;
+        } else if (SDL_strncmp(line, "kerning ", 8) == 0) {
+            add_kerning(f, (Uint32)field(line, "first", 0), (Uint32)field(line, "second", 0), field(line, "amount", 0));
+        }
+    }
+    SDL_free(text);
+
+    /* glyphs off their page are kept for their advance but never drawn */
+    for (i = 0; i < glyph_count; i++) {
+        Glyph *g = &f->glyphs[i];
+        if (g->page >= f->page_count || g->x + g->w > f->pages[g->page].w || g->y + g->h > f->pages[g->page].h) {
+            g->w = g->h = 0;
+        }
+    }
+    f->fallback = find_glyph(f, '?');
+    if (f->line_height <= 0) {
+        f->line_height = 1;
+    }
+    return true;
+
+fail:
+    SDL_free(text);
+    free_font(f);
+    return false;
+}
+
+
+/* glyph cache */
+static bool cache_glyph(const Font *f, Glyph *g)
+{
+    const FontPage *page = &f->pages[g->page];
+    SDL_Rect rect;
+
+    if (g->epoch == cache_epoch) {
+        return true;
+    }
+    if (g->w >= FONT_CACHE_SIZE || g->h >= FONT_CACHE_SIZE) {
+        return false;
+    }
+    if (shelf_x + g->w > FONT_CACHE_SIZE) {
+        shelf_x = 0;
+        shelf_y += shelf_h + 1;
+        shelf_h = 0;
+    }
+    if (shelf_y + g->h > FONT_CACHE_SIZE) {
+        /* full: start over, drawing what is queued while it still shows the old glyphs */
+        gfx_flush();
+        cache_epoch++;
+        shelf_x = shelf_y = shelf_h = 0;
+    }
+
+    rect.x = shelf_x;
+    rect.y = shelf_y;
+    rect.w = g->w;
+    rect.h = g->h;
+    if (!gfx_update_texture(cache, &rect, page->pixels + ((size_t)g->y * page->w + g->x) * 4, page->w * 4)) {
+        return false;
+    }
+    g->cache_x = (Uint16)shelf_x;
+    g->cache_y = (Uint16)shelf_y;
+    g->epoch = cache_epoch;
+    shelf_x += g->w + 1;
+    shelf_h = SDL_max(shelf_h, g->h);
+    return true;
+}
+
+/* caches the glyphs `text` needs and returns how many quads it draws */
+static int prepare(Font *f, const char *text, size_t len)
+{
+    const char *s;
+    size_t left;
+    Uint32 cp;
+    int attempt, quads = 0;
+
+    /* a second pass if the cache was emptied under the glyphs cached first */
+    for (attempt = 0; attempt < 2; attempt++) {
+        const Uint32 epoch = cache_epoch;
+
+        for (s = text, left = len; left > 0 && (cp = SDL_StepUTF8(&s, &left)) != 0;) {
+            Glyph *g = cp == '\n' ? NULL : find_glyph(f, cp);
+            if (drawable(g)) {
+                cache_glyph(f, g);
+            }
+        }
+        if (epoch == cache_epoch) {
+            break;
+        }
+    }
+    for (s = text, left = len; left > 0 && (cp = SDL_StepUTF8(&s, &left)) != 0;) {
+        const Glyph *g = cp == '\n' ? NULL : find_glyph(f, cp);
+        quads += drawable(g) && g->epoch == cache_epoch;
+    }
+    return quads;
+}
+
+
+/* layout */
+
+/* the advance of the word starting with `first`, up to the next space or line break */
+static float word_width(const Font *f, Uint32 first, const char *s, size_t left, Uint32 prev)
+{
+    float w = 0.0f;
+    Uint32 cp = first;
+
+    for (;;) {
+        const Glyph *g = find_glyph(f, cp);
+        if (g) {
+            w += (float)(kerning(f, prev, cp) + g->xadvance);
+        }
+        prev = cp;
+        if (left == 0 || (cp = SDL_StepUTF8(&s, &left)) == 0 || cp == ' ' || cp == '\t' || cp == '\n') {
+            return w;
+        }
+    }
+}
+
+/*
+ * Greedy word wrap: a word that would cross max_width starts a new line
+ * unless it is the first on its line. Fills quads into v if it is not NULL
+ * and returns how many; always reports the size of the text's box.
+ */
+static int layout(const Font *f, float x, float y, const char *text, size_t len, float max_width,
+                  SDL_Vertex *v, float *width, float *height)
+{
+    const float texel = 1.0f / FONT_CACHE_SIZE;
+    const char *s = text;
+    size_t left = len;
+    float pen = 0.0f, line_end = 0.0f, widest = 0.0f, top = 0.0f;
+    bool in_word = false;
+    Uint32 prev = 0, cp;
+    int quads = 0;
+
+    while (left > 0 && (cp = SDL_StepUTF8(&s, &left)) != 0) {
+        const Glyph *g;
+
+        if (cp == '\n') {
+            widest = SDL_max(widest, line_end);
+            pen = line_end = 0.0f;
+            top += (float)f->line_height;
+            prev = 0;
+            in_word = false;
+            continue;
+        }
+        if (cp == ' ' || cp == '\t') {
+            in_word = false;
+        } else if (!in_word) {
+            in_word = true;
+            if (max_width > 0.0f && line_end > 0.0f && pen + word_width(f, cp, s, left, prev) > max_width) {
+                widest = SDL_max(widest, line_end);
+                pen = line_end = 0.0f;
+                top += (float)f->line_height;
+                prev = 0;
+            }
+        }
+
+        g = find_glyph(f, cp);
+        if (!g) {
+            continue;
+        }
+        pen += (float)kerning(f, prev, cp);
+        if (v && drawable(g) && g->epoch == cache_epoch) {
+            const float x0 = x + pen + g->xoffset, y0 = y + top + g->yoffset;
+            const float u0 = g->cache_x * texel, v0 = g->cache_y * texel;
+
+            v[0].position.x = v[3].position.x = x0;
+            v[1].position.x = v[2].position.x = x0 + g->w;
+            v[0].position.y = v[1].position.y = y0;
+            v[2].position.y = v[3].position.y = y0 + g->h;
+            v[0].tex_coord.x = v[3].tex_coord.x = u0;
+            v[1].tex_coord.x = v[2].tex_coord.x = u0 + g->w * texel;
+            v[0].tex_coord.y = v[1].tex_coord.y = v0;
+            v[2].tex_coord.y = v[3].tex_coord.y = v0 + g->h * texel;
+            v += 4;
+            quads++;
+        }
+        pen += (float)g->xadvance;
+        if (cp != ' ' && cp != '\t') {
+            line_end = pen;
+        }
+        prev = cp;
+    }
+    *width = SDL_max(widest, line_end);
+    *height = top + (float)f->line_height;
+    return quads;
+}
+
+bool font_draw(int font, float x, float y, const char *text, size_t len, float max_width)
+{
+    Font *f;
+    SDL_Vertex *v;
+    float w, h;
+    int quads, drawn;
+
+    if (font < 0 || font >= font_count) {
+        return SDL_SetError("no such font: %d", font);
+    }
+    f = &fonts[font];
+    quads = prepare(f, text, len);
+    if (quads == 0) {
+        return true;
+    }
+    v = gfx_reserve(cache, quads);
+    if (!v) {
+        return SDL_SetError("text too long (max %d glyphs)", GFX_BATCH_QUADS);
+    }
+    drawn = layout(f, x, y, text, len, max_width, v, &w, &h);
+    if (drawn < quads) {
+        SDL_memset(&v[drawn * 4], 0, (size_t)(quads - drawn) * 4 * sizeof(SDL_Vertex));
+    }
+    return true;
+}
+
+static bool create_cache(void)
+{
+    cache = gfx_create_texture(NULL, FONT_CACHE_SIZE, FONT_CACHE_SIZE);
+    if (!cache) {
+        return false;
+    }
+    SDL_SetTextureScaleMode(cache, SDL_SCALEMODE_NEAREST);
+    return true;
+}
+
+void font_quit(void)
+{
+    int i;
+
+    for (i = 0; i < font_count; i++) {
+        free_font(&fonts[i]);
+    }
+    font_count = 0;
+    if (cache) {
+        SDL_DestroyTexture(cache);
+        cache = NULL;
+    }
+}
+
+
+/* javascript bridge logic */
+static duk_ret_t native_gfx_load_font(duk_context *ctx)
+{
+    const char *path = duk_require_string(ctx, 0);
+
+    if (font_count == FONT_MAX) {
+        return duk_error(ctx, DUK_ERR_RANGE_ERROR, "too many fonts (max %d)", FONT_MAX);
+    }
+    if ((!cache && !create_cache()) || !load_font(&fonts[font_count], path)) {
+        return duk_error(ctx, DUK_ERR_ERROR, "Couldn't load %s: %s", path, SDL_GetError());
+    }
+    duk_push_int(ctx, font_count++);
+    return 1;
+}
+
+/* the string or text buffer at idx, without making a JS string of a buffer */
+static const char *require_text(duk_context *ctx, duk_idx_t idx, duk_size_t *len)
+{
+    const char *text = textbuf_get(ctx, idx, len);
+
+    return text ? text : duk_safe_to_lstring(ctx, idx, len);
+}
+
+/* gfx.text(font, x, y, str, maxWidth) draws str, a string or text buffer, in the current tint */
+static duk_ret_t native_gfx_text(duk_context *ctx)
+{
+    const int font = duk_require_int(ctx, 0);
+    const float x = (float)duk_require_number(ctx, 1), y = (float)duk_require_number(ctx, 2);
+    duk_size_t len;
+    const char *text = require_text(ctx, 3, &len);
+
+    if (!font_draw(font, x, y, text, len, (float)duk_opt_number(ctx, 4, 0.0))) {
+        return duk_error(ctx, DUK_ERR_RANGE_ERROR, "%s", SDL_GetError());
+    }
+    return 0;
+}
+
+/* gfx.measure(font, str, maxWidth) -> { width, height } of the laid out text */
+static duk_ret_t native_gfx_measure(duk_context *ctx)
+{
+    const int font = duk_require_int(ctx, 0);
+    duk_size_t len;
+    const char *text = require_text(ctx, 1, &len);
+    float w, h;
+
+    if (font < 0 || font >= font_count) {
+        return duk_error(ctx, DUK_ERR_RANGE_ERROR, "no such font: %d", font);
+    }
+    layout(&fonts[font], 0.0f, 0.0f, text, len, (float)duk_opt_number(ctx, 2, 0.0), NULL, &w, &h);
+    duk_push_object(ctx);
+    duk_push_number(ctx, w);
+    duk_put_prop_string(ctx, -2, "width");
+    duk_push_number(ctx, h);
+    duk_put_prop_string(ctx, -2, "height");
+    return 1;
+}
+
+static const duk_function_list_entry font_functions[] = {
+    { "loadFont", native_gfx_load_font, 1 },
+    { "text", native_gfx_text, DUK_VARARGS },
+    { "measure", native_gfx_measure, DUK_VARARGS },
+    { NULL, NULL, 0 }
+};
+
+void font_bind(duk_context *ctx)
+{
+    duk_get_global_string(ctx, "gfx");
+    duk_put_function_list(ctx, -1, font_functions);
+    duk_pop(ctx);
+}
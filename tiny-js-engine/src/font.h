@@ -0,0 +1,25 @@
+#ifndef FONT_H
+#define FONT_H
+
+#include <SDL3/SDL.h>
+#include "duktape/duktape.h"
+
+/* font config */
+#define FONT_MAX        16
+#define FONT_CACHE_SIZE 512 /* glyph cache texture, in pixels per side */
+
+/*
+ * Bitmap fonts in the AngelCode BMFont text format, with QOI or TJSI page
+ * images. Glyphs are copied on first use into one cache texture shared by
+ * every font, so all text on screen draws with the same texture; when the
+ * cache fills up it is emptied and refilled by the glyphs drawn next. A
+ * string is laid out in C (UTF-8, kerning, word wrap) and queued as a
+ * single run of quads in the gfx batch.
+ */
+void font_bind(duk_context *ctx); /* adds to the gfx object, bind after gfx */
+void font_quit(void);
+
+/* draws `len` bytes of UTF-8 with its top left at (x, y), wrapping lines at max_width if it is > 0 */
+bool font_draw(int font, float x, float y, const char *text, size_t len, float max_width);
+
+#endif
@@ -0,0 +1,880 @@
+#include "gfx.h"
+#include "atlas.h"
+#include "image.h"
+#include "loader.h"
+#include "mapfile.h"
+#include "soft.h"
+#include "upscale.h"
+
+typedef struct
+{
+    int texture_id; /* its index in textures[] */
+    float w, h;
+    float u0, v0, u1, v1;
+} Region;
+
+/* an atlas page or image, which can be evicted and reloaded if it has a path */
+typedef struct
+{
+    SDL_Texture *texture; /* NULL while evicted */
+    char *path;
+    int width, height;
+    int refs;             /* an atlas page has one for good, an image one per gfx.image() of it */
+    Sint32 region;        /* an image's whole-texture region, -1 for atlas pages */
+    Uint64 last_used;     /* the frame it was last drawn in */
+    bool loading;
+} TextureSlot;
+
+typedef struct
+{
+    MappedFile file; /* kept mapped for name lookups */
+    const AtlasHeader *header;
+    const AtlasRegion *regions;
+    const Uint32 *table;
+    const char *names;
+    Uint32 first; /* id of the atlas's first region */
+} Atlas;
+
+typedef struct
+{
+    Uint32 quads;
+    Uint32 draws;
+    Uint32 binds;
+} GfxStats;
+
+static SDL_Renderer *renderer;
+static bool software; /* drawing goes through soft.c */
+
+static SDL_Vertex vertices[GFX_BATCH_QUADS * 4];
+static int indices[GFX_BATCH_QUADS * 6];
+static int quad_count;
+static SDL_Texture *batch_texture;
+
+/* the logical resolution frames are drawn at, or 0 to draw straight to the window */
+static int canvas_w, canvas_h;
+static UpscaleMode canvas_mode;
+static SDL_Texture *canvas; /* the render target; soft.c draws into its framebuffer instead */
+
+static SDL_FColor tint = { 1.0f, 1.0f, 1.0f, 1.0f };
+static Uint8 clear_color[3];
+static GfxStats frame_stats;
+static GfxStats last_stats;
+
+static Atlas atlases[GFX_MAX_ATLASES];
+static int atlas_count;
+static TextureSlot textures[GFX_MAX_TEXTURES];
+static int texture_count;
+static Region *regions;
+static Uint32 region_count;
+
+/* texture residency */
+static size_t texture_bytes, texture_budget; /* 0 for no budget */
+static Uint64 frame_number;
+static Uint32 evictions, reloads;
+
+void gfx_init(SDL_Renderer *r)
+{
+    const char *budget = SDL_getenv("TJS_TEXTURE_BUDGET");
+    int i;
+
+    renderer = r;
+    software = soft_init(r);
+    texture_budget = budget ? (size_t)SDL_atoi(budget) << 20 : 0;
+    /* every quad is two triangles over its 4 vertices */
+    for (i = 0; i < GFX_BATCH_QUADS; i++) {
+        indices[i * 6 + 0] = i * 4 + 0;
+        indices[i * 6 + 1] = i * 4 + 1;
+        indices[i * 6 + 2] = i * 4 + 2;
+        indices[i * 6 + 3] = i * 4 + 2;
+        indices[i * 6 + 4] = i * 4 + 3;
+        indices[i * 6 + 5] = i * 4 + 0;
+    }
+}
+
+void gfx_flush(void)
+{
+    if (quad_count == 0) {
+        return;
+    }
+    if (software) {
+        soft_draw(batch_texture, vertices, quad_count);
+    } else if (!SDL_RenderGeometry(renderer, batch_texture, vertices, quad_count * 4, indices, quad_count * 6)) {
+        SDL_Log("Couldn't draw: %s", SDL_GetError());
+    }
+    frame_stats.draws++;
+    quad_count = 0;
+}
+
+void gfx_output_size(int *width, int *height)
+{
+    if (canvas_w > 0) {
+        *width = canvas_w;
+        *height = canvas_h;
+    } else if (!SDL_GetCurrentRenderOutputSize(renderer, width, height)) {
+        *width = *height = 0;
+    }
+}
+
+SDL_Vertex *gfx_reserve(SDL_Texture *texture, int quads)
+{
+    SDL_Vertex *v;
+    int i;
+
+    if (quads > GFX_BATCH_QUADS) {
+        return NULL;
+    }
+    if (texture != batch_texture) {
+        gfx_flush();
+        batch_texture = texture;
+        frame_stats.binds++;
+    } else if (quad_count + quads > GFX_BATCH_QUADS) {
+        gfx_flush();
+    }
+    v = &vertices[quad_count * 4];
+    for (i = 0; i < quads * 4; i++) {
+        v[i].color = tint;
+    }
+    quad_count += quads;
+    frame_stats.quads += (Uint32)quads;
+    return v;
+}
+
+static size_t slot_bytes(const TextureSlot *t)
+{
+    return (size_t)t->width * t->height * 4;
+}
+
+/*
+ * The texture to evict next, or -1: released ones first, then the least
+ * recently drawn. One still in use is only evicted once it has gone
+ * GFX_EVICT_IDLE_FRAMES undrawn, so a working set over the budget goes over
+ * it rather than reloading the same pages every frame.
+ */
+static int eviction_candidate(void)
+{
+    const TextureSlot *t, *best = NULL;
+    int i, found = -1;
+
+    for (i = 0; i < texture_count; i++) {
+        t = &textures[i];
+        if (!t->texture || (t->refs > 0 && (!t->path || t->last_used + GFX_EVICT_IDLE_FRAMES > frame_number))) {
+            continue;
+        }
+        if (!best || (t->refs == 0 && best->refs > 0) ||
+            ((t->refs == 0) == (best->refs == 0) && t->last_used < best->last_used)) {
+            best = t;
+            found = i;
+        }
+    }
+    return found;
+}
+
+/* after a frame: frees textures until they fit the budget */
+static void evict_textures(void)
+{
+    TextureSlot *t;
+    int i;
+
+    while (texture_budget > 0 && texture_bytes > texture_budget && (i = eviction_candidate()) >= 0) {
+        t = &textures[i];
+        SDL_DestroyTexture(t->texture);
+        t->texture = NULL;
+        texture_bytes -= slot_bytes(t);
+        evictions++;
+    }
+}
+
+void gfx_begin_frame(void)
+{
+    int w, h;
+
+    last_stats = frame_stats;
+    SDL_zero(frame_stats);
+    batch_texture = NULL;
+    frame_number++;
+    if (software) {
+        /* without a canvas the framebuffer follows the window as it is resized */
+        if (canvas_w == 0 && SDL_GetCurrentRenderOutputSize(renderer, &w, &h) && !soft_resize(w, h)) {
+            SDL_Log("Couldn't resize the framebuffer: %s", SDL_GetError());
+        }
+        soft_clear(clear_color[0], clear_color[1], clear_color[2]);
+        return;
+    }
+    if (canvas) {
+        SDL_SetRenderTarget(renderer, canvas);
+    }
+    SDL_SetRenderDrawColor(renderer, clear_color[0], clear_color[1], clear_color[2], SDL_ALPHA_OPAQUE);
+    SDL_RenderClear(renderer);
+}
+
+void gfx_end_frame(void)
+{
+    SDL_Texture *frame = canvas;
+    const Uint32 *pixels = NULL;
+    bool ok = true;
+
+    gfx_flush();
+    if (canvas_w > 0) {
+        if (software) {
+            frame = soft_frame(&pixels);
+        }
+        ok = frame && upscale_present(renderer, frame, canvas_w, canvas_h, pixels, canvas_w, canvas_mode);
+    } else if (software) {
+        ok = soft_present();
+    }
+    if (!ok) {
+        SDL_Log("Couldn't present: %s", SDL_GetError());
+    }
+    SDL_RenderPresent(renderer);
+    evict_textures();
+}
+
+static void destroy_canvas(void)
+{
+    if (canvas) {
+        SDL_SetRenderTarget(renderer, NULL);
+        SDL_DestroyTexture(canvas);
+        canvas = NULL;
+    }
+    canvas_w = canvas_h = 0;
+}
+
+/* draws frames at `width` x `height` from now on; 0 x 0 goes back to the window's size */
+static bool set_canvas(int width, int height, UpscaleMode mode)
+{
+    int w = width, h = height;
+
+    gfx_flush();
+    destroy_canvas();
+    canvas_mode = mode;
+    if (software) {
+        if (width == 0 && !SDL_GetCurrentRenderOutputSize(renderer, &w, &h)) {
+            return false;
+        }
+        if (!soft_resize(w, h)) {
+            return false;
+        }
+        soft_clear(clear_color[0], clear_color[1], clear_color[2]);
+    } else if (width > 0) {
+        canvas = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_TARGET, width, height);
+        if (!canvas) {
+            return false;
+        }
+        SDL_SetTextureBlendMode(canvas, SDL_BLENDMODE_NONE);
+        SDL_SetTextureScaleMode(canvas, SDL_SCALEMODE_NEAREST);
+        /* a frame already under way carries on in the canvas */
+        SDL_SetRenderTarget(renderer, canvas);
+        SDL_SetRenderDrawColor(renderer, clear_color[0], clear_color[1], clear_color[2], SDL_ALPHA_OPAQUE);
+        SDL_RenderClear(renderer);
+    }
+    canvas_w = width;
+    canvas_h = height;
+    return true;
+}
+
+static void unload_textures(void)
+{
+    int i;
+
+    for (i = 0; i < texture_count; i++) {
+        if (textures[i].texture) {
+            SDL_DestroyTexture(textures[i].texture);
+        }
+        SDL_free(textures[i].path);
+        SDL_zero(textures[i]);
+    }
+    for (i = 0; i < atlas_count; i++) {
+        unmap_file(&atlases[i].file);
+    }
+    SDL_free(regions);
+    regions = NULL;
+    region_count = 0;
+    texture_count = 0;
+    texture_bytes = 0;
+    atlas_count = 0;
+}
+
+void gfx_quit(void)
+{
+    destroy_canvas();
+    upscale_quit();
+    unload_textures();
+    if (software) {
+        soft_quit();
+        software = false;
+    }
+    renderer = NULL;
+}
+
+SDL_Texture *gfx_create_texture(const Uint8 *pixels, int width, int height)
+{
+    SDL_Texture *texture;
+    Uint8 *dst, *clear = NULL;
+
+    if (software) {
+        texture = soft_create_texture(width, height, &dst);
+        if (texture) {
+            if (pixels) {
+                SDL_memcpy(dst, pixels, (size_t)width * height * 4);
+            } else {
+                SDL_memset(dst, 0, (size_t)width * height * 4);
+            }
+        }
+        return texture;
+    }
+
+    texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STATIC, width, height);
+    if (!texture) {
+        return NULL;
+    }
+    if (!pixels) {
+        pixels = clear = (Uint8 *)SDL_calloc((size_t)width * height, 4);
+    }
+    if (!pixels || !SDL_UpdateTexture(texture, NULL, pixels, width * 4)) {
+        SDL_DestroyTexture(texture);
+        texture = NULL;
+    }
+    SDL_free(clear);
+    return texture;
+}
+
+bool gfx_update_texture(SDL_Texture *texture, const SDL_Rect *rect, const Uint8 *pixels, int pitch)
+{
+    if (software) {
+        return soft_update_texture(texture, rect, pixels, pitch);
+    }
+    return SDL_UpdateTexture(texture, rect, pixels, pitch);
+}
+
+/* a QOI or TJSI image file as a texture, decoded into RAM for the software rasterizer */
+static SDL_Texture *load_texture(const char *path, int *width, int *height)
+{
+    SDL_Texture *texture = NULL;
+    MappedFile mf;
+    Uint8 *pixels;
+    float w, h;
+
+    if (!software) {
+        texture = image_load_texture(renderer, path);
+        if (!texture) {
+            return NULL;
+        }
+        if (!SDL_GetTextureSize(texture, &w, &h)) {
+            SDL_DestroyTexture(texture);
+            return NULL;
+        }
+        *width = (int)w;
+        *height = (int)h;
+        return texture;
+    }
+
+    if (!map_file(path, &mf)) {
+        return NULL;
+    }
+    if (image_info(mf.data, mf.size, width, height)) {
+        texture = soft_create_texture(*width, *height, &pixels);
+        if (texture && !image_decode(mf.data, mf.size, pixels, *width * 4)) {
+            SDL_DestroyTexture(texture);
+            texture = NULL;
+        }
+    }
+    unmap_file(&mf);
+    return texture;
+}
+
+/* puts a texture in textures[i], which takes ownership of it */
+static void make_resident(int i, SDL_Texture *texture)
+{
+    SDL_SetTextureScaleMode(texture, SDL_SCALEMODE_NEAREST);
+    textures[i].texture = texture;
+    texture_bytes += slot_bytes(&textures[i]);
+}
+
+static void reloaded(void *userdata, void *result, const char *error)
+{
+    const int i = (int)(intptr_t)userdata;
+    TextureSlot *t = &textures[i];
+    LoaderImage *image = (LoaderImage *)result;
+    SDL_Texture *texture = NULL;
+
+    t->loading = false;
+    if (image && (image->width != t->width || image->height != t->height)) {
+        error = "its size has changed";
+    } else if (image && !(texture = gfx_create_texture(image->pixels, image->width, image->height))) {
+        error = SDL_GetError();
+    }
+    SDL_free(image);
+    if (!texture) {
+        /* drawing it would retry every frame, leave it evicted for good */
+        SDL_Log("Couldn't reload %s: %s", t->path, error);
+        SDL_free(t->path);
+        t->path = NULL;
+        return;
+    }
+    make_resident(i, texture);
+    reloads++;
+}
+
+/* starts reloading an evicted texture; it is drawn again once loader_update() has it */
+static void reload_texture(int i)
+{
+    TextureSlot *t = &textures[i];
+    SDL_Texture *texture;
+    int w, h;
+
+    if (t->texture || t->loading || !t->path) {
+        return;
+    }
+    t->loading = loader_load(t->path, &loader_image_kind, reloaded, (void *)(intptr_t)i);
+    if (!t->loading) {
+        /* no loader, e.g. it failed to start: load it here instead */
+        texture = load_texture(t->path, &w, &h);
+        if (texture && w == t->width && h == t->height) {
+            make_resident(i, texture);
+            reloads++;
+            return;
+        }
+        if (texture) {
+            SDL_DestroyTexture(texture);
+        }
+        reloaded((void *)(intptr_t)i, NULL, texture ? "its size has changed" : SDL_GetError());
+    }
+}
+
+/* the next texture slot for an image of `width` x `height` that will be reloaded from `path` (owned) if evicted */
+static int add_slot(SDL_Texture *texture, int width, int height, char *path, Sint32 region)
+{
+    TextureSlot *t = &textures[texture_count];
+
+    SDL_zerop(t);
+    t->path = path;
+    t->width = width;
+    t->height = height;
+    t->refs = 1;
+    t->region = region;
+    t->last_used = frame_number;
+    make_resident(texture_count, texture);
+    return texture_count++;
+}
+
+/* the region named `name` in any loaded atlas, or -1 */
+static Sint32 find_region(const char *name)
+{
+    const Uint32 hash = pack_hash(name, 0);
+    int i;
+
+    for (i = 0; i < atlas_count; i++) {
+        const Atlas *a = &atlases[i];
+        const Uint32 mask = a->header->table_size - 1;
+        Uint32 slot = hash & mask;
+
+        /* the table is never full, so every probe ends at an empty slot */
+        while (a->table[slot] != 0) {
+            const AtlasRegion *r = &a->regions[a->table[slot] - 1];
+            if (SDL_strcmp(a->names + r->name, name) == 0) {
+                return (Sint32)(a->first + a->table[slot] - 1);
+            }
+            slot = (slot + 1) & mask;
+        }
+    }
+    return -1;
+}
+
+static bool check_atlas(const MappedFile *mf)
+{
+    const AtlasHeader *h = (const AtlasHeader *)mf->data;
+    const AtlasPage *p;
+    const AtlasRegion *r;
+    const Uint32 *table;
+    Uint32 i;
+
+    if (mf->size < sizeof(AtlasHeader) || SDL_memcmp(h->magic, ATLAS_MAGIC, 4) != 0) {
+        return false;
+    }
+    if (h->version != ATLAS_VERSION || h->pages > GFX_MAX_TEXTURES || h->regions > 0xFFFFFF ||
+        h->table_size < 2 * h->regions || (h->table_size & (h->table_size - 1)) != 0 || h->names_size == 0 ||
+        mf->size < sizeof(AtlasHeader) + (size_t)h->pages * sizeof(AtlasPage) +
+                   (size_t)h->regions * sizeof(AtlasRegion) + (size_t)h->table_size * sizeof(Uint32) +
+                   h->names_size) {
+        return false;
+    }
+
+    p = (const AtlasPage *)(h + 1);
+    r = (const AtlasRegion *)(p + h->pages);
+    table = (const Uint32 *)(r + h->regions);
+    if (((const char *)(table + h->table_size))[h->names_size - 1] != '\0') {
+        return false;
+    }
+    for (i = 0; i < h->pages; i++) {
+        if (p[i].name >= h->names_size) {
+            return false;
+        }
+    }
+    for (i = 0; i < h->regions; i++) {
+        if (r[i].name >= h->names_size || r[i].page >= h->pages) {
+            return false;
+        }
+    }
+    for (i = 0; i < h->table_size; i++) {
+        if (table[i] > h->regions) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* maps an atlas and uploads its pages; page files are relative to the atlas */
+static bool load_atlas(const char *path)
+{
+    Atlas *a = &atlases[atlas_count];
+    const AtlasPage *p;
+    const char *slash = SDL_strrchr(path, '/');
+    const int dir_len = slash ? (int)(slash - path) + 1 : 0;
+    const int first_page = texture_count;
+    Region *grown;
+    Uint32 i;
+
+    SDL_zerop(a);
+    if (!map_file(path, &a->file)) {
+        return false;
+    }
+    if (!check_atlas(&a->file)) {
+        unmap_file(&a->file);
+        return SDL_SetError("Not a supported atlas: %s", path);
+    }
+    a->header = (const AtlasHeader *)a->file.data;
+    p = (const AtlasPage *)(a->header + 1);
+    a->regions = (const AtlasRegion *)(p + a->header->pages);
+    a->table = (const Uint32 *)(a->regions + a->header->regions);
+    a->names = (const char *)(a->table + a->header->table_size);
+    a->first = region_count;
+
+    if (texture_count + (int)a->header->pages > GFX_MAX_TEXTURES) {
+        unmap_file(&a->file);
+        return SDL_SetError("too many textures (max %d)", GFX_MAX_TEXTURES);
+    }
+    grown = (Region *)SDL_realloc(regions, ((size_t)region_count + a->header->regions + 1) * sizeof(Region));
+    if (!grown) {
+        unmap_file(&a->file);
+        return false;
+    }
+    regions = grown;
+
+    for (i = 0; i < a->header->pages; i++) {
+        char *page_path;
+        SDL_Texture *texture = NULL;
+        int w, h;
+
+        if (SDL_asprintf(&page_path, "%.*s%s", dir_len, path, a->names + p[i].name) >= 0) {
+            texture = load_texture(page_path, &w, &h);
+            if (!texture) {
+                SDL_free(page_path);
+            }
+        }
+        if (!texture) {
+            while (texture_count > first_page) {
+                TextureSlot *t = &textures[--texture_count];
+
+                SDL_DestroyTexture(t->texture);
+                texture_bytes -= slot_bytes(t);
+                SDL_free(t->path);
+                SDL_zerop(t);
+            }
+            unmap_file(&a->file);
+            return false;
+        }
+        add_slot(texture, w, h, page_path, -1);
+    }
+
+    for (i = 0; i < a->header->regions; i++) {
+        const AtlasRegion *src = &a->regions[i];
+        Region *dst = &regions[region_count + i];
+
+        dst->texture_id = first_page + src->page;
+        dst->w = src->w;
+        dst->h = src->h;
+        dst->u0 = src->u0;
+        dst->v0 = src->v0;
+        dst->u1 = src->u1;
+        dst->v1 = src->v1;
+    }
+    region_count += a->header->regions;
+    atlas_count++;
+    return true;
+}
+
+/* adds a region covering all of `texture`, which it then owns; path may be NULL if it can't be reloaded */
+static Sint32 add_texture(SDL_Texture *texture, int width, int height, const char *path)
+{
+    char *copy = NULL;
+    Region *grown;
+
+    if (texture_count == GFX_MAX_TEXTURES) {
+        SDL_DestroyTexture(texture);
+        SDL_SetError("too many textures (max %d)", GFX_MAX_TEXTURES);
+        return -1;
+    }
+    grown = (Region *)SDL_realloc(regions, ((size_t)region_count + 1) * sizeof(Region));
+    if (!grown || (path && !(copy = SDL_strdup(path)))) {
+        SDL_DestroyTexture(texture);
+        return -1;
+    }
+    regions = grown;
+    regions[region_count].texture_id = add_slot(texture, width, height, copy, (Sint32)region_count);
+    regions[region_count].w = (float)width;
+    regions[region_count].h = (float)height;
+    regions[region_count].u0 = regions[region_count].v0 = 0.0f;
+    regions[region_count].u1 = regions[region_count].v1 = 1.0f;
+    return (Sint32)region_count++;
+}
+
+Sint32 gfx_add_image(const Uint8 *pixels, int width, int height, const char *path)
+{
+    SDL_Texture *texture = gfx_create_texture(pixels, width, height);
+
+    return texture ? add_texture(texture, width, height, path) : -1;
+}
+
+/*
+ * One sprite: (x, y) is the top left corner of the unrotated sprite, which
+ * is scaled and then rotated about its centre. A negative scale mirrors the
+ * sprite in place.
+ */
+static void draw_region(const Region *r, float x, float y, float sx, float sy, float angle)
+{
+    const float hx = r->w * sx * 0.5f, hy = r->h * sy * 0.5f;
+    const float cx = x + SDL_fabsf(hx), cy = y + SDL_fabsf(hy);
+    float ax = hx, ay = 0.0f, bx = 0.0f, by = hy; /* rotated half extents */
+    TextureSlot *t = &textures[r->texture_id];
+    SDL_Vertex *v;
+
+    t->last_used = frame_number;
+    if (!t->texture) {
+        /* evicted: skipped until it is back */
+        reload_texture(r->texture_id);
+        if (!t->texture) {
+            return;
+        }
+    }
+    v = gfx_reserve(t->texture, 1);
+    if (angle != 0.0f) {
+        const float c = SDL_cosf(angle), s = SDL_sinf(angle);
+        ax = hx * c;
+        ay = hx * s;
+        bx = -hy * s;
+        by = hy * c;
+    }
+
+    v[0].position.x = cx - ax - bx;
+    v[0].position.y = cy - ay - by;
+    v[0].tex_coord.x = r->u0;
+    v[0].tex_coord.y = r->v0;
+    v[1].position.x = cx + ax - bx;
+    v[1].position.y = cy + ay - by;
+    v[1].tex_coord.x = r->u1;
+    v[1].tex_coord.y = r->v0;
+    v[2].position.x = cx + ax + bx;
+    v[2].position.y = cy + ay + by;
+    v[2].tex_coord.x = r->u1;
+    v[2].tex_coord.y = r->v1;
+    v[3].position.x = cx - ax + bx;
+    v[3].position.y = cy - ay + by;
+    v[3].tex_coord.x = r->u0;
+    v[3].tex_coord.y = r->v1;
+}
+
+bool gfx_region_info(Sint32 region, float *width, float *height, int *texture)
+{
+    if (region < 0 || (Uint32)region >= region_count) {
+        return false;
+    }
+    *width = regions[region].w;
+    *height = regions[region].h;
+    *texture = regions[region].texture_id;
+    return true;
+}
+
+void gfx_draw_region(Sint32 region, float x, float y, float scale_x, float scale_y)
+{
+    draw_region(&regions[region], x, y, scale_x, scale_y, 0.0f);
+}
+
+/* javascript bridge logic */
+static duk_ret_t native_gfx_load_atlas(duk_context *ctx)
+{
+    const char *path = duk_require_string(ctx, 0);
+
+    if (atlas_count == GFX_MAX_ATLASES) {
+        return duk_error(ctx, DUK_ERR_RANGE_ERROR, "too many atlases (max %d)", GFX_MAX_ATLASES);
+    }
+    if (!load_atlas(path)) {
+        return duk_error(ctx, DUK_ERR_ERROR, "Couldn't load %s: %s", path, SDL_GetError());
+    }
+    duk_push_uint(ctx, atlases[atlas_count - 1].header->regions);
+    return 1;
+}
+
+/* gfx.image(path) -> region id of a whole QOI or TJSI image; loading one again shares it */
+static duk_ret_t native_gfx_image(duk_context *ctx)
+{
+    const char *path = duk_require_string(ctx, 0);
+    SDL_Texture *texture;
+    Sint32 id;
+    int i, w, h;
+
+    for (i = 0; i < texture_count; i++) {
+        if (textures[i].region >= 0 && textures[i].path && SDL_strcmp(textures[i].path, path) == 0) {
+            textures[i].refs++;
+            reload_texture(i);
+            duk_push_int(ctx, textures[i].region);
+            return 1;
+        }
+    }
+    texture = load_texture(path, &w, &h);
+    id = texture ? add_texture(texture, w, h, path) : -1;
+    if (id < 0) {
+        return duk_error(ctx, DUK_ERR_ERROR, "Couldn't load %s: %s", path, SDL_GetError());
+    }
+    duk_push_int(ctx, id);
+    return 1;
+}
+
+/* gfx.release(region) drops a reference to an image, which makes it the first to go when over budget */
+static duk_ret_t native_gfx_release(duk_context *ctx)
+{
+    const Sint32 id = duk_require_int(ctx, 0);
+    TextureSlot *t;
+
+    if (id < 0 || (Uint32)id >= region_count || textures[regions[id].texture_id].region != id) {
+        return duk_error(ctx, DUK_ERR_RANGE_ERROR, "not an image: %d", (int)id);
+    }
+    t = &textures[regions[id].texture_id];
+    if (t->refs > 0) {
+        t->refs--;
+    }
+    return 0;
+}
+
+/* gfx.textureBudget(megabytes) sets how much texture memory to keep resident; 0 for no limit */
+static duk_ret_t native_gfx_texture_budget(duk_context *ctx)
+{
+    const double mb = duk_require_number(ctx, 0);
+
+    if (!(mb >= 0.0)) {
+        return duk_error(ctx, DUK_ERR_RANGE_ERROR, "budget must be 0 or more megabytes");
+    }
+    texture_budget = (size_t)(mb * 1048576.0);
+    return 0;
+}
+
+/* gfx.region(name) -> region id, or -1 if no loaded atlas has it */
+static duk_ret_t native_gfx_region(duk_context *ctx)
+{
+    duk_push_int(ctx, find_region(duk_require_string(ctx, 0)));
+    return 1;
+}
+
+/* gfx.sprite(region, x, y, scaleX, scaleY, angle); region is an id or a name */
+static duk_ret_t native_gfx_sprite(duk_context *ctx)
+{
+    const Sint32 id = duk_is_string(ctx, 0) ? find_region(duk_get_string(ctx, 0)) : duk_require_int(ctx, 0);
+    const float sx = (float)duk_opt_number(ctx, 3, 1.0);
+
+    if (id < 0 || (Uint32)id >= region_count) {
+        return duk_error(ctx, DUK_ERR_RANGE_ERROR, "no such region: %s", duk_safe_to_string(ctx, 0));
+    }
+    draw_region(&regions[id], (float)duk_require_number(ctx, 1), (float)duk_require_number(ctx, 2), sx,
+                (float)duk_opt_number(ctx, 4, sx), (float)duk_opt_number(ctx, 5, 0.0));
+    return 0;
+}
+
+/* gfx.tint(r, g, b, a) in 0-255, applied to the sprites drawn after it; no arguments resets it */
+static duk_ret_t native_gfx_tint(duk_context *ctx)
+{
+    tint.r = (float)duk_opt_number(ctx, 0, 255.0) / 255.0f;
+    tint.g = (float)duk_opt_number(ctx, 1, 255.0) / 255.0f;
+    tint.b = (float)duk_opt_number(ctx, 2, 255.0) / 255.0f;
+    tint.a = (float)duk_opt_number(ctx, 3, 255.0) / 255.0f;
+    return 0;
+}
+
+static duk_ret_t native_gfx_clear_color(duk_context *ctx)
+{
+    clear_color[0] = (Uint8)SDL_clamp(duk_require_int(ctx, 0), 0, 255);
+    clear_color[1] = (Uint8)SDL_clamp(duk_require_int(ctx, 1), 0, 255);
+    clear_color[2] = (Uint8)SDL_clamp(duk_require_int(ctx, 2), 0, 255);
+    return 0;
+}
+
+/*
+ * gfx.canvas(width, height, mode) draws every frame at a fixed resolution and
+ * scales it to the window, by gfx.INTEGER unless mode says otherwise. No
+ * arguments draws straight to the window again.
+ */
+static duk_ret_t native_gfx_canvas(duk_context *ctx)
+{
+    const int width = duk_opt_int(ctx, 0, 0), height = duk_opt_int(ctx, 1, 0);
+    const int mode = duk_opt_int(ctx, 2, UPSCALE_INTEGER);
+
+    if (mode < UPSCALE_INTEGER || mode > UPSCALE_SCALE3X) {
+        return duk_error(ctx, DUK_ERR_RANGE_ERROR, "unknown canvas mode: %d", mode);
+    }
+    if ((width != 0 || height != 0) &&
+        (width < 1 || height < 1 || width > UPSCALE_MAX_SIZE || height > UPSCALE_MAX_SIZE)) {
+        return duk_error(ctx, DUK_ERR_RANGE_ERROR, "canvas must be 1-%d pixels a side", UPSCALE_MAX_SIZE);
+    }
+    if (!set_canvas(width, height, (UpscaleMode)mode)) {
+        return duk_error(ctx, DUK_ERR_ERROR, "Couldn't create the canvas: %s", SDL_GetError());
+    }
+    return 0;
+}
+
+/* gfx.stats() -> counts for the last complete frame */
+static duk_ret_t native_gfx_stats(duk_context *ctx)
+{
+    duk_push_object(ctx);
+    duk_push_uint(ctx, last_stats.quads);
+    duk_put_prop_string(ctx, -2, "quads");
+    duk_push_uint(ctx, last_stats.draws);
+    duk_put_prop_string(ctx, -2, "draws");
+    duk_push_uint(ctx, last_stats.binds);
+    duk_put_prop_string(ctx, -2, "binds");
+    duk_push_number(ctx, (double)texture_bytes);
+    duk_put_prop_string(ctx, -2, "textureBytes");
+    duk_push_uint(ctx, evictions);
+    duk_put_prop_string(ctx, -2, "evictions");
+    duk_push_uint(ctx, reloads);
+    duk_put_prop_string(ctx, -2, "reloads");
+    return 1;
+}
+
+static const duk_function_list_entry gfx_functions[] = {
+    { "loadAtlas", native_gfx_load_atlas, 1 },
+    { "image", native_gfx_image, 1 },
+    { "region", native_gfx_region, 1 },
+    { "release", native_gfx_release, 1 },
+    { "textureBudget", native_gfx_texture_budget, 1 },
+    { "sprite", native_gfx_sprite, DUK_VARARGS },
+    { "tint", native_gfx_tint, DUK_VARARGS },
+    { "clearColor", native_gfx_clear_color, 3 },
+    { "canvas", native_gfx_canvas, 3 },
+    { "stats", native_gfx_stats, 0 },
+    { NULL, NULL, 0 }
+};
+
+static const duk_number_list_entry gfx_canvas_modes[] = {
+    { "INTEGER", UPSCALE_INTEGER },
+    { "FIT", UPSCALE_FIT },
+    { "SHARP", UPSCALE_SHARP },
+    { "SCALE2X", UPSCALE_SCALE2X },
+    { "SCALE3X", UPSCALE_SCALE3X },
+    { NULL, 0.0 }
+};
+
+void gfx_bind(duk_context *ctx)
+{
+    duk_push_object(ctx);
+    duk_put_function_list(ctx, -1, gfx_functions);
+    duk_put_number_list(ctx, -1, gfx_canvas_modes);
+    duk_put_global_string(ctx, "gfx");
+}
@@ -0,0 +1,60 @@
+#ifndef GFX_H
+#define GFX_H
+
+#include <SDL3/SDL.h>
+#include "duktape/duktape.h"
+
+/* batch config */
+#define GFX_BATCH_QUADS  2048 /* quads per SDL_RenderGeometry call */
+#define GFX_MAX_ATLASES  16
+#define GFX_MAX_TEXTURES 256 /* atlas pages and standalone images */
+
+/* texture residency config */
+#define GFX_EVICT_IDLE_FRAMES 60 /* a texture in use must go this long undrawn to be evicted */
+
+/*
+ * Sprite drawing. Sprites come from atlases built by tools/atlas.c and are
+ * queued as textured quads into one vertex batch, which is only submitted
+ * when the texture changes, the batch fills up or the frame ends, so a frame
+ * drawn from one atlas page is a single draw call.
+ */
+void gfx_init(SDL_Renderer *renderer);
+void gfx_bind(duk_context *ctx);
+void gfx_begin_frame(void);
+void gfx_end_frame(void);
+void gfx_quit(void);
+
+/*
+ * Room for `quads` quads drawn with `texture`, flushing the batch first if
+ * needed: fill in the positions and texture coordinates of 4 vertices per
+ * quad, clockwise from the top left. Their colour is already the current
+ * tint. Returns NULL if more than GFX_BATCH_QUADS are asked for.
+ */
+SDL_Vertex *gfx_reserve(SDL_Texture *texture, int quads);
+
+/* submits the queued quads now, e.g. before changing a texture they use */
+void gfx_flush(void);
+
+/* the size of the area being drawn to, in pixels */
+void gfx_output_size(int *width, int *height);
+
+/*
+ * An RGBA32 texture for the active renderer, filled from `pixels` or cleared
+ * if it is NULL. Textures drawn through gfx_reserve() must be made and
+ * updated with these so that the software rasterizer can read them.
+ */
+SDL_Texture *gfx_create_texture(const Uint8 *pixels, int width, int height);
+bool gfx_update_texture(SDL_Texture *texture, const SDL_Rect *rect, const Uint8 *pixels, int pitch);
+
+/*
+ * Uploads decoded RGBA32 pixels as a standalone image; returns its region id,
+ * or -1. It can be evicted and reloaded from `path` if that isn't NULL.
+ */
+Sint32 gfx_add_image(const Uint8 *pixels, int width, int height, const char *path);
+
+/* a region's size and texture index (0 to GFX_MAX_TEXTURES - 1); false if there is no such region */
+bool gfx_region_info(Sint32 region, float *width, float *height, int *texture);
+/* queues a region that gfx_region_info() accepted, as gfx.sprite() does */
+void gfx_draw_region(Sint32 region, float x, float y, float scale_x, float scale_y);
+
+#endif
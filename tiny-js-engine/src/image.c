@@ -0,0 +1,221 @@
+#include "image.h"
+#include "mapfile.h"
+
+/* QOI, see https://qoiformat.org/qoi-specification.pdf */
+#define QOI_MAGIC       "qoif"
+#define QOI_HEADER_SIZE 14
+#define QOI_PADDING     8 /* end marker, so an op's operands never run off the file */
+#define QOI_MAX_SIZE    16384
+#define QOI_OP_INDEX    0x00
+#define QOI_OP_DIFF     0x40
+#define QOI_OP_LUMA     0x80
+#define QOI_OP_RUN      0xC0
+#define QOI_OP_RGB      0xFE
+#define QOI_OP_RGBA     0xFF
+
+static Uint32 read_be32(const Uint8 *p)
+{
+    return ((Uint32)p[0] << 24) | ((Uint32)p[1] << 16) | ((Uint32)p[2] << 8) | p[3];
+}
+
+/* bytes a TJSI image needs, or 0 for an unknown format */
+static size_t raw_size(const ImageHeader *h)
+{
+    const size_t w = h->width, rows = h->height;
+
+    switch (h->format) {
+    case IMAGE_RGBA8:
+        return sizeof(ImageHeader) + w * rows * 4;
+    case IMAGE_INDEXED8:
+        return sizeof(ImageHeader) + 256 * 4 + w * rows;
+    case IMAGE_INDEXED4:
+        return sizeof(ImageHeader) + 16 * 4 + (w + 1) / 2 * rows;
+    default:
+        return 0;
+    }
+}
+
+bool image_info(const Uint8 *data, size_t size, int *width, int *height)
+{
+    if (size >= sizeof(ImageHeader) && SDL_memcmp(data, IMAGE_MAGIC, 4) == 0) {
+        const ImageHeader *h = (const ImageHeader *)data;
+        const size_t need = raw_size(h);
+
+        if (need == 0 || h->width == 0 || h->height == 0) {
+            return SDL_SetError("unsupported image format");
+        }
+        if (size < need) {
+            return SDL_SetError("truncated image");
+        }
+        *width = h->width;
+        *height = h->height;
+        return true;
+    }
+
+    if (size >= QOI_HEADER_SIZE + QOI_PADDING && SDL_memcmp(data, QOI_MAGIC, 4) == 0) {
+        const Uint32 w = read_be32(data + 4), h = read_be32(data + 8);
+
+        if (w == 0 || h == 0 || w > QOI_MAX_SIZE || h > QOI_MAX_SIZE || data[12] < 3 || data[12] > 4) {
+            return SDL_SetError("unsupported QOI image");
+        }
+        *width = (int)w;
+        *height = (int)h;
+        return true;
+    }
+    return SDL_SetError("not a TJSI or QOI image");
+}
+
+static bool decode_qoi(const Uint8 *data, size_t size, Uint8 *dst, int pitch, int width, int height)
+{
+    const Uint8 *p = data + QOI_HEADER_SIZE, *end = data + size - QOI_PADDING;
+    union {
+        Uint32 word;
+        Uint8 c[4];
+    } px, index[64];
+    int run = 0, x, y;
+
+    SDL_zeroa(index);
+    px.c[0] = px.c[1] = px.c[2] = 0;
+    px.c[3] = 255;
+    for (y = 0; y < height; y++) {
+        Uint32 *row = (Uint32 *)(dst + (size_t)y * pitch);
+
+        for (x = 0; x < width; x++) {
+            if (run > 0) {
+                run--;
+            } else {
+                Uint8 op, b;
+
+                if (p >= end) {
+                    return SDL_SetError("truncated QOI image");
+                }
+                op = *p++;
+                if (op == QOI_OP_RGB) {
+                    px.c[0] = p[0];
+                    px.c[1] = p[1];
+                    px.c[2] = p[2];
+                    p += 3;
+                } else if (op == QOI_OP_RGBA) {
+                    SDL_memcpy(px.c, p, 4);
+                    p += 4;
+                } else {
+                    switch (op & 0xC0) {
+                    case QOI_OP_INDEX:
+                        px = index[op];
+                        row[x] = px.word;
+                        continue; /* already in the index */
+                    case QOI_OP_DIFF:
+                        px.c[0] += ((op >> 4) & 3) - 2;
+                        px.c[1] += ((op >> 2) & 3) - 2;
+                        px.c[2] += (op & 3) - 2;
+                        break;
+                    case QOI_OP_LUMA:
+                        b = *p++;
+                        px.c[0] += (op & 0x3F) - 40 + (b >> 4);
+                        px.c[1] += (op & 0x3F) - 32;
+                        px.c[2] += (op & 0x3F) - 40 + (b & 0x0F);
+                        break;
+                    default: /* QOI_OP_RUN, this pixel and `run` more */
+                        run = op & 0x3F;
+                        row[x] = px.word;
+                        continue;
+                    }
+                }
+                index[(px.c[0] * 3 + px.c[1] * 5 + px.c[2] * 7 + px.c[3] * 11) & 63] = px;
+            }
+            row[x] = px.word;
+        }
+    }
+    return true;
+}
+
+/* palette lookups; RGBA bytes copied as words keep their byte order */
+static void decode_indexed(const ImageHeader *h, Uint8 *dst, int pitch)
+{
+    const int bits = h->format == IMAGE_INDEXED8 ? 8 : 4;
+    const Uint8 *src = (const Uint8 *)(h + 1) + (4 << bits);
+    Uint32 palette[256];
+    int x, y;
+
+    SDL_memcpy(palette, h + 1, (size_t)4 << bits);
+    for (y = 0; y < h->height; y++) {
+        Uint32 *out = (Uint32 *)(dst + (size_t)y * pitch);
+
+        if (bits == 8) {
+            for (x = 0; x < h->width; x++) {
+                out[x] = palette[*src++];
+            }
+            continue;
+        }
+        for (x = 0; x + 1 < h->width; x += 2, src++) {
+            out[x] = palette[*src >> 4];
+            out[x + 1] = palette[*src & 0x0F];
+        }
+        if (x < h->width) {
+            out[x] = palette[*src++ >> 4];
+        }
+    }
+}
+
+bool image_decode(const Uint8 *data, size_t size, Uint8 *dst, int pitch)
+{
+    const ImageHeader *h = (const ImageHeader *)data;
+    int width, height, y;
+
+    if (!image_info(data, size, &width, &height)) {
+        return false;
+    }
+    if (SDL_memcmp(data, QOI_MAGIC, 4) == 0) {
+        return decode_qoi(data, size, dst, pitch, width, height);
+    }
+    if (h->format != IMAGE_RGBA8) {
+        decode_indexed(h, dst, pitch);
+        return true;
+    }
+    for (y = 0; y < height; y++) {
+        SDL_memcpy(dst + (size_t)y * pitch, data + sizeof(ImageHeader) + (size_t)y * width * 4, (size_t)width * 4);
+    }
+    return true;
+}
+
+SDL_Texture *image_load_texture(SDL_Renderer *renderer, const char *path)
+{
+    SDL_Texture *texture;
+    MappedFile mf;
+    int width, height, pitch;
+    void *pixels;
+
+    if (!map_file(path, &mf)) {
+        return NULL;
+    }
+    if (!image_info(mf.data, mf.size, &width, &height)) {
+        unmap_file(&mf);
+        return NULL;
+    }
+
+    /* raw RGBA is uploaded straight from the file, anything else is decoded into the locked texture */
+    if (SDL_memcmp(mf.data, IMAGE_MAGIC, 4) == 0 && ((const ImageHeader *)mf.data)->format == IMAGE_RGBA8) {
+        texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STATIC, width, height);
+        if (texture && !SDL_UpdateTexture(texture, NULL, mf.data + sizeof(ImageHeader), width * 4)) {
+            SDL_DestroyTexture(texture);
+            texture = NULL;
+        }
+    } else {
+        texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STREAMING, width, height);
+        if (texture) {
+            if (!SDL_LockTexture(texture, NULL, &pixels, &pitch)) {
+                SDL_DestroyTexture(texture);
+                texture = NULL;
+            } else {
+                const bool ok = image_decode(mf.data, mf.size, (Uint8 *)pixels, pitch);
+                SDL_UnlockTexture(texture);
+                if (!ok) {
+                    SDL_DestroyTexture(texture);
+                    texture = NULL;
+                }
+            }
+        }
+    }
+    unmap_file(&mf);
+    return texture;
+}
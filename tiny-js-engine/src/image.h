@@ -0,0 +1,41 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <SDL3/SDL.h>
+
+/*
+ * Raw images ("TJSI") written by the asset tools: a header followed by
+ * pixels already in the texture's layout, so loading is a copy or a palette
+ * lookup per pixel straight out of the (possibly packed and mapped) file.
+ * Palettes are RGBA bytes. Little endian.
+ */
+#define IMAGE_MAGIC "TJSI"
+
+typedef enum
+{
+    IMAGE_RGBA8,    /* R, G, B, A bytes, rows packed */
+    IMAGE_INDEXED8, /* 256 palette entries, then one index per pixel */
+    IMAGE_INDEXED4  /* 16 palette entries, then two pixels per byte, high nibble first, rows padded to a byte */
+} ImageFormat;
+
+typedef struct
+{
+    char magic[4];
+    Uint16 width;
+    Uint16 height;
+    Uint32 format;
+} ImageHeader;
+
+/*
+ * Image decoding for TJSI and QOI files. image_info checks the header and
+ * the file size; image_decode then writes SDL_PIXELFORMAT_RGBA32 rows
+ * `pitch` bytes apart in a single pass over the file, without allocating.
+ * Both are safe on any thread.
+ */
+bool image_info(const Uint8 *data, size_t size, int *width, int *height);
+bool image_decode(const Uint8 *data, size_t size, Uint8 *dst, int pitch);
+
+/* loads an image file into a new texture, decoding into the texture's own memory */
+SDL_Texture *image_load_texture(SDL_Renderer *renderer, const char *path);
+
+#endif
@@ -0,0 +1,512 @@
+#include "indexed.h"
+#include "gfx.h"
+#include "pack.h"
+
+#define BYTE_LANES 0x0101010101010101ULL /* times a byte, that byte in all 8 lanes */
+
+typedef struct
+{
+    Uint8 *data; /* planar tiles, bpp * 8 bytes each */
+    Uint32 count;
+    int bpp;
+} TileBank;
+
+static Uint8 *screen; /* one palette index per pixel */
+static int screen_w, screen_h;
+static Uint32 *frame; /* the expanded screen, RGBA32 */
+static SDL_Texture *texture;
+
+static Uint32 palette[256]; /* RGBA32 */
+static TileBank banks[INDEXED_MAX_BANKS];
+static int bank_count;
+
+/* a plane byte's 8 bits, leftmost pixel first, as bit 0 of 8 byte lanes; [1] is mirrored */
+static Uint64 spread[2][256];
+
+#if defined(SDL_AVX2_INTRINSICS)
+static bool have_avx2;
+#endif
+#if defined(SDL_NEON_INTRINSICS) && defined(__aarch64__)
+#define INDEXED_NEON_LUT
+static Uint8 channels[3][256]; /* the palette split by channel for table lookups */
+static bool channels_dirty = true;
+#endif
+
+static void palette_changed(void)
+{
+#if defined(INDEXED_NEON_LUT)
+    channels_dirty = true;
+#endif
+}
+
+static void set_color(int index, int r, int g, int b)
+{
+    const Uint8 rgba[4] = { (Uint8)SDL_clamp(r, 0, 255), (Uint8)SDL_clamp(g, 0, 255), (Uint8)SDL_clamp(b, 0, 255), 255 };
+
+    SDL_memcpy(&palette[index], rgba, 4);
+}
+
+static void free_screen(void)
+{
+    if (texture) {
+        SDL_DestroyTexture(texture);
+        texture = NULL;
+    }
+    SDL_free(screen);
+    SDL_free(frame);
+    screen = NULL;
+    frame = NULL;
+}
+
+static bool create_screen(int width, int height)
+{
+    free_screen();
+    screen = (Uint8 *)SDL_calloc((size_t)width, height);
+    frame = (Uint32 *)SDL_malloc((size_t)width * height * 4);
+    texture = gfx_create_texture(NULL, width, height);
+    if (!screen || !frame || !texture) {
+        free_screen();
+        return false;
+    }
+    SDL_SetTextureScaleMode(texture, SDL_SCALEMODE_NEAREST);
+    screen_w = width;
+    screen_h = height;
+    return true;
+}
+
+/* tile drawing */
+
+/*
+ * Row y of a planar tile as 8 indices, byte i holding pixel i; *mask has 0xFF
+ * in the lanes whose colour is not 0. Both planes of a pair sit next to each
+ * other, and 4bpp tiles keep planes 2 and 3 in their second 16 bytes.
+ */
+static Uint64 decode_row(const Uint8 *tile, int bpp, int y, const Uint64 *lanes, Uint64 *mask)
+{
+    const Uint8 p0 = tile[y * 2], p1 = tile[y * 2 + 1];
+    Uint64 px = lanes[p0] | lanes[p1] << 1;
+    Uint8 any = p0 | p1;
+
+    if (bpp == 4) {
+        const Uint8 p2 = tile[16 + y * 2], p3 = tile[17 + y * 2];
+        px |= lanes[p2] << 2 | lanes[p3] << 3;
+        any |= p2 | p3;
+    }
+    *mask = lanes[any] * 0xFF;
+    return px;
+}
+
+Uint64 indexed_tile_row(const Uint8 *tile, int bpp, int row, bool flip_x, Uint64 *mask)
+{
+    return decode_row(tile, bpp, row, spread[flip_x], mask);
+}
+
+static void draw_tile(const TileBank *bank, Uint32 tile, int x, int y, int pal, int flags)
+{
+    const Uint8 *data = bank->data + (size_t)tile * bank->bpp * 8;
+    const Uint64 *lanes = spread[(flags & INDEXED_FLIP_X) != 0];
+    const Uint64 base = (Uint64)((pal << bank->bpp) & 0xFF) * BYTE_LANES;
+    int row, i;
+
+    if (x <= -8 || y <= -8 || x >= screen_w || y >= screen_h) {
+        return;
+    }
+    for (row = SDL_max(0, -y); row < 8 && y + row < screen_h; row++) {
+        Uint8 *dst = screen + (size_t)(y + row) * screen_w + x;
+        Uint64 mask, px, d;
+
+        px = decode_row(data, bank->bpp, (flags & INDEXED_FLIP_Y) ? 7 - row : row, lanes, &mask) | base;
+        if (flags & INDEXED_OPAQUE) {
+            mask = ~(Uint64)0;
+        }
+        if (x >= 0 && x + 8 <= screen_w) {
+            SDL_memcpy(&d, dst, 8);
+            d = SDL_Swap64LE(d);
+            d = SDL_Swap64LE((d & ~mask) | (px & mask));
+            SDL_memcpy(dst, &d, 8);
+            continue;
+        }
+        /* clipped at the left or right edge */
+        for (i = 0; i < 8; i++) {
+            if (x + i >= 0 && x + i < screen_w && ((mask >> (i * 8)) & 1)) {
+                dst[i] = (Uint8)(px >> (i * 8));
+            }
+        }
+    }
+}
+
+/* a block of w x h tiles stored row by row from `first`, flipped as a whole */
+static void draw_sprite(const TileBank *bank, Uint32 first, int x, int y, int w, int h, int pal, int flags)
+{
+    int tx, ty;
+
+    for (ty = 0; ty < h; ty++) {
+        const int sy = y + ((flags & INDEXED_FLIP_Y) ? h - 1 - ty : ty) * 8;
+
+        for (tx = 0; tx < w; tx++) {
+            const int sx = x + ((flags & INDEXED_FLIP_X) ? w - 1 - tx : tx) * 8;
+            const Uint32 tile = first + (Uint32)(ty * w + tx);
+
+            if (tile < bank->count) {
+                draw_tile(bank, tile, sx, sy, pal, flags);
+            }
+        }
+    }
+}
+
+/* palette expansion */
+
+static void expand_scalar(const Uint8 *src, Uint32 *dst, int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++) {
+        dst[i] = palette[src[i]];
+    }
+}
+
+#if defined(SDL_AVX2_INTRINSICS)
+SDL_TARGETING("avx2") static void expand_avx2(const Uint8 *src, Uint32 *dst, int n)
+{
+    int i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        const __m256i index = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(src + i)));
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_i32gather_epi32((const int *)palette, index, 4));
+    }
+    expand_scalar(src + i, dst + i, n - i);
+}
+#endif
+
+#if defined(INDEXED_NEON_LUT)
+static uint8x16x4_t load_table(const Uint8 *p)
+{
+    uint8x16x4_t t;
+
+    t.val[0] = vld1q_u8(p);
+    t.val[1] = vld1q_u8(p + 16);
+    t.val[2] = vld1q_u8(p + 32);
+    t.val[3] = vld1q_u8(p + 48);
+    return t;
+}
+
+/*
+ * 16 pixels at a time: each channel is four 64 byte table lookups, where
+ * indices out of a table's range keep what the previous lookup found.
+ */
+static void expand_neon(const Uint8 *src, Uint32 *dst, int n)
+{
+    const uint8x16_t q64 = vdupq_n_u8(64), q128 = vdupq_n_u8(128), q192 = vdupq_n_u8(192);
+    int i = 0, c;
+
+    if (channels_dirty) {
+        for (i = 0; i < 256; i++) {
+            const Uint8 *rgba = (const Uint8 *)&palette[i];
+            channels[0][i] = rgba[0];
+            channels[1][i] = rgba[1];
+            channels[2][i] = rgba[2];
+        }
+        channels_dirty = false;
+        i = 0;
+    }
+    for (; i + 16 <= n; i += 16) {
+        const uint8x16_t index = vld1q_u8(src + i);
+        uint8x16x4_t out;
+
+        for (c = 0; c < 3; c++) {
+            uint8x16_t v = vqtbl4q_u8(load_table(channels[c]), index);
+            v = vqtbx4q_u8(v, load_table(channels[c] + 64), vsubq_u8(index, q64));
+            v = vqtbx4q_u8(v, load_table(channels[c] + 128), vsubq_u8(index, q128));
+            out.val[c] = vqtbx4q_u8(v, load_table(channels[c] + 192), vsubq_u8(index, q192));
+        }
+        out.val[3] = vdupq_n_u8(255);
+        vst4q_u8((uint8_t *)(dst + i), out);
+    }
+    expand_scalar(src + i, dst + i, n - i);
+}
+#endif
+
+static void expand_row(const Uint8 *src, Uint32 *dst, int n)
+{
+#if defined(SDL_AVX2_INTRINSICS)
+    if (have_avx2) {
+        expand_avx2(src, dst, n);
+        return;
+    }
+#endif
+#if defined(INDEXED_NEON_LUT)
+    expand_neon(src, dst, n);
+#else
+    expand_scalar(src, dst, n);
+#endif
+}
+
+/* expands the screen and queues it in the gfx batch, `scale` times its size with its top left at (x, y) */
+static bool present(float x, float y, float scale)
+{
+    const float w = (float)screen_w * scale, h = (float)screen_h * scale;
+    SDL_Vertex *v;
+    int row;
+
+    for (row = 0; row < screen_h; row++) {
+        expand_row(screen + (size_t)row * screen_w, frame + (size_t)row * screen_w, screen_w);
+    }
+    /* whatever is queued may still be drawn from the old frame */
+    gfx_flush();
+    if (!gfx_update_texture(texture, NULL, (const Uint8 *)frame, screen_w * 4)) {
+        return false;
+    }
+    v = gfx_reserve(texture, 1);
+    v[0].position.x = v[3].position.x = x;
+    v[1].position.x = v[2].position.x = x + w;
+    v[0].position.y = v[1].position.y = y;
+    v[2].position.y = v[3].position.y = y + h;
+    v[0].tex_coord.x = v[3].tex_coord.x = 0.0f;
+    v[1].tex_coord.x = v[2].tex_coord.x = 1.0f;
+    v[0].tex_coord.y = v[1].tex_coord.y = 0.0f;
+    v[2].tex_coord.y = v[3].tex_coord.y = 1.0f;
+    return true;
+}
+
+Uint8 *indexed_get_screen(int *width, int *height)
+{
+    if (!screen && !create_screen(INDEXED_WIDTH, INDEXED_HEIGHT)) {
+        return NULL;
+    }
+    *width = screen_w;
+    *height = screen_h;
+    return screen;
+}
+
+const Uint8 *indexed_get_tiles(int bank, int *bpp, Uint32 *count)
+{
+    if (bank < 0 || bank >= bank_count) {
+        return NULL;
+    }
+    *bpp = banks[bank].bpp;
+    *count = banks[bank].count;
+    return banks[bank].data;
+}
+
+void indexed_quit(void)
+{
+    int i;
+
+    free_screen();
+    for (i = 0; i < bank_count; i++) {
+        SDL_free(banks[i].data);
+    }
+    bank_count = 0;
+}
+
+
+/* javascript bridge logic */
+static void require_screen(duk_context *ctx)
+{
+    int w, h;
+
+    if (!indexed_get_screen(&w, &h)) {
+        (void)duk_error(ctx, DUK_ERR_ERROR, "Couldn't create the indexed screen: %s", SDL_GetError());
+    }
+}
+
+static const TileBank *require_bank(duk_context *ctx, duk_idx_t idx)
+{
+    const int bank = duk_require_int(ctx, idx);
+
+    if (bank < 0 || bank >= bank_count) {
+        (void)duk_error(ctx, DUK_ERR_RANGE_ERROR, "no such tile bank: %d", bank);
+    }
+    return &banks[bank];
+}
+
+/* indexed.screen(width, height) replaces the screen, 160x144 by default */
+static duk_ret_t native_indexed_screen(duk_context *ctx)
+{
+    const int width = duk_opt_int(ctx, 0, INDEXED_WIDTH), height = duk_opt_int(ctx, 1, INDEXED_HEIGHT);
+
+    if (width < 1 || height < 1 || width > INDEXED_MAX_SIZE || height > INDEXED_MAX_SIZE) {
+        return duk_error(ctx, DUK_ERR_RANGE_ERROR, "screen must be 1-%d pixels a side", INDEXED_MAX_SIZE);
+    }
+    if (!create_screen(width, height)) {
+        return duk_error(ctx, DUK_ERR_ERROR, "Couldn't create the indexed screen: %s", SDL_GetError());
+    }
+    return 0;
+}
+
+/* indexed.loadTiles(path, bpp) -> bank id of a file of planar 2bpp or 4bpp tiles */
+static duk_ret_t native_indexed_load_tiles(duk_context *ctx)
+{
+    const char *path = duk_require_string(ctx, 0);
+    const int bpp = duk_opt_int(ctx, 1, 2);
+    TileBank *bank = &banks[bank_count];
+    size_t size;
+
+    if (bpp != 2 && bpp != 4) {
+        return duk_error(ctx, DUK_ERR_RANGE_ERROR, "tiles are 2 or 4 bits per pixel");
+    }
+    if (bank_count == INDEXED_MAX_BANKS) {
+        return duk_error(ctx, DUK_ERR_RANGE_ERROR, "too many tile banks (max %d)", INDEXED_MAX_BANKS);
+    }
+    bank->data = (Uint8 *)pack_load_file(path, &size);
+    if (!bank->data) {
+        return duk_error(ctx, DUK_ERR_ERROR, "Couldn't load %s: %s", path, SDL_GetError());
+    }
+    if (size == 0 || size % (size_t)(bpp * 8) != 0) {
+        SDL_free(bank->data);
+        return duk_error(ctx, DUK_ERR_ERROR, "Couldn't load %s: not a whole number of %dbpp tiles", path, bpp);
+    }
+    bank->count = (Uint32)(size / (size_t)(bpp * 8));
+    bank->bpp = bpp;
+    duk_push_int(ctx, bank_count++);
+    return 1;
+}
+
+static duk_ret_t native_indexed_clear(duk_context *ctx)
+{
+    require_screen(ctx);
+    SDL_memset(screen, duk_opt_int(ctx, 0, 0) & 0xFF, (size_t)screen_w * screen_h);
+    return 0;
+}
+
+/* indexed.tile(bank, tile, x, y, palette, flags); palette picks colours palette * 2^bpp onwards */
+static duk_ret_t native_indexed_tile(duk_context *ctx)
+{
+    const TileBank *bank = require_bank(ctx, 0);
+    const Uint32 tile = duk_require_uint(ctx, 1);
+
+    require_screen(ctx);
+    if (tile < bank->count) {
+        draw_tile(bank, tile, duk_require_int(ctx, 2), duk_require_int(ctx, 3), duk_opt_int(ctx, 4, 0),
+                  duk_opt_int(ctx, 5, 0));
+    }
+    return 0;
+}
+
+/* indexed.sprite(bank, first, x, y, w, h, palette, flags) draws w x h tiles stored row by row */
+static duk_ret_t native_indexed_sprite(duk_context *ctx)
+{
+    const TileBank *bank = require_bank(ctx, 0);
+
+    require_screen(ctx);
+    draw_sprite(bank, duk_require_uint(ctx, 1), duk_require_int(ctx, 2), duk_require_int(ctx, 3),
+                SDL_clamp(duk_require_int(ctx, 4), 0, 64), SDL_clamp(duk_require_int(ctx, 5), 0, 64),
+                duk_opt_int(ctx, 6, 0), duk_opt_int(ctx, 7, 0));
+    return 0;
+}
+
+/* indexed.color(index, r, g, b) */
+static duk_ret_t native_indexed_color(duk_context *ctx)
+{
+    set_color(duk_require_int(ctx, 0) & 0xFF, duk_require_int(ctx, 1), duk_require_int(ctx, 2), duk_require_int(ctx, 3));
+    palette_changed();
+    return 0;
+}
+
+/* indexed.palette(first, [r, g, b, r, g, b, ...]) sets consecutive colours */
+static duk_ret_t native_indexed_palette(duk_context *ctx)
+{
+    const int first = duk_require_int(ctx, 0);
+    duk_size_t count, i;
+    int rgb[3], c;
+
+    if (first < 0 || first > 255) {
+        return duk_error(ctx, DUK_ERR_RANGE_ERROR, "no such colour: %d", first);
+    }
+    duk_require_object(ctx, 1);
+    count = SDL_min(duk_get_length(ctx, 1) / 3, (duk_size_t)(256 - first));
+    for (i = 0; i < count; i++) {
+        for (c = 0; c < 3; c++) {
+            duk_get_prop_index(ctx, 1, (duk_uarridx_t)(i * 3 + c));
+            rgb[c] = duk_to_int(ctx, -1);
+            duk_pop(ctx);
+        }
+        set_color(first + (int)i, rgb[0], rgb[1], rgb[2]);
+    }
+    palette_changed();
+    return 0;
+}
+
+/* indexed.cycle(first, count, step) rotates colours first .. first + count - 1 by step places */
+static duk_ret_t native_indexed_cycle(duk_context *ctx)
+{
+    const int first = duk_require_int(ctx, 0), count = duk_require_int(ctx, 1);
+    Uint32 rotated[256];
+    int step, i;
+
+    if (first < 0 || count < 1 || first + count > 256) {
+        return duk_error(ctx, DUK_ERR_RANGE_ERROR, "colours out of range");
+    }
+    step = duk_opt_int(ctx, 2, 1) % count;
+    for (i = 0; i < count; i++) {
+        rotated[(i + step + count) % count] = palette[first + i];
+    }
+    SDL_memcpy(&palette[first], rotated, (size_t)count * sizeof(Uint32));
+    palette_changed();
+    return 0;
+}
+
+/* indexed.present(x, y, scale) draws the screen through gfx; by default as large as fits, centred */
+static duk_ret_t native_indexed_present(duk_context *ctx)
+{
+    int out_w, out_h;
+    float scale;
+
+    require_screen(ctx);
+    gfx_output_size(&out_w, &out_h);
+    scale = (float)SDL_max(1, SDL_min(out_w / screen_w, out_h / screen_h));
+    scale = (float)duk_opt_number(ctx, 2, scale);
+    if (!present((float)duk_opt_number(ctx, 0, (out_w - screen_w * scale) / 2.0f),
+                 (float)duk_opt_number(ctx, 1, (out_h - screen_h * scale) / 2.0f), scale)) {
+        return duk_error(ctx, DUK_ERR_ERROR, "Couldn't present: %s", SDL_GetError());
+    }
+    return 0;
+}
+
+static const duk_function_list_entry indexed_functions[] = {
+    { "screen", native_indexed_screen, 2 },
+    { "loadTiles", native_indexed_load_tiles, 2 },
+    { "clear", native_indexed_clear, 1 },
+    { "tile", native_indexed_tile, 6 },
+    { "sprite", native_indexed_sprite, 8 },
+    { "color", native_indexed_color, 4 },
+    { "palette", native_indexed_palette, 2 },
+    { "cycle", native_indexed_cycle, 3 },
+    { "present", native_indexed_present, 3 },
+    { NULL, NULL, 0 }
+};
+
+static const duk_number_list_entry indexed_flags[] = {
+    { "FLIP_X", INDEXED_FLIP_X },
+    { "FLIP_Y", INDEXED_FLIP_Y },
+    { "OPAQUE", INDEXED_OPAQUE },
+    { NULL, 0.0 }
+};
+
+void indexed_bind(duk_context *ctx)
+{
+    int b, i;
+
+    for (b = 0; b < 256; b++) {
+        spread[0][b] = spread[1][b] = 0;
+        for (i = 0; i < 8; i++) {
+            if (b & (0x80 >> i)) {
+                spread[0][b] |= (Uint64)1 << (i * 8);
+                spread[1][b] |= (Uint64)1 << ((7 - i) * 8);
+            }
+        }
+    }
+    /* four greys, light to dark, repeated until script sets its own colours */
+    for (i = 0; i < 256; i++) {
+        set_color(i, 255 - (i & 3) * 85, 255 - (i & 3) * 85, 255 - (i & 3) * 85);
+    }
+    palette_changed();
+#if defined(SDL_AVX2_INTRINSICS)
+    have_avx2 = SDL_HasAVX2();
+#endif
+
+    duk_push_object(ctx);
+    duk_put_function_list(ctx, -1, indexed_functions);
+    duk_put_number_list(ctx, -1, indexed_flags);
+    duk_put_global_string(ctx, "indexed");
+}
@@ -0,0 +1,41 @@
+#ifndef INDEXED_H
+#define INDEXED_H
+
+#include <SDL3/SDL.h>
+#include "duktape/duktape.h"
+
+/* indexed screen config */
+#define INDEXED_WIDTH     160 /* default screen size, the web client's */
+#define INDEXED_HEIGHT    144
+#define INDEXED_MAX_SIZE  1024
+#define INDEXED_MAX_BANKS 16
+
+/* tile flags */
+#define INDEXED_FLIP_X 1
+#define INDEXED_FLIP_Y 2
+#define INDEXED_OPAQUE 4 /* colour 0 is drawn instead of being transparent */
+
+/*
+ * Indexed colour mode. Tiles are 8x8 and stay in the planar 2bpp (Game Boy)
+ * or 4bpp (SNES) layout they are loaded in, 16 or 32 bytes each. They are
+ * drawn into a screen of 8 bit palette indices, a row of 8 pixels at a time,
+ * and only indexed.present() looks colours up in the 256 entry palette, with
+ * an AVX2 gather or NEON table lookups where available. Changing or cycling
+ * the palette therefore recolours everything at no cost.
+ */
+void indexed_bind(duk_context *ctx);
+void indexed_quit(void);
+
+/* for other code drawing into the screen, such as the PPU */
+
+/* the screen, created at its default size on first use; NULL if that fails */
+Uint8 *indexed_get_screen(int *width, int *height);
+/* a bank's planar tile data, or NULL if there is no such bank */
+const Uint8 *indexed_get_tiles(int bank, int *bpp, Uint32 *count);
+/*
+ * Row `row` of a tile as 8 indices, pixel i in bits 8i to 8i + 7 (store it
+ * with SDL_Swap64LE); *mask has 0xFF in the lanes whose colour is not 0.
+ */
+Uint64 indexed_tile_row(const Uint8 *tile, int bpp, int row, bool flip_x, Uint64 *mask);
+
+#endif
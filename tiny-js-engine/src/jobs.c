@@ -0,0 +1,217 @@
+#include <stdio.h>
+#include "jobs.h"
+
+typedef struct
+{
+    Uint32 ran;     /* jobs run */
+    Uint32 peak;    /* deepest the queue got */
+    Uint32 drains;  /* drain passes that had work */
+    Uint64 time_ns; /* time spent running jobs */
+} JobStats;
+
+/* jobs are stash.jobs[head .. tail - 1] */
+static Uint32 job_head;
+static Uint32 job_tail;
+static Uint32 budget = JOBS_FRAME_BUDGET;
+static bool draining;
+
+static JobStats frame_stats;
+static JobStats last_stats;
+
+/*
+ * Promises/A+ on top of queueMicrotask, installed only when the engine has
+ * no Promise of its own. Unhandled rejections are reported one frame later
+ * so handlers attached by a later job still count.
+ */
+static const char promise_source[] =
+    "(function (global) {\n"
+    "  if (typeof global.Promise === 'function') return;\n"
+    "  var PENDING = 0, FULFILLED = 1, REJECTED = 2;\n"
+    "  function Promise(executor) {\n"
+    "    if (!(this instanceof Promise)) throw new TypeError('Promise must be called with new');\n"
+    "    if (typeof executor !== 'function') throw new TypeError('Promise resolver is not a function');\n"
+    "    this._state = PENDING; this._value = undefined; this._reactions = []; this._handled = false;\n"
+    "    var fns = resolvers(this);\n"
+    "    try { executor(fns[0], fns[1]); } catch (e) { fns[1](e); }\n"
+    "  }\n"
+    "  function resolvers(p) {\n"
+    "    var done = false;\n"
+    "    return [function (v) { if (!done) { done = true; resolve(p, v); } },\n"
+    "            function (e) { if (!done) { done = true; settle(p, REJECTED, e); } }];\n"
+    "  }\n"
+    "  function resolve(p, v) {\n"
+    "    if (v === p) return settle(p, REJECTED, new TypeError('a promise cannot resolve to itself'));\n"
+    "    if (v !== null && (typeof v === 'object' || typeof v === 'function')) {\n"
+    "      var then;\n"
+    "      try { then = v.then; } catch (e) { return settle(p, REJECTED, e); }\n"
+    "      if (typeof then === 'function') {\n"
+    "        var fns = resolvers(p);\n"
+    "        queueMicrotask(function () { try { then.call(v, fns[0], fns[1]); } catch (e) { fns[1](e); } });\n"
+    "        return;\n"
+    "      }\n"
+    "    }\n"
+    "    settle(p, FULFILLED, v);\n"
+    "  }\n"
+    "  function settle(p, state, value) {\n"
+    "    if (p._state !== PENDING) return;\n"
+    "    var reactions = p._reactions;\n"
+    "    p._state = state; p._value = value; p._reactions = null;\n"
+    "    for (var i = 0; i < reactions.length; i++) schedule(p, reactions[i]);\n"
+    "    if (state === REJECTED && !p._handled && typeof setTimeout === 'function') {\n"
+    "      setTimeout(function () { if (!p._handled) console.log('Unhandled promise rejection:', value); }, 0);\n"
+    "    }\n"
+    "  }\n"
+    "  function schedule(p, r) {\n"
+    "    p._handled = true;\n"
+    "    queueMicrotask(function () {\n"
+    "      var cb = p._state === FULFILLED ? r.onFulfilled : r.onRejected, x;\n"
+    "      if (typeof cb !== 'function') { (p._state === FULFILLED ? r.resolve : r.reject)(p._value); return; }\n"
+    "      try { x = cb(p._value); } catch (e) { r.reject(e); return; }\n"
+    "      r.resolve(x);\n"
+    "    });\n"
+    "  }\n"
+    "  Promise.prototype.then = function (onFulfilled, onRejected) {\n"
+    "    var r = { onFulfilled: onFulfilled, onRejected: onRejected };\n"
+    "    var next = new Promise(function (res, rej) { r.resolve = res; r.reject = rej; });\n"
+    "    if (this._state === PENDING) { this._handled = true; this._reactions.push(r); } else schedule(this, r);\n"
+    "    return next;\n"
+    "  };\n"
+    "  Promise.prototype['catch'] = function (onRejected) { return this.then(undefined, onRejected); };\n"
+    "  Promise.prototype['finally'] = function (f) {\n"
+    "    return this.then(function (v) { return Promise.resolve(f()).then(function () { return v; }); },\n"
+    "                     function (e) { return Promise.resolve(f()).then(function () { throw e; }); });\n"
+    "  };\n"
+    "  Promise.resolve = function (v) {\n"
+    "    return v instanceof Promise ? v : new Promise(function (res) { res(v); });\n"
+    "  };\n"
+    "  Promise.reject = function (e) { return new Promise(function (res, rej) { rej(e); }); };\n"
+    "  function collect(list, settled) {\n"
+    "    return new Promise(function (res, rej) {\n"
+    "      var results = [], left = list.length;\n"
+    "      if (left === 0) { res(results); return; }\n"
+    "      list.forEach(function (item, i) {\n"
+    "        Promise.resolve(item).then(function (v) {\n"
+    "          results[i] = settled ? { status: 'fulfilled', value: v } : v;\n"
+    "          if (--left === 0) res(results);\n"
+    "        }, function (e) {\n"
+    "          if (!settled) { rej(e); return; }\n"
+    "          results[i] = { status: 'rejected', reason: e };\n"
+    "          if (--left === 0) res(results);\n"
+    "        });\n"
+    "      });\n"
+    "    });\n"
+    "  }\n"
+    "  Promise.all = function (list) { return collect(list, false); };\n"
+    "  Promise.allSettled = function (list) { return collect(list, true); };\n"
+    "  Promise.race = function (list) {\n"
+    "    return new Promise(function (res, rej) {\n"
+    "      list.forEach(function (item) { Promise.resolve(item).then(res, rej); });\n"
+    "    });\n"
+    "  };\n"
+    "  global.Promise = Promise;\n"
+    "})(this);\n";
+
+
+void jobs_begin_frame(void)
+{
+    last_stats = frame_stats;
+    SDL_zero(frame_stats);
+}
+
+void jobs_drain(duk_context *ctx)
+{
+    Uint64 start;
+
+    if (job_head == job_tail || draining) {
+        return;
+    }
+    start = SDL_GetTicksNS();
+    draining = true;
+    frame_stats.drains++;
+
+    duk_push_heap_stash(ctx);
+    duk_get_prop_string(ctx, -1, "jobs");
+    while (job_head != job_tail && frame_stats.ran < budget) {
+        Uint32 id = job_head++;
+
+        frame_stats.peak = SDL_max(frame_stats.peak, job_tail - id);
+        duk_get_prop_index(ctx, -1, id);
+        duk_del_prop_index(ctx, -2, id);
+        if (duk_pcall(ctx, 0) != 0) {
+            fprintf(stderr, "Error in microtask: %s\n", duk_safe_to_string(ctx, -1));
+        }
+        duk_pop(ctx);
+        frame_stats.ran++;
+    }
+    duk_pop_2(ctx);
+
+#ifdef DEBUG
+    if (job_head != job_tail) {
+        fprintf(stderr, "microtask budget spent, %u jobs deferred to the next frame\n", job_tail - job_head);
+    }
+#endif
+    draining = false;
+    frame_stats.time_ns += SDL_GetTicksNS() - start;
+}
+
+
+/* javascript bridge logic */
+static duk_ret_t native_queue_microtask(duk_context *ctx)
+{
+    duk_require_function(ctx, 0);
+    duk_push_heap_stash(ctx);
+    duk_get_prop_string(ctx, -1, "jobs");
+    duk_dup(ctx, 0);
+    duk_put_prop_index(ctx, -2, job_tail++);
+    return 0;
+}
+
+/* microtasks.stats() -> numbers for the last complete frame, plus the current depth */
+static duk_ret_t native_microtasks_stats(duk_context *ctx)
+{
+    duk_push_object(ctx);
+    duk_push_uint(ctx, job_tail - job_head);
+    duk_put_prop_string(ctx, -2, "depth");
+    duk_push_uint(ctx, last_stats.ran);
+    duk_put_prop_string(ctx, -2, "ran");
+    duk_push_uint(ctx, last_stats.peak);
+    duk_put_prop_string(ctx, -2, "peak");
+    duk_push_uint(ctx, last_stats.drains);
+    duk_put_prop_string(ctx, -2, "drains");
+    duk_push_number(ctx, (double)last_stats.time_ns / SDL_NS_PER_MS);
+    duk_put_prop_string(ctx, -2, "timeMs");
+    return 1;
+}
+
+/* microtasks.budget(n) sets how many jobs may run per frame */
+static duk_ret_t native_microtasks_budget(duk_context *ctx)
+{
+    budget = SDL_max(duk_require_uint(ctx, 0), 1U);
+    return 0;
+}
+
+static const duk_function_list_entry microtask_functions[] = {
+    { "stats", native_microtasks_stats, 0 },
+    { "budget", native_microtasks_budget, 1 },
+    { NULL, NULL, 0 }
+};
+
+void jobs_bind(duk_context *ctx)
+{
+    duk_push_heap_stash(ctx);
+    duk_push_object(ctx);
+    duk_put_prop_string(ctx, -2, "jobs");
+    duk_pop(ctx);
+
+    duk_push_c_function(ctx, native_queue_microtask, 1);
+    duk_put_global_string(ctx, "queueMicrotask");
+
+    duk_push_object(ctx);
+    duk_put_function_list(ctx, -1, microtask_functions);
+    duk_put_global_string(ctx, "microtasks");
+
+    if (duk_peval_string(ctx, promise_source) != 0) {
+        fprintf(stderr, "Error installing Promise: %s\n", duk_safe_to_string(ctx, -1));
+    }
+    duk_pop(ctx);
+}
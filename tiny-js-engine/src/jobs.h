@@ -0,0 +1,21 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <SDL3/SDL.h>
+#include "duktape/duktape.h"
+
+/* microtasks run per frame before the rest wait for the next one */
+#define JOBS_FRAME_BUDGET 10000
+
+/*
+ * Microtask (job) queue. queueMicrotask() and Promise reactions append jobs
+ * that the host drains after every script entry point: the initial eval,
+ * each timer or animation frame callback, and update(). Duktape has no
+ * Promise builtin, so jobs_bind() also installs a small Promise
+ * implementation that schedules its reactions through this queue.
+ */
+void jobs_bind(duk_context *ctx);
+void jobs_begin_frame(void);
+void jobs_drain(duk_context *ctx);
+
+#endif
@@ -0,0 +1,838 @@
+#include <stdio.h>
+#include "audio.h"
+#include "gfx.h"
+#include "image.h"
+#include "jobs.h"
+#include "loader.h"
+#include "pack.h"
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define LOADER_HAVE_URING
+#endif
+#endif
+
+#ifdef LOADER_HAVE_URING
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/io_uring.h>
+#include <linux/stat.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+typedef enum
+{
+    LOAD_QUEUED,  /* nothing submitted yet */
+    LOAD_OPENING, /* open and statx in flight */
+    LOAD_READING
+} LoadStage;
+
+typedef struct LoadRequest
+{
+    struct LoadRequest *next;
+    const LoaderKind *kind;
+    char *path;
+    Uint32 id;    /* key of the callback or deferred in stash.loads */
+    LoaderDone done; /* or this instead, for engine code */
+    void *userdata;
+    Uint8 *data;  /* the whole file, NUL terminated */
+    size_t size;
+    void *result; /* from kind->decode */
+    char *error;
+#ifdef LOADER_HAVE_URING
+    struct statx stx;
+    size_t issued; /* bytes with a read submitted */
+    size_t read;   /* bytes read so far */
+    int fd;
+    int ops;       /* submissions without a completion yet */
+    Uint8 stage;
+    bool queued;   /* on the issue list */
+#endif
+} LoadRequest;
+
+typedef struct
+{
+    LoadRequest *head;
+    LoadRequest *tail;
+} LoadList;
+
+/* worker pool, everything below the mutex is shared with the workers */
+static SDL_Thread *workers[LOADER_MAX_WORKERS];
+static int worker_count;
+static SDL_Mutex *lock;
+static SDL_Condition *wake;
+static LoadList work;     /* waiting for a worker */
+static LoadList finished; /* waiting for loader_update */
+static bool quitting;
+
+/* game thread only */
+static Uint32 next_id;
+static int pending;
+
+static const char deferred_source[] =
+    "(function () {\n"
+    "  var d = {};\n"
+    "  d.promise = new Promise(function (resolve, reject) { d.resolve = resolve; d.reject = reject; });\n"
+    "  return d;\n"
+    "})";
+
+
+/* request lists */
+static void load_list_push(LoadList *list, LoadRequest *req)
+{
+    req->next = NULL;
+    if (list->tail) {
+        list->tail->next = req;
+    } else {
+        list->head = req;
+    }
+    list->tail = req;
+}
+
+static LoadRequest *load_list_pop(LoadList *list)
+{
+    LoadRequest *req = list->head;
+
+    if (req) {
+        list->head = req->next;
+        if (!list->head) {
+            list->tail = NULL;
+        }
+    }
+    return req;
+}
+
+static void request_fail(LoadRequest *req, const char *error)
+{
+    if (!req->error) {
+        req->error = SDL_strdup(error);
+    }
+}
+
+static void request_free(LoadRequest *req)
+{
+    if (req->result && req->kind->discard) {
+        req->kind->discard(req->result);
+    }
+    SDL_free(req->data);
+    SDL_free(req->path);
+    SDL_free(req->error);
+    SDL_free(req);
+}
+
+
+/* worker threads */
+
+/* reads the file (or pack entry) unless io_uring already did, then decodes it */
+static void run_request(LoadRequest *req)
+{
+    if (!req->data) {
+        req->data = (Uint8 *)pack_load_file(req->path, &req->size);
+        if (!req->data) {
+            request_fail(req, SDL_GetError());
+            return;
+        }
+    }
+    if (req->kind->decode) {
+        if (!req->kind->decode(req->data, req->size, &req->result)) {
+            request_fail(req, SDL_GetError());
+        }
+        SDL_free(req->data);
+        req->data = NULL;
+    }
+}
+
+static int SDLCALL worker_main(void *userdata)
+{
+    (void)userdata;
+
+    SDL_LockMutex(lock);
+    for (;;) {
+        LoadRequest *req;
+
+        while (!quitting && !work.head) {
+            SDL_WaitCondition(wake, lock);
+        }
+        if (quitting) {
+            break;
+        }
+        req = load_list_pop(&work);
+        SDL_UnlockMutex(lock);
+
+        run_request(req);
+
+        SDL_LockMutex(lock);
+        load_list_push(&finished, req);
+    }
+    SDL_UnlockMutex(lock);
+    return 0;
+}
+
+/* queues a request for a worker, or straight for delivery when there is nothing left to do */
+static void hand_off(LoadRequest *req)
+{
+    SDL_LockMutex(lock);
+    if (!req->error && (!req->data || req->kind->decode)) {
+        load_list_push(&work, req);
+        SDL_SignalCondition(wake);
+    } else {
+        load_list_push(&finished, req);
+    }
+    SDL_UnlockMutex(lock);
+}
+
+
+/* io_uring */
+#ifdef LOADER_HAVE_URING
+
+/* operations, kept in the low bits of the request pointer in user_data */
+#define URING_OPEN  0U
+#define URING_STATX 1U
+#define URING_READ  2U
+#define URING_OPS   3U
+
+static struct
+{
+    int fd;
+    Uint8 *sq_ring;
+    Uint8 *cq_ring;
+    size_t sq_ring_size;
+    size_t cq_ring_size;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    volatile unsigned *sq_head;
+    volatile unsigned *sq_tail;
+    unsigned *sq_array;
+    volatile unsigned *cq_head;
+    volatile unsigned *cq_tail;
+    unsigned sq_mask;
+    unsigned cq_mask;
+    unsigned entries;
+    unsigned tail;      /* our copy of sq_tail, ahead of it until submitted */
+    unsigned in_flight; /* kept at or below entries so the completion queue never overflows */
+} uring = { -1 };
+
+static LoadList issue; /* requests with submissions left to make */
+
+static void uring_close(void)
+{
+    if (uring.sqes) {
+        munmap(uring.sqes, uring.entries * sizeof(struct io_uring_sqe));
+    }
+    if (uring.cq_ring && uring.cq_ring != uring.sq_ring) {
+        munmap(uring.cq_ring, uring.cq_ring_size);
+    }
+    if (uring.sq_ring) {
+        munmap(uring.sq_ring, uring.sq_ring_size);
+    }
+    if (uring.fd >= 0) {
+        close(uring.fd);
+    }
+    SDL_zero(uring);
+    uring.fd = -1;
+}
+
+static bool uring_init(void)
+{
+    struct io_uring_params p;
+    void *map;
+
+    SDL_zero(p);
+    uring.fd = (int)syscall(__NR_io_uring_setup, LOADER_RING_ENTRIES, &p);
+    if (uring.fd < 0) {
+        uring.fd = -1;
+        return false;
+    }
+    /* OPENAT, STATX and READ arrived in the same kernel as this flag */
+    if (!(p.features & IORING_FEAT_RW_CUR_POS)) {
+        uring_close();
+        return false;
+    }
+
+    uring.entries = p.sq_entries;
+    uring.sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    uring.cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        uring.sq_ring_size = uring.cq_ring_size = SDL_max(uring.sq_ring_size, uring.cq_ring_size);
+    }
+
+    map = mmap(NULL, uring.sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uring.fd, IORING_OFF_SQ_RING);
+    if (map == MAP_FAILED) {
+        uring_close();
+        return false;
+    }
+    uring.sq_ring = (Uint8 *)map;
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        uring.cq_ring = uring.sq_ring;
+    } else {
+        map = mmap(NULL, uring.cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uring.fd, IORING_OFF_CQ_RING);
+        if (map == MAP_FAILED) {
+            uring_close();
+            return false;
+        }
+        uring.cq_ring = (Uint8 *)map;
+    }
+    map = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uring.fd, IORING_OFF_SQES);
+    if (map == MAP_FAILED) {
+        uring_close();
+        return false;
+    }
+    uring.sqes = (struct io_uring_sqe *)map;
+
+    uring.sq_head = (volatile unsigned *)(uring.sq_ring + p.sq_off.head);
+    uring.sq_tail = (volatile unsigned *)(uring.sq_ring + p.sq_off.tail);
+    uring.sq_mask = *(unsigned *)(uring.sq_ring + p.sq_off.ring_mask);
+    uring.sq_array = (unsigned *)(uring.sq_ring + p.sq_off.array);
+    uring.cq_head = (volatile unsigned *)(uring.cq_ring + p.cq_off.head);
+    uring.cq_tail = (volatile unsigned *)(uring.cq_ring + p.cq_off.tail);
+    uring.cq_mask = *(unsigned *)(uring.cq_ring + p.cq_off.ring_mask);
+    uring.cqes = (struct io_uring_cqe *)(uring.cq_ring + p.cq_off.cqes);
+    uring.tail = *uring.sq_tail;
+    return true;
+}
+
+static struct io_uring_sqe *uring_sqe(LoadRequest *req, unsigned op, Uint8 opcode)
+{
+    struct io_uring_sqe *sqe;
+    unsigned index;
+
+    if (uring.in_flight == uring.entries) {
+        return NULL;
+    }
+    index = uring.tail & uring.sq_mask;
+    sqe = &uring.sqes[index];
+    SDL_zerop(sqe);
+    sqe->opcode = opcode;
+    sqe->user_data = (Uint64)(uintptr_t)req | op;
+    uring.sq_array[index] = index;
+    uring.tail++;
+    uring.in_flight++;
+    req->ops++;
+    return sqe;
+}
+
+static void uring_submit(void)
+{
+    unsigned count;
+
+    SDL_MemoryBarrierRelease();
+    *uring.sq_tail = uring.tail;
+    count = uring.tail - *uring.sq_head;
+    if (count > 0) {
+        syscall(__NR_io_uring_enter, uring.fd, count, 0, 0, NULL, 0);
+    }
+}
+
+/* makes as many of req's submissions as fit; true once it has none left */
+static bool uring_issue(LoadRequest *req)
+{
+    struct io_uring_sqe *sqe;
+
+    if (req->error) {
+        return true;
+    }
+    if (req->stage == LOAD_QUEUED) {
+        if (uring.entries - uring.in_flight < 2) {
+            return false;
+        }
+        sqe = uring_sqe(req, URING_OPEN, IORING_OP_OPENAT);
+        sqe->fd = AT_FDCWD;
+        sqe->addr = (Uint64)(uintptr_t)req->path;
+        sqe->open_flags = O_RDONLY | O_CLOEXEC;
+        sqe = uring_sqe(req, URING_STATX, IORING_OP_STATX);
+        sqe->fd = AT_FDCWD;
+        sqe->addr = (Uint64)(uintptr_t)req->path;
+        sqe->len = STATX_SIZE;
+        sqe->off = (Uint64)(uintptr_t)&req->stx;
+        req->stage = LOAD_OPENING;
+        return true;
+    }
+    while (req->issued < req->size) {
+        size_t len = SDL_min(req->size - req->issued, (size_t)LOADER_CHUNK);
+
+        sqe = uring_sqe(req, URING_READ, IORING_OP_READ);
+        if (!sqe) {
+            return false;
+        }
+        sqe->fd = req->fd;
+        sqe->addr = (Uint64)(uintptr_t)(req->data + req->issued);
+        sqe->len = (Uint32)len;
+        sqe->off = req->issued;
+        req->issued += len;
+    }
+    return true;
+}
+
+static void uring_finish(LoadRequest *req)
+{
+    if (req->fd >= 0) {
+        close(req->fd);
+        req->fd = -1;
+    }
+    if (!req->error && req->read != req->size) {
+        request_fail(req, "file changed while loading");
+    }
+    if (req->error) {
+        SDL_free(req->data);
+        req->data = NULL;
+    }
+    hand_off(req);
+}
+
+static void uring_pump(void)
+{
+    while (issue.head && uring_issue(issue.head)) {
+        LoadRequest *req = load_list_pop(&issue);
+
+        req->queued = false;
+        if (req->ops == 0) {
+            uring_finish(req);
+        }
+    }
+    uring_submit();
+}
+
+static void uring_complete(LoadRequest *req, unsigned op, int res)
+{
+    req->ops--;
+    if (res < 0) {
+        request_fail(req, strerror(-res));
+    } else if (op == URING_OPEN) {
+        req->fd = res;
+    } else if (op == URING_STATX) {
+        req->size = (size_t)req->stx.stx_size;
+    } else {
+        req->read += (size_t)res;
+    }
+    if (req->ops > 0 || req->queued) {
+        return;
+    }
+
+    if (req->stage == LOAD_OPENING && !req->error) {
+        req->stage = LOAD_READING;
+        req->data = (Uint8 *)SDL_malloc(req->size + 1);
+        if (!req->data) {
+            request_fail(req, "out of memory");
+        } else if (req->size > 0) {
+            req->data[req->size] = '\0';
+            req->queued = true;
+            load_list_push(&issue, req);
+            return;
+        } else {
+            req->data[0] = '\0';
+        }
+    }
+    uring_finish(req);
+}
+
+static void uring_reap(void)
+{
+    unsigned head = *uring.cq_head;
+    unsigned tail = *uring.cq_tail;
+
+    SDL_MemoryBarrierAcquire();
+    while (head != tail) {
+        const struct io_uring_cqe *cqe = &uring.cqes[head & uring.cq_mask];
+
+        uring_complete((LoadRequest *)(uintptr_t)(cqe->user_data & ~(Uint64)URING_OPS),
+                       (unsigned)(cqe->user_data & URING_OPS), cqe->res);
+        uring.in_flight--;
+        head++;
+    }
+    SDL_MemoryBarrierRelease();
+    *uring.cq_head = head;
+}
+
+static void uring_quit(void)
+{
+    LoadRequest *req;
+
+    if (uring.fd < 0) {
+        return;
+    }
+    /* the kernel may still be writing into request buffers */
+    while (uring.in_flight > 0) {
+        syscall(__NR_io_uring_enter, uring.fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+        uring_reap();
+    }
+    while ((req = load_list_pop(&issue)) != NULL) {
+        if (req->fd >= 0) {
+            close(req->fd);
+        }
+        request_free(req);
+    }
+    uring_close();
+}
+
+#endif /* LOADER_HAVE_URING */
+
+
+/* game thread */
+static void submit(LoadRequest *req)
+{
+#ifdef LOADER_HAVE_URING
+    /* packed entries are already mapped, the workers copy them out */
+    if (uring.fd >= 0 && !pack_contains(req->path)) {
+        req->fd = -1;
+        req->stage = LOAD_QUEUED;
+        req->queued = true;
+        load_list_push(&issue, req);
+        uring_pump();
+        return;
+    }
+#endif
+    hand_off(req);
+}
+
+/* settles the request's promise or calls its callback */
+static void deliver(duk_context *ctx, LoadRequest *req)
+{
+    const char *error = req->error;
+    duk_idx_t target;
+
+    if (req->done) {
+        req->done(req->userdata, error ? NULL : req->result, error);
+        if (!error) {
+            req->result = NULL;
+        }
+        request_free(req);
+        return;
+    }
+
+    duk_push_heap_stash(ctx);
+    duk_get_prop_string(ctx, -1, "loads");
+    duk_get_prop_index(ctx, -1, req->id);
+    duk_del_prop_index(ctx, -2, req->id);
+    target = duk_get_top_index(ctx);
+
+    if (!error) {
+        void *result = req->result;
+
+        req->result = NULL; /* push owns it now */
+        if (!req->kind->push(ctx, req->path, req->data, req->size, result)) {
+            error = SDL_GetError();
+        }
+    }
+    if (error) {
+        duk_push_error_object(ctx, DUK_ERR_ERROR, "Couldn't load %s: %s", req->path, error);
+    }
+
+    if (duk_is_function(ctx, target)) {
+        duk_dup(ctx, target);
+        if (error) {
+            duk_dup(ctx, -2);
+            duk_push_undefined(ctx);
+        } else {
+            duk_push_null(ctx);
+            duk_dup(ctx, -3);
+        }
+        if (duk_pcall(ctx, 2) != 0) {
+            fprintf(stderr, "Error in load callback: %s\n", duk_safe_to_string(ctx, -1));
+        }
+    } else {
+        duk_get_prop_string(ctx, target, error ? "reject" : "resolve");
+        duk_dup(ctx, -2);
+        duk_pcall(ctx, 1);
+    }
+    duk_set_top(ctx, target - 2);
+    jobs_drain(ctx);
+    request_free(req);
+    pending--;
+}
+
+void loader_update(duk_context *ctx)
+{
+    LoadList done;
+    LoadRequest *req;
+
+    if (!lock) {
+        return;
+    }
+#ifdef LOADER_HAVE_URING
+    if (uring.fd >= 0) {
+        uring_reap();
+        uring_pump();
+    }
+#endif
+
+    SDL_LockMutex(lock);
+    done = finished;
+    finished.head = finished.tail = NULL;
+    SDL_UnlockMutex(lock);
+
+    /* callbacks may start new loads, those finish next frame at the earliest */
+    while ((req = load_list_pop(&done)) != NULL) {
+        deliver(ctx, req);
+    }
+}
+
+duk_ret_t loader_push_load(duk_context *ctx, const LoaderKind *kind)
+{
+    const char *path = duk_require_string(ctx, 0);
+    const bool callback = duk_is_function(ctx, 1);
+    LoadRequest *req;
+
+    if (!lock) {
+        return duk_error(ctx, DUK_ERR_ERROR, "loader is not running");
+    }
+    req = (LoadRequest *)SDL_calloc(1, sizeof(LoadRequest));
+    if (!req || !(req->path = SDL_strdup(path))) {
+        SDL_free(req);
+        return duk_error(ctx, DUK_ERR_ERROR, "out of memory");
+    }
+    req->kind = kind;
+    if (++next_id == 0) {
+        next_id = 1;
+    }
+    req->id = next_id;
+
+    duk_push_heap_stash(ctx);
+    duk_get_prop_string(ctx, -1, "loads");
+    if (callback) {
+        duk_dup(ctx, 1);
+    } else {
+        duk_get_prop_string(ctx, -2, "loaderDeferred");
+        duk_call(ctx, 0);
+    }
+    duk_dup_top(ctx);
+    duk_put_prop_index(ctx, -3, req->id);
+
+    submit(req);
+    pending++;
+    if (callback) {
+        return 0;
+    }
+    duk_get_prop_string(ctx, -1, "promise");
+    return 1;
+}
+
+bool loader_load(const char *path, const LoaderKind *kind, LoaderDone done, void *userdata)
+{
+    LoadRequest *req;
+
+    if (!lock) {
+        return SDL_SetError("loader is not running");
+    }
+    req = (LoadRequest *)SDL_calloc(1, sizeof(LoadRequest));
+    if (!req || !(req->path = SDL_strdup(path))) {
+        SDL_free(req);
+        return false;
+    }
+    req->kind = kind;
+    req->done = done;
+    req->userdata = userdata;
+    submit(req);
+    return true;
+}
+
+
+/* load kinds */
+static bool push_bytes(duk_context *ctx, const char *path, const Uint8 *data, size_t size, void *result)
+{
+    (void)path;
+    (void)result;
+    SDL_memcpy(duk_push_fixed_buffer(ctx, size), data, size);
+    duk_push_buffer_object(ctx, -1, 0, size, DUK_BUFOBJ_ARRAYBUFFER);
+    duk_remove(ctx, -2);
+    return true;
+}
+
+static bool push_text(duk_context *ctx, const char *path, const Uint8 *data, size_t size, void *result)
+{
+    (void)path;
+    (void)result;
+    duk_push_lstring(ctx, (const char *)data, size);
+    return true;
+}
+
+static bool decode_sound(const Uint8 *data, size_t size, void **result)
+{
+    Sound *sound = (Sound *)SDL_malloc(sizeof(Sound));
+
+    if (!sound) {
+        return false;
+    }
+    if (!audio_decode(SDL_IOFromConstMem(data, size), sound)) {
+        SDL_free(sound);
+        return false;
+    }
+    *result = sound;
+    return true;
+}
+
+static bool push_sound(duk_context *ctx, const char *path, const Uint8 *data, size_t size, void *result)
+{
+    int id = audio_add_sound((Sound *)result);
+
+    (void)path;
+    (void)data;
+    (void)size;
+    SDL_free(result);
+    if (id < 0) {
+        return SDL_SetError("too many sounds (max %d)", AUDIO_MAX_SOUNDS);
+    }
+    duk_push_int(ctx, id);
+    return true;
+}
+
+static void discard_sound(void *result)
+{
+    SDL_free(((Sound *)result)->samples);
+    SDL_free(result);
+}
+
+static bool decode_image(const Uint8 *data, size_t size, void **result)
+{
+    LoaderImage *image;
+    int width, height;
+
+    if (!image_info(data, size, &width, &height)) {
+        return false;
+    }
+    image = (LoaderImage *)SDL_malloc(sizeof(LoaderImage) + (size_t)width * height * 4);
+    if (!image) {
+        return false;
+    }
+    image->width = width;
+    image->height = height;
+    if (!image_decode(data, size, image->pixels, width * 4)) {
+        SDL_free(image);
+        return false;
+    }
+    *result = image;
+    return true;
+}
+
+static bool push_image(duk_context *ctx, const char *path, const Uint8 *data, size_t size, void *result)
+{
+    LoaderImage *image = (LoaderImage *)result;
+    Sint32 id = gfx_add_image(image->pixels, image->width, image->height, path);
+
+    (void)data;
+    (void)size;
+    SDL_free(image);
+    if (id < 0) {
+        return false;
+    }
+    duk_push_int(ctx, id);
+    return true;
+}
+
+static const LoaderKind bytes_kind = { NULL, push_bytes, NULL };
+static const LoaderKind text_kind = { NULL, push_text, NULL };
+static const LoaderKind sound_kind = { decode_sound, push_sound, discard_sound };
+const LoaderKind loader_image_kind = { decode_image, push_image, SDL_free };
+
+
+/* javascript bridge logic */
+static duk_ret_t native_loader_bytes(duk_context *ctx)
+{
+    return loader_push_load(ctx, &bytes_kind);
+}
+
+static duk_ret_t native_loader_text(duk_context *ctx)
+{
+    return loader_push_load(ctx, &text_kind);
+}
+
+static duk_ret_t native_loader_sound(duk_context *ctx)
+{
+    return loader_push_load(ctx, &sound_kind);
+}
+
+static duk_ret_t native_loader_image(duk_context *ctx)
+{
+    return loader_push_load(ctx, &loader_image_kind);
+}
+
+static duk_ret_t native_loader_pending(duk_context *ctx)
+{
+    duk_push_int(ctx, pending);
+    return 1;
+}
+
+static const duk_function_list_entry loader_functions[] = {
+    { "bytes", native_loader_bytes, 2 },
+    { "text", native_loader_text, 2 },
+    { "sound", native_loader_sound, 2 },
+    { "image", native_loader_image, 2 },
+    { "pending", native_loader_pending, 0 },
+    { NULL, NULL, 0 }
+};
+
+void loader_bind(duk_context *ctx)
+{
+    const char *backend = "threads";
+    int i;
+
+    lock = SDL_CreateMutex();
+    wake = SDL_CreateCondition();
+    if (!lock || !wake) {
+        SDL_Log("Couldn't start the loader: %s", SDL_GetError());
+        loader_quit();
+        return;
+    }
+    worker_count = SDL_clamp(SDL_GetNumLogicalCPUCores() - 1, 1, LOADER_MAX_WORKERS);
+    for (i = 0; i < worker_count; i++) {
+        workers[i] = SDL_CreateThread(worker_main, "loader", NULL);
+        if (!workers[i]) {
+            SDL_Log("Couldn't create loader thread: %s", SDL_GetError());
+            worker_count = i;
+            break;
+        }
+    }
+#ifdef LOADER_HAVE_URING
+    if (uring_init()) {
+        backend = "io_uring";
+    }
+#endif
+
+    duk_push_heap_stash(ctx);
+    duk_push_object(ctx);
+    duk_put_prop_string(ctx, -2, "loads");
+    duk_eval_string(ctx, deferred_source);
+    duk_put_prop_string(ctx, -2, "loaderDeferred");
+    duk_pop(ctx);
+
+    duk_push_object(ctx);
+    duk_put_function_list(ctx, -1, loader_functions);
+    duk_push_string(ctx, backend);
+    duk_put_prop_string(ctx, -2, "backend");
+    duk_put_global_string(ctx, "loader");
+}
+
+void loader_quit(void)
+{
+    LoadRequest *req;
+    int i;
+
+#ifdef LOADER_HAVE_URING
+    uring_quit();
+#endif
+    if (lock) {
+        SDL_LockMutex(lock);
+        quitting = true;
+        SDL_BroadcastCondition(wake);
+        SDL_UnlockMutex(lock);
+    }
+    for (i = 0; i < worker_count; i++) {
+        SDL_WaitThread(workers[i], NULL);
+        workers[i] = NULL;
+    }
+    worker_count = 0;
+
+    while ((req = load_list_pop(&work)) != NULL) {
+        request_free(req);
+    }
+    while ((req = load_list_pop(&finished)) != NULL) {
+        request_free(req);
+    }
+    SDL_DestroyCondition(wake);
+    SDL_DestroyMutex(lock);
+    wake = NULL;
+    lock = NULL;
+    quitting = false;
+    pending = 0;
+}
@@ -0,0 +1,60 @@
+#ifndef LOADER_H
+#define LOADER_H
+
+#include <SDL3/SDL.h>
+#include "duktape/duktape.h"
+
+/* loader config */
+#define LOADER_RING_ENTRIES 256U      /* io_uring submission queue size */
+#define LOADER_CHUNK        (1 << 20) /* bytes per read request */
+#define LOADER_MAX_WORKERS  4
+
+/*
+ * What a load produces. decode runs on a worker thread with the whole file
+ * and may be NULL for kinds that hand script the bytes themselves. push runs
+ * on the game thread and pushes the value script receives: it gets the path,
+ * the file (data, size) when there is no decoder and the decoder's result
+ * otherwise, and owns that result from then on. discard frees a result nobody
+ * will receive. decode and push report failures through SDL_SetError.
+ */
+typedef struct
+{
+    bool (*decode)(const Uint8 *data, size_t size, void **result);
+    bool (*push)(duk_context *ctx, const char *path, const Uint8 *data, size_t size, void *result);
+    void (*discard)(void *result);
+} LoaderKind;
+
+/* loader_image_kind's result: RGBA32 pixels, freed with SDL_free */
+typedef struct
+{
+    int width, height;
+    Uint8 pixels[];
+} LoaderImage;
+
+extern const LoaderKind loader_image_kind;
+
+/* a load for engine code: gets the decoder's result, which it owns, or NULL and the error */
+typedef void (*LoaderDone)(void *userdata, void *result, const char *error);
+
+/*
+ * Asynchronous asset loading. Reads go through io_uring when the kernel
+ * supports it and through a small pool of worker threads otherwise; decoding
+ * always happens on the workers. Finished loads reach script from
+ * loader_update() at the start of the next frame, either as a settled
+ * Promise or as a node style callback(err, value).
+ */
+void loader_bind(duk_context *ctx);
+void loader_update(duk_context *ctx);
+void loader_quit(void);
+
+/* for bindings: loads path (argument 0) as `kind` with an optional callback (argument 1) */
+duk_ret_t loader_push_load(duk_context *ctx, const LoaderKind *kind);
+
+/*
+ * Loads path as `kind` (which needs a decoder) and calls done from
+ * loader_update(). Doesn't count towards loader.pending(). False if the
+ * loader isn't running or out of memory; done is then never called.
+ */
+bool loader_load(const char *path, const LoaderKind *kind, LoaderDone done, void *userdata);
+
+#endif
@@ -0,0 +1,184 @@
+#include "lz.h"
+
+#define LZ_HASH_BITS    14
+#define LZ_MIN_MATCH    4
+#define LZ_MAX_OFFSET   65535
+#define LZ_LAST_LITERALS 5  /* the block always ends in at least this many literals */
+#define LZ_MATCH_LIMIT  12  /* no match may start in the last this many bytes */
+
+static Uint32 read32(const Uint8 *p)
+{
+    Uint32 v;
+    SDL_memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static Uint32 hash32(Uint32 v)
+{
+    return (v * 2654435761U) >> (32 - LZ_HASH_BITS);
+}
+
+static Uint8 *put_length(Uint8 *op, size_t len)
+{
+    while (len >= 255) {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = (Uint8)len;
+    return op;
+}
+
+/* one sequence: literals, then a match unless match_len is 0 (the last sequence) */
+static Uint8 *put_sequence(Uint8 *op, const Uint8 *end, const Uint8 *literals, size_t literal_len,
+                           size_t offset, size_t match_len)
+{
+    Uint8 *token;
+
+    if ((size_t)(end - op) < 1 + literal_len + literal_len / 255 + 1 + 2 + match_len / 255 + 1) {
+        return NULL;
+    }
+    token = op++;
+    if (literal_len >= 15) {
+        *token = 15 << 4;
+        op = put_length(op, literal_len - 15);
+    } else {
+        *token = (Uint8)(literal_len << 4);
+    }
+    SDL_memcpy(op, literals, literal_len);
+    op += literal_len;
+
+    if (match_len) {
+        match_len -= LZ_MIN_MATCH;
+        *op++ = (Uint8)offset;
+        *op++ = (Uint8)(offset >> 8);
+        if (match_len >= 15) {
+            *token |= 15;
+            op = put_length(op, match_len - 15);
+        } else {
+            *token |= (Uint8)match_len;
+        }
+    }
+    return op;
+}
+
+size_t lz_compress(const Uint8 *src, size_t size, Uint8 *dst, size_t capacity)
+{
+    const Uint8 *end = dst + capacity;
+    Uint32 *table;
+    Uint8 *op = dst;
+    size_t ip = 0;
+    size_t anchor = 0;
+
+    table = (Uint32 *)SDL_calloc(1 << LZ_HASH_BITS, sizeof(Uint32));
+    if (!table) {
+        return 0;
+    }
+
+    if (size > LZ_MATCH_LIMIT) {
+        const size_t match_limit = size - LZ_MATCH_LIMIT;
+        const size_t match_end = size - LZ_LAST_LITERALS;
+
+        while (ip < match_limit) {
+            const Uint32 seq = read32(src + ip);
+            const Uint32 h = hash32(seq);
+            const size_t ref = table[h];
+            size_t len;
+
+            table[h] = (Uint32)ip;
+            if (ref >= ip || ip - ref > LZ_MAX_OFFSET || read32(src + ref) != seq) {
+                /* skip faster through data that does not compress */
+                ip += 1 + ((ip - anchor) >> 6);
+                continue;
+            }
+
+            len = LZ_MIN_MATCH;
+            while (ip + len < match_end && src[ref + len] == src[ip + len]) {
+                len++;
+            }
+            op = put_sequence(op, end, src + anchor, ip - anchor, ip - ref, len);
+            if (!op) {
+                SDL_free(table);
+                return 0;
+            }
+            ip += len;
+            anchor = ip;
+            if (ip < match_limit) {
+                table[hash32(read32(src + ip - 2))] = (Uint32)(ip - 2);
+            }
+        }
+    }
+
+    op = put_sequence(op, end, src + anchor, size - anchor, 0, 0);
+    SDL_free(table);
+    return op ? (size_t)(op - dst) : 0;
+}
+
+static bool get_length(const Uint8 **ip, const Uint8 *end, size_t *len)
+{
+    Uint8 b;
+
+    do {
+        if (*ip >= end) {
+            return false;
+        }
+        b = *(*ip)++;
+        *len += b;
+    } while (b == 255);
+    return true;
+}
+
+bool lz_decompress(const Uint8 *src, size_t src_size, Uint8 *dst, size_t size)
+{
+    const Uint8 *ip = src;
+    const Uint8 *const iend = src + src_size;
+    Uint8 *op = dst;
+    Uint8 *const oend = dst + size;
+
+    while (ip < iend) {
+        const Uint8 token = *ip++;
+        size_t literal_len = token >> 4;
+        size_t match_len = token & 15;
+        size_t offset;
+
+        if (literal_len == 15 && !get_length(&ip, iend, &literal_len)) {
+            return false;
+        }
+        if (literal_len > (size_t)(iend - ip) || literal_len > (size_t)(oend - op)) {
+            return false;
+        }
+        SDL_memcpy(op, ip, literal_len);
+        ip += literal_len;
+        op += literal_len;
+        if (ip == iend) {
+            break; /* the last sequence has no match */
+        }
+
+        if (iend - ip < 2) {
+            return false;
+        }
+        offset = (size_t)ip[0] | ((size_t)ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > (size_t)(op - dst)) {
+            return false;
+        }
+        if (match_len == 15 && !get_length(&ip, iend, &match_len)) {
+            return false;
+        }
+        match_len += LZ_MIN_MATCH;
+        if (match_len > (size_t)(oend - op)) {
+            return false;
+        }
+
+        if (offset >= match_len) {
+            SDL_memcpy(op, op - offset, match_len);
+            op += match_len;
+        } else {
+            /* overlapping copy repeats the last `offset` bytes */
+            const Uint8 *match = op - offset;
+            while (match_len--) {
+                *op++ = *match++;
+            }
+        }
+    }
+    return op == oend;
+}
@@ -0,0 +1,21 @@
+#ifndef LZ_H
+#define LZ_H
+
+#include <SDL3/SDL.h>
+
+/*
+ * LZ4 block format codec. Compression is a single pass greedy matcher meant
+ * for offline packing; decompression is bounds checked and fast enough to
+ * run on load.
+ */
+
+/* worst case compressed size for `size` input bytes */
+#define LZ_BOUND(size) ((size) + (size) / 255 + 16)
+
+/* returns the compressed size, or 0 if it does not fit in `capacity` */
+size_t lz_compress(const Uint8 *src, size_t size, Uint8 *dst, size_t capacity);
+
+/* true only if src decodes to exactly `size` bytes */
+bool lz_decompress(const Uint8 *src, size_t src_size, Uint8 *dst, size_t size);
+
+#endif
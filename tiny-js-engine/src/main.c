@@ -4,6 +4,25 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include "duktape/duktape.h"
+#include "apu.h"
+#include "audio.h"
+#include "coro.h"
+#include "font.h"
+#include "textbuf.h"
+#include "scene.h"
+#include "indexed.h"
+#include "ppu.h"
+#include "world.h"
+#include "gfx.h"
+#include "jobs.h"
+#include "loader.h"
+#include "music.h"
+#include "pack.h"
+#include "path.h"
+#include "sight.h"
+#include "board.h"
+#include "ecs.h"
+#include "timers.h"
 
 
 /* game config  */
@@ -56,6 +75,7 @@ typedef struct
 {
     SDL_Window *window;
     SDL_Renderer *renderer;
+    duk_context *ctx;
     playerContext player_ctx;
     Uint64 last_step;
 } AppState;
@@ -89,31 +109,40 @@ static void setup_context(duk_context *ctx) {
     duk_push_c_function(ctx, native_print, DUK_VARARGS);
     duk_put_prop_string(ctx, -2, "log");
     duk_put_global_string(ctx, "console");
-}
-
-static char* read_file(const char *filename, long *file_size) {
-	FILE *file = fopen(filename, "rb");
-	if (!file) {
-		fprintf(stderr, "Could not open file: %s\n", filename);
-		return NULL;
-	}
-
-	fseek(file, 0, SEEK_END);
-	*file_size = ftell(file);
-	fseek(file, 0, SEEK_SET);
-
-	char *script = (char *)malloc(*file_size + 1);
-	if (!script) {
-		fprintf(stderr, "Memory allocation failed\n");
-		fclose(file);
-		return NULL;
-	}
 
-	fread(script, 1, *file_size, file);
-	script[*file_size] = '\0';
-	fclose(file);
+    jobs_bind(ctx);
+    loader_bind(ctx);
+    audio_bind(ctx);
+    music_bind(ctx);
+    apu_bind(ctx);
+    timers_bind(ctx);
+    coro_bind(ctx);
+    gfx_bind(ctx);
+    font_bind(ctx);
+    textbuf_bind(ctx);
+    scene_bind(ctx);
+    indexed_bind(ctx);
+    ppu_bind(ctx);
+    world_bind(ctx);
+    path_bind(ctx);
+    sight_bind(ctx);
+    board_bind(ctx);
+    ecs_bind(ctx);
+}
 
-	return script;
+/* calls a global script function such as update(dt), if the script defines it */
+static void call_script(duk_context *ctx, const char *name, double arg)
+{
+    if (!duk_get_global_string(ctx, name) || !duk_is_function(ctx, -1)) {
+        duk_pop(ctx);
+        return;
+    }
+    duk_push_number(ctx, arg);
+    if (duk_pcall(ctx, 1) != 0) {
+        fprintf(stderr, "Error in %s: %s\n", name, duk_safe_to_string(ctx, -1));
+    }
+    duk_pop(ctx);
+    jobs_drain(ctx);
 }
 
  /* Standard Routines and Interfaces. */
@@ -150,6 +179,23 @@ static int handle_key_event_(playerContext *ctx, SDL_Scancode key_code)
 SDL_AppResult SDL_AppIterate(void *appstate)
 {
     AppState *as = (AppState *)appstate;
+    const Uint64 now = SDL_GetTicks();
+
+    jobs_begin_frame();
+    gfx_begin_frame();
+    loader_update(as->ctx);
+    path_update(as->ctx);
+    world_update();
+    timers_dispatch(as->ctx);
+    coro_dispatch(as->ctx);
+
+    /* script time is in seconds */
+    call_script(as->ctx, "update", (double)(now - as->last_step) / 1000.0);
+    as->last_step = now;
+
+    gfx_end_frame();
+    music_update();
+
     return SDL_APP_CONTINUE;
 }
 
@@ -178,23 +224,14 @@ SDL_AppResult SDL_AppInit(void **appstate, int argc, char *argv[])
 		return 1;
 	}
 
-	long file_size;
-	char *script = read_file(argv[1], &file_size);
+	/* argv[1] is either a script or a pack holding main.js and its assets */
+	const char *script_path = pack_mount(argv[1]) ? PACK_MAIN_SCRIPT : argv[1];
+	char *script = (char *)pack_load_file(script_path, NULL);
 	if (!script) {
+		fprintf(stderr, "Could not open file: %s\n", script_path);
 		return 1;
 	}
 
-	duk_context *ctx = duk_create_heap_default();
-	setup_context(ctx);
-
-	if (duk_peval_string(ctx, script) != 0) {
-		fprintf(stderr, "Error: %s\n", duk_safe_to_string(ctx, -1));
-	}
-
-	duk_pop(ctx);  /* pop eval result */
-	duk_destroy_heap(ctx);
-	free(script);
-
     for (i = 0; i < SDL_arraysize(extended_metadata); i++) {
         if (!SDL_SetAppMetadataProperty(extended_metadata[i].key, extended_metadata[i].value)) {
             return SDL_APP_FAILURE;
@@ -212,10 +249,25 @@ SDL_AppResult SDL_AppInit(void **appstate, int argc, char *argv[])
 
     *appstate = as;
 
-    if (!SDL_CreateWindowAndRenderer("examples/game/player", SDL_WINDOW_WIDTH, SDL_WINDOW_HEIGHT, 0, &as->window, &as->renderer)) {
+    if (!SDL_CreateWindowAndRenderer("examples/game/player", SDL_WINDOW_WIDTH, SDL_WINDOW_HEIGHT, SDL_WINDOW_RESIZABLE, &as->window, &as->renderer)) {
         return SDL_APP_FAILURE;
     }
+    gfx_init(as->renderer);
+
+    /* a missing audio device is not fatal, the game just runs silent */
+    audio_init();
+
+	/* the heap lives as long as the app so the script's callbacks stay callable */
+	as->ctx = duk_create_heap_default();
+	setup_context(as->ctx);
 
+	if (duk_peval_string(as->ctx, script) != 0) {
+		fprintf(stderr, "Error: %s\n", duk_safe_to_string(as->ctx, -1));
+	}
+
+	duk_pop(as->ctx);  /* pop eval result */
+	SDL_free(script);
+	jobs_drain(as->ctx);
 
     as->last_step = SDL_GetTicks();
 
@@ -238,6 +290,22 @@ void SDL_AppQuit(void *appstate, SDL_AppResult result)
 {
     if (appstate != NULL) {
         AppState *as = (AppState *)appstate;
+        if (as->ctx) {
+            duk_destroy_heap(as->ctx);
+        }
+        loader_quit();
+        path_quit();
+        ecs_quit();
+        world_quit();
+        timers_quit();
+        coro_quit();
+        audio_quit();
+        music_quit();
+        indexed_quit();
+        scene_quit();
+        font_quit();
+        gfx_quit();
+        pack_unmount();
         SDL_DestroyRenderer(as->renderer);
         SDL_DestroyWindow(as->window);
         SDL_free(as);
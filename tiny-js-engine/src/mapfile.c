@@ -0,0 +1,148 @@
+#include "mapfile.h"
+#include "pack.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define MAPFILE_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if MAPFILE_MMAP
+static size_t page_size(void)
+{
+    static size_t size;
+    if (!size) {
+        size = (size_t)sysconf(_SC_PAGESIZE);
+    }
+    return size;
+}
+
+static void page_range(const MappedFile *mf, size_t *offset, size_t *len)
+{
+    size_t begin = *offset & ~(page_size() - 1);
+    size_t end = SDL_min(*offset + *len, mf->size);
+
+    *offset = begin;
+    *len = end > begin ? end - begin : 0;
+}
+#endif
+
+bool map_file(const char *path, MappedFile *mf)
+{
+#if MAPFILE_MMAP
+    struct stat st;
+    void *data;
+    int fd;
+#endif
+
+    if (pack_map(path, mf)) {
+        return true;
+    }
+#if MAPFILE_MMAP
+    fd = open(path, O_RDONLY);
+
+    if (fd < 0) {
+        return SDL_SetError("Could not open file: %s", path);
+    }
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return SDL_SetError("Could not map empty file: %s", path);
+    }
+    data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return SDL_SetError("Could not map file: %s", path);
+    }
+    mf->data = (const Uint8 *)data;
+    mf->size = (size_t)st.st_size;
+    mf->mapped = true;
+    return true;
+#else
+    mf->data = (const Uint8 *)SDL_LoadFile(path, &mf->size);
+    return mf->data != NULL;
+#endif
+}
+
+bool map_file_writable(const char *path, MappedFile *mf)
+{
+#if MAPFILE_MMAP
+    struct stat st;
+    void *data;
+    int fd = open(path, O_RDWR);
+
+    if (fd < 0) {
+        return SDL_SetError("Could not open file for writing: %s", path);
+    }
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return SDL_SetError("Could not map empty file: %s", path);
+    }
+    data = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return SDL_SetError("Could not map file: %s", path);
+    }
+    SDL_zerop(mf);
+    mf->data = (const Uint8 *)data;
+    mf->size = (size_t)st.st_size;
+    mf->mapped = true;
+    return true;
+#else
+    (void)mf;
+    return SDL_SetError("Could not map file for writing: %s", path);
+#endif
+}
+
+void unmap_file(MappedFile *mf)
+{
+    if (!mf->data || mf->borrowed) {
+        SDL_zerop(mf);
+        return;
+    }
+#if MAPFILE_MMAP
+    if (mf->mapped) {
+        munmap((void *)mf->data, mf->size);
+    } else
+#endif
+    {
+        SDL_free((void *)mf->data);
+    }
+    SDL_zerop(mf);
+}
+
+void map_prefetch(const MappedFile *mf, size_t offset, size_t len)
+{
+#if MAPFILE_MMAP
+    if (mf->mapped && offset < mf->size) {
+        page_range(mf, &offset, &len);
+        madvise((void *)(mf->data + offset), len, MADV_WILLNEED);
+    }
+#endif
+}
+
+void map_flush(const MappedFile *mf, size_t offset, size_t len)
+{
+#if MAPFILE_MMAP
+    if (mf->mapped && offset < mf->size) {
+        page_range(mf, &offset, &len);
+        msync((void *)(mf->data + offset), len, MS_ASYNC);
+    }
+#endif
+}
+
+void map_release(const MappedFile *mf, size_t offset, size_t len)
+{
+#if MAPFILE_MMAP
+    if (mf->mapped && offset < mf->size) {
+        /* only whole pages inside the range may be dropped */
+        size_t end = SDL_min(offset + len, mf->size);
+        size_t begin = (offset + page_size() - 1) & ~(page_size() - 1);
+        end &= ~(page_size() - 1);
+        if (end > begin) {
+            madvise((void *)(mf->data + begin), end - begin, MADV_DONTNEED);
+        }
+    }
+#endif
+}
@@ -0,0 +1,35 @@
+#ifndef MAPFILE_H
+#define MAPFILE_H
+
+#include <SDL3/SDL.h>
+
+/*
+ * Read-only file mapping. On POSIX systems the file is mmap'd so pages are
+ * only resident while they are used; elsewhere it falls back to reading the
+ * whole file into memory. Paths found in the mounted pack are served from
+ * the pack's own mapping instead.
+ */
+typedef struct
+{
+    const Uint8 *data;
+    size_t size;
+    bool mapped;
+    bool borrowed; /* points into the mounted pack, nothing to unmap */
+} MappedFile;
+
+bool map_file(const char *path, MappedFile *mf);
+void unmap_file(MappedFile *mf);
+
+/*
+ * A shared read/write mapping of a file on disk (never the pack): stores
+ * through (Uint8 *)mf->data change the file. Not available where mmap isn't.
+ */
+bool map_file_writable(const char *path, MappedFile *mf);
+/* starts writing changed pages in the range back to the file without waiting */
+void map_flush(const MappedFile *mf, size_t offset, size_t len);
+
+/* residency hints; offsets are rounded out to whole pages */
+void map_prefetch(const MappedFile *mf, size_t offset, size_t len);
+void map_release(const MappedFile *mf, size_t offset, size_t len);
+
+#endif
@@ -0,0 +1,733 @@
+#include <stdio.h>
+#include "audio.h"
+#include "mapfile.h"
+#include "music.h"
+#include "ring.h"
+
+#define MUSIC_RING_MASK (MUSIC_RING_FRAMES - 1U)
+#define MUSIC_NO_LOOP   0xFFFFFFFFU
+
+#define WAVE_FORMAT_PCM        0x0001
+#define WAVE_FORMAT_IMA_ADPCM  0x0011
+#define WAVE_FORMAT_EXTENSIBLE 0xFFFE
+
+typedef struct
+{
+    /* set up by the game thread before the track is handed over */
+    MappedFile file;
+    const Uint8 *data;
+    Uint32 data_size;
+    Uint16 format;
+    Uint16 channels;
+    Uint32 rate;
+    Uint32 block_align;
+    Uint32 block_frames;  /* frames per block, 1 for PCM */
+    Uint32 frames;
+    Uint64 step;          /* source frames per output frame, 32.32 fixed point */
+
+    /* audio thread */
+    Uint32 loop_start;
+    Uint32 loop_end;
+    bool loop;
+    bool ended;           /* decoder reached the end of a non-looping track */
+    Uint32 cursor;        /* next source frame to decode */
+    Uint32 play_frame;    /* source frame at the ring read position */
+    Uint32 ring_head;     /* frames written into the ring */
+    Uint64 ring_pos;      /* 32.32 fixed point read position, in ring frames */
+    Uint32 scratch_block; /* ADPCM block currently decoded into scratch */
+    float ring[MUSIC_RING_FRAMES * 2];
+    float scratch[MUSIC_MAX_BLOCK_FRAMES * 2];
+
+    /* published by the audio thread for the game thread */
+    SDL_AtomicU32 decode_frame;
+    SDL_AtomicU32 loop_from;
+    SDL_AtomicU32 loop_to;
+
+    /* game thread */
+    size_t released_to;   /* data bytes behind the cursor already dropped */
+    size_t prefetched_at;
+    Uint32 last_decode;
+} MusicTrack;
+
+typedef struct
+{
+    MusicTrack *track;
+    float gain;
+    float target;
+    float delta;   /* per output frame */
+    bool stopping; /* release the track once the fade reaches zero */
+} Deck;
+
+typedef enum
+{
+    MUSIC_CMD_PLAY,
+    MUSIC_CMD_STOP,
+    MUSIC_CMD_VOLUME,
+    MUSIC_CMD_LOOP
+} MusicCommandType;
+
+typedef struct
+{
+    Uint8 type;
+    Uint8 loop;
+    MusicTrack *track;
+    float volume;
+    Uint32 fade; /* output frames */
+    Uint32 loop_start;
+    Uint32 loop_end;
+} MusicCommand;
+
+/* game thread -> audio thread */
+static MusicCommand command_slots[MUSIC_QUEUE_SIZE];
+static SpscRing commands = { (Uint8 *)command_slots, MUSIC_QUEUE_SIZE, sizeof(MusicCommand) };
+
+/* audio thread -> game thread, tracks that can be unmapped */
+static MusicTrack *released_slots[MUSIC_MAX_TRACKS];
+static SpscRing released = { (Uint8 *)released_slots, MUSIC_MAX_TRACKS, sizeof(MusicTrack *) };
+
+/* game thread */
+static MusicTrack *tracks[MUSIC_MAX_TRACKS];
+
+/* audio thread */
+static Deck decks[MUSIC_DECKS];
+static SDL_AtomicU32 position;
+
+static const Sint16 ima_steps[89] = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31,
+    34, 37, 41, 45, 50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143,
+    157, 173, 190, 209, 230, 253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658,
+    724, 796, 876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024,
+    3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+    15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+
+static const Sint8 ima_index[8] = { -1, -1, -1, -1, 2, 4, 6, 8 };
+
+
+static Uint16 read_u16(const Uint8 *p)
+{
+    return (Uint16)(p[0] | (p[1] << 8));
+}
+
+static Uint32 read_u32(const Uint8 *p)
+{
+    return (Uint32)p[0] | ((Uint32)p[1] << 8) | ((Uint32)p[2] << 16) | ((Uint32)p[3] << 24);
+}
+
+static size_t track_offset(const MusicTrack *t, Uint32 frame)
+{
+    return (size_t)(frame / t->block_frames) * t->block_align;
+}
+
+/* frames held by an ADPCM block of `bytes` bytes; the last block may be short */
+static Uint32 adpcm_block_frames(const MusicTrack *t, Uint32 bytes)
+{
+    Uint32 header = 4U * t->channels;
+
+    if (bytes <= header) {
+        return bytes == header ? 1 : 0;
+    }
+    if (t->channels == 1) {
+        return (bytes - header) * 2 + 1;
+    }
+    return ((bytes - header) / 8) * 8 + 1;
+}
+
+
+/* WAV parsing, game thread */
+static bool track_open(MusicTrack *t, const char *path)
+{
+    const Uint8 *p, *end, *fmt = NULL;
+    Uint32 fmt_size = 0;
+    Uint16 bits;
+
+    if (!map_file(path, &t->file)) {
+        return false;
+    }
+    p = t->file.data;
+    end = p + t->file.size;
+    if (t->file.size < 12 || SDL_memcmp(p, "RIFF", 4) != 0 || SDL_memcmp(p + 8, "WAVE", 4) != 0) {
+        return SDL_SetError("not a WAV file");
+    }
+
+    for (p += 12; end - p >= 8; ) {
+        const Uint8 *body = p + 8;
+        Uint32 size = SDL_min(read_u32(p + 4), (Uint32)(end - body));
+
+        if (SDL_memcmp(p, "fmt ", 4) == 0) {
+            fmt = body;
+            fmt_size = size;
+        } else if (SDL_memcmp(p, "data", 4) == 0) {
+            t->data = body;
+            t->data_size = size;
+        } else if (SDL_memcmp(p, "smpl", 4) == 0 && size >= 60 && read_u32(body + 28) > 0) {
+            /* the first sampler loop; its end is inclusive */
+            t->loop_start = read_u32(body + 44);
+            t->loop_end = read_u32(body + 48) + 1;
+            t->loop = true;
+        }
+        if ((size_t)(end - body) < (size_t)size + (size & 1)) {
+            break;
+        }
+        p = body + size + (size & 1);
+    }
+    if (!fmt || fmt_size < 16 || !t->data) {
+        return SDL_SetError("missing fmt or data chunk");
+    }
+
+    t->format = read_u16(fmt);
+    t->channels = read_u16(fmt + 2);
+    t->rate = read_u32(fmt + 4);
+    t->block_align = read_u16(fmt + 12);
+    bits = read_u16(fmt + 14);
+    if (t->format == WAVE_FORMAT_EXTENSIBLE && fmt_size >= 26) {
+        t->format = read_u16(fmt + 24);
+    }
+    if (t->channels < 1 || t->channels > 2 || t->rate < 8000 || t->rate > 192000) {
+        return SDL_SetError("unsupported channel count or sample rate");
+    }
+
+    if (t->format == WAVE_FORMAT_PCM && bits == 16 && t->block_align == 2U * t->channels) {
+        t->block_frames = 1;
+        t->frames = t->data_size / t->block_align;
+    } else if (t->format == WAVE_FORMAT_IMA_ADPCM && bits == 4 && t->block_align > 4U * t->channels) {
+        t->block_frames = adpcm_block_frames(t, t->block_align);
+        if (t->block_frames > MUSIC_MAX_BLOCK_FRAMES) {
+            return SDL_SetError("ADPCM blocks too large");
+        }
+        t->frames = (t->data_size / t->block_align) * t->block_frames +
+                    adpcm_block_frames(t, t->data_size % t->block_align);
+    } else {
+        return SDL_SetError("only 16-bit PCM and IMA-ADPCM are supported");
+    }
+    if (t->frames == 0) {
+        return SDL_SetError("no samples");
+    }
+
+    t->step = ((Uint64)t->rate << 32) / AUDIO_SAMPLE_RATE;
+    t->scratch_block = 0xFFFFFFFFU;
+    if (!t->loop) {
+        t->loop_start = 0;
+        t->loop_end = t->frames;
+    }
+    SDL_SetAtomicU32(&t->loop_from, MUSIC_NO_LOOP);
+
+    /* get the first pages on their way before the audio thread needs them */
+    map_prefetch(&t->file, (size_t)(t->data - t->file.data), MUSIC_PREFETCH_BYTES);
+    return true;
+}
+
+static void track_free(MusicTrack *t)
+{
+    int i;
+
+    for (i = 0; i < MUSIC_MAX_TRACKS; i++) {
+        if (tracks[i] == t) {
+            tracks[i] = NULL;
+        }
+    }
+    unmap_file(&t->file);
+    SDL_free(t);
+}
+
+
+/* decoding, audio thread */
+static float ima_next(int *pred, int *index, int nibble)
+{
+    int step = ima_steps[*index];
+    int diff = step >> 3;
+
+    if (nibble & 1) {
+        diff += step >> 2;
+    }
+    if (nibble & 2) {
+        diff += step >> 1;
+    }
+    if (nibble & 4) {
+        diff += step;
+    }
+    *pred = SDL_clamp(*pred + ((nibble & 8) ? -diff : diff), -32768, 32767);
+    *index = SDL_clamp(*index + ima_index[nibble & 7], 0, 88);
+    return (float)*pred * (1.0f / 32768.0f);
+}
+
+/* decodes one ADPCM block into scratch as interleaved stereo */
+static void decode_adpcm_block(MusicTrack *t, Uint32 block)
+{
+    const Uint8 *p = t->data + (size_t)block * t->block_align;
+    Uint32 bytes = SDL_min(t->block_align, t->data_size - block * t->block_align);
+    Uint32 frames = adpcm_block_frames(t, bytes);
+    float *out = t->scratch;
+    int pred[2], index[2];
+    Uint32 f, i;
+    int c;
+
+    for (c = 0; c < t->channels; c++) {
+        pred[c] = (Sint16)read_u16(p + 4 * c);
+        index[c] = SDL_min(p[4 * c + 2], 88);
+        out[c] = (float)pred[c] * (1.0f / 32768.0f);
+    }
+    p += 4 * t->channels;
+
+    if (t->channels == 1) {
+        out[1] = out[0];
+        for (f = 1; f < frames; f += 2, p++) {
+            out[f * 2] = out[f * 2 + 1] = ima_next(&pred[0], &index[0], *p & 15);
+            if (f + 1 < frames) {
+                out[f * 2 + 2] = out[f * 2 + 3] = ima_next(&pred[0], &index[0], *p >> 4);
+            }
+        }
+    } else {
+        /* groups of 8 bytes: 8 left samples, then 8 right samples */
+        for (f = 1; f < frames; f += 8, p += 8) {
+            for (c = 0; c < 2; c++) {
+                for (i = 0; i < 8 && f + i < frames; i++) {
+                    Uint8 b = p[c * 4 + i / 2];
+                    out[(f + i) * 2 + c] = ima_next(&pred[c], &index[c], (i & 1) ? b >> 4 : b & 15);
+                }
+            }
+        }
+    }
+    t->scratch_block = block;
+}
+
+/* decodes `count` frames starting at `frame` as interleaved stereo */
+static void track_decode(MusicTrack *t, Uint32 frame, float *dst, Uint32 count)
+{
+    Uint32 i;
+
+    if (t->format == WAVE_FORMAT_PCM) {
+        const Uint8 *p = t->data + (size_t)frame * t->block_align;
+        for (i = 0; i < count; i++, p += t->block_align) {
+            dst[i * 2] = (float)(Sint16)read_u16(p) * (1.0f / 32768.0f);
+            dst[i * 2 + 1] = t->channels == 2 ? (float)(Sint16)read_u16(p + 2) * (1.0f / 32768.0f) : dst[i * 2];
+        }
+        return;
+    }
+
+    while (count > 0) {
+        Uint32 block = frame / t->block_frames;
+        Uint32 first = frame % t->block_frames;
+        Uint32 n = SDL_min(count, t->block_frames - first);
+
+        if (block != t->scratch_block) {
+            decode_adpcm_block(t, block);
+        }
+        SDL_memcpy(dst, t->scratch + first * 2, sizeof(float) * 2 * n);
+        dst += n * 2;
+        frame += n;
+        count -= n;
+    }
+}
+
+/* tops the ring up, following loop points */
+static void track_fill(MusicTrack *t)
+{
+    const Uint32 read = (Uint32)(t->ring_pos >> 32);
+
+    while (!t->ended) {
+        Uint32 space = MUSIC_RING_FRAMES - (t->ring_head - read);
+        Uint32 index = t->ring_head & MUSIC_RING_MASK;
+        Uint32 end = t->loop ? t->loop_end : t->frames;
+        Uint32 n = SDL_min(SDL_min(space, MUSIC_RING_FRAMES - index), end - t->cursor);
+
+        if (space == 0) {
+            break;
+        }
+        if (n == 0) {
+            if (t->loop) {
+                t->cursor = t->loop_start;
+                continue;
+            }
+            t->ended = true;
+            break;
+        }
+        track_decode(t, t->cursor, &t->ring[index * 2], n);
+        t->cursor += n;
+        t->ring_head += n;
+    }
+    SDL_SetAtomicU32(&t->decode_frame, t->cursor);
+}
+
+static Uint32 track_advance(const MusicTrack *t, Uint32 frame, Uint32 n)
+{
+    frame += n;
+    if (t->loop && frame >= t->loop_end) {
+        frame = t->loop_start + (frame - t->loop_end) % (t->loop_end - t->loop_start);
+    }
+    return frame;
+}
+
+static void track_set_loop(MusicTrack *t, bool loop, Uint32 start, Uint32 end)
+{
+    end = SDL_min(end, t->frames);
+    t->loop = loop && start < end;
+    t->loop_start = t->loop ? start : 0;
+    t->loop_end = t->loop ? end : t->frames;
+    SDL_SetAtomicU32(&t->loop_from, t->loop ? t->loop_start : MUSIC_NO_LOOP);
+    SDL_SetAtomicU32(&t->loop_to, t->loop_end);
+
+    /* throw away what was decoded ahead under the old loop and restart at the read position */
+    if (t->loop && t->play_frame >= t->loop_end) {
+        t->play_frame = t->loop_start;
+    }
+    t->cursor = t->play_frame;
+    t->ring_head = (Uint32)(t->ring_pos >> 32);
+    t->ended = false;
+}
+
+
+/* decks, audio thread */
+static void deck_fade(Deck *d, float target, Uint32 frames)
+{
+    d->target = target;
+    if (frames == 0) {
+        d->gain = target;
+        d->delta = 0.0f;
+    } else {
+        d->delta = (target - d->gain) / (float)frames;
+    }
+}
+
+static void deck_release(Deck *d)
+{
+    ring_push(&released, &d->track);
+    d->track = NULL;
+}
+
+/* mixes one deck into `out`; returns false once the deck has finished */
+static bool deck_render(Deck *d, float *out, int frames)
+{
+    MusicTrack *t = d->track;
+    const Uint32 read = (Uint32)(t->ring_pos >> 32);
+    int i;
+
+    track_fill(t);
+    for (i = 0; i < frames; i++) {
+        Uint32 ipos = (Uint32)(t->ring_pos >> 32);
+        const float *a, *b;
+        float f;
+
+        if ((Sint32)(t->ring_head - ipos) <= 0) {
+            break;
+        }
+        a = &t->ring[(ipos & MUSIC_RING_MASK) * 2];
+        b = ipos + 1 != t->ring_head ? &t->ring[((ipos + 1) & MUSIC_RING_MASK) * 2] : a;
+        f = (float)(t->ring_pos & 0xFFFFFFFFU) * (1.0f / 4294967296.0f);
+        out[i * 2] += (a[0] + (b[0] - a[0]) * f) * d->gain;
+        out[i * 2 + 1] += (a[1] + (b[1] - a[1]) * f) * d->gain;
+        t->ring_pos += t->step;
+
+        if (d->delta != 0.0f) {
+            d->gain += d->delta;
+            if ((d->delta > 0.0f) == (d->gain >= d->target)) {
+                d->gain = d->target;
+                d->delta = 0.0f;
+            }
+        }
+    }
+
+    t->play_frame = track_advance(t, t->play_frame, (Uint32)(t->ring_pos >> 32) - read);
+    if (i < frames && t->ended) {
+        return false;
+    }
+    return !(d->stopping && d->gain <= 0.0f);
+}
+
+static void run_command(const MusicCommand *cmd)
+{
+    Deck *free_deck = NULL;
+    int i;
+
+    switch (cmd->type) {
+    case MUSIC_CMD_PLAY:
+        /* whatever is playing fades out while the new track fades in */
+        for (i = 0; i < MUSIC_DECKS; i++) {
+            Deck *d = &decks[i];
+            if (d->track && !d->stopping) {
+                deck_fade(d, 0.0f, cmd->fade);
+                d->stopping = true;
+            }
+        }
+        for (i = 0; i < MUSIC_DECKS && !free_deck; i++) {
+            if (!decks[i].track) {
+                free_deck = &decks[i];
+            }
+        }
+        if (!free_deck) {
+            /* out of decks: cut the quietest fade short */
+            free_deck = &decks[0];
+            for (i = 1; i < MUSIC_DECKS; i++) {
+                if (decks[i].gain < free_deck->gain) {
+                    free_deck = &decks[i];
+                }
+            }
+            deck_release(free_deck);
+        }
+        free_deck->track = cmd->track;
+        free_deck->gain = 0.0f;
+        free_deck->stopping = false;
+        deck_fade(free_deck, cmd->volume, cmd->fade);
+        break;
+    case MUSIC_CMD_STOP:
+        for (i = 0; i < MUSIC_DECKS; i++) {
+            if (decks[i].track) {
+                deck_fade(&decks[i], 0.0f, cmd->fade);
+                decks[i].stopping = true;
+            }
+        }
+        break;
+    case MUSIC_CMD_VOLUME:
+        for (i = 0; i < MUSIC_DECKS; i++) {
+            if (decks[i].track && !decks[i].stopping) {
+                deck_fade(&decks[i], cmd->volume, cmd->fade);
+            }
+        }
+        break;
+    case MUSIC_CMD_LOOP:
+        for (i = 0; i < MUSIC_DECKS; i++) {
+            if (decks[i].track && !decks[i].stopping) {
+                track_set_loop(decks[i].track, cmd->loop != 0, cmd->loop_start, cmd->loop_end);
+            }
+        }
+        break;
+    }
+}
+
+void music_render(float *out, int frames)
+{
+    MusicCommand cmd;
+    int i;
+
+    while (ring_pop(&commands, &cmd)) {
+        run_command(&cmd);
+    }
+    for (i = 0; i < MUSIC_DECKS; i++) {
+        Deck *d = &decks[i];
+        if (!d->track) {
+            continue;
+        }
+        if (!deck_render(d, out, frames)) {
+            deck_release(d);
+        } else if (!d->stopping) {
+            SDL_SetAtomicU32(&position, d->track->play_frame);
+        }
+    }
+}
+
+
+/* residency, game thread */
+static void track_update_residency(MusicTrack *t)
+{
+    const size_t base = (size_t)(t->data - t->file.data);
+    const Uint32 frame = SDL_GetAtomicU32(&t->decode_frame);
+    const Uint32 loop_from = SDL_GetAtomicU32(&t->loop_from);
+    const size_t offset = track_offset(t, frame);
+
+    if (frame < t->last_decode) {
+        /* looped back to the start of the loop */
+        t->released_to = track_offset(t, loop_from == MUSIC_NO_LOOP ? 0 : loop_from);
+        t->prefetched_at = 0;
+    }
+    t->last_decode = frame;
+
+    if (offset >= t->prefetched_at + MUSIC_PREFETCH_BYTES / 2 || t->prefetched_at == 0) {
+        map_prefetch(&t->file, base + offset, MUSIC_PREFETCH_BYTES);
+        t->prefetched_at = offset;
+    }
+    if (loop_from != MUSIC_NO_LOOP &&
+        track_offset(t, SDL_GetAtomicU32(&t->loop_to)) <= offset + MUSIC_PREFETCH_BYTES) {
+        map_prefetch(&t->file, base + track_offset(t, loop_from), MUSIC_PREFETCH_BYTES);
+    }
+    if (offset > t->released_to + MUSIC_PREFETCH_BYTES) {
+        map_release(&t->file, base + t->released_to, offset - MUSIC_PREFETCH_BYTES - t->released_to);
+        t->released_to = offset - MUSIC_PREFETCH_BYTES;
+    }
+}
+
+void music_update(void)
+{
+    MusicTrack *t;
+    int i;
+
+    while (ring_pop(&released, &t)) {
+        track_free(t);
+    }
+    for (i = 0; i < MUSIC_MAX_TRACKS; i++) {
+        if (tracks[i]) {
+            track_update_residency(tracks[i]);
+        }
+    }
+}
+
+void music_quit(void)
+{
+    int i;
+
+    for (i = 0; i < MUSIC_MAX_TRACKS; i++) {
+        if (tracks[i]) {
+            track_free(tracks[i]);
+        }
+    }
+    SDL_zeroa(decks);
+    ring_init(&commands, command_slots, MUSIC_QUEUE_SIZE, sizeof(MusicCommand));
+    ring_init(&released, released_slots, MUSIC_MAX_TRACKS, sizeof(MusicTrack *));
+}
+
+
+/* javascript bridge logic */
+static double get_number(duk_context *ctx, duk_idx_t idx, const char *key, double def)
+{
+    double value = def;
+
+    if (duk_is_object(ctx, idx)) {
+        if (duk_get_prop_string(ctx, idx, key)) {
+            value = duk_require_number(ctx, -1);
+        }
+        duk_pop(ctx);
+    }
+    return value;
+}
+
+/* a source frame option, clamped to 0-0xFFFFFFFF like duk_require_uint(); NaN is 0 */
+static Uint32 get_frame(duk_context *ctx, duk_idx_t idx, const char *key, Uint32 def)
+{
+    const double value = get_number(ctx, idx, key, (double)def);
+
+    if (!(value > 0.0)) {
+        return 0;
+    }
+    return value < 4294967295.0 ? (Uint32)value : 0xFFFFFFFFU;
+}
+
+static Uint32 fade_frames(double seconds)
+{
+    const double frames = seconds * AUDIO_SAMPLE_RATE;
+
+    if (!(frames > 0.0)) {
+        return 0;
+    }
+    return frames < 4294967295.0 ? (Uint32)frames : 0xFFFFFFFFU;
+}
+
+/* music.play(path, { volume, fade, loop, loopStart, loopEnd }); loop points are in source frames */
+static duk_ret_t native_music_play(duk_context *ctx)
+{
+    const char *path = duk_require_string(ctx, 0);
+    MusicCommand cmd;
+    MusicTrack *t;
+    bool loop;
+    int slot;
+
+    if (!audio_is_running()) {
+        duk_push_false(ctx);
+        return 1;
+    }
+    for (slot = 0; slot < MUSIC_MAX_TRACKS && tracks[slot]; slot++) {
+    }
+    if (slot == MUSIC_MAX_TRACKS) {
+        return duk_error(ctx, DUK_ERR_RANGE_ERROR, "too many music tracks open (max %d)", MUSIC_MAX_TRACKS);
+    }
+
+    t = (MusicTrack *)SDL_calloc(1, sizeof(MusicTrack));
+    if (!t) {
+        return duk_error(ctx, DUK_ERR_ERROR, "out of memory");
+    }
+    if (!track_open(t, path)) {
+        track_free(t);
+        return duk_error(ctx, DUK_ERR_ERROR, "Couldn't open %s: %s", path, SDL_GetError());
+    }
+
+    loop = true;
+    if (duk_is_object(ctx, 1)) {
+        if (duk_get_prop_string(ctx, 1, "loop")) {
+            loop = duk_to_boolean(ctx, -1);
+        }
+        duk_pop(ctx);
+    }
+    track_set_loop(t, loop,
+                   get_frame(ctx, 1, "loopStart", t->loop_start),
+                   get_frame(ctx, 1, "loopEnd", t->loop_end));
+
+    SDL_zero(cmd);
+    cmd.type = MUSIC_CMD_PLAY;
+    cmd.track = t;
+    cmd.volume = (float)get_number(ctx, 1, "volume", 1.0);
+    cmd.fade = fade_frames(get_number(ctx, 1, "fade", 0.0));
+    if (!ring_push(&commands, &cmd)) {
+        track_free(t);
+        duk_push_false(ctx);
+        return 1;
+    }
+    tracks[slot] = t;
+    duk_push_true(ctx);
+    return 1;
+}
+
+/* music.stop({ fade }) */
+static duk_ret_t native_music_stop(duk_context *ctx)
+{
+    MusicCommand cmd;
+
+    SDL_zero(cmd);
+    cmd.type = MUSIC_CMD_STOP;
+    cmd.fade = fade_frames(get_number(ctx, 0, "fade", 0.0));
+    duk_push_boolean(ctx, audio_is_running() && ring_push(&commands, &cmd));
+    return 1;
+}
+
+/* music.volume(volume, fadeSeconds) */
+static duk_ret_t native_music_volume(duk_context *ctx)
+{
+    MusicCommand cmd;
+
+    SDL_zero(cmd);
+    cmd.type = MUSIC_CMD_VOLUME;
+    cmd.volume = SDL_max((float)duk_require_number(ctx, 0), 0.0f);
+    cmd.fade = fade_frames(duk_get_number_default(ctx, 1, 0.0));
+    duk_push_boolean(ctx, audio_is_running() && ring_push(&commands, &cmd));
+    return 1;
+}
+
+/* music.loop(start, end) sets loop points in source frames; music.loop(false) plays out */
+static duk_ret_t native_music_loop(duk_context *ctx)
+{
+    MusicCommand cmd;
+
+    SDL_zero(cmd);
+    cmd.type = MUSIC_CMD_LOOP;
+    if (duk_is_boolean(ctx, 0)) {
+        cmd.loop = duk_get_boolean(ctx, 0) ? 1 : 0;
+        cmd.loop_start = 0;
+        cmd.loop_end = 0xFFFFFFFFU;
+    } else {
+        cmd.loop = 1;
+        cmd.loop_start = duk_require_uint(ctx, 0);
+        cmd.loop_end = duk_get_uint_default(ctx, 1, 0xFFFFFFFFU);
+    }
+    duk_push_boolean(ctx, audio_is_running() && ring_push(&commands, &cmd));
+    return 1;
+}
+
+/* music.position() -> source frame of the current track */
+static duk_ret_t native_music_position(duk_context *ctx)
+{
+    duk_push_uint(ctx, SDL_GetAtomicU32(&position));
+    return 1;
+}
+
+static const duk_function_list_entry music_functions[] = {
+    { "play", native_music_play, 2 },
+    { "stop", native_music_stop, 1 },
+    { "volume", native_music_volume, 2 },
+    { "loop", native_music_loop, 2 },
+    { "position", native_music_position, 0 },
+    { NULL, NULL, 0 }
+};
+
+void music_bind(duk_context *ctx)
+{
+    duk_push_object(ctx);
+    duk_put_function_list(ctx, -1, music_functions);
+    duk_put_global_string(ctx, "music");
+}
@@ -0,0 +1,26 @@
+#ifndef MUSIC_H
+#define MUSIC_H
+
+#include <SDL3/SDL.h>
+#include "duktape/duktape.h"
+
+/* streaming config */
+#define MUSIC_DECKS             2
+#define MUSIC_MAX_TRACKS        8
+#define MUSIC_RING_FRAMES       4096U  /* decoded frames kept ahead, power of two */
+#define MUSIC_MAX_BLOCK_FRAMES  4096U  /* largest IMA-ADPCM block we accept */
+#define MUSIC_PREFETCH_BYTES    (64 * 1024)
+#define MUSIC_QUEUE_SIZE        64U
+
+/*
+ * Music tracks are memory-mapped WAV files (16-bit PCM or IMA-ADPCM) that
+ * are decoded on the audio thread into a small per-track ring, so resident
+ * memory does not grow with track length. The game thread only opens and
+ * closes mappings and keeps the pages around the play cursor resident.
+ */
+void music_render(float *out, int frames); /* audio thread */
+void music_update(void);                   /* game thread, once per frame */
+void music_quit(void);                     /* after the audio stream is gone */
+void music_bind(duk_context *ctx);
+
+#endif
@@ -0,0 +1,147 @@
+#include "lz.h"
+#include "pack.h"
+
+static MappedFile archive;
+static const PackHeader *header;
+static const Uint32 *displacement;
+static const PackEntry *entries;
+static const char *names;
+
+static const char *entry_name(const char *path)
+{
+    while (path[0] == '.' && path[1] == '/') {
+        path += 2;
+    }
+    return path;
+}
+
+static const PackEntry *find_entry(const char *path)
+{
+    const char *name;
+    const PackEntry *e;
+    Uint32 seed;
+
+    if (!header || header->count == 0) {
+        return NULL;
+    }
+    name = entry_name(path);
+    seed = displacement[pack_hash(name, 0) % header->buckets];
+    e = &entries[pack_hash(name, seed) % header->count];
+    if (e->name >= header->names_size || SDL_strcmp(names + e->name, name) != 0) {
+        return NULL;
+    }
+    return e;
+}
+
+/* the entry's decompressed contents in a new NUL terminated buffer */
+static Uint8 *entry_load(const PackEntry *e)
+{
+    const Uint8 *src = archive.data + e->offset;
+    Uint8 *data = (Uint8 *)SDL_malloc((size_t)e->size + 1);
+
+    if (!data) {
+        return NULL;
+    }
+    if (e->codec == PACK_LZ) {
+        if (!lz_decompress(src, e->stored, data, e->size)) {
+            SDL_free(data);
+            SDL_SetError("Corrupt pack entry: %s", names + e->name);
+            return NULL;
+        }
+    } else {
+        SDL_memcpy(data, src, e->size);
+    }
+    data[e->size] = '\0';
+    return data;
+}
+
+bool pack_mount(const char *path)
+{
+    const PackHeader *h;
+    size_t index_size;
+    Uint32 i;
+
+    pack_unmount();
+    if (!map_file(path, &archive)) {
+        return false;
+    }
+
+    h = (const PackHeader *)archive.data;
+    if (archive.size < sizeof(PackHeader) || SDL_memcmp(h->magic, PACK_MAGIC, 4) != 0) {
+        unmap_file(&archive);
+        return SDL_SetError("Not a pack: %s", path);
+    }
+    index_size = sizeof(PackHeader) + ((h->buckets * sizeof(Uint32) + 7) & ~(size_t)7) +
+                 (size_t)h->count * sizeof(PackEntry) + h->names_size;
+    if (h->version != PACK_VERSION || h->buckets == 0 || index_size > archive.size) {
+        unmap_file(&archive);
+        return SDL_SetError("Unsupported or truncated pack: %s", path);
+    }
+
+    displacement = (const Uint32 *)(archive.data + sizeof(PackHeader));
+    entries = (const PackEntry *)(archive.data + sizeof(PackHeader) +
+                                  ((h->buckets * sizeof(Uint32) + 7) & ~(size_t)7));
+    names = (const char *)(entries + h->count);
+    if (h->names_size == 0 || names[h->names_size - 1] != '\0') {
+        unmap_file(&archive);
+        return SDL_SetError("Corrupt pack index: %s", path);
+    }
+    for (i = 0; i < h->count; i++) {
+        const PackEntry *e = &entries[i];
+        if (e->offset > archive.size || e->stored > archive.size - e->offset ||
+            (e->codec == PACK_STORED && e->stored != e->size) || e->codec > PACK_LZ) {
+            unmap_file(&archive);
+            return SDL_SetError("Corrupt pack index: %s", path);
+        }
+    }
+    header = h;
+    return true;
+}
+
+void pack_unmount(void)
+{
+    header = NULL;
+    unmap_file(&archive);
+}
+
+bool pack_contains(const char *path)
+{
+    return find_entry(path) != NULL;
+}
+
+void *pack_load_file(const char *path, size_t *size)
+{
+    const PackEntry *e = find_entry(path);
+    void *data;
+
+    if (!e) {
+        return SDL_LoadFile(path, size);
+    }
+    data = entry_load(e);
+    if (data && size) {
+        *size = e->size;
+    }
+    return data;
+}
+
+bool pack_map(const char *path, MappedFile *mf)
+{
+    const PackEntry *e = find_entry(path);
+
+    SDL_zerop(mf);
+    if (!e) {
+        return false;
+    }
+    if (e->codec == PACK_STORED) {
+        mf->data = archive.data + e->offset;
+        mf->mapped = archive.mapped && e->offset % PACK_ALIGN == 0; /* madvise needs whole pages */
+        mf->borrowed = true;
+    } else {
+        mf->data = entry_load(e);
+        if (!mf->data) {
+            return false;
+        }
+    }
+    mf->size = e->size;
+    return true;
+}
@@ -0,0 +1,86 @@
+#ifndef PACK_H
+#define PACK_H
+
+#include <SDL3/SDL.h>
+#include "mapfile.h"
+
+/*
+ * Packed asset archive ("TJSP"), written by tools/pack.c. All fields are
+ * little endian.
+ *
+ *   PackHeader
+ *   Uint32 displacement[buckets]    padded to 8 bytes
+ *   PackEntry entries[count]        in hash slot order
+ *   names                           NUL terminated, entries point into them
+ *   file data                       see below for alignment
+ *
+ * The index is a minimal perfect hash: a name's bucket is
+ * pack_hash(name, 0) % buckets and its slot is
+ * pack_hash(name, displacement[bucket]) % count, so a lookup is two hashes
+ * and one name compare. Entries of at least PACK_ALIGN bytes start on a
+ * PACK_ALIGN boundary so they can be mapped and madvise'd page by page
+ * straight out of the archive; smaller ones are packed PACK_SMALL_ALIGN
+ * apart.
+ */
+#define PACK_MAGIC       "TJSP"
+#define PACK_VERSION     1
+#define PACK_ALIGN       4096
+#define PACK_SMALL_ALIGN 16
+#define PACK_MAIN_SCRIPT "main.js"
+
+typedef enum
+{
+    PACK_STORED,
+    PACK_LZ
+} PackCodec;
+
+typedef struct
+{
+    char magic[4];
+    Uint32 version;
+    Uint32 count;
+    Uint32 buckets;
+    Uint32 names_size;
+    Uint32 reserved[3];
+} PackHeader;
+
+typedef struct
+{
+    Uint64 offset; /* from the start of the archive */
+    Uint32 stored; /* bytes in the archive */
+    Uint32 size;   /* bytes once decompressed */
+    Uint32 name;   /* offset into the names block */
+    Uint32 codec;
+} PackEntry;
+
+static inline Uint32 pack_hash(const char *name, Uint32 seed)
+{
+    Uint32 h = 2166136261U ^ (seed * 0x9E3779B9U);
+
+    while (*name) {
+        h = (h ^ (Uint8)*name++) * 16777619U;
+    }
+    h ^= h >> 16;
+    h *= 0x85EBCA6BU;
+    h ^= h >> 13;
+    h *= 0xC2B2AE35U;
+    h ^= h >> 16;
+    return h;
+}
+
+/*
+ * One archive can be mounted at a time. While it is, every asset path that
+ * names one of its entries ("./" prefixes are ignored) is served from it:
+ * pack_load_file() and map_file() fall back to the file system otherwise.
+ */
+bool pack_mount(const char *path);
+void pack_unmount(void);
+bool pack_contains(const char *path);
+
+/* the whole file, NUL terminated, to be freed with SDL_free */
+void *pack_load_file(const char *path, size_t *size);
+
+/* a view of a stored entry, or a decompressed copy; release with unmap_file */
+bool pack_map(const char *path, MappedFile *mf);
+
+#endif
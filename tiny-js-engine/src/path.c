@@ -0,0 +1,1273 @@
+#include <stdio.h>
+#include "path.h"
+#include "jobs.h"
+
+#define STRAIGHT_COST 10
+#define DIAGONAL_COST 14
+#define NO_PATH       (-1)
+#define OUT_OF_MEMORY (-2)
+
+typedef struct
+{
+    const Uint8 *cells;
+    int width, height;
+} Grid;
+
+typedef struct
+{
+    Uint64 key; /* searches use f << 32 | h, so ties go to the node nearer the goal */
+    Uint32 cell;
+} HeapEntry;
+
+typedef struct
+{
+    HeapEntry *entries;
+    Uint32 size, capacity;
+} Heap;
+
+/* one thread's search state, grown to the largest grid it has seen and reused */
+typedef struct
+{
+    Uint32 cells;
+    Uint32 *g;
+    Sint32 *parent;
+    Uint32 *mark;  /* == generation: seen, == generation + 1: closed */
+    Uint32 *trail; /* the last path found, goal first */
+    Uint32 generation;
+    Heap heap;
+} Scratch;
+
+typedef struct PathBatch
+{
+    struct PathBatch *next;
+    Uint32 id; /* key of the callback in stash.pathBatches */
+    Grid grid; /* cells are the batch's own copy */
+    bool diagonal;
+    Sint16 *queries;
+    Uint32 count;
+    Uint32 claimed, done; /* under the lock */
+    Sint16 **points;      /* each query's turning points */
+    int *lengths;         /* in points, or NO_PATH / OUT_OF_MEMORY */
+} PathBatch;
+
+typedef struct
+{
+    PathBatch *head;
+    PathBatch *tail;
+} BatchList;
+
+static Scratch scratch; /* the game thread's */
+
+/* worker pool, everything below the mutex is shared with the workers */
+static SDL_Thread *workers[PATH_MAX_WORKERS];
+static int worker_count;
+static SDL_Mutex *lock;
+static SDL_Condition *wake;
+static BatchList work;     /* with queries nobody has claimed */
+static BatchList finished; /* waiting for path_update */
+static bool quitting;
+
+static Uint32 next_id;
+
+
+/* search */
+static bool reserve(Scratch *s, Uint32 cells)
+{
+    Uint8 *block;
+
+    if (cells <= s->cells) {
+        return true;
+    }
+    block = (Uint8 *)SDL_calloc(cells, sizeof(Uint32) * 4);
+    if (!block) {
+        return false;
+    }
+    SDL_free(s->g);
+    s->cells = cells;
+    s->g = (Uint32 *)block;
+    s->parent = (Sint32 *)(s->g + cells);
+    s->mark = (Uint32 *)(s->parent + cells);
+    s->trail = s->mark + cells;
+    s->generation = 0;
+    return true;
+}
+
+static void release(Scratch *s)
+{
+    SDL_free(s->g);
+    SDL_free(s->heap.entries);
+    SDL_zerop(s);
+}
+
+static bool heap_push(Heap *h, Uint64 key, Uint32 cell)
+{
+    HeapEntry *heap = h->entries;
+    Uint32 i = h->size, up;
+
+    if (h->size == h->capacity) {
+        const Uint32 capacity = h->capacity ? h->capacity * 2 : 1024;
+
+        heap = (HeapEntry *)SDL_realloc(h->entries, capacity * sizeof(HeapEntry));
+        if (!heap) {
+            return false;
+        }
+        h->entries = heap;
+        h->capacity = capacity;
+    }
+    for (; i > 0; i = up) {
+        up = (i - 1) / 2;
+        if (heap[up].key <= key) {
+            break;
+        }
+        heap[i] = heap[up];
+    }
+    heap[i].key = key;
+    heap[i].cell = cell;
+    h->size++;
+    return true;
+}
+
+/* removes the entry with the lowest key and returns it */
+static HeapEntry heap_pop(Heap *h)
+{
+    HeapEntry *heap = h->entries;
+    const HeapEntry top = heap[0];
+    const HeapEntry last = heap[--h->size];
+    Uint32 i = 0, child;
+
+    for (;;) {
+        child = i * 2 + 1;
+        if (child >= h->size) {
+            break;
+        }
+        if (child + 1 < h->size && heap[child + 1].key < heap[child].key) {
+            child++;
+        }
+        if (last.key <= heap[child].key) {
+            break;
+        }
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = last;
+    return top;
+}
+
+static bool open_at(const Grid *grid, int x, int y)
+{
+    return (unsigned)x < (unsigned)grid->width && (unsigned)y < (unsigned)grid->height &&
+           grid->cells[y * grid->width + x] == 0;
+}
+
+/* the cost of a straight or 45 degree run, and the heuristic: octile, or Manhattan without diagonals */
+static Uint32 distance(int dx, int dy, bool diagonal)
+{
+    const int ax = SDL_abs(dx), ay = SDL_abs(dy);
+
+    if (!diagonal) {
+        return (Uint32)(ax + ay) * STRAIGHT_COST;
+    }
+    return (Uint32)(SDL_min(ax, ay) * DIAGONAL_COST + (SDL_max(ax, ay) - SDL_min(ax, ay)) * STRAIGHT_COST);
+}
+
+/*
+ * Jump point search: runs from (x, y) on by (dx, dy) and returns the first
+ * cell where the path could turn, or -1 if it hits a wall first. Diagonal
+ * runs stop where either of their straight runs would find one.
+ */
+static Sint32 jump(const Grid *grid, int x, int y, int dx, int dy, int gx, int gy)
+{
+    for (;; x += dx, y += dy) {
+        if (!open_at(grid, x, y)) {
+            return -1;
+        }
+        if (x == gx && y == gy) {
+            break;
+        }
+        if (dx != 0 && dy != 0) {
+            if (jump(grid, x + dx, y, dx, 0, gx, gy) >= 0 || jump(grid, x, y + dy, 0, dy, gx, gy) >= 0) {
+                break;
+            }
+            if (!open_at(grid, x + dx, y) || !open_at(grid, x, y + dy)) {
+                return -1;
+            }
+        } else if (dx != 0) {
+            if ((open_at(grid, x, y - 1) && !open_at(grid, x - dx, y - 1)) ||
+                (open_at(grid, x, y + 1) && !open_at(grid, x - dx, y + 1))) {
+                break;
+            }
+        } else if ((open_at(grid, x - 1, y) && !open_at(grid, x - 1, y - dy)) ||
+                   (open_at(grid, x + 1, y) && !open_at(grid, x + 1, y - dy))) {
+            break;
+        }
+    }
+    return y * grid->width + x;
+}
+
+/* the directions worth searching from (x, y) when it was reached moving by (dx, dy); (0, 0) is the start */
+static int jump_directions(const Grid *grid, int x, int y, int dx, int dy, int dirs[8][2])
+{
+    static const int all[8][2] = { { 1, 0 }, { 0, 1 }, { -1, 0 }, { 0, -1 }, { 1, 1 }, { -1, 1 }, { -1, -1 }, { 1, -1 } };
+    int i, n = 0;
+
+#define ADD(ddx, ddy) (dirs[n][0] = (ddx), dirs[n][1] = (ddy), n++)
+    if (dx == 0 && dy == 0) {
+        for (i = 0; i < 8; i++) {
+            if (all[i][0] == 0 || all[i][1] == 0 ||
+                (open_at(grid, x + all[i][0], y) && open_at(grid, x, y + all[i][1]))) {
+                ADD(all[i][0], all[i][1]);
+            }
+        }
+    } else if (dx != 0 && dy != 0) {
+        const bool across = open_at(grid, x + dx, y), down = open_at(grid, x, y + dy);
+
+        if (down) {
+            ADD(0, dy);
+        }
+        if (across) {
+            ADD(dx, 0);
+        }
+        if (across && down) {
+            ADD(dx, dy);
+        }
+    } else if (dx != 0) {
+        const bool ahead = open_at(grid, x + dx, y), up = open_at(grid, x, y - 1), down = open_at(grid, x, y + 1);
+
+        if (ahead) {
+            ADD(dx, 0);
+            if (up) {
+                ADD(dx, -1);
+            }
+            if (down) {
+                ADD(dx, 1);
+            }
+        }
+        if (up) {
+            ADD(0, -1);
+        }
+        if (down) {
+            ADD(0, 1);
+        }
+    } else {
+        const bool ahead = open_at(grid, x, y + dy), left = open_at(grid, x - 1, y), right = open_at(grid, x + 1, y);
+
+        if (ahead) {
+            ADD(0, dy);
+            if (left) {
+                ADD(-1, dy);
+            }
+            if (right) {
+                ADD(1, dy);
+            }
+        }
+        if (left) {
+            ADD(-1, 0);
+        }
+        if (right) {
+            ADD(1, 0);
+        }
+    }
+#undef ADD
+    return n;
+}
+
+/* finds a shortest path and leaves its cells in s->trail, goal first; returns how many, NO_PATH or OUT_OF_MEMORY */
+static int search(Scratch *s, const Grid *grid, int sx, int sy, int gx, int gy, bool diagonal)
+{
+    static const int steps[4][2] = { { 1, 0 }, { 0, 1 }, { -1, 0 }, { 0, -1 } };
+    const Uint32 goal = (Uint32)(gy * grid->width + gx);
+    int dirs[8][2];
+    Uint32 c, gen, cost, h;
+    Sint32 n;
+    int i, count, x, y, px, py, length;
+
+    if (!reserve(s, (Uint32)(grid->width * grid->height))) {
+        return OUT_OF_MEMORY;
+    }
+    if (!open_at(grid, sx, sy) || !open_at(grid, gx, gy)) {
+        return NO_PATH;
+    }
+    if (s->generation >= 0xFFFFFFF0u) {
+        SDL_memset(s->mark, 0, s->cells * sizeof(Uint32));
+        s->generation = 0;
+    }
+    s->generation += 2;
+    gen = s->generation;
+    s->heap.size = 0;
+
+    c = (Uint32)(sy * grid->width + sx);
+    s->g[c] = 0;
+    s->parent[c] = -1;
+    s->mark[c] = gen;
+    h = distance(gx - sx, gy - sy, diagonal);
+    if (!heap_push(&s->heap, (Uint64)h << 32 | h, c)) {
+        return OUT_OF_MEMORY;
+    }
+
+    while (s->heap.size > 0) {
+        c = heap_pop(&s->heap).cell;
+        if (s->mark[c] == gen + 1) {
+            continue; /* a stale entry, the cell was reached more cheaply before */
+        }
+        s->mark[c] = gen + 1;
+        if (c == goal) {
+            length = 0;
+            for (n = (Sint32)c; n >= 0; n = s->parent[n]) {
+                s->trail[length++] = (Uint32)n;
+            }
+            return length;
+        }
+
+        x = (int)(c % (Uint32)grid->width);
+        y = (int)(c / (Uint32)grid->width);
+        if (diagonal) {
+            px = x;
+            py = y;
+            if (s->parent[c] >= 0) {
+                px = s->parent[c] % grid->width;
+                py = s->parent[c] / grid->width;
+            }
+            count = jump_directions(grid, x, y, (x > px) - (x < px), (y > py) - (y < py), dirs);
+        } else {
+            SDL_memcpy(dirs, steps, sizeof(steps));
+            count = 4;
+        }
+
+        for (i = 0; i < count; i++) {
+            if (diagonal) {
+                n = jump(grid, x + dirs[i][0], y + dirs[i][1], dirs[i][0], dirs[i][1], gx, gy);
+            } else {
+                n = open_at(grid, x + dirs[i][0], y + dirs[i][1]) ? (Sint32)c + dirs[i][1] * grid->width + dirs[i][0] : -1;
+            }
+            if (n < 0 || s->mark[n] == gen + 1) {
+                continue;
+            }
+            px = n % grid->width;
+            py = n / grid->width;
+            cost = s->g[c] + distance(px - x, py - y, diagonal);
+            if (s->mark[n] != gen || cost < s->g[n]) {
+                s->g[n] = cost;
+                s->parent[n] = (Sint32)c;
+                s->mark[n] = gen;
+                h = distance(gx - px, gy - py, diagonal);
+                if (!heap_push(&s->heap, (Uint64)(cost + h) << 32 | h, (Uint32)n)) {
+                    return OUT_OF_MEMORY;
+                }
+            }
+        }
+    }
+    return NO_PATH;
+}
+
+/* keeps only the trail's turning points, and the ends; returns how many are left */
+static int simplify(Scratch *s, int length, int width)
+{
+    int i, kept = 1, dx, dy, next_dx, next_dy;
+    Uint32 prev = s->trail[0];
+
+    for (i = 1; i < length - 1; i++) {
+        const Uint32 c = s->trail[i], next = s->trail[i + 1];
+
+        dx = (int)(c % width) - (int)(prev % width);
+        dy = (int)(c / width) - (int)(prev / width);
+        next_dx = (int)(next % width) - (int)(c % width);
+        next_dy = (int)(next / width) - (int)(c / width);
+        if ((dx > 0) - (dx < 0) != (next_dx > 0) - (next_dx < 0) ||
+            (dy > 0) - (dy < 0) != (next_dy > 0) - (next_dy < 0)) {
+            s->trail[kept++] = c;
+        }
+        prev = c;
+    }
+    if (length > 1) {
+        s->trail[kept++] = s->trail[length - 1];
+    }
+    return kept;
+}
+
+/* writes up to max of the points as x, y pairs, start first */
+static void write_points(const Scratch *s, int count, int width, Sint16 *out, int max)
+{
+    int i;
+
+    for (i = 0; i < count && i < max; i++) {
+        const Uint32 c = s->trail[count - 1 - i];
+
+        out[i * 2] = (Sint16)(c % width);
+        out[i * 2 + 1] = (Sint16)(c / width);
+    }
+}
+
+
+/* worker threads */
+static void batch_list_push(BatchList *list, PathBatch *batch)
+{
+    batch->next = NULL;
+    if (list->tail) {
+        list->tail->next = batch;
+    } else {
+        list->head = batch;
+    }
+    list->tail = batch;
+}
+
+static PathBatch *batch_list_pop(BatchList *list)
+{
+    PathBatch *batch = list->head;
+
+    if (batch) {
+        list->head = batch->next;
+        if (!list->head) {
+            list->tail = NULL;
+        }
+    }
+    return batch;
+}
+
+static void batch_free(PathBatch *batch)
+{
+    Uint32 i;
+
+    if (batch->points) {
+        for (i = 0; i < batch->count; i++) {
+            SDL_free(batch->points[i]);
+        }
+    }
+    SDL_free(batch->points);
+    SDL_free(batch->lengths);
+    SDL_free(batch->queries);
+    SDL_free((void *)batch->grid.cells);
+    SDL_free(batch);
+}
+
+static void run_query(Scratch *s, PathBatch *batch, Uint32 q)
+{
+    const Sint16 *query = &batch->queries[q * 4];
+    int length = search(s, &batch->grid, query[0], query[1], query[2], query[3], batch->diagonal);
+
+    if (length > 0) {
+        length = simplify(s, length, batch->grid.width);
+        batch->points[q] = (Sint16 *)SDL_malloc((size_t)length * 2 * sizeof(Sint16));
+        if (!batch->points[q]) {
+            length = OUT_OF_MEMORY;
+        } else {
+            write_points(s, length, batch->grid.width, batch->points[q], length);
+        }
+    }
+    batch->lengths[q] = length;
+}
+
+static int SDLCALL worker_main(void *userdata)
+{
+    Scratch own;
+    PathBatch *batch;
+    Uint32 q;
+
+    (void)userdata;
+    SDL_zero(own);
+    SDL_LockMutex(lock);
+    for (;;) {
+        while (!quitting && !work.head) {
+            SDL_WaitCondition(wake, lock);
+        }
+        if (quitting) {
+            break;
+        }
+        batch = work.head;
+        q = batch->claimed++;
+        if (batch->claimed == batch->count) {
+            batch_list_pop(&work);
+        }
+        SDL_UnlockMutex(lock);
+
+        run_query(&own, batch, q);
+
+        SDL_LockMutex(lock);
+        if (++batch->done == batch->count) {
+            batch_list_push(&finished, batch);
+        }
+    }
+    SDL_UnlockMutex(lock);
+    release(&own);
+    return 0;
+}
+
+static bool start_workers(void)
+{
+    int count;
+
+    lock = SDL_CreateMutex();
+    wake = SDL_CreateCondition();
+    if (!lock || !wake) {
+        path_quit();
+        return false;
+    }
+    count = SDL_clamp(SDL_GetNumLogicalCPUCores() - 1, 1, PATH_MAX_WORKERS);
+    for (worker_count = 0; worker_count < count; worker_count++) {
+        workers[worker_count] = SDL_CreateThread(worker_main, "path", NULL);
+        if (!workers[worker_count]) {
+            break;
+        }
+    }
+    if (worker_count == 0) {
+        path_quit();
+        return false;
+    }
+    return true;
+}
+
+
+/* flow fields */
+
+/*
+ * A field's state, in one Duktape buffer: this header, then per cell the
+ * distance to the nearest goal, a mark for incremental updates, a goal flag
+ * and the direction script reads.
+ */
+typedef struct
+{
+    Uint32 width, height;
+    Uint32 diagonal;
+    Uint32 generation; /* marks equal to it are in the current update */
+} FlowField;
+
+static const int flow_dx[8] = { 1, 1, 0, -1, -1, -1, 0, 1 };
+static const int flow_dy[8] = { 0, 1, 1, 1, 0, -1, -1, -1 };
+
+static Heap flow_heap;
+static Uint32 *touched; /* cells the current update changed */
+static Uint32 touched_count, touched_capacity;
+
+static Uint32 *field_distances(FlowField *f)
+{
+    return (Uint32 *)(f + 1);
+}
+
+static Uint32 *field_marks(FlowField *f)
+{
+    return field_distances(f) + f->width * f->height;
+}
+
+static Uint8 *field_goals(FlowField *f)
+{
+    return (Uint8 *)(field_marks(f) + f->width * f->height);
+}
+
+static Uint8 *field_directions(FlowField *f)
+{
+    return field_goals(f) + f->width * f->height;
+}
+
+static size_t field_size(Uint32 cells)
+{
+    return sizeof(FlowField) + (size_t)cells * (2 * sizeof(Uint32) + 2);
+}
+
+/* whether a move in direction d from (x, y) is allowed; diagonals need both corners open */
+static bool can_step(const FlowField *f, const Grid *grid, int x, int y, int d)
+{
+    if ((d & 1) && (!f->diagonal || !open_at(grid, x + flow_dx[d], y) || !open_at(grid, x, y + flow_dy[d]))) {
+        return false;
+    }
+    return open_at(grid, x + flow_dx[d], y + flow_dy[d]);
+}
+
+static Uint32 step_cost(int d)
+{
+    return (d & 1) ? DIAGONAL_COST : STRAIGHT_COST;
+}
+
+/* the cheapest way to a goal from an open cell through neighbours that aren't marked, or PATH_UNREACHED */
+static Uint32 best_distance(FlowField *f, const Grid *grid, Uint32 c, bool skip_marked)
+{
+    const Uint32 *dist = field_distances(f);
+    const Uint32 *mark = field_marks(f);
+    const int x = (int)(c % f->width), y = (int)(c / f->width);
+    Uint32 best = PATH_UNREACHED, n;
+    int d;
+
+    if (field_goals(f)[c]) {
+        return 0;
+    }
+    for (d = 0; d < 8; d++) {
+        if (can_step(f, grid, x, y, d)) {
+            n = c + (Uint32)(flow_dy[d] * (int)f->width + flow_dx[d]);
+            if (dist[n] != PATH_UNREACHED && !(skip_marked && mark[n] == f->generation)) {
+                best = SDL_min(best, dist[n] + step_cost(d));
+            }
+        }
+    }
+    return best;
+}
+
+/* the direction script reads for cell c: downhill towards the nearest goal */
+static void set_direction(FlowField *f, const Grid *grid, Uint32 c)
+{
+    const Uint32 *dist = field_distances(f);
+    const int x = (int)(c % f->width), y = (int)(c / f->width);
+    Uint8 best = PATH_FLOW_NONE;
+    Uint32 lowest = PATH_UNREACHED, n;
+    int d;
+
+    if (dist[c] == 0) {
+        best = PATH_FLOW_GOAL;
+    } else if (dist[c] != PATH_UNREACHED && open_at(grid, x, y)) {
+        for (d = 0; d < 8; d++) {
+            if (can_step(f, grid, x, y, d)) {
+                n = c + (Uint32)(flow_dy[d] * (int)f->width + flow_dx[d]);
+                if (dist[n] != PATH_UNREACHED && dist[n] + step_cost(d) < lowest) {
+                    lowest = dist[n] + step_cost(d);
+                    best = (Uint8)d;
+                }
+            }
+        }
+    }
+    field_directions(f)[c] = best;
+}
+
+static bool touch(Uint32 c)
+{
+    Uint32 *grown;
+
+    if (touched_count == touched_capacity) {
+        const Uint32 capacity = touched_capacity ? touched_capacity * 2 : 1024;
+
+        grown = (Uint32 *)SDL_realloc(touched, capacity * sizeof(Uint32));
+        if (!grown) {
+            return false;
+        }
+        touched = grown;
+        touched_capacity = capacity;
+    }
+    touched[touched_count++] = c;
+    return true;
+}
+
+/*
+ * Dijkstra from whatever is on the heap. With `within_marked` distances only
+ * change inside the marked cells; with `track` every cell that improves is
+ * marked and touched.
+ */
+static bool propagate(FlowField *f, const Grid *grid, bool within_marked, bool track)
+{
+    Uint32 *dist = field_distances(f);
+    Uint32 *mark = field_marks(f);
+    HeapEntry e;
+    Uint32 c, n, cost;
+    int d, x, y;
+
+    while (flow_heap.size > 0) {
+        e = heap_pop(&flow_heap);
+        c = e.cell;
+        if (e.key > dist[c]) {
+            continue;
+        }
+        x = (int)(c % f->width);
+        y = (int)(c / f->width);
+        for (d = 0; d < 8; d++) {
+            if (!can_step(f, grid, x, y, d)) {
+                continue;
+            }
+            n = c + (Uint32)(flow_dy[d] * (int)f->width + flow_dx[d]);
+            cost = dist[c] + step_cost(d);
+            if (cost >= dist[n] || (within_marked && mark[n] != f->generation)) {
+                continue;
+            }
+            dist[n] = cost;
+            if (track && mark[n] != f->generation) {
+                mark[n] = f->generation;
+                if (!touch(n)) {
+                    return false;
+                }
+            }
+            if (!heap_push(&flow_heap, cost, n)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static void next_generation(FlowField *f)
+{
+    if (++f->generation == 0) {
+        SDL_memset(field_marks(f), 0, (size_t)f->width * f->height * sizeof(Uint32));
+        f->generation = 1;
+    }
+}
+
+/* recomputes every distance and direction */
+static bool field_rebuild(FlowField *f, const Grid *grid)
+{
+    const Uint32 cells = f->width * f->height;
+    Uint32 *dist = field_distances(f);
+    const Uint8 *goals = field_goals(f);
+    Uint32 c;
+
+    next_generation(f);
+    flow_heap.size = 0;
+    for (c = 0; c < cells; c++) {
+        dist[c] = PATH_UNREACHED;
+        if (goals[c] && grid->cells[c] == 0) {
+            dist[c] = 0;
+            if (!heap_push(&flow_heap, 0, c)) {
+                return false;
+            }
+        }
+    }
+    if (!propagate(f, grid, false, false)) {
+        return false;
+    }
+    for (c = 0; c < cells; c++) {
+        set_direction(f, grid, c);
+    }
+    return true;
+}
+
+/*
+ * Repairs the field after cell (x, y) was opened or blocked. Opening one can
+ * only shorten distances, so they spread out from it. Blocking one lengthens
+ * the distances of every cell whose shortest path ran through it or cut
+ * past its corner: those are forgotten and found again from the cells
+ * around them. The number of cells whose distance was redone goes to
+ * *redone; returns false if it ran out of memory.
+ */
+static bool field_change(FlowField *f, const Grid *grid, int x, int y, Uint32 *redone)
+{
+    static const int pairs[4][2] = { { 0, 2 }, { 2, 4 }, { 4, 6 }, { 6, 0 } };
+    Uint32 *dist = field_distances(f);
+    Uint32 *mark = field_marks(f);
+    const Uint32 c = (Uint32)(y * (int)f->width + x);
+    Uint32 i, p, q, a, b, best;
+    int d, px, py;
+
+    next_generation(f);
+    flow_heap.size = 0;
+    touched_count = 0;
+#define TOUCH(cell) \
+    do { \
+        mark[cell] = f->generation; \
+        if (!touch(cell)) { \
+            return false; \
+        } \
+    } while (0)
+
+    if (!open_at(grid, x, y)) {
+        TOUCH(c);
+        /* diagonal steps between two of its neighbours needed it open */
+        for (i = 0; f->diagonal && i < 4; i++) {
+            if (!open_at(grid, x + flow_dx[pairs[i][0]], y + flow_dy[pairs[i][0]]) ||
+                !open_at(grid, x + flow_dx[pairs[i][1]], y + flow_dy[pairs[i][1]])) {
+                continue;
+            }
+            a = c + (Uint32)(flow_dy[pairs[i][0]] * (int)f->width + flow_dx[pairs[i][0]]);
+            b = c + (Uint32)(flow_dy[pairs[i][1]] * (int)f->width + flow_dx[pairs[i][1]]);
+            if (dist[b] != PATH_UNREACHED && dist[a] == dist[b] + DIAGONAL_COST && mark[a] != f->generation) {
+                TOUCH(a);
+            } else if (dist[a] != PATH_UNREACHED && dist[b] == dist[a] + DIAGONAL_COST && mark[b] != f->generation) {
+                TOUCH(b);
+            }
+        }
+        /* everything downstream of those, by the old distances */
+        for (i = 0; i < touched_count; i++) {
+            p = touched[i];
+            px = (int)(p % f->width);
+            py = (int)(p / f->width);
+            for (d = 0; d < 8; d++) {
+                if (!open_at(grid, px + flow_dx[d], py + flow_dy[d])) {
+                    continue;
+                }
+                q = p + (Uint32)(flow_dy[d] * (int)f->width + flow_dx[d]);
+                if (mark[q] != f->generation && dist[p] != PATH_UNREACHED && dist[q] == dist[p] + step_cost(d)) {
+                    TOUCH(q);
+                }
+            }
+        }
+        for (i = 0; i < touched_count; i++) {
+            dist[touched[i]] = PATH_UNREACHED;
+        }
+        for (i = 0; i < touched_count; i++) {
+            p = touched[i];
+            if (open_at(grid, (int)(p % f->width), (int)(p / f->width))) {
+                best = best_distance(f, grid, p, true);
+                if (best != PATH_UNREACHED) {
+                    dist[p] = best;
+                    if (!heap_push(&flow_heap, best, p)) {
+                        return false;
+                    }
+                }
+            }
+        }
+        if (!propagate(f, grid, true, false)) {
+            return false;
+        }
+    } else {
+        for (d = -1; d < 8; d++) {
+            px = x + (d < 0 ? 0 : flow_dx[d]);
+            py = y + (d < 0 ? 0 : flow_dy[d]);
+            if (!open_at(grid, px, py)) {
+                continue;
+            }
+            p = (Uint32)(py * (int)f->width + px);
+            best = best_distance(f, grid, p, false);
+            if (best < dist[p]) {
+                dist[p] = best;
+                TOUCH(p);
+                if (!heap_push(&flow_heap, best, p)) {
+                    return false;
+                }
+            }
+        }
+        if (!propagate(f, grid, false, true)) {
+            return false;
+        }
+    }
+#undef TOUCH
+
+    /* opening or blocking a corner changes which diagonals its neighbours can take */
+    for (d = -1; d < 8; d++) {
+        px = x + (d < 0 ? 0 : flow_dx[d]);
+        py = y + (d < 0 ? 0 : flow_dy[d]);
+        if ((unsigned)px < f->width && (unsigned)py < f->height) {
+            set_direction(f, grid, (Uint32)(py * (int)f->width + px));
+        }
+    }
+    for (i = 0; i < touched_count; i++) {
+        p = touched[i];
+        px = (int)(p % f->width);
+        py = (int)(p / f->width);
+        set_direction(f, grid, p);
+        for (d = 0; d < 8; d++) {
+            if ((unsigned)(px + flow_dx[d]) < f->width && (unsigned)(py + flow_dy[d]) < f->height) {
+                set_direction(f, grid, p + (Uint32)(flow_dy[d] * (int)f->width + flow_dx[d]));
+            }
+        }
+    }
+    *redone = touched_count;
+    return true;
+}
+
+
+/* game thread */
+
+/* calls the batch's callback with (null, { points, starts }) or an error */
+static void deliver(duk_context *ctx, PathBatch *batch)
+{
+    Uint32 i, total = 0;
+    Uint32 *starts;
+    Sint16 *points;
+    bool failed = false;
+
+    duk_push_heap_stash(ctx);
+    duk_get_prop_string(ctx, -1, "pathBatches");
+    duk_get_prop_index(ctx, -1, batch->id);
+    duk_del_prop_index(ctx, -2, batch->id);
+
+    for (i = 0; i < batch->count; i++) {
+        if (batch->lengths[i] > 0) {
+            total += (Uint32)batch->lengths[i];
+        }
+        failed = failed || batch->lengths[i] == OUT_OF_MEMORY;
+    }
+    if (failed) {
+        duk_push_error_object(ctx, DUK_ERR_ERROR, "Couldn't find paths: out of memory");
+        duk_push_undefined(ctx);
+    } else {
+        duk_push_null(ctx);
+        duk_push_object(ctx);
+        points = (Sint16 *)duk_push_fixed_buffer(ctx, (duk_size_t)total * 2 * sizeof(Sint16));
+        duk_push_buffer_object(ctx, -1, 0, (duk_size_t)total * 2 * sizeof(Sint16), DUK_BUFOBJ_INT16ARRAY);
+        duk_remove(ctx, -2);
+        duk_put_prop_string(ctx, -2, "points");
+        starts = (Uint32 *)duk_push_fixed_buffer(ctx, ((duk_size_t)batch->count + 1) * sizeof(Uint32));
+        duk_push_buffer_object(ctx, -1, 0, ((duk_size_t)batch->count + 1) * sizeof(Uint32), DUK_BUFOBJ_UINT32ARRAY);
+        duk_remove(ctx, -2);
+        duk_put_prop_string(ctx, -2, "starts");
+
+        starts[0] = 0;
+        for (i = 0; i < batch->count; i++) {
+            const int length = SDL_max(batch->lengths[i], 0);
+
+            if (length > 0) {
+                SDL_memcpy(points + starts[i] * 2, batch->points[i], (size_t)length * 2 * sizeof(Sint16));
+            }
+            starts[i + 1] = starts[i] + (Uint32)length;
+        }
+    }
+    if (duk_pcall(ctx, 2) != 0) {
+        fprintf(stderr, "Error in path callback: %s\n", duk_safe_to_string(ctx, -1));
+    }
+    duk_pop_3(ctx);
+    jobs_drain(ctx);
+    batch_free(batch);
+}
+
+void path_update(duk_context *ctx)
+{
+    BatchList done;
+    PathBatch *batch;
+
+    if (!lock) {
+        return;
+    }
+    SDL_LockMutex(lock);
+    done = finished;
+    finished.head = finished.tail = NULL;
+    SDL_UnlockMutex(lock);
+
+    while ((batch = batch_list_pop(&done)) != NULL) {
+        deliver(ctx, batch);
+    }
+}
+
+static void require_grid(duk_context *ctx, duk_idx_t idx, int width, Grid *grid)
+{
+    duk_size_t size;
+
+    grid->cells = (const Uint8 *)duk_require_buffer_data(ctx, idx, &size);
+    if (width < 1 || width > PATH_MAX_SIDE || size == 0 || size % (duk_size_t)width != 0 ||
+        size / (duk_size_t)width > PATH_MAX_SIDE) {
+        (void)duk_error(ctx, DUK_ERR_RANGE_ERROR, "grid must be width x height bytes, 1-%d a side", PATH_MAX_SIDE);
+    }
+    grid->width = width;
+    grid->height = (int)(size / (duk_size_t)width);
+}
+
+/* javascript bridge logic */
+
+/*
+ * path.find(grid, width, startX, startY, goalX, goalY, out, flags) writes
+ * the path's turning points, start and goal included, into `out` and returns
+ * how many there are, or -1 if the goal can't be reached. A path longer than
+ * `out` is cut short. flags: path.DIAGONAL.
+ */
+static duk_ret_t native_path_find(duk_context *ctx)
+{
+    const int width = duk_require_int(ctx, 1);
+    const int sx = duk_require_int(ctx, 2), sy = duk_require_int(ctx, 3);
+    const int gx = duk_require_int(ctx, 4), gy = duk_require_int(ctx, 5);
+    const bool diagonal = (duk_opt_uint(ctx, 7, 0) & PATH_DIAGONAL) != 0;
+    duk_size_t out_size;
+    Sint16 *out;
+    Grid grid;
+    int length;
+
+    require_grid(ctx, 0, width, &grid);
+    out = (Sint16 *)duk_require_buffer_data(ctx, 6, &out_size);
+    length = search(&scratch, &grid, sx, sy, gx, gy, diagonal);
+    if (length == OUT_OF_MEMORY) {
+        return duk_error(ctx, DUK_ERR_ERROR, "Couldn't find a path: out of memory");
+    }
+    if (length > 0) {
+        length = simplify(&scratch, length, width);
+        write_points(&scratch, length, width, out, (int)(out_size / (2 * sizeof(Sint16))));
+    }
+    duk_push_int(ctx, length);
+    return 1;
+}
+
+/*
+ * path.findAll(grid, width, queries, flags, callback) searches for every
+ * startX, startY, goalX, goalY in the Int16Array `queries` on the worker
+ * threads, then calls callback(err, { points, starts }) on a later frame.
+ * Query i's turning points are points[starts[i] * 2] up to
+ * points[starts[i + 1] * 2]; none if there is no path.
+ */
+static duk_ret_t native_path_find_all(duk_context *ctx)
+{
+    const int width = duk_require_int(ctx, 1);
+    const bool diagonal = (duk_opt_uint(ctx, 3, 0) & PATH_DIAGONAL) != 0;
+    const Sint16 *queries;
+    duk_size_t size;
+    PathBatch *batch;
+    Uint8 *cells;
+    Grid grid;
+
+    require_grid(ctx, 0, width, &grid);
+    queries = (const Sint16 *)duk_require_buffer_data(ctx, 2, &size);
+    duk_require_function(ctx, 4);
+    if (size % (4 * sizeof(Sint16)) != 0 || size / (4 * sizeof(Sint16)) > PATH_MAX_BATCH) {
+        return duk_error(ctx, DUK_ERR_RANGE_ERROR, "queries must be up to %d sets of 4 Int16s", PATH_MAX_BATCH);
+    }
+    if (size == 0) {
+        return duk_error(ctx, DUK_ERR_RANGE_ERROR, "no queries");
+    }
+    if (!lock && !start_workers()) {
+        return duk_error(ctx, DUK_ERR_ERROR, "Couldn't start path workers: %s", SDL_GetError());
+    }
+
+    batch = (PathBatch *)SDL_calloc(1, sizeof(PathBatch));
+    if (!batch) {
+        return duk_error(ctx, DUK_ERR_ERROR, "out of memory");
+    }
+    batch->count = (Uint32)(size / (4 * sizeof(Sint16)));
+    cells = (Uint8 *)SDL_malloc((size_t)grid.width * grid.height);
+    batch->grid.cells = cells;
+    batch->queries = (Sint16 *)SDL_malloc(size);
+    batch->points = (Sint16 **)SDL_calloc(batch->count, sizeof(Sint16 *));
+    batch->lengths = (int *)SDL_calloc(batch->count, sizeof(int));
+    if (!cells || !batch->queries || !batch->points || !batch->lengths) {
+        batch_free(batch);
+        return duk_error(ctx, DUK_ERR_ERROR, "out of memory");
+    }
+    SDL_memcpy(cells, grid.cells, (size_t)grid.width * grid.height);
+    SDL_memcpy(batch->queries, queries, size);
+    batch->grid.width = grid.width;
+    batch->grid.height = grid.height;
+    batch->diagonal = diagonal;
+    if (++next_id == 0) {
+        next_id = 1;
+    }
+    batch->id = next_id;
+
+    duk_push_heap_stash(ctx);
+    duk_get_prop_string(ctx, -1, "pathBatches");
+    duk_dup(ctx, 4);
+    duk_put_prop_index(ctx, -2, batch->id);
+    duk_pop_2(ctx);
+
+    SDL_LockMutex(lock);
+    batch_list_push(&work, batch);
+    SDL_BroadcastCondition(wake);
+    SDL_UnlockMutex(lock);
+    return 0;
+}
+
+/* field.* run on `this`, with the grid it was made from */
+static FlowField *require_field(duk_context *ctx, Grid *grid)
+{
+    FlowField *f = NULL;
+    duk_size_t size;
+
+    duk_push_this(ctx);
+    if (duk_get_prop_string(ctx, -1, DUK_HIDDEN_SYMBOL("field"))) {
+        f = (FlowField *)duk_get_buffer(ctx, -1, &size);
+        if (size < sizeof(FlowField)) {
+            f = NULL;
+        }
+    }
+    duk_pop(ctx);
+    if (!f) {
+        (void)duk_error(ctx, DUK_ERR_TYPE_ERROR, "not a flow field");
+    }
+    duk_get_prop_string(ctx, -1, DUK_HIDDEN_SYMBOL("grid"));
+    require_grid(ctx, -1, (int)f->width, grid);
+    if ((Uint32)grid->height != f->height) {
+        (void)duk_error(ctx, DUK_ERR_RANGE_ERROR, "the field's grid changed size");
+    }
+    duk_pop_2(ctx);
+    return f;
+}
+
+/* a typed array view of part of the field's buffer, as property `name` of the field on top of the stack */
+static void push_view(duk_context *ctx, void *data, Uint32 size, duk_uint_t type, const char *name)
+{
+    duk_get_prop_string(ctx, -1, DUK_HIDDEN_SYMBOL("field"));
+    duk_push_buffer_object(ctx, -1, (duk_size_t)((Uint8 *)data - (Uint8 *)duk_get_buffer(ctx, -1, NULL)), size, type);
+    duk_remove(ctx, -2);
+    duk_put_prop_string(ctx, -2, name);
+}
+
+/*
+ * path.flowField(grid, width, flags) makes a field over the grid, which it
+ * keeps using: call field.changed() after editing a cell of it. Once goals
+ * are set, field.directions[y * width + x] says which way to step from each
+ * cell towards the nearest one: 0-7 (see path.dirX and path.dirY),
+ * path.GOAL, or path.NONE. field.distances has the cost of the way there,
+ * 10 a straight step and 14 a diagonal. flags: path.DIAGONAL.
+ */
+static duk_ret_t native_path_flow_field(duk_context *ctx)
+{
+    const int width = duk_require_int(ctx, 1);
+    const bool diagonal = (duk_opt_uint(ctx, 2, 0) & PATH_DIAGONAL) != 0;
+    FlowField *f;
+    Uint32 cells;
+    Grid grid;
+
+    require_grid(ctx, 0, width, &grid);
+    cells = (Uint32)grid.width * (Uint32)grid.height;
+    duk_push_object(ctx);
+    duk_push_heap_stash(ctx);
+    duk_get_prop_string(ctx, -1, "flowField");
+    duk_set_prototype(ctx, -3);
+    duk_pop(ctx);
+    f = (FlowField *)duk_push_fixed_buffer(ctx, field_size(cells));
+    f->width = (Uint32)grid.width;
+    f->height = (Uint32)grid.height;
+    f->diagonal = diagonal;
+    f->generation = 0;
+    SDL_memset(field_distances(f), 0xff, cells * sizeof(Uint32));
+    SDL_memset(field_directions(f), PATH_FLOW_NONE, cells);
+    duk_put_prop_string(ctx, -2, DUK_HIDDEN_SYMBOL("field"));
+    duk_dup(ctx, 0);
+    duk_put_prop_string(ctx, -2, DUK_HIDDEN_SYMBOL("grid"));
+
+    push_view(ctx, field_directions(f), cells, DUK_BUFOBJ_UINT8ARRAY, "directions");
+    push_view(ctx, field_distances(f), cells * sizeof(Uint32), DUK_BUFOBJ_UINT32ARRAY, "distances");
+    duk_push_uint(ctx, f->width);
+    duk_put_prop_string(ctx, -2, "width");
+    duk_push_uint(ctx, f->height);
+    duk_put_prop_string(ctx, -2, "height");
+    return 1;
+}
+
+/* field.setGoals(x, y) or field.setGoals(points), an Int16Array of x, y pairs, replaces the goals and rebuilds */
+static duk_ret_t native_field_set_goals(duk_context *ctx)
+{
+    Grid grid;
+    FlowField *f = require_field(ctx, &grid);
+    Uint8 *goals = field_goals(f);
+    const Sint16 *points;
+    Sint16 one[2];
+    duk_size_t count, i;
+    int x, y;
+
+    if (duk_is_buffer_data(ctx, 0)) {
+        points = (const Sint16 *)duk_require_buffer_data(ctx, 0, &count);
+        count /= 2 * sizeof(Sint16);
+    } else {
+        one[0] = (Sint16)duk_require_int(ctx, 0);
+        one[1] = (Sint16)duk_require_int(ctx, 1);
+        points = one;
+        count = 1;
+    }
+    SDL_memset(goals, 0, (size_t)f->width * f->height);
+    for (i = 0; i < count; i++) {
+        x = points[i * 2];
+        y = points[i * 2 + 1];
+        if ((unsigned)x < f->width && (unsigned)y < f->height) {
+            goals[(Uint32)y * f->width + (Uint32)x] = 1;
+        }
+    }
+    if (!field_rebuild(f, &grid)) {
+        return duk_error(ctx, DUK_ERR_ERROR, "Couldn't build flow field: out of memory");
+    }
+    return 0;
+}
+
+/* field.update() rebuilds the whole field, after changing many cells of the grid at once */
+static duk_ret_t native_field_update(duk_context *ctx)
+{
+    Grid grid;
+    FlowField *f = require_field(ctx, &grid);
+
+    if (!field_rebuild(f, &grid)) {
+        return duk_error(ctx, DUK_ERR_ERROR, "Couldn't build flow field: out of memory");
+    }
+    return 0;
+}
+
+/*
+ * field.changed(x, y) repairs the field after grid cell x, y was opened or
+ * blocked, redoing only the cells whose way to a goal it affects, and
+ * returns how many those were. One call per changed cell.
+ */
+static duk_ret_t native_field_changed(duk_context *ctx)
+{
+    const int x = duk_require_int(ctx, 0), y = duk_require_int(ctx, 1);
+    Grid grid;
+    FlowField *f = require_field(ctx, &grid);
+    Uint32 redone = 0;
+
+    if ((unsigned)x >= f->width || (unsigned)y >= f->height) {
+        return duk_error(ctx, DUK_ERR_RANGE_ERROR, "no such cell: %d, %d", x, y);
+    }
+    if (!field_change(f, &grid, x, y, &redone)) {
+        /* leave it whole, if slower */
+        if (!field_rebuild(f, &grid)) {
+            return duk_error(ctx, DUK_ERR_ERROR, "Couldn't update flow field: out of memory");
+        }
+        redone = f->width * f->height;
+    }
+    duk_push_uint(ctx, redone);
+    return 1;
+}
+
+static const duk_function_list_entry path_functions[] = {
+    { "find", native_path_find, 8 },
+    { "findAll", native_path_find_all, 5 },
+    { "flowField", native_path_flow_field, 3 },
+    { NULL, NULL, 0 }
+};
+
+static const duk_function_list_entry field_functions[] = {
+    { "setGoals", native_field_set_goals, 2 },
+    { "update", native_field_update, 0 },
+    { "changed", native_field_changed, 2 },
+    { NULL, NULL, 0 }
+};
+
+static const duk_number_list_entry path_constants[] = {
+    { "DIAGONAL", PATH_DIAGONAL },
+    { "GOAL", PATH_FLOW_GOAL },
+    { "NONE", PATH_FLOW_NONE },
+    { NULL, 0.0 }
+};
+
+/* path.dirX[d], path.dirY[d]: the step a direction stands for */
+static void push_steps(duk_context *ctx, const int *steps, const char *name)
+{
+    Sint8 *out = (Sint8 *)duk_push_fixed_buffer(ctx, 9);
+    int d;
+
+    for (d = 0; d < 8; d++) {
+        out[d] = (Sint8)steps[d];
+    }
+    out[PATH_FLOW_GOAL] = 0;
+    duk_push_buffer_object(ctx, -1, 0, 9, DUK_BUFOBJ_INT8ARRAY);
+    duk_remove(ctx, -2);
+    duk_put_prop_string(ctx, -2, name);
+}
+
+void path_bind(duk_context *ctx)
+{
+    duk_push_heap_stash(ctx);
+    duk_push_object(ctx);
+    duk_put_prop_string(ctx, -2, "pathBatches");
+    duk_push_object(ctx);
+    duk_put_function_list(ctx, -1, field_functions);
+    duk_put_prop_string(ctx, -2, "flowField");
+    duk_pop(ctx);
+
+    duk_push_object(ctx);
+    duk_put_function_list(ctx, -1, path_functions);
+    duk_put_number_list(ctx, -1, path_constants);
+    push_steps(ctx, flow_dx, "dirX");
+    push_steps(ctx, flow_dy, "dirY");
+    duk_put_global_string(ctx, "path");
+}
+
+void path_quit(void)
+{
+    PathBatch *batch;
+    int i;
+
+    if (lock) {
+        SDL_LockMutex(lock);
+        quitting = true;
+        SDL_BroadcastCondition(wake);
+        SDL_UnlockMutex(lock);
+    }
+    for (i = 0; i < worker_count; i++) {
+        SDL_WaitThread(workers[i], NULL);
+        workers[i] = NULL;
+    }
+    worker_count = 0;
+
+    while ((batch = batch_list_pop(&work)) != NULL) {
+        batch_free(batch);
+    }
+    while ((batch = batch_list_pop(&finished)) != NULL) {
+        batch_free(batch);
+    }
+    SDL_DestroyCondition(wake);
+    SDL_DestroyMutex(lock);
+    wake = NULL;
+    lock = NULL;
+    quitting = false;
+    release(&scratch);
+    SDL_free(flow_heap.entries);
+    SDL_free(touched);
+    SDL_zero(flow_heap);
+    touched = NULL;
+    touched_count = touched_capacity = 0;
+}
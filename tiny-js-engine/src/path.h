@@ -0,0 +1,38 @@
+#ifndef PATH_H
+#define PATH_H
+
+#include <SDL3/SDL.h>
+#include "duktape/duktape.h"
+
+/* pathfinding config */
+#define PATH_MAX_SIDE    4096 /* cells a side */
+#define PATH_MAX_WORKERS 4
+#define PATH_MAX_BATCH   4096 /* queries per path.findAll() */
+
+#define PATH_DIAGONAL 1 /* 8 way movement; diagonal steps never cut a blocked corner */
+
+/* flow field directions: 0-7 are east, south east, south and on round clockwise */
+#define PATH_FLOW_GOAL  8
+#define PATH_FLOW_NONE  255 /* a wall, or no way to a goal */
+#define PATH_UNREACHED  0xFFFFFFFFu
+
+/*
+ * Grid pathfinding in C. A grid is a Uint8Array of width x height cells,
+ * row by row, where 0 is open and anything else blocks. Searches are A* over
+ * a binary heap with scratch buffers that are kept between searches and never
+ * cleared; with 8 way movement the successors come from jump point search,
+ * so long open stretches cost one step each. Paths are written as x, y pairs
+ * of their turning points into an Int16Array. path.findAll() runs a batch of
+ * searches on worker threads against a copy of the grid and hands the
+ * results to a callback from path_update() on a later frame.
+ *
+ * path.flowField() is for many agents with the same goals: a Dijkstra pass
+ * from the goals leaves a direction in every cell. When a cell of the grid
+ * is opened or blocked, only the cells whose distance that changes are
+ * redone.
+ */
+void path_bind(duk_context *ctx);
+void path_update(duk_context *ctx); /* once a frame: delivers finished batches */
+void path_quit(void);
+
+#endif
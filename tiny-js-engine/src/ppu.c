@@ -0,0 +1,404 @@
+#include <stdio.h>
+#include "ppu.h"
+#include "indexed.h"
+
+#define BYTE_LANES  0x0101010101010101ULL
+#define LINE_MARGIN 8 /* either side of a line, so sprites hanging off its edges need no clipping */
+#define HIDDEN_Y    (-32768) /* far enough up that no line ever meets the sprite */
+
+typedef struct
+{
+    Uint16 tile;
+    Uint8 attr;
+} MapEntry;
+
+typedef struct
+{
+    Sint16 x, y; /* top left, in screen pixels */
+    Uint16 tile;
+    Uint8 attr;
+} Sprite;
+
+typedef struct
+{
+    const Uint8 *data;
+    Uint32 count;
+    int bpp;
+} Tiles;
+
+static MapEntry maps[2][PPU_MAP_SIZE * PPU_MAP_SIZE]; /* background, window */
+static Sprite oam[PPU_MAX_SPRITES];
+static int bg_bank = -1, sprite_bank = -1;
+static int sprite_height = 8;
+static int layers = PPU_LAYER_BG | PPU_LAYER_WINDOW | PPU_LAYER_SPRITES;
+
+/* registers; scroll_x/y may be replaced line by line */
+static int scroll_x, scroll_y;
+static int window_x, window_y;
+
+/* the line being composed, with 0xFF masks where sprites are held back */
+static Uint8 line[LINE_MARGIN + INDEXED_MAX_SIZE + LINE_MARGIN];
+static Uint8 opaque[LINE_MARGIN + INDEXED_MAX_SIZE + LINE_MARGIN];  /* background colours 1-3 */
+static Uint8 front[LINE_MARGIN + INDEXED_MAX_SIZE + LINE_MARGIN];   /* ... of tiles with PPU_PRIORITY */
+static Uint8 claimed[LINE_MARGIN + INDEXED_MAX_SIZE + LINE_MARGIN]; /* a sprite's colours 1-3 */
+/* whole tile rows of a layer, before they are lined up with the screen */
+static Uint8 fetched[3][INDEXED_MAX_SIZE + 16];
+
+static Uint64 load_lanes(const Uint8 *p)
+{
+    Uint64 v;
+
+    SDL_memcpy(&v, p, sizeof(v));
+    return SDL_Swap64LE(v);
+}
+
+static void store_lanes(Uint8 *p, Uint64 v)
+{
+    v = SDL_Swap64LE(v);
+    SDL_memcpy(p, &v, sizeof(v));
+}
+
+static bool get_tiles(int bank, Tiles *tiles)
+{
+    tiles->data = indexed_get_tiles(bank, &tiles->bpp, &tiles->count);
+    return tiles->data != NULL;
+}
+
+/*
+ * Fetches the tile rows of map pixel row y covering `width` pixels from map
+ * pixel x, returning where x starts in fetched[]
+ */
+static int fetch_layer(const MapEntry *map, const Tiles *tiles, int x, int y, int width)
+{
+    const int wrap = PPU_MAP_SIZE * 8 - 1;
+    const MapEntry *row = map + ((y & wrap) >> 3) * PPU_MAP_SIZE;
+    const int start = x & 7;
+    int col = (x & wrap) >> 3, i;
+
+    y &= 7;
+    for (i = 0; i < start + width; i += 8, col = (col + 1) & (PPU_MAP_SIZE - 1)) {
+        const MapEntry *e = &row[col];
+        const Uint32 tile = e->tile < tiles->count ? e->tile : 0;
+        const Uint64 base = BYTE_LANES * (Uint64)(((e->attr & PPU_PALETTE) << tiles->bpp) & 0xFF);
+        Uint64 mask, px;
+
+        px = indexed_tile_row(tiles->data + tile * (Uint32)tiles->bpp * 8, tiles->bpp,
+                              (e->attr & PPU_FLIP_Y) ? 7 - y : y, (e->attr & PPU_FLIP_X) != 0, &mask);
+        store_lanes(fetched[0] + i, px | base);
+        store_lanes(fetched[1] + i, mask);
+        store_lanes(fetched[2] + i, (e->attr & PPU_PRIORITY) ? mask : 0);
+    }
+    return start;
+}
+
+/* copies `width` fetched pixels from `from` into the line at screen x */
+static void put_layer(int from, int x, int width)
+{
+    SDL_memcpy(line + LINE_MARGIN + x, fetched[0] + from, (size_t)width);
+    SDL_memcpy(opaque + LINE_MARGIN + x, fetched[1] + from, (size_t)width);
+    SDL_memcpy(front + LINE_MARGIN + x, fetched[2] + from, (size_t)width);
+}
+
+static void draw_sprites(const Tiles *tiles, int y, int width)
+{
+    int selected[PPU_SPRITES_PER_LINE];
+    int count = 0, i;
+
+    /* like the hardware, the first sprites on the line win, whether or not they are on screen */
+    for (i = 0; i < PPU_MAX_SPRITES && count < PPU_SPRITES_PER_LINE; i++) {
+        if (y >= oam[i].y && y < oam[i].y + sprite_height) {
+            selected[count++] = i;
+        }
+    }
+    /*
+     * Front to back: the first sprite with a colour at a pixel owns it even
+     * when it is behind the background there, hiding the sprites under it
+     */
+    for (i = 0; i < count; i++) {
+        const Sprite *s = &oam[selected[i]];
+        const int at = LINE_MARGIN + s->x;
+        int row = y - s->y;
+        Uint32 tile = s->tile;
+        Uint64 mask, px;
+
+        if (s->attr & PPU_FLIP_Y) {
+            row = sprite_height - 1 - row;
+        }
+        if (sprite_height == 16) {
+            tile = (tile & ~1U) | (Uint32)(row >> 3);
+        }
+        if (s->x <= -8 || s->x >= width || tile >= tiles->count) {
+            continue;
+        }
+        px = indexed_tile_row(tiles->data + tile * (Uint32)tiles->bpp * 8, tiles->bpp, row & 7,
+                              (s->attr & PPU_FLIP_X) != 0, &mask);
+        px |= BYTE_LANES * (Uint64)(((8 + (s->attr & PPU_PALETTE)) << tiles->bpp) & 0xFF);
+        mask &= ~load_lanes(claimed + at);
+        store_lanes(claimed + at, load_lanes(claimed + at) | mask);
+        mask &= ~load_lanes(((s->attr & PPU_PRIORITY) ? opaque : front) + at);
+        store_lanes(line + at, (load_lanes(line + at) & ~mask) | (px & mask));
+    }
+    for (i = 0; i < count; i++) {
+        store_lanes(claimed + LINE_MARGIN + oam[selected[i]].x, 0);
+    }
+}
+
+static void compose_line(Uint8 *dst, int y, int width)
+{
+    Tiles tiles;
+
+    if ((layers & PPU_LAYER_BG) && get_tiles(bg_bank, &tiles)) {
+        put_layer(fetch_layer(maps[0], &tiles, scroll_x, y + scroll_y, width), 0, width);
+    } else {
+        SDL_memset(line + LINE_MARGIN, 0, (size_t)width);
+        SDL_memset(opaque + LINE_MARGIN, 0, (size_t)width);
+        SDL_memset(front + LINE_MARGIN, 0, (size_t)width);
+    }
+    if ((layers & PPU_LAYER_WINDOW) && y >= window_y && window_x < width && get_tiles(bg_bank, &tiles)) {
+        const int x = SDL_max(window_x, 0);
+
+        put_layer(fetch_layer(maps[1], &tiles, x - window_x, y - window_y, width - x), x, width - x);
+    }
+    if ((layers & PPU_LAYER_SPRITES) && get_tiles(sprite_bank, &tiles)) {
+        draw_sprites(&tiles, y, width);
+    }
+    SDL_memcpy(dst, line + LINE_MARGIN, (size_t)width);
+}
+
+
+/* javascript bridge logic */
+static MapEntry *require_map(duk_context *ctx, duk_idx_t idx)
+{
+    const int layer = duk_require_int(ctx, idx);
+
+    if (layer != PPU_LAYER_BG && layer != PPU_LAYER_WINDOW) {
+        (void)duk_error(ctx, DUK_ERR_RANGE_ERROR, "layer must be ppu.BG or ppu.WINDOW");
+    }
+    return maps[layer == PPU_LAYER_WINDOW];
+}
+
+/* the scroll register table's entry for a line, if the table reaches that far */
+static bool table_scroll(duk_context *ctx, duk_idx_t idx, int y, int *x_out, int *y_out)
+{
+    duk_size_t size;
+    const Uint8 *table = (const Uint8 *)duk_get_buffer_data(ctx, idx, &size);
+    Sint16 entry[2];
+
+    if (!table || size < (duk_size_t)(y + 1) * sizeof(entry)) {
+        return false;
+    }
+    SDL_memcpy(entry, table + (size_t)y * sizeof(entry), sizeof(entry));
+    *x_out = entry[0];
+    *y_out = entry[1];
+    return true;
+}
+
+/* ppu.tiles(bgBank, spriteBank) picks the indexed tile banks; sprites share the background's by default */
+static duk_ret_t native_ppu_tiles(duk_context *ctx)
+{
+    bg_bank = duk_require_int(ctx, 0);
+    sprite_bank = duk_opt_int(ctx, 1, bg_bank);
+    return 0;
+}
+
+/* ppu.map(layer, x, y, tile, attr) */
+static duk_ret_t native_ppu_map(duk_context *ctx)
+{
+    MapEntry *map = require_map(ctx, 0);
+    const int x = duk_require_int(ctx, 1), y = duk_require_int(ctx, 2);
+
+    if (x < 0 || y < 0 || x >= PPU_MAP_SIZE || y >= PPU_MAP_SIZE) {
+        return duk_error(ctx, DUK_ERR_RANGE_ERROR, "map position out of range: %d, %d", x, y);
+    }
+    map[y * PPU_MAP_SIZE + x].tile = (Uint16)duk_require_uint(ctx, 3);
+    map[y * PPU_MAP_SIZE + x].attr = (Uint8)duk_opt_uint(ctx, 4, 0);
+    return 0;
+}
+
+/* ppu.loadMap(layer, tiles, attrs) fills a map row by row from arrays or typed arrays */
+static duk_ret_t native_ppu_load_map(duk_context *ctx)
+{
+    MapEntry *map = require_map(ctx, 0);
+    const bool has_attrs = duk_is_object(ctx, 2);
+    duk_size_t count, i;
+
+    duk_require_object(ctx, 1);
+    count = SDL_min(duk_get_length(ctx, 1), (duk_size_t)(PPU_MAP_SIZE * PPU_MAP_SIZE));
+    for (i = 0; i < count; i++) {
+        duk_get_prop_index(ctx, 1, (duk_uarridx_t)i);
+        map[i].tile = (Uint16)duk_to_uint(ctx, -1);
+        duk_pop(ctx);
+        if (has_attrs) {
+            duk_get_prop_index(ctx, 2, (duk_uarridx_t)i);
+            map[i].attr = (Uint8)duk_to_uint(ctx, -1);
+            duk_pop(ctx);
+        } else {
+            map[i].attr = 0;
+        }
+    }
+    return 0;
+}
+
+static duk_ret_t native_ppu_scroll(duk_context *ctx)
+{
+    scroll_x = duk_require_int(ctx, 0);
+    scroll_y = duk_require_int(ctx, 1);
+    return 0;
+}
+
+/* ppu.window(x, y) places the window's top left corner on screen */
+static duk_ret_t native_ppu_window(duk_context *ctx)
+{
+    window_x = duk_require_int(ctx, 0);
+    window_y = duk_require_int(ctx, 1);
+    return 0;
+}
+
+/* ppu.sprite(index, x, y, tile, attr); without a position the sprite is hidden */
+static duk_ret_t native_ppu_sprite(duk_context *ctx)
+{
+    const int index = duk_require_int(ctx, 0);
+    Sprite *s;
+
+    if (index < 0 || index >= PPU_MAX_SPRITES) {
+        return duk_error(ctx, DUK_ERR_RANGE_ERROR, "no such sprite: %d", index);
+    }
+    s = &oam[index];
+    if (duk_is_undefined(ctx, 1)) {
+        s->y = HIDDEN_Y;
+        return 0;
+    }
+    s->x = (Sint16)SDL_clamp(duk_require_int(ctx, 1), -8, INDEXED_MAX_SIZE);
+    s->y = (Sint16)SDL_clamp(duk_require_int(ctx, 2), -16, INDEXED_MAX_SIZE);
+    s->tile = (Uint16)duk_require_uint(ctx, 3);
+    s->attr = (Uint8)duk_opt_uint(ctx, 4, 0);
+    return 0;
+}
+
+/* ppu.spriteSize(8 or 16); tall sprites use an even tile and the one after it */
+static duk_ret_t native_ppu_sprite_size(duk_context *ctx)
+{
+    const int height = duk_require_int(ctx, 0);
+
+    if (height != 8 && height != 16) {
+        return duk_error(ctx, DUK_ERR_RANGE_ERROR, "sprites are 8 or 16 pixels tall");
+    }
+    sprite_height = height;
+    return 0;
+}
+
+/* ppu.layers(ppu.BG | ppu.WINDOW | ppu.SPRITES) */
+static duk_ret_t native_ppu_layers(duk_context *ctx)
+{
+    layers = duk_require_int(ctx, 0);
+    return 0;
+}
+
+/*
+ * ppu.scrollTable(table) takes an Int16Array of x, y pairs, one per line,
+ * that replace the scroll registers as each line is drawn; null removes it
+ */
+static duk_ret_t native_ppu_scroll_table(duk_context *ctx)
+{
+    if (!duk_is_null_or_undefined(ctx, 0) && !duk_is_buffer_data(ctx, 0)) {
+        return duk_error(ctx, DUK_ERR_TYPE_ERROR, "scroll table must be a typed array");
+    }
+    duk_push_heap_stash(ctx);
+    duk_dup(ctx, 0);
+    duk_put_prop_string(ctx, -2, "ppuScrollTable");
+    return 0;
+}
+
+/* ppu.onLine(fn) calls fn(line) before each line is drawn, to change registers mid frame */
+static duk_ret_t native_ppu_on_line(duk_context *ctx)
+{
+    if (!duk_is_null_or_undefined(ctx, 0)) {
+        duk_require_function(ctx, 0);
+    }
+    duk_push_heap_stash(ctx);
+    duk_dup(ctx, 0);
+    duk_put_prop_string(ctx, -2, "ppuLine");
+    return 0;
+}
+
+/* ppu.render() draws the whole frame into the indexed screen; indexed.present() shows it */
+static duk_ret_t native_ppu_render(duk_context *ctx)
+{
+    Uint8 *screen;
+    int width, height, w, h, y;
+    bool callback;
+
+    screen = indexed_get_screen(&width, &height);
+    if (!screen) {
+        return duk_error(ctx, DUK_ERR_ERROR, "Couldn't create the indexed screen: %s", SDL_GetError());
+    }
+    duk_push_heap_stash(ctx);
+    duk_get_prop_string(ctx, -1, "ppuScrollTable");
+    duk_get_prop_string(ctx, -2, "ppuLine");
+    callback = duk_is_function(ctx, -1);
+    /* [... stash table fn] */
+
+    for (y = 0; y < height; y++) {
+        table_scroll(ctx, -2, y, &scroll_x, &scroll_y);
+        if (callback) {
+            duk_dup(ctx, -1);
+            duk_push_int(ctx, y);
+            if (duk_pcall(ctx, 1) != 0) {
+                /* report it once and draw the rest of the frame without it */
+                fprintf(stderr, "Error in line callback: %s\n", duk_safe_to_string(ctx, -1));
+                callback = false;
+            }
+            duk_pop(ctx);
+            /* the callback may have replaced the screen */
+            screen = indexed_get_screen(&w, &h);
+            if (!screen || w != width || h != height) {
+                break;
+            }
+        }
+        compose_line(screen + (size_t)y * width, y, width);
+    }
+    duk_pop_3(ctx);
+    return 0;
+}
+
+static const duk_function_list_entry ppu_functions[] = {
+    { "tiles", native_ppu_tiles, 2 },
+    { "map", native_ppu_map, 5 },
+    { "loadMap", native_ppu_load_map, 3 },
+    { "scroll", native_ppu_scroll, 2 },
+    { "window", native_ppu_window, 2 },
+    { "sprite", native_ppu_sprite, 5 },
+    { "spriteSize", native_ppu_sprite_size, 1 },
+    { "layers", native_ppu_layers, 1 },
+    { "scrollTable", native_ppu_scroll_table, 1 },
+    { "onLine", native_ppu_on_line, 1 },
+    { "render", native_ppu_render, 0 },
+    { NULL, NULL, 0 }
+};
+
+static const duk_number_list_entry ppu_constants[] = {
+    { "BG", PPU_LAYER_BG },
+    { "WINDOW", PPU_LAYER_WINDOW },
+    { "SPRITES", PPU_LAYER_SPRITES },
+    { "FLIP_X", PPU_FLIP_X },
+    { "FLIP_Y", PPU_FLIP_Y },
+    { "PRIORITY", PPU_PRIORITY },
+    { NULL, 0.0 }
+};
+
+void ppu_bind(duk_context *ctx)
+{
+    int i;
+
+    for (i = 0; i < PPU_MAX_SPRITES; i++) {
+        oam[i].y = HIDDEN_Y;
+    }
+    /* the window starts off screen, as it does on the hardware */
+    window_x = INDEXED_MAX_SIZE;
+    window_y = INDEXED_MAX_SIZE;
+
+    duk_push_object(ctx);
+    duk_put_function_list(ctx, -1, ppu_functions);
+    duk_put_number_list(ctx, -1, ppu_constants);
+    duk_put_global_string(ctx, "ppu");
+}
@@ -0,0 +1,35 @@
+#ifndef PPU_H
+#define PPU_H
+
+#include <SDL3/SDL.h>
+#include "duktape/duktape.h"
+
+/* PPU config */
+#define PPU_MAP_SIZE         32 /* tiles a side; layers wrap around like the hardware's */
+#define PPU_MAX_SPRITES      40
+#define PPU_SPRITES_PER_LINE 10 /* later sprites on a busy line are dropped */
+
+/* layers, for ppu.layers() and the layer argument of ppu.map() */
+#define PPU_LAYER_BG      1
+#define PPU_LAYER_WINDOW  2
+#define PPU_LAYER_SPRITES 4
+
+/* map and sprite attributes; the low 3 bits pick one of 8 palettes */
+#define PPU_PALETTE  7
+#define PPU_FLIP_X   0x20
+#define PPU_FLIP_Y   0x40
+#define PPU_PRIORITY 0x80 /* a map tile is drawn over sprites, a sprite behind colours 1-3 */
+
+/*
+ * Game Boy style compositor over the indexed screen. A scrolling background,
+ * a window layer that is not scrolled, and 40 sprites of 8x8 or 8x16 from
+ * the indexed tile banks are composed a scanline at a time: each layer is
+ * fetched 8 pixels per tile row, and sprites are merged with their priority
+ * masks as 64 bit words, so no pixel branches on which layer it came from.
+ * Between lines the scroll can come from a register table or a script
+ * callback, for raster effects. Background palettes are 0-7 and sprite
+ * palettes 8-15 in the indexed palette's numbering.
+ */
+void ppu_bind(duk_context *ctx);
+
+#endif
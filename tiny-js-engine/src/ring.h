@@ -0,0 +1,73 @@
+#ifndef RING_H
+#define RING_H
+
+#include <SDL3/SDL.h>
+
+/*
+ * Single-producer/single-consumer ring of fixed-size elements. One thread
+ * may push and one other thread may pop without any locks; a full ring makes
+ * push fail instead of blocking. `capacity` must be a power of two.
+ */
+typedef struct
+{
+    Uint8 *slots;
+    Uint32 capacity;
+    Uint32 elem_size;
+    SDL_AtomicU32 head; /* only written by the producer */
+    SDL_AtomicU32 tail; /* only written by the consumer */
+} SpscRing;
+
+static inline void ring_init(SpscRing *r, void *slots, Uint32 capacity, Uint32 elem_size)
+{
+    r->slots = (Uint8 *)slots;
+    r->capacity = capacity;
+    r->elem_size = elem_size;
+    SDL_SetAtomicU32(&r->head, 0);
+    SDL_SetAtomicU32(&r->tail, 0);
+}
+
+static inline bool ring_push(SpscRing *r, const void *elem)
+{
+    Uint32 head = SDL_GetAtomicU32(&r->head);
+    Uint32 tail = SDL_GetAtomicU32(&r->tail);
+
+    if (head - tail == r->capacity) {
+        return false;
+    }
+    SDL_memcpy(r->slots + (size_t)(head & (r->capacity - 1)) * r->elem_size, elem, r->elem_size);
+    SDL_MemoryBarrierRelease();
+    SDL_SetAtomicU32(&r->head, head + 1);
+    return true;
+}
+
+/* returns the oldest element without consuming it, or NULL when empty */
+static inline const void *ring_peek(SpscRing *r)
+{
+    Uint32 tail = SDL_GetAtomicU32(&r->tail);
+    Uint32 head = SDL_GetAtomicU32(&r->head);
+
+    if (tail == head) {
+        return NULL;
+    }
+    SDL_MemoryBarrierAcquire();
+    return r->slots + (size_t)(tail & (r->capacity - 1)) * r->elem_size;
+}
+
+static inline void ring_consume(SpscRing *r)
+{
+    SDL_SetAtomicU32(&r->tail, SDL_GetAtomicU32(&r->tail) + 1);
+}
+
+static inline bool ring_pop(SpscRing *r, void *elem)
+{
+    const void *slot = ring_peek(r);
+
+    if (!slot) {
+        return false;
+    }
+    SDL_memcpy(elem, slot, r->elem_size);
+    ring_consume(r);
+    return true;
+}
+
+#endif
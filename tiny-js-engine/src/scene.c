@@ -0,0 +1,346 @@
+#include "scene.h"
+#include "gfx.h"
+
+#define CELL_SIZE ((float)(1 << SCENE_CELL_SHIFT))
+#define ID_BITS   16 /* SCENE_MAX_SPRITES ids in the low bits of a sort key */
+
+typedef struct
+{
+    float x, y;
+    float w, h; /* drawn size */
+    float scale_x, scale_y;
+    Sint32 region; /* -1 while the slot is free */
+    Uint32 layer, texture;
+    Uint32 bucket;
+    Sint32 prev, next; /* in the bucket, or the free list */
+} SceneSprite;
+
+static SceneSprite *sprites;
+static Uint32 sprite_capacity, sprite_top; /* slots ever handed out */
+static Sint32 free_slots = -1;
+
+static Sint32 buckets[SCENE_BUCKETS];
+static Uint32 visited[SCENE_BUCKETS], query_stamp;
+static float reach_w, reach_h; /* the largest sprite so far: how far one reaches out of its cell */
+static float camera_x, camera_y;
+
+/* draw list: (layer, bottom, texture, id) keys, and the other half for the sort to scatter into */
+static Uint64 *sort_block, *keys, *scratch;
+
+static int cell_of(float v)
+{
+    return (int)SDL_floorf(v / CELL_SIZE);
+}
+
+static Uint32 bucket_of(int cx, int cy)
+{
+    return ((Uint32)cx * 73856093u ^ (Uint32)cy * 19349663u) & (SCENE_BUCKETS - 1);
+}
+
+static void unlink_sprite(Sint32 id)
+{
+    SceneSprite *s = &sprites[id];
+
+    if (s->prev >= 0) {
+        sprites[s->prev].next = s->next;
+    } else {
+        buckets[s->bucket] = s->next;
+    }
+    if (s->next >= 0) {
+        sprites[s->next].prev = s->prev;
+    }
+}
+
+static void link_sprite(Sint32 id)
+{
+    SceneSprite *s = &sprites[id];
+
+    s->bucket = bucket_of(cell_of(s->x), cell_of(s->y));
+    s->prev = -1;
+    s->next = buckets[s->bucket];
+    if (s->next >= 0) {
+        sprites[s->next].prev = id;
+    }
+    buckets[s->bucket] = id;
+}
+
+static bool set_region(SceneSprite *s, Sint32 region)
+{
+    float w, h;
+    int texture;
+
+    if (!gfx_region_info(region, &w, &h, &texture)) {
+        return false;
+    }
+    s->region = region;
+    s->texture = (Uint32)texture;
+    s->w = w * SDL_fabsf(s->scale_x);
+    s->h = h * SDL_fabsf(s->scale_y);
+    reach_w = SDL_max(reach_w, s->w);
+    reach_h = SDL_max(reach_h, s->h);
+    return true;
+}
+
+static bool grow(void)
+{
+    const Uint32 capacity = sprite_capacity ? sprite_capacity * 2 : 256;
+    SceneSprite *more;
+    Uint64 *block;
+
+    if (sprite_capacity >= SCENE_MAX_SPRITES) {
+        return SDL_SetError("more than %d sprites", SCENE_MAX_SPRITES);
+    }
+    more = (SceneSprite *)SDL_realloc(sprites, capacity * sizeof(SceneSprite));
+    if (!more) {
+        return false;
+    }
+    sprites = more;
+    block = (Uint64 *)SDL_realloc(sort_block, capacity * 2 * sizeof(Uint64));
+    if (!block) {
+        return false;
+    }
+    sort_block = block;
+    keys = block;
+    scratch = block + capacity;
+    sprite_capacity = capacity;
+    return true;
+}
+
+/*
+ * LSD radix sort of keys[0..count), 12 bits at a time over the 48 bit keys.
+ * Digits that are the same in every key are skipped, so a scene on one layer
+ * in a view under 4096 pixels high takes three passes.
+ */
+static void sort_keys(Uint32 count)
+{
+    static Uint32 counts[4][4096];
+    Uint64 *swap;
+    Uint32 i, sum, n;
+    int pass, shift;
+
+    SDL_memset(counts, 0, sizeof(counts));
+    for (i = 0; i < count; i++) {
+        const Uint64 k = keys[i];
+        counts[0][k & 0xfff]++;
+        counts[1][(k >> 12) & 0xfff]++;
+        counts[2][(k >> 24) & 0xfff]++;
+        counts[3][(k >> 36) & 0xfff]++;
+    }
+    for (pass = 0; pass < 4; pass++) {
+        shift = pass * 12;
+        if (counts[pass][(keys[0] >> shift) & 0xfff] == count) {
+            continue;
+        }
+        for (i = 0, sum = 0; i < 4096; i++) {
+            n = counts[pass][i];
+            counts[pass][i] = sum;
+            sum += n;
+        }
+        for (i = 0; i < count; i++) {
+            scratch[counts[pass][(keys[i] >> shift) & 0xfff]++] = keys[i];
+        }
+        swap = keys;
+        keys = scratch;
+        scratch = swap;
+    }
+}
+
+/* adds the sprites in a bucket that overlap the view to the draw list */
+static Uint32 collect(Uint32 bucket, float x0, float y0, float x1, float y1, Uint32 count)
+{
+    const SceneSprite *s;
+    Sint32 id;
+    Uint32 bottom;
+
+    for (id = buckets[bucket]; id >= 0; id = s->next) {
+        s = &sprites[id];
+        if (s->x < x1 && s->x + s->w > x0 && s->y < y1 && s->y + s->h > y0) {
+            bottom = (Uint32)SDL_min(s->y + s->h - y0, 65535.0f);
+            keys[count++] = ((Uint64)(s->layer << 24 | bottom << 8 | (s->texture & 0xff)) << ID_BITS) | (Uint64)id;
+        }
+    }
+    return count;
+}
+
+static Uint32 draw_sprites(void)
+{
+    int view_w, view_h, cx, cy, cx0, cy0, cx1, cy1;
+    float x0, y0, x1, y1;
+    const SceneSprite *s;
+    Uint32 i, b, count = 0;
+
+    if (!sprite_top) {
+        return 0;
+    }
+    gfx_output_size(&view_w, &view_h);
+    x0 = camera_x;
+    y0 = camera_y;
+    x1 = x0 + (float)view_w;
+    y1 = y0 + (float)view_h;
+
+    /* sprites are filed by their top left corner, so look as far up and left as the largest reaches */
+    cx0 = cell_of(x0 - reach_w);
+    cy0 = cell_of(y0 - reach_h);
+    cx1 = cell_of(x1);
+    cy1 = cell_of(y1);
+    if ((Sint64)(cx1 - cx0 + 1) * (cy1 - cy0 + 1) >= SCENE_BUCKETS) {
+        for (b = 0; b < SCENE_BUCKETS; b++) {
+            count = collect(b, x0, y0, x1, y1, count);
+        }
+    } else {
+        /* cells far apart can share a bucket, only read each one once */
+        if (++query_stamp == 0) {
+            SDL_memset(visited, 0, sizeof(visited));
+            query_stamp = 1;
+        }
+        for (cy = cy0; cy <= cy1; cy++) {
+            for (cx = cx0; cx <= cx1; cx++) {
+                b = bucket_of(cx, cy);
+                if (visited[b] != query_stamp) {
+                    visited[b] = query_stamp;
+                    count = collect(b, x0, y0, x1, y1, count);
+                }
+            }
+        }
+    }
+    if (count > 1) {
+        sort_keys(count);
+    }
+
+    for (i = 0; i < count; i++) {
+        s = &sprites[keys[i] & ((1u << ID_BITS) - 1)];
+        gfx_draw_region(s->region, s->x - camera_x, s->y - camera_y, s->scale_x, s->scale_y);
+    }
+    return count;
+}
+
+static void clear_sprites(void)
+{
+    SDL_memset(buckets, 0xff, sizeof(buckets));
+    sprite_top = 0;
+    free_slots = -1;
+    reach_w = reach_h = 0.0f;
+}
+
+static SceneSprite *require_sprite(duk_context *ctx, duk_idx_t idx)
+{
+    const Sint32 id = duk_require_int(ctx, idx);
+
+    if (id < 0 || (Uint32)id >= sprite_top || sprites[id].region < 0) {
+        (void)duk_error(ctx, DUK_ERR_RANGE_ERROR, "no such sprite: %d", (int)id);
+    }
+    return &sprites[id];
+}
+
+/* javascript bridge logic */
+
+/* gfx.camera(x, y) sets the world position drawn at the top left of the screen */
+static duk_ret_t native_gfx_camera(duk_context *ctx)
+{
+    camera_x = (float)duk_opt_number(ctx, 0, 0.0);
+    camera_y = (float)duk_opt_number(ctx, 1, 0.0);
+    return 0;
+}
+
+/* gfx.addSprite(region, x, y, layer, scaleX, scaleY) returns an id; layers 0-255 draw back to front */
+static duk_ret_t native_gfx_add_sprite(duk_context *ctx)
+{
+    const Sint32 region = duk_require_int(ctx, 0);
+    SceneSprite *s;
+    Sint32 id;
+
+    if (free_slots < 0 && sprite_top == sprite_capacity && !grow()) {
+        return duk_error(ctx, DUK_ERR_RANGE_ERROR, "Couldn't add sprite: %s", SDL_GetError());
+    }
+    id = free_slots >= 0 ? free_slots : (Sint32)sprite_top;
+    s = &sprites[id];
+    s->x = (float)duk_require_number(ctx, 1);
+    s->y = (float)duk_require_number(ctx, 2);
+    s->layer = (Uint32)SDL_clamp(duk_opt_int(ctx, 3, 0), 0, 255);
+    s->scale_x = (float)duk_opt_number(ctx, 4, 1.0);
+    s->scale_y = (float)duk_opt_number(ctx, 5, s->scale_x);
+    if (!set_region(s, region)) {
+        return duk_error(ctx, DUK_ERR_RANGE_ERROR, "no such region: %d", (int)region);
+    }
+    if (id == free_slots) {
+        free_slots = s->next;
+    } else {
+        sprite_top++;
+    }
+    link_sprite(id);
+    duk_push_int(ctx, id);
+    return 1;
+}
+
+/* gfx.moveSprite(id, x, y, region) moves a sprite, and changes its region if one is given */
+static duk_ret_t native_gfx_move_sprite(duk_context *ctx)
+{
+    SceneSprite *s = require_sprite(ctx, 0);
+    const Sint32 id = (Sint32)(s - sprites);
+    const float x = (float)duk_require_number(ctx, 1), y = (float)duk_require_number(ctx, 2);
+
+    if (!duk_is_undefined(ctx, 3) && !set_region(s, duk_require_int(ctx, 3))) {
+        return duk_error(ctx, DUK_ERR_RANGE_ERROR, "no such region: %s", duk_safe_to_string(ctx, 3));
+    }
+    s->x = x;
+    s->y = y;
+    if (bucket_of(cell_of(x), cell_of(y)) != s->bucket) {
+        unlink_sprite(id);
+        link_sprite(id);
+    }
+    return 0;
+}
+
+static duk_ret_t native_gfx_remove_sprite(duk_context *ctx)
+{
+    SceneSprite *s = require_sprite(ctx, 0);
+    const Sint32 id = (Sint32)(s - sprites);
+
+    unlink_sprite(id);
+    s->region = -1;
+    s->next = free_slots;
+    free_slots = id;
+    return 0;
+}
+
+static duk_ret_t native_gfx_clear_sprites(duk_context *ctx)
+{
+    (void)ctx;
+    clear_sprites();
+    return 0;
+}
+
+/* gfx.drawSprites() draws the sprites in view in order and returns how many there were */
+static duk_ret_t native_gfx_draw_sprites(duk_context *ctx)
+{
+    duk_push_uint(ctx, draw_sprites());
+    return 1;
+}
+
+static const duk_function_list_entry scene_functions[] = {
+    { "camera", native_gfx_camera, 2 },
+    { "addSprite", native_gfx_add_sprite, 6 },
+    { "moveSprite", native_gfx_move_sprite, 4 },
+    { "removeSprite", native_gfx_remove_sprite, 1 },
+    { "clearSprites", native_gfx_clear_sprites, 0 },
+    { "drawSprites", native_gfx_draw_sprites, 0 },
+    { NULL, NULL, 0 }
+};
+
+void scene_bind(duk_context *ctx)
+{
+    clear_sprites();
+    duk_get_global_string(ctx, "gfx");
+    duk_put_function_list(ctx, -1, scene_functions);
+    duk_pop(ctx);
+}
+
+void scene_quit(void)
+{
+    SDL_free(sprites);
+    SDL_free(sort_block);
+    sprites = NULL;
+    sort_block = keys = scratch = NULL;
+    sprite_capacity = 0;
+    clear_sprites();
+}
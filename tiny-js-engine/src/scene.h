@@ -0,0 +1,23 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <SDL3/SDL.h>
+#include "duktape/duktape.h"
+
+/* scene config */
+#define SCENE_MAX_SPRITES 65536
+#define SCENE_CELL_SHIFT  7    /* 128 pixel grid cells */
+#define SCENE_BUCKETS     4096 /* power of two */
+
+/*
+ * Retained sprites in world coordinates. gfx.addSprite() files each sprite
+ * in a spatial hash of grid cells, so gfx.drawSprites() only looks at the
+ * cells under the gfx.camera() rect. The sprites it finds on screen are
+ * ordered by layer, then by their bottom edge, then by texture, with a
+ * radix sort on one packed 32 bit key, which keeps overlapping sprites
+ * in depth order and same-texture runs together for batching.
+ */
+void scene_bind(duk_context *ctx); /* adds to the gfx object, bind after gfx */
+void scene_quit(void);
+
+#endif
@@ -0,0 +1,310 @@
+#include "sight.h"
+#include "board.h"
+
+#define DEFAULT_OPAQUE 0xfffffffeu /* everything but 0 */
+
+typedef struct
+{
+    const Uint8 *cells;
+    size_t size;         /* bytes */
+    const Uint64 *words; /* instead of cells, for a board */
+    int lanes, stride;
+    int width, height;
+    int bits;
+    Uint32 opaque;
+} SightGrid;
+
+typedef struct
+{
+    const SightGrid *grid;
+    Uint8 *visible;
+    int x, y, radius;
+    int xx, xy, yx, yy; /* maps octant rows and columns to the grid */
+} Octant;
+
+static Uint32 cell_value(const SightGrid *g, int x, int y)
+{
+    const Uint32 i = (Uint32)(y * g->width + x);
+    size_t bit;
+    Uint32 v;
+
+    if (g->words) {
+        return (Uint32)(g->words[y * g->stride + x / g->lanes] >> (x % g->lanes * g->bits)) & ((1u << g->bits) - 1);
+    }
+    if (g->bits == 8) {
+        return g->cells[i];
+    }
+    bit = (size_t)i * (size_t)g->bits;
+    v = g->cells[bit >> 3];
+    if ((bit >> 3) + 1 < g->size) {
+        v |= (Uint32)g->cells[(bit >> 3) + 1] << 8;
+    }
+    return (v >> (bit & 7)) & ((1u << g->bits) - 1);
+}
+
+/* off the grid counts as a wall */
+static bool blocks(const SightGrid *g, int x, int y)
+{
+    Uint32 v;
+
+    if ((unsigned)x >= (unsigned)g->width || (unsigned)y >= (unsigned)g->height) {
+        return true;
+    }
+    v = cell_value(g, x, y);
+    return v >= 32 || ((g->opaque >> v) & 1) != 0;
+}
+
+static void mark(Uint8 *visible, const SightGrid *g, int x, int y)
+{
+    const Uint32 i = (Uint32)(y * g->width + x);
+
+    visible[i >> 3] |= (Uint8)(1u << (i & 7));
+}
+
+/*
+ * Lights one octant from row `row` outwards between slopes `start` and `end`
+ * (1 is the diagonal, 0 straight ahead). A run of walls in a row leaves the
+ * slopes before it to a recursive call and carries on past it.
+ */
+static void cast_light(const Octant *o, int row, float start, float end)
+{
+    const SightGrid *g = o->grid;
+    const int radius2 = o->radius * o->radius;
+    float next_start = start, left, right;
+    bool blocked = false;
+    int j, dx, dy, x, y;
+
+    if (start < end) {
+        return;
+    }
+    for (j = row; j <= o->radius && !blocked; j++) {
+        dy = -j;
+        /* start at the first column the slopes let through, not the edge of the row */
+        for (dx = SDL_max(-j, (int)SDL_floorf(-start * ((float)j + 0.5f) - 0.5f)); dx <= 0; dx++) {
+            left = ((float)dx - 0.5f) / ((float)dy + 0.5f);
+            right = ((float)dx + 0.5f) / ((float)dy - 0.5f);
+            if (start < right) {
+                continue;
+            }
+            if (end > left) {
+                break;
+            }
+            x = o->x + dx * o->xx + dy * o->xy;
+            y = o->y + dx * o->yx + dy * o->yy;
+            if ((unsigned)x < (unsigned)g->width && (unsigned)y < (unsigned)g->height && dx * dx + dy * dy <= radius2) {
+                mark(o->visible, g, x, y);
+            }
+            if (blocked) {
+                if (blocks(g, x, y)) {
+                    next_start = right;
+                } else {
+                    blocked = false;
+                    start = next_start;
+                }
+            } else if (blocks(g, x, y) && j < o->radius) {
+                blocked = true;
+                cast_light(o, j + 1, start, left);
+                next_start = right;
+            }
+        }
+    }
+}
+
+static void field_of_view(const SightGrid *g, int x, int y, int radius, Uint8 *visible)
+{
+    static const int transforms[8][4] = {
+        { 1, 0, 0, 1 }, { 0, 1, 1, 0 }, { 0, -1, 1, 0 }, { -1, 0, 0, 1 },
+        { -1, 0, 0, -1 }, { 0, -1, -1, 0 }, { 0, 1, -1, 0 }, { 1, 0, 0, -1 }
+    };
+    Octant o;
+    int i;
+
+    if ((unsigned)x >= (unsigned)g->width || (unsigned)y >= (unsigned)g->height) {
+        return;
+    }
+    mark(visible, g, x, y);
+    o.grid = g;
+    o.visible = visible;
+    o.x = x;
+    o.y = y;
+    o.radius = radius;
+    for (i = 0; i < 8; i++) {
+        o.xx = transforms[i][0];
+        o.xy = transforms[i][1];
+        o.yx = transforms[i][2];
+        o.yy = transforms[i][3];
+        cast_light(&o, 1, 1.0f, 0.0f);
+    }
+}
+
+/*
+ * Walks the cells between the centres of two cells, in integers: a step
+ * goes across or down by whichever boundary the line meets first. The end
+ * cell itself can be a wall, so walls are visible. A line through a corner
+ * exactly is only stopped if both cells beside it block.
+ */
+static bool line_of_sight(const SightGrid *g, int x0, int y0, int x1, int y1)
+{
+    const int nx = SDL_abs(x1 - x0), ny = SDL_abs(y1 - y0);
+    const int sx = x1 > x0 ? 1 : -1, sy = y1 > y0 ? 1 : -1;
+    int ix = 0, iy = 0, x = x0, y = y0;
+    Sint64 across, down;
+
+    if ((unsigned)x0 >= (unsigned)g->width || (unsigned)y0 >= (unsigned)g->height) {
+        return false;
+    }
+    while (ix < nx || iy < ny) {
+        across = (Sint64)(1 + 2 * ix) * ny;
+        down = (Sint64)(1 + 2 * iy) * nx;
+        if (across == down) {
+            if (blocks(g, x + sx, y) && blocks(g, x, y + sy)) {
+                return false;
+            }
+            x += sx;
+            y += sy;
+            ix++;
+            iy++;
+        } else if (across < down) {
+            x += sx;
+            ix++;
+        } else {
+            y += sy;
+            iy++;
+        }
+        if (x == x1 && y == y1) {
+            break;
+        }
+        if (blocks(g, x, y)) {
+            return false;
+        }
+    }
+    return (unsigned)x1 < (unsigned)g->width && (unsigned)y1 < (unsigned)g->height;
+}
+
+static void require_grid(duk_context *ctx, duk_idx_t idx, int width, duk_uint_t flags, Uint32 opaque, SightGrid *g)
+{
+    BoardCells board;
+    duk_size_t size;
+    size_t cells;
+
+    g->opaque = opaque;
+    g->words = NULL;
+    if (board_cells(ctx, idx, &board)) {
+        /* read in place, in the board's own layout */
+        g->words = board.words;
+        g->lanes = (int)board.lanes;
+        g->stride = (int)board.stride;
+        g->width = (int)board.width;
+        g->height = (int)board.height;
+        g->bits = (int)board.bits;
+        return;
+    }
+    g->cells = (const Uint8 *)duk_require_buffer_data(ctx, idx, &size);
+    g->size = size;
+    g->bits = (flags & SIGHT_BITS_MASK) ? (int)(flags & SIGHT_BITS_MASK) : 8;
+    if (g->bits > 8) {
+        (void)duk_error(ctx, DUK_ERR_RANGE_ERROR, "cells must be 1-8 bits");
+    }
+    cells = size * 8 / (size_t)g->bits;
+    if (width < 1 || width > SIGHT_MAX_SIDE || cells < (size_t)width || cells / (size_t)width > SIGHT_MAX_SIDE) {
+        (void)duk_error(ctx, DUK_ERR_RANGE_ERROR, "grid must be width x height cells, 1-%d a side", SIGHT_MAX_SIDE);
+    }
+    g->width = width;
+    g->height = (int)(cells / (size_t)width);
+}
+
+/* javascript bridge logic */
+
+/*
+ * sight.fov(grid, width, x, y, radius, visible, flags, opaque) sets the bit
+ * of every cell seen from x, y within radius in the bitset `visible`, bit
+ * y * width + x counting from the low bit of its first byte, after clearing
+ * it unless flags has sight.KEEP. Walls in view are seen too.
+ */
+static duk_ret_t native_sight_fov(duk_context *ctx)
+{
+    const int width = duk_opt_int(ctx, 1, 0);
+    const int x = duk_require_int(ctx, 2), y = duk_require_int(ctx, 3);
+    const int radius = duk_require_int(ctx, 4);
+    const duk_uint_t flags = duk_opt_uint(ctx, 6, 0);
+    duk_size_t size, needed;
+    Uint8 *visible;
+    SightGrid g;
+
+    require_grid(ctx, 0, width, flags, duk_opt_uint(ctx, 7, DEFAULT_OPAQUE), &g);
+    if (radius < 0 || radius > SIGHT_MAX_RADIUS) {
+        return duk_error(ctx, DUK_ERR_RANGE_ERROR, "radius must be 0-%d", SIGHT_MAX_RADIUS);
+    }
+    visible = (Uint8 *)duk_require_buffer_data(ctx, 5, &size);
+    needed = ((duk_size_t)g.width * (duk_size_t)g.height + 7) / 8;
+    if (size < needed) {
+        return duk_error(ctx, DUK_ERR_RANGE_ERROR, "visible must be at least %d bytes", (int)needed);
+    }
+    if (!(flags & SIGHT_KEEP)) {
+        SDL_memset(visible, 0, needed);
+    }
+    field_of_view(&g, x, y, radius, visible);
+    return 0;
+}
+
+/* sight.lineOfSight(grid, width, x0, y0, x1, y1, flags, opaque) is true if nothing blocks the way */
+static duk_ret_t native_sight_line_of_sight(duk_context *ctx)
+{
+    const int width = duk_opt_int(ctx, 1, 0);
+    const int x0 = duk_require_int(ctx, 2), y0 = duk_require_int(ctx, 3);
+    const int x1 = duk_require_int(ctx, 4), y1 = duk_require_int(ctx, 5);
+    SightGrid g;
+
+    require_grid(ctx, 0, width, duk_opt_uint(ctx, 6, 0), duk_opt_uint(ctx, 7, DEFAULT_OPAQUE), &g);
+    duk_push_boolean(ctx, line_of_sight(&g, x0, y0, x1, y1));
+    return 1;
+}
+
+/*
+ * sight.castAll(grid, width, lines, results, flags, opaque) checks every
+ * x0, y0, x1, y1 set in the Int16Array `lines`, writes 1 or 0 for each into
+ * the Uint8Array `results` and returns how many were clear.
+ */
+static duk_ret_t native_sight_cast_all(duk_context *ctx)
+{
+    const int width = duk_opt_int(ctx, 1, 0);
+    const Sint16 *lines;
+    duk_size_t size, results_size, i, count;
+    Uint8 *results;
+    Uint32 clear = 0;
+    SightGrid g;
+
+    require_grid(ctx, 0, width, duk_opt_uint(ctx, 4, 0), duk_opt_uint(ctx, 5, DEFAULT_OPAQUE), &g);
+    lines = (const Sint16 *)duk_require_buffer_data(ctx, 2, &size);
+    results = (Uint8 *)duk_require_buffer_data(ctx, 3, &results_size);
+    count = size / (4 * sizeof(Sint16));
+    if (count > SIGHT_MAX_BATCH || results_size < count) {
+        return duk_error(ctx, DUK_ERR_RANGE_ERROR, "up to %d lines, with a result byte each", SIGHT_MAX_BATCH);
+    }
+    for (i = 0; i < count; i++) {
+        results[i] = line_of_sight(&g, lines[i * 4], lines[i * 4 + 1], lines[i * 4 + 2], lines[i * 4 + 3]);
+        clear += results[i];
+    }
+    duk_push_uint(ctx, clear);
+    return 1;
+}
+
+static const duk_function_list_entry sight_functions[] = {
+    { "fov", native_sight_fov, 8 },
+    { "lineOfSight", native_sight_line_of_sight, 8 },
+    { "castAll", native_sight_cast_all, 6 },
+    { NULL, NULL, 0 }
+};
+
+static const duk_number_list_entry sight_constants[] = {
+    { "KEEP", SIGHT_KEEP },
+    { NULL, 0.0 }
+};
+
+void sight_bind(duk_context *ctx)
+{
+    duk_push_object(ctx);
+    duk_put_function_list(ctx, -1, sight_functions);
+    duk_put_number_list(ctx, -1, sight_constants);
+    duk_put_global_string(ctx, "sight");
+}
@@ -0,0 +1,31 @@
+#ifndef SIGHT_H
+#define SIGHT_H
+
+#include <SDL3/SDL.h>
+#include "duktape/duktape.h"
+
+/* sight config */
+#define SIGHT_MAX_SIDE   4096 /* cells a side */
+#define SIGHT_MAX_RADIUS 1024
+#define SIGHT_MAX_BATCH  65536 /* lines per sight.castAll() */
+
+/* flags: the low 4 bits are the bits per cell, 1-8, or 0 for one byte each */
+#define SIGHT_BITS_MASK 0x0f
+#define SIGHT_KEEP      0x10 /* add to what's in the visibility bitset instead of clearing it */
+
+/*
+ * Line of sight and field of view over a grid kept by script: one byte per
+ * cell like path's, cells packed a few bits each, low bits first, like the
+ * 3 bit cells of the snake board, or a board, read in place in its own word
+ * layout. Which cell values block sight is a mask over values 0-31; higher
+ * values always block.
+ *
+ * sight.fov() is recursive shadowcasting: each octant is swept row by row
+ * outwards, and a wall only narrows the slopes the rest of it looks at, so
+ * every cell in range is read about once. The result is a bitset, one bit
+ * per cell, for script to read or to OR into an explored map for fog of war.
+ * sight.lineOfSight() and sight.castAll() walk single lines with integer DDA.
+ */
+void sight_bind(duk_context *ctx);
+
+#endif
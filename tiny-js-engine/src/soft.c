@@ -0,0 +1,352 @@
+#include "soft.h"
+
+#define SOFT_TEXTURE_PROP "tjs.soft.texture"
+#define SOFT_SPAN         64 /* texels gathered per blend call */
+
+typedef struct
+{
+    int w, h;
+    Uint32 pixels[]; /* RGBA32 */
+} SoftTexture;
+
+static SDL_Renderer *renderer;
+static SDL_Texture *screen; /* streaming, the framebuffer goes here once a frame */
+static Uint32 *framebuffer;
+static int fb_w, fb_h;
+
+static void free_texture(void *userdata, void *value)
+{
+    SDL_free(value);
+}
+
+static SoftTexture *get_texture(SDL_Texture *texture)
+{
+    return (SoftTexture *)SDL_GetPointerProperty(SDL_GetTextureProperties(texture), SOFT_TEXTURE_PROP, NULL);
+}
+
+bool soft_init(SDL_Renderer *r)
+{
+    const char *force = SDL_getenv("TJS_SOFTWARE");
+    const char *name = SDL_GetRendererName(r);
+    int w, h;
+
+    if (force ? SDL_atoi(force) == 0 : !name || SDL_strcmp(name, SDL_SOFTWARE_RENDERER) != 0) {
+        return false;
+    }
+    renderer = r;
+    if (!SDL_GetCurrentRenderOutputSize(r, &w, &h) || !soft_resize(w, h)) {
+        SDL_Log("Couldn't start the software rasterizer: %s", SDL_GetError());
+        renderer = NULL;
+        return false;
+    }
+    return true;
+}
+
+bool soft_resize(int width, int height)
+{
+    Uint32 *pixels;
+    SDL_Texture *texture;
+
+    if (framebuffer && width == fb_w && height == fb_h) {
+        return true;
+    }
+    /* the old framebuffer stays in use if there is no room for the new one */
+    pixels = (Uint32 *)SDL_calloc((size_t)width * height, sizeof(Uint32));
+    texture = pixels ? SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STREAMING, width, height) : NULL;
+    if (!texture) {
+        SDL_free(pixels);
+        return false;
+    }
+    SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_NONE);
+    SDL_SetTextureScaleMode(texture, SDL_SCALEMODE_NEAREST);
+    if (screen) {
+        SDL_DestroyTexture(screen);
+    }
+    SDL_free(framebuffer);
+    screen = texture;
+    framebuffer = pixels;
+    fb_w = width;
+    fb_h = height;
+    return true;
+}
+
+void soft_quit(void)
+{
+    if (screen) {
+        SDL_DestroyTexture(screen);
+        screen = NULL;
+    }
+    SDL_free(framebuffer);
+    framebuffer = NULL;
+    renderer = NULL;
+}
+
+SDL_Texture *soft_create_texture(int width, int height, Uint8 **pixels)
+{
+    SoftTexture *st = (SoftTexture *)SDL_malloc(sizeof(SoftTexture) + (size_t)width * height * 4);
+    SDL_Texture *texture;
+
+    if (!st) {
+        return NULL;
+    }
+    texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STATIC, 1, 1);
+    if (!texture) {
+        SDL_free(st);
+        return NULL;
+    }
+    st->w = width;
+    st->h = height;
+    /* the pixels go away with the texture; on failure SDL has already freed them */
+    if (!SDL_SetPointerPropertyWithCleanup(SDL_GetTextureProperties(texture), SOFT_TEXTURE_PROP, st, free_texture, NULL)) {
+        SDL_DestroyTexture(texture);
+        return NULL;
+    }
+    *pixels = (Uint8 *)st->pixels;
+    return texture;
+}
+
+bool soft_update_texture(SDL_Texture *texture, const SDL_Rect *rect, const Uint8 *pixels, int pitch)
+{
+    SoftTexture *st = get_texture(texture);
+    SDL_Rect full;
+    int y;
+
+    if (!st) {
+        return SDL_SetError("not a software texture");
+    }
+    if (!rect) {
+        full.x = full.y = 0;
+        full.w = st->w;
+        full.h = st->h;
+        rect = &full;
+    }
+    if (rect->x < 0 || rect->y < 0 || rect->w < 0 || rect->h < 0 || rect->x + rect->w > st->w || rect->y + rect->h > st->h) {
+        return SDL_SetError("rect outside the texture");
+    }
+    for (y = 0; y < rect->h; y++) {
+        SDL_memcpy(&st->pixels[(size_t)(rect->y + y) * st->w + rect->x], pixels + (size_t)y * pitch, (size_t)rect->w * 4);
+    }
+    return true;
+}
+
+void soft_clear(Uint8 r, Uint8 g, Uint8 b)
+{
+    const Uint8 rgba[4] = { r, g, b, 255 };
+    Uint32 color;
+
+    SDL_memcpy(&color, rgba, 4);
+    SDL_memset4(framebuffer, color, (size_t)fb_w * fb_h);
+}
+
+SDL_Texture *soft_frame(const Uint32 **pixels)
+{
+    *pixels = framebuffer;
+    return SDL_UpdateTexture(screen, NULL, framebuffer, fb_w * 4) ? screen : NULL;
+}
+
+bool soft_present(void)
+{
+    const Uint32 *pixels;
+    SDL_Texture *frame = soft_frame(&pixels);
+
+    return frame && SDL_RenderTexture(renderer, frame, NULL, NULL);
+}
+
+
+/* blending */
+
+/*
+ * dst = src * a + dst * (1 - a) per channel, after multiplying src by the
+ * tint, which is in 0-256 so that 256 leaves it unchanged. x / 255 is done as
+ * (x + 128 + ((x + 128) >> 8)) >> 8, exact for the products of two bytes, by
+ * every kernel so they all give the same result. The framebuffer is opaque.
+ */
+#if defined(SDL_SSE2_INTRINSICS)
+/* two pixels, one channel per 16 bit lane */
+static __m128i blend_sse2(__m128i s, __m128i d, __m128i tint)
+{
+    __m128i a, x;
+
+    s = _mm_srli_epi16(_mm_mullo_epi16(s, tint), 8);
+    a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+    x = _mm_add_epi16(_mm_mullo_epi16(s, a), _mm_mullo_epi16(d, _mm_sub_epi16(_mm_set1_epi16(255), a)));
+    x = _mm_add_epi16(x, _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+}
+#endif
+
+static void blend_span(Uint32 *dst, const Uint32 *src, int n, const Uint16 *tint)
+{
+    int i = 0;
+
+#if defined(SDL_SSE2_INTRINSICS)
+    const __m128i zero = _mm_setzero_si128(), opaque = _mm_set1_epi32((int)0xFF000000);
+    const __m128i t = _mm_setr_epi16((short)tint[0], (short)tint[1], (short)tint[2], (short)tint[3],
+                                     (short)tint[0], (short)tint[1], (short)tint[2], (short)tint[3]);
+
+    for (; i + 4 <= n; i += 4) {
+        const __m128i s = _mm_loadu_si128((const __m128i *)(src + i));
+        const __m128i d = _mm_loadu_si128((const __m128i *)(dst + i));
+        const __m128i lo = blend_sse2(_mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(d, zero), t);
+        const __m128i hi = blend_sse2(_mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(d, zero), t);
+
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_or_si128(_mm_packus_epi16(lo, hi), opaque));
+    }
+#elif defined(SDL_NEON_INTRINSICS)
+    /* eight pixels, deinterleaved into one register per channel */
+    for (; i + 8 <= n; i += 8) {
+        const uint8x8x4_t s = vld4_u8((const uint8_t *)(src + i));
+        uint8x8x4_t d = vld4_u8((const uint8_t *)(dst + i));
+        const uint8x8_t a = vshrn_n_u16(vmulq_n_u16(vmovl_u8(s.val[3]), tint[3]), 8);
+        const uint8x8_t inv = vmvn_u8(a);
+        int c;
+
+        for (c = 0; c < 3; c++) {
+            const uint8x8_t sc = vshrn_n_u16(vmulq_n_u16(vmovl_u8(s.val[c]), tint[c]), 8);
+            const uint16x8_t x = vmlal_u8(vmull_u8(sc, a), d.val[c], inv);
+            d.val[c] = vraddhn_u16(x, vrshrq_n_u16(x, 8));
+        }
+        d.val[3] = vdup_n_u8(255);
+        vst4_u8((uint8_t *)(dst + i), d);
+    }
+#endif
+
+    for (; i < n; i++) {
+        const Uint8 *s = (const Uint8 *)&src[i];
+        Uint8 *d = (Uint8 *)&dst[i];
+        const Uint32 a = (s[3] * tint[3]) >> 8;
+        int c;
+
+        for (c = 0; c < 3; c++) {
+            const Uint32 x = ((s[c] * tint[c]) >> 8) * a + d[c] * (255 - a) + 128;
+            d[c] = (Uint8)((x + (x >> 8)) >> 8);
+        }
+        d[3] = 255;
+    }
+}
+
+
+/* rasterizing */
+
+/* narrows [*lo, *hi) to where 0 <= c0 + dc * x < 1; inv is 1 / dc */
+static void clip_axis(float c0, float dc, float inv, float *lo, float *hi)
+{
+    if (dc > 0.0f) {
+        *lo = SDL_max(*lo, -c0 * inv);
+        *hi = SDL_min(*hi, (1.0f - c0) * inv);
+    } else if (dc < 0.0f) {
+        *lo = SDL_max(*lo, (1.0f - c0) * inv);
+        *hi = SDL_min(*hi, -c0 * inv);
+    } else if (c0 < 0.0f || c0 >= 1.0f) {
+        *hi = *lo;
+    }
+}
+
+/* one span of nearest neighbour samples stepped in 16.16 fixed point */
+static void draw_span(const SoftTexture *st, Uint32 *dst, int n, Sint32 u, Sint32 v, Sint32 du, Sint32 dv,
+                      const Uint16 *tint)
+{
+    Uint32 texels[SOFT_SPAN];
+
+    /* unscaled and unrotated: blend straight from the texture's row */
+    if (du == 0x10000 && dv == 0) {
+        const int tx = u >> 16, ty = v >> 16;
+        if (tx >= 0 && tx + n <= st->w && ty >= 0 && ty < st->h) {
+            blend_span(dst, &st->pixels[(size_t)ty * st->w + tx], n, tint);
+            return;
+        }
+    }
+    while (n > 0) {
+        const int count = SDL_min(n, SOFT_SPAN);
+        int i;
+
+        for (i = 0; i < count; i++) {
+            const int tx = SDL_clamp(u >> 16, 0, st->w - 1), ty = SDL_clamp(v >> 16, 0, st->h - 1);
+            texels[i] = st->pixels[(size_t)ty * st->w + tx];
+            u += du;
+            v += dv;
+        }
+        blend_span(dst, texels, count, tint);
+        dst += count;
+        n -= count;
+    }
+}
+
+/*
+ * A quad from the gfx batch is a parallelogram: v0 + s * (v1 - v0) +
+ * t * (v3 - v0) for s and t in [0, 1). Each row covers the pixels whose
+ * centres have s and t in range, and the texture coordinates change by a
+ * constant step along it.
+ */
+static void draw_quad(const SoftTexture *st, const SDL_Vertex *v)
+{
+    const float e1x = v[1].position.x - v[0].position.x, e1y = v[1].position.y - v[0].position.y;
+    const float e2x = v[3].position.x - v[0].position.x, e2y = v[3].position.y - v[0].position.y;
+    const float det = e1x * e2y - e1y * e2x, inv_det = 1.0f / det;
+    const float tu = v[0].tex_coord.x * st->w, tv = v[0].tex_coord.y * st->h;
+    const float us = (v[1].tex_coord.x - v[0].tex_coord.x) * st->w, vs = (v[1].tex_coord.y - v[0].tex_coord.y) * st->h;
+    const float ut = (v[3].tex_coord.x - v[0].tex_coord.x) * st->w, vt = (v[3].tex_coord.y - v[0].tex_coord.y) * st->h;
+    float dsdx, dtdx, inv_dsdx, inv_dtdx, top, bottom;
+    Sint32 du, dv;
+    Uint16 tint[4];
+    int y, y0, y1, i;
+
+    if (SDL_fabsf(det) < 1e-6f) {
+        return; /* degenerate, e.g. an unused quad zeroed by the font code */
+    }
+    top = bottom = v[0].position.y;
+    for (i = 1; i < 4; i++) {
+        top = SDL_min(top, v[i].position.y);
+        bottom = SDL_max(bottom, v[i].position.y);
+    }
+    y0 = SDL_max((int)SDL_ceilf(top - 0.5f), 0);
+    y1 = SDL_min((int)SDL_ceilf(bottom - 0.5f), fb_h);
+
+    tint[0] = (Uint16)(SDL_clamp(v[0].color.r, 0.0f, 1.0f) * 256.0f + 0.5f);
+    tint[1] = (Uint16)(SDL_clamp(v[0].color.g, 0.0f, 1.0f) * 256.0f + 0.5f);
+    tint[2] = (Uint16)(SDL_clamp(v[0].color.b, 0.0f, 1.0f) * 256.0f + 0.5f);
+    tint[3] = (Uint16)(SDL_clamp(v[0].color.a, 0.0f, 1.0f) * 256.0f + 0.5f);
+
+    dsdx = e2y * inv_det;
+    dtdx = -e1y * inv_det;
+    inv_dsdx = dsdx != 0.0f ? 1.0f / dsdx : 0.0f;
+    inv_dtdx = dtdx != 0.0f ? 1.0f / dtdx : 0.0f;
+    du = (Sint32)SDL_lroundf((dsdx * us + dtdx * ut) * 65536.0f);
+    dv = (Sint32)SDL_lroundf((dsdx * vs + dtdx * vt) * 65536.0f);
+    for (y = y0; y < y1; y++) {
+        const float dy = (float)y + 0.5f - v[0].position.y;
+        const float s0 = -dy * e2x * inv_det, t0 = dy * e1x * inv_det; /* at x = v0.x */
+        float lo = -1e30f, hi = 1e30f, dx, s, t;
+        int x0, x1;
+
+        clip_axis(s0, dsdx, inv_dsdx, &lo, &hi);
+        clip_axis(t0, dtdx, inv_dtdx, &lo, &hi);
+        if (lo >= hi) {
+            continue;
+        }
+        x0 = (int)SDL_clamp(SDL_ceilf(lo + v[0].position.x - 0.5f), 0.0f, (float)fb_w);
+        x1 = (int)SDL_clamp(SDL_ceilf(hi + v[0].position.x - 0.5f), 0.0f, (float)fb_w);
+        if (x0 >= x1) {
+            continue;
+        }
+        dx = (float)x0 + 0.5f - v[0].position.x;
+        s = s0 + dsdx * dx;
+        t = t0 + dtdx * dx;
+        draw_span(st, &framebuffer[(size_t)y * fb_w + x0], x1 - x0,
+                  (Sint32)SDL_floorf((tu + s * us + t * ut) * 65536.0f),
+                  (Sint32)SDL_floorf((tv + s * vs + t * vt) * 65536.0f), du, dv, tint);
+    }
+}
+
+void soft_draw(SDL_Texture *texture, const SDL_Vertex *vertices, int quads)
+{
+    const SoftTexture *st = get_texture(texture);
+    int i;
+
+    if (!st) {
+        return;
+    }
+    for (i = 0; i < quads; i++) {
+        draw_quad(st, &vertices[i * 4]);
+    }
+}
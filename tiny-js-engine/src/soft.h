@@ -0,0 +1,34 @@
+#ifndef SOFT_H
+#define SOFT_H
+
+#include <SDL3/SDL.h>
+
+/*
+ * Software rasterizer for devices without a usable GPU. The gfx batch is
+ * composited into a CPU framebuffer instead of going to SDL_RenderGeometry,
+ * and the finished frame goes to the screen as one streaming texture.
+ * Textures keep their pixels in RAM; the SDL_Texture handed out for them is
+ * only a 1x1 handle that owns those pixels, so the batching code stays the
+ * same on both paths. Spans are blended 4 or 8 pixels at a time with SSE2 or
+ * NEON where SDL reports them.
+ *
+ * It is used when SDL could only give us its own software renderer, or when
+ * TJS_SOFTWARE=1 is set in the environment (TJS_SOFTWARE=0 turns it off).
+ */
+bool soft_init(SDL_Renderer *renderer); /* true if drawing goes through here */
+void soft_quit(void);
+/* gives the framebuffer a new size, such as a canvas's, clearing it */
+bool soft_resize(int width, int height);
+
+/* a texture whose `width` * `height` RGBA32 pixels the caller fills in through *pixels */
+SDL_Texture *soft_create_texture(int width, int height, Uint8 **pixels);
+bool soft_update_texture(SDL_Texture *texture, const SDL_Rect *rect, const Uint8 *pixels, int pitch);
+
+void soft_clear(Uint8 r, Uint8 g, Uint8 b);
+/* draws quads laid out as gfx_reserve() fills them, tinted by their first vertex's colour */
+void soft_draw(SDL_Texture *texture, const SDL_Vertex *vertices, int quads);
+bool soft_present(void);
+/* uploads the framebuffer for the caller to draw, also handing out its pixels */
+SDL_Texture *soft_frame(const Uint32 **pixels);
+
+#endif
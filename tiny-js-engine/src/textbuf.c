@@ -0,0 +1,227 @@
+#include "textbuf.h"
+
+typedef struct
+{
+    Uint32 length, capacity;
+    char data[];
+} TextBuffer;
+
+static TextBuffer *get_buffer(duk_context *ctx, duk_idx_t idx)
+{
+    TextBuffer *tb = NULL;
+    duk_size_t size;
+
+    if (!duk_is_object(ctx, idx)) {
+        return NULL;
+    }
+    if (duk_get_prop_string(ctx, idx, DUK_HIDDEN_SYMBOL("text"))) {
+        tb = (TextBuffer *)duk_get_buffer(ctx, -1, &size);
+        if (size < sizeof(TextBuffer)) {
+            tb = NULL;
+        }
+    }
+    duk_pop(ctx);
+    return tb;
+}
+
+const char *textbuf_get(duk_context *ctx, duk_idx_t idx, duk_size_t *len)
+{
+    const TextBuffer *tb = get_buffer(ctx, idx);
+
+    if (!tb) {
+        return NULL;
+    }
+    *len = tb->length;
+    return tb->data;
+}
+
+static void put(TextBuffer *tb, const char *s, size_t len)
+{
+    const size_t room = (size_t)(tb->capacity - tb->length);
+
+    if (len > room) {
+        /* cut before the character that doesn't fit, not through the middle of it */
+        len = room;
+        while (len > 0 && (s[len] & 0xC0) == 0x80) {
+            len--;
+        }
+    }
+    SDL_memcpy(tb->data + tb->length, s, len);
+    tb->length += (Uint32)len;
+}
+
+/* writes the decimal digits of v, at least min_digits of them, ending at end; returns the first */
+static char *format_digits(char *end, Uint64 v, int min_digits)
+{
+    char *p = end;
+
+    do {
+        *--p = (char)('0' + v % 10);
+        v /= 10;
+        min_digits--;
+    } while (v != 0 || min_digits > 0);
+    return p;
+}
+
+static bool put_special(TextBuffer *tb, double n)
+{
+    if (SDL_isnan(n)) {
+        put(tb, "NaN", 3);
+        return true;
+    }
+    if (SDL_isinf(n)) {
+        put(tb, n < 0 ? "-Infinity" : "Infinity", n < 0 ? 9 : 8);
+        return true;
+    }
+    return false;
+}
+
+/* 2^53, past which doubles are no longer exact integers */
+#define TEXTBUF_EXACT 9007199254740992.0
+
+static void put_number(TextBuffer *tb, double n, int decimals, int min_digits)
+{
+    static const double scales[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9 };
+    char digits[48], *end = digits + sizeof(digits), *p;
+    const bool negative = n < 0;
+    double scaled;
+    Uint64 v;
+
+    if (put_special(tb, n)) {
+        return;
+    }
+    scaled = SDL_round(SDL_fabs(n) * scales[decimals]);
+    if (scaled >= TEXTBUF_EXACT) {
+        /* too big for fixed point, let the C library spell it out */
+        const int len = SDL_snprintf(digits, sizeof(digits), "%.*g", 17, n);
+        put(tb, digits, (size_t)SDL_clamp(len, 0, (int)sizeof(digits) - 1));
+        return;
+    }
+    v = (Uint64)scaled;
+    if (decimals > 0) {
+        p = format_digits(end, v % (Uint64)scales[decimals], decimals);
+        *--p = '.';
+        p = format_digits(p, v / (Uint64)scales[decimals], min_digits);
+    } else {
+        p = format_digits(end, v, min_digits);
+    }
+    if (negative && v != 0) {
+        *--p = '-';
+    }
+    put(tb, p, (size_t)(end - p));
+}
+
+
+/* javascript bridge logic */
+static TextBuffer *require_this(duk_context *ctx)
+{
+    TextBuffer *tb;
+
+    duk_push_this(ctx);
+    tb = get_buffer(ctx, -1);
+    if (!tb) {
+        (void)duk_error(ctx, DUK_ERR_TYPE_ERROR, "not a text buffer");
+    }
+    return tb;
+}
+
+/* gfx.textBuffer(capacity) -> an empty buffer for up to capacity bytes of UTF-8 */
+static duk_ret_t native_gfx_text_buffer(duk_context *ctx)
+{
+    const int capacity = duk_opt_int(ctx, 0, TEXTBUF_DEFAULT_CAPACITY);
+    TextBuffer *tb;
+
+    if (capacity < 1 || capacity > TEXTBUF_MAX_CAPACITY) {
+        return duk_error(ctx, DUK_ERR_RANGE_ERROR, "capacity must be 1-%d", TEXTBUF_MAX_CAPACITY);
+    }
+    duk_push_object(ctx);
+    duk_push_heap_stash(ctx);
+    duk_get_prop_string(ctx, -1, "textBuffer");
+    duk_set_prototype(ctx, -3);
+    duk_pop(ctx);
+    tb = (TextBuffer *)duk_push_fixed_buffer(ctx, sizeof(TextBuffer) + (size_t)capacity);
+    tb->length = 0;
+    tb->capacity = (Uint32)capacity;
+    duk_put_prop_string(ctx, -2, DUK_HIDDEN_SYMBOL("text"));
+    return 1;
+}
+
+/* buf.clear() empties it; like the other writers it returns buf for chaining */
+static duk_ret_t native_text_clear(duk_context *ctx)
+{
+    require_this(ctx)->length = 0;
+    return 1;
+}
+
+/* buf.put(str) appends a string or the contents of another text buffer */
+static duk_ret_t native_text_put(duk_context *ctx)
+{
+    TextBuffer *tb = require_this(ctx);
+    const char *s;
+    duk_size_t len;
+
+    if (!(s = textbuf_get(ctx, 0, &len))) {
+        s = duk_safe_to_lstring(ctx, 0, &len);
+    }
+    put(tb, s, len);
+    return 1;
+}
+
+/* buf.int(n, minDigits) appends n truncated to an integer, zero padded to minDigits */
+static duk_ret_t native_text_int(duk_context *ctx)
+{
+    TextBuffer *tb = require_this(ctx);
+    const double n = duk_require_number(ctx, 0);
+
+    put_number(tb, SDL_trunc(n), 0, SDL_clamp(duk_opt_int(ctx, 1, 1), 1, 20));
+    return 1;
+}
+
+/* buf.fixed(n, decimals) appends n rounded to 0-9 decimals (default 2) */
+static duk_ret_t native_text_fixed(duk_context *ctx)
+{
+    TextBuffer *tb = require_this(ctx);
+    const double n = duk_require_number(ctx, 0);
+
+    put_number(tb, n, SDL_clamp(duk_opt_int(ctx, 1, 2), 0, 9), 1);
+    return 1;
+}
+
+static duk_ret_t native_text_length(duk_context *ctx)
+{
+    duk_push_uint(ctx, require_this(ctx)->length);
+    return 1;
+}
+
+/* buf.toString() makes a JS string of it, for debugging */
+static duk_ret_t native_text_to_string(duk_context *ctx)
+{
+    const TextBuffer *tb = require_this(ctx);
+
+    duk_push_lstring(ctx, tb->data, tb->length);
+    return 1;
+}
+
+static const duk_function_list_entry text_functions[] = {
+    { "clear", native_text_clear, 0 },
+    { "put", native_text_put, 1 },
+    { "int", native_text_int, 2 },
+    { "fixed", native_text_fixed, 2 },
+    { "length", native_text_length, 0 },
+    { "toString", native_text_to_string, 0 },
+    { NULL, NULL, 0 }
+};
+
+void textbuf_bind(duk_context *ctx)
+{
+    duk_push_heap_stash(ctx);
+    duk_push_object(ctx);
+    duk_put_function_list(ctx, -1, text_functions);
+    duk_put_prop_string(ctx, -2, "textBuffer");
+    duk_pop(ctx);
+
+    duk_get_global_string(ctx, "gfx");
+    duk_push_c_function(ctx, native_gfx_text_buffer, 1);
+    duk_put_prop_string(ctx, -2, "textBuffer");
+    duk_pop(ctx);
+}
@@ -0,0 +1,23 @@
+#ifndef TEXTBUF_H
+#define TEXTBUF_H
+
+#include <SDL3/SDL.h>
+#include "duktape/duktape.h"
+
+/* text buffer config */
+#define TEXTBUF_DEFAULT_CAPACITY 64
+#define TEXTBUF_MAX_CAPACITY     4096
+
+/*
+ * Mutable UTF-8 text for HUDs. gfx.textBuffer(capacity) returns an object
+ * whose storage is a fixed Duktape buffer; clear(), put(), int() and fixed()
+ * write into it in place and gfx.text() reads it directly, so redrawing a
+ * changing score every frame creates no JS strings. Writes past the capacity
+ * are cut off.
+ */
+void textbuf_bind(duk_context *ctx); /* adds to the gfx object, bind after gfx */
+
+/* the text of the buffer at idx and its length in bytes, or NULL if it is not a text buffer */
+const char *textbuf_get(duk_context *ctx, duk_idx_t idx, duk_size_t *len);
+
+#endif
@@ -0,0 +1,468 @@
+#include <stdio.h>
+#include "jobs.h"
+#include "timers.h"
+
+#define TIMER_INDEX_BITS 20
+#define TIMER_INDEX_MASK ((1U << TIMER_INDEX_BITS) - 1U)
+#define TIMER_GEN_MASK   0xFFFU
+#define TIMER_NONE       (-1)
+#define TIMER_MAX_DELAY  0x7FFFFFFF
+
+typedef enum
+{
+    TIMER_FREE,
+    TIMER_ARMED, /* linked into a wheel slot */
+    TIMER_FIRED  /* waiting in this frame's batch */
+} TimerState;
+
+typedef struct
+{
+    Uint64 expires;  /* wheel tick, in milliseconds */
+    Uint32 interval; /* milliseconds, 0 for one-shot timers */
+    Sint32 next;     /* slot list, or free list while free */
+    Sint32 prev;
+    Uint16 slot;     /* level * TIMER_WHEEL_SIZE + index while armed */
+    Uint16 gen;      /* bumped on free so stale ids never match */
+    Uint8 state;
+} Timer;
+
+static Timer *pool;
+static Sint32 pool_size;
+static Sint32 free_list = TIMER_NONE;
+static Sint32 wheel[TIMER_WHEEL_LEVELS * TIMER_WHEEL_SIZE];
+static Uint64 wheel_tick;
+
+/* ids of the timers that expired this frame */
+static Uint32 *batch;
+static int batch_count;
+static int batch_capacity;
+
+/* requestAnimationFrame ids waiting for the next frame */
+static Uint32 *frames;
+static int frame_count;
+static int frame_capacity;
+static Uint32 next_frame_id;
+
+
+static Uint64 now_tick(void)
+{
+    return SDL_GetTicksNS() / SDL_NS_PER_MS;
+}
+
+static bool append_id(Uint32 **list, int *count, int *capacity, Uint32 id)
+{
+    if (*count == *capacity) {
+        int capacity_ = *capacity ? *capacity * 2 : 64;
+        Uint32 *list_ = (Uint32 *)SDL_realloc(*list, sizeof(Uint32) * capacity_);
+        if (!list_) {
+            return false;
+        }
+        *list = list_;
+        *capacity = capacity_;
+    }
+    (*list)[(*count)++] = id;
+    return true;
+}
+
+
+/* timer pool */
+static Uint32 timer_id(Sint32 index)
+{
+    return ((Uint32)pool[index].gen << TIMER_INDEX_BITS) | (Uint32)index;
+}
+
+static Sint32 timer_lookup(Uint32 id)
+{
+    Sint32 index = (Sint32)(id & TIMER_INDEX_MASK);
+
+    if (index >= pool_size || pool[index].state == TIMER_FREE || pool[index].gen != id >> TIMER_INDEX_BITS) {
+        return TIMER_NONE;
+    }
+    return index;
+}
+
+static Sint32 timer_alloc(void)
+{
+    Sint32 index;
+
+    if (free_list == TIMER_NONE) {
+        Sint32 size = pool_size ? pool_size * 2 : 256;
+        Timer *pool_;
+
+        if (size > TIMER_MAX) {
+            return TIMER_NONE;
+        }
+        pool_ = (Timer *)SDL_realloc(pool, sizeof(Timer) * size);
+        if (!pool_) {
+            return TIMER_NONE;
+        }
+        pool = pool_;
+        for (index = size - 1; index >= pool_size; index--) {
+            pool[index].state = TIMER_FREE;
+            pool[index].gen = 1;
+            pool[index].next = free_list;
+            free_list = index;
+        }
+        pool_size = size;
+    }
+    index = free_list;
+    free_list = pool[index].next;
+    return index;
+}
+
+static void timer_free(Sint32 index)
+{
+    Timer *t = &pool[index];
+
+    t->gen = (Uint16)((t->gen & TIMER_GEN_MASK) == TIMER_GEN_MASK ? 1 : t->gen + 1);
+    t->state = TIMER_FREE;
+    t->next = free_list;
+    free_list = index;
+}
+
+
+/* timing wheel */
+static void wheel_link(Sint32 index, int slot)
+{
+    Timer *t = &pool[index];
+
+    t->slot = (Uint16)slot;
+    t->prev = TIMER_NONE;
+    t->next = wheel[slot];
+    if (t->next != TIMER_NONE) {
+        pool[t->next].prev = index;
+    }
+    wheel[slot] = index;
+}
+
+static void wheel_unlink(Sint32 index)
+{
+    Timer *t = &pool[index];
+
+    if (t->prev != TIMER_NONE) {
+        pool[t->prev].next = t->next;
+    } else {
+        wheel[t->slot] = t->next;
+    }
+    if (t->next != TIMER_NONE) {
+        pool[t->next].prev = t->prev;
+    }
+}
+
+static void wheel_insert(Sint32 index)
+{
+    Uint64 expires = pool[index].expires;
+    Uint64 delta = expires - wheel_tick;
+    int level;
+
+    for (level = 0; level < TIMER_WHEEL_LEVELS - 1; level++) {
+        if (delta < (Uint64)1 << (TIMER_WHEEL_BITS * (level + 1))) {
+            break;
+        }
+    }
+    if (delta >= (Uint64)1 << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS)) {
+        /* beyond the wheel: park in the furthest slot, it is reinserted on cascade */
+        expires = wheel_tick + ((Uint64)1 << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS)) - 1;
+    }
+    pool[index].state = TIMER_ARMED;
+    wheel_link(index, level * TIMER_WHEEL_SIZE +
+                      (int)((expires >> (TIMER_WHEEL_BITS * level)) & (TIMER_WHEEL_SIZE - 1)));
+}
+
+static void wheel_cascade(int level, int index)
+{
+    const int slot = level * TIMER_WHEEL_SIZE + index;
+    Sint32 node = wheel[slot];
+
+    wheel[slot] = TIMER_NONE;
+    while (node != TIMER_NONE) {
+        Sint32 next = pool[node].next;
+        wheel_insert(node);
+        node = next;
+    }
+}
+
+static void wheel_step(void)
+{
+    Sint32 node;
+    int level;
+
+    wheel_tick++;
+    for (level = 1; level < TIMER_WHEEL_LEVELS; level++) {
+        if (wheel_tick & (((Uint64)1 << (TIMER_WHEEL_BITS * level)) - 1)) {
+            break;
+        }
+        wheel_cascade(level, (int)((wheel_tick >> (TIMER_WHEEL_BITS * level)) & (TIMER_WHEEL_SIZE - 1)));
+    }
+
+    node = wheel[wheel_tick & (TIMER_WHEEL_SIZE - 1)];
+    wheel[wheel_tick & (TIMER_WHEEL_SIZE - 1)] = TIMER_NONE;
+    while (node != TIMER_NONE) {
+        Sint32 next = pool[node].next;
+        if (append_id(&batch, &batch_count, &batch_capacity, timer_id(node))) {
+            pool[node].state = TIMER_FIRED;
+        } else {
+            /* no room to run it now, it stays armed and is due again next tick */
+            pool[node].expires = wheel_tick + 1;
+            wheel_insert(node);
+        }
+        node = next;
+    }
+}
+
+
+/* dispatch */
+
+/* calls the callback, or [callback, ...args], on top of the stack and pops it */
+static void run_callback(duk_context *ctx, const char *what)
+{
+    duk_idx_t nargs = 0;
+
+    if (duk_is_array(ctx, -1)) {
+        duk_idx_t list = duk_get_top_index(ctx);
+        duk_idx_t i, n = (duk_idx_t)duk_get_length(ctx, list);
+
+        for (i = 0; i < n; i++) {
+            duk_get_prop_index(ctx, list, (duk_uarridx_t)i);
+        }
+        duk_remove(ctx, list);
+        nargs = n - 1;
+    }
+    if (duk_pcall(ctx, nargs) != 0) {
+        fprintf(stderr, "Error in %s: %s\n", what, duk_safe_to_string(ctx, -1));
+    }
+    duk_pop(ctx);
+    jobs_drain(ctx);
+}
+
+static void dispatch_timers(duk_context *ctx)
+{
+    const Uint64 now = now_tick();
+    duk_idx_t callbacks;
+    int i;
+
+    batch_count = 0;
+    while (wheel_tick < now) {
+        wheel_step();
+    }
+    if (batch_count == 0) {
+        return;
+    }
+
+    duk_push_heap_stash(ctx);
+    duk_get_prop_string(ctx, -1, "timers");
+    callbacks = duk_get_top_index(ctx);
+
+    for (i = 0; i < batch_count; i++) {
+        Sint32 index = timer_lookup(batch[i]);
+        Timer *t;
+
+        if (index == TIMER_NONE || pool[index].state != TIMER_FIRED) {
+            continue; /* cleared by an earlier callback in this batch */
+        }
+        t = &pool[index];
+        duk_get_prop_index(ctx, callbacks, (duk_uarridx_t)index);
+        if (t->interval) {
+            Uint64 next = t->expires + t->interval;
+            t->expires = next > wheel_tick ? next : wheel_tick + t->interval;
+            wheel_insert(index);
+        } else {
+            timer_free(index);
+            duk_del_prop_index(ctx, callbacks, (duk_uarridx_t)index);
+        }
+        /* the pool may grow during the call, so `t` is dead from here */
+        run_callback(ctx, "timer");
+    }
+    duk_pop_2(ctx);
+}
+
+static void dispatch_frames(duk_context *ctx)
+{
+    Uint32 *running = frames;
+    int count = frame_count;
+    int i;
+
+    if (count == 0) {
+        return;
+    }
+    /* frames requested from inside a callback wait for the next frame */
+    frames = NULL;
+    frame_count = 0;
+    frame_capacity = 0;
+
+    duk_push_heap_stash(ctx);
+    duk_get_prop_string(ctx, -1, "frames");
+    for (i = 0; i < count; i++) {
+        if (duk_get_prop_index(ctx, -1, running[i])) {
+            duk_del_prop_index(ctx, -2, running[i]);
+            duk_push_number(ctx, (double)SDL_GetTicksNS() / SDL_NS_PER_MS);
+            if (duk_pcall(ctx, 1) != 0) {
+                fprintf(stderr, "Error in animation frame: %s\n", duk_safe_to_string(ctx, -1));
+            }
+        }
+        duk_pop(ctx);
+        jobs_drain(ctx);
+    }
+    duk_pop_2(ctx);
+    SDL_free(running);
+}
+
+void timers_dispatch(duk_context *ctx)
+{
+    dispatch_timers(ctx);
+    dispatch_frames(ctx);
+}
+
+
+/* javascript bridge logic */
+static duk_ret_t create_timer(duk_context *ctx, bool repeat)
+{
+    duk_idx_t nargs = duk_get_top(ctx);
+    double delay = duk_get_number_default(ctx, 1, 0.0);
+    Uint64 start = SDL_max(now_tick(), wheel_tick);
+    Sint32 index;
+    duk_idx_t i;
+
+    duk_require_function(ctx, 0);
+    if (!(delay >= 0.0)) {
+        delay = 0.0;
+    }
+    delay = SDL_min(delay, (double)TIMER_MAX_DELAY);
+
+    index = timer_alloc();
+    if (index == TIMER_NONE) {
+        return duk_error(ctx, DUK_ERR_RANGE_ERROR, "too many timers");
+    }
+    pool[index].interval = repeat ? SDL_max((Uint32)delay, 1U) : 0;
+    pool[index].expires = SDL_max(start + (Uint64)delay, wheel_tick + 1);
+    wheel_insert(index);
+
+    duk_push_heap_stash(ctx);
+    duk_get_prop_string(ctx, -1, "timers");
+    if (nargs > 2) {
+        duk_push_array(ctx);
+        duk_dup(ctx, 0);
+        duk_put_prop_index(ctx, -2, 0);
+        for (i = 2; i < nargs; i++) {
+            duk_dup(ctx, i);
+            duk_put_prop_index(ctx, -2, (duk_uarridx_t)(i - 1));
+        }
+    } else {
+        duk_dup(ctx, 0);
+    }
+    duk_put_prop_index(ctx, -2, (duk_uarridx_t)index);
+
+    duk_push_uint(ctx, timer_id(index));
+    return 1;
+}
+
+static duk_ret_t native_set_timeout(duk_context *ctx)
+{
+    return create_timer(ctx, false);
+}
+
+static duk_ret_t native_set_interval(duk_context *ctx)
+{
+    return create_timer(ctx, true);
+}
+
+/* clearTimeout and clearInterval */
+static duk_ret_t native_clear_timer(duk_context *ctx)
+{
+    Sint32 index;
+
+    if (!duk_is_number(ctx, 0)) {
+        return 0;
+    }
+    index = timer_lookup(duk_get_uint(ctx, 0));
+    if (index == TIMER_NONE) {
+        return 0;
+    }
+    if (pool[index].state == TIMER_ARMED) {
+        wheel_unlink(index);
+    }
+    timer_free(index);
+
+    duk_push_heap_stash(ctx);
+    duk_get_prop_string(ctx, -1, "timers");
+    duk_del_prop_index(ctx, -1, (duk_uarridx_t)index);
+    return 0;
+}
+
+static duk_ret_t native_request_animation_frame(duk_context *ctx)
+{
+    Uint32 id;
+
+    duk_require_function(ctx, 0);
+    if (++next_frame_id == 0) {
+        next_frame_id = 1;
+    }
+    id = next_frame_id;
+    if (!append_id(&frames, &frame_count, &frame_capacity, id)) {
+        return duk_error(ctx, DUK_ERR_ERROR, "out of memory");
+    }
+
+    duk_push_heap_stash(ctx);
+    duk_get_prop_string(ctx, -1, "frames");
+    duk_dup(ctx, 0);
+    duk_put_prop_index(ctx, -2, id);
+
+    duk_push_uint(ctx, id);
+    return 1;
+}
+
+static duk_ret_t native_cancel_animation_frame(duk_context *ctx)
+{
+    if (!duk_is_number(ctx, 0)) {
+        return 0;
+    }
+    duk_push_heap_stash(ctx);
+    duk_get_prop_string(ctx, -1, "frames");
+    duk_del_prop_index(ctx, -1, duk_get_uint(ctx, 0));
+    return 0;
+}
+
+static const duk_function_list_entry timer_functions[] = {
+    { "setTimeout", native_set_timeout, DUK_VARARGS },
+    { "setInterval", native_set_interval, DUK_VARARGS },
+    { "clearTimeout", native_clear_timer, 1 },
+    { "clearInterval", native_clear_timer, 1 },
+    { "requestAnimationFrame", native_request_animation_frame, 1 },
+    { "cancelAnimationFrame", native_cancel_animation_frame, 1 },
+    { NULL, NULL, 0 }
+};
+
+void timers_bind(duk_context *ctx)
+{
+    int i;
+
+    for (i = 0; i < TIMER_WHEEL_LEVELS * TIMER_WHEEL_SIZE; i++) {
+        wheel[i] = TIMER_NONE;
+    }
+    wheel_tick = now_tick();
+
+    duk_push_heap_stash(ctx);
+    duk_push_object(ctx);
+    duk_put_prop_string(ctx, -2, "timers");
+    duk_push_object(ctx);
+    duk_put_prop_string(ctx, -2, "frames");
+    duk_pop(ctx);
+
+    duk_push_global_object(ctx);
+    duk_put_function_list(ctx, -1, timer_functions);
+    duk_pop(ctx);
+}
+
+void timers_quit(void)
+{
+    SDL_free(pool);
+    SDL_free(batch);
+    SDL_free(frames);
+    pool = NULL;
+    batch = NULL;
+    frames = NULL;
+    pool_size = 0;
+    free_list = TIMER_NONE;
+    batch_count = batch_capacity = 0;
+    frame_count = frame_capacity = 0;
+}
@@ -0,0 +1,24 @@
+#ifndef TIMERS_H
+#define TIMERS_H
+
+#include <SDL3/SDL.h>
+#include "duktape/duktape.h"
+
+/* wheel config: 4 levels of 64 one-millisecond slots cover about 4.6 hours */
+#define TIMER_WHEEL_BITS    6
+#define TIMER_WHEEL_SIZE    (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_LEVELS  4
+#define TIMER_MAX           (1 << 20)
+
+/*
+ * setTimeout/setInterval/clearTimeout/clearInterval and
+ * requestAnimationFrame/cancelAnimationFrame. Timers live in a hierarchical
+ * timing wheel keyed on SDL_GetTicksNS, so arming, cancelling and expiring a
+ * timer are all O(1). Callbacks are kept in the heap stash and run in one
+ * batch per frame from timers_dispatch().
+ */
+void timers_bind(duk_context *ctx);
+void timers_dispatch(duk_context *ctx);
+void timers_quit(void);
+
+#endif
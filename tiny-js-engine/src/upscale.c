@@ -0,0 +1,333 @@
+#include "upscale.h"
+
+static Uint32 rows[3][UPSCALE_MAX_SIZE + 2]; /* the lines above, at and below, edge pixels repeated */
+static Uint32 *filtered; /* the canvas after scale2x/scale3x */
+static int filtered_w, filtered_h;
+static SDL_Texture *filtered_texture;
+static SDL_Texture *prescaled; /* the canvas at a whole multiple, for UPSCALE_SHARP */
+static int prescaled_w, prescaled_h;
+
+
+/* filters */
+
+/*
+ * AdvMAME2x/3x, after Andrea Mazzoleni's scale2x. With E the pixel being
+ * scaled and its neighbours named
+ *
+ *     A B C
+ *     D E F
+ *     G H I
+ *
+ * each corner of its block takes the colour of the two edges that meet there
+ * when those match and the opposite edges don't, so diagonals come out
+ * smooth while everything else stays square. Only equality is tested, so
+ * the kernels don't care about the pixel format.
+ */
+
+/* the padded row for line y, clamped to the image */
+static const Uint32 *pad_row(int slot, const Uint32 *pixels, int pitch, int width, int height, int y)
+{
+    const Uint32 *src = pixels + (size_t)SDL_clamp(y, 0, height - 1) * pitch;
+    Uint32 *row = rows[slot];
+
+    row[0] = src[0];
+    SDL_memcpy(row + 1, src, (size_t)width * sizeof(Uint32));
+    row[width + 1] = src[width - 1];
+    return row + 1;
+}
+
+#if defined(SDL_SSE2_INTRINSICS)
+static __m128i select_sse2(__m128i mask, __m128i a, __m128i b)
+{
+    return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+/* a0 b0 c0 a1 b1 c1 ... */
+static void store3_sse2(Uint32 *dst, __m128i a, __m128i b, __m128i c)
+{
+    const __m128 ab_lo = _mm_castsi128_ps(_mm_unpacklo_epi32(a, b));
+    const __m128 ab_hi = _mm_castsi128_ps(_mm_unpackhi_epi32(a, b));
+    const __m128 bc_lo = _mm_castsi128_ps(_mm_unpacklo_epi32(b, c));
+    const __m128 bc_hi = _mm_castsi128_ps(_mm_unpackhi_epi32(b, c));
+    const __m128 ca_lo = _mm_castsi128_ps(_mm_unpacklo_epi32(c, a));
+    const __m128 ca_hi = _mm_castsi128_ps(_mm_unpackhi_epi32(c, a));
+
+    _mm_storeu_si128((__m128i *)dst, _mm_castps_si128(_mm_shuffle_ps(ab_lo, ca_lo, _MM_SHUFFLE(3, 0, 1, 0))));
+    _mm_storeu_si128((__m128i *)(dst + 4), _mm_castps_si128(_mm_shuffle_ps(bc_lo, ab_hi, _MM_SHUFFLE(1, 0, 3, 2))));
+    _mm_storeu_si128((__m128i *)(dst + 8), _mm_castps_si128(_mm_shuffle_ps(ca_hi, bc_hi, _MM_SHUFFLE(3, 2, 3, 0))));
+}
+#endif
+
+static void scale2x_row(const Uint32 *b, const Uint32 *e, const Uint32 *h, Uint32 *out0, Uint32 *out1, int width)
+{
+    int x = 0;
+
+#if defined(SDL_SSE2_INTRINSICS)
+    for (; x + 4 <= width; x += 4) {
+        const __m128i B = _mm_loadu_si128((const __m128i *)(b + x));
+        const __m128i D = _mm_loadu_si128((const __m128i *)(e + x - 1));
+        const __m128i E = _mm_loadu_si128((const __m128i *)(e + x));
+        const __m128i F = _mm_loadu_si128((const __m128i *)(e + x + 1));
+        const __m128i H = _mm_loadu_si128((const __m128i *)(h + x));
+        const __m128i db = _mm_cmpeq_epi32(D, B), bf = _mm_cmpeq_epi32(B, F);
+        const __m128i dh = _mm_cmpeq_epi32(D, H), hf = _mm_cmpeq_epi32(H, F);
+        const __m128i e0 = select_sse2(_mm_andnot_si128(_mm_or_si128(bf, dh), db), D, E);
+        const __m128i e1 = select_sse2(_mm_andnot_si128(_mm_or_si128(db, hf), bf), F, E);
+        const __m128i e2 = select_sse2(_mm_andnot_si128(_mm_or_si128(db, hf), dh), D, E);
+        const __m128i e3 = select_sse2(_mm_andnot_si128(_mm_or_si128(dh, bf), hf), F, E);
+
+        _mm_storeu_si128((__m128i *)(out0 + x * 2), _mm_unpacklo_epi32(e0, e1));
+        _mm_storeu_si128((__m128i *)(out0 + x * 2 + 4), _mm_unpackhi_epi32(e0, e1));
+        _mm_storeu_si128((__m128i *)(out1 + x * 2), _mm_unpacklo_epi32(e2, e3));
+        _mm_storeu_si128((__m128i *)(out1 + x * 2 + 4), _mm_unpackhi_epi32(e2, e3));
+    }
+#elif defined(SDL_NEON_INTRINSICS)
+    for (; x + 4 <= width; x += 4) {
+        const uint32x4_t B = vld1q_u32(b + x), D = vld1q_u32(e + x - 1), E = vld1q_u32(e + x);
+        const uint32x4_t F = vld1q_u32(e + x + 1), H = vld1q_u32(h + x);
+        const uint32x4_t db = vceqq_u32(D, B), bf = vceqq_u32(B, F), dh = vceqq_u32(D, H), hf = vceqq_u32(H, F);
+        uint32x4x2_t top, bottom;
+
+        top.val[0] = vbslq_u32(vbicq_u32(db, vorrq_u32(bf, dh)), D, E);
+        top.val[1] = vbslq_u32(vbicq_u32(bf, vorrq_u32(db, hf)), F, E);
+        bottom.val[0] = vbslq_u32(vbicq_u32(dh, vorrq_u32(db, hf)), D, E);
+        bottom.val[1] = vbslq_u32(vbicq_u32(hf, vorrq_u32(dh, bf)), F, E);
+        vst2q_u32(out0 + x * 2, top);
+        vst2q_u32(out1 + x * 2, bottom);
+    }
+#endif
+
+    for (; x < width; x++) {
+        const Uint32 B = b[x], D = e[x - 1], E = e[x], F = e[x + 1], H = h[x];
+
+        out0[x * 2] = (D == B && B != F && D != H) ? D : E;
+        out0[x * 2 + 1] = (B == F && B != D && F != H) ? F : E;
+        out1[x * 2] = (D == H && D != B && H != F) ? D : E;
+        out1[x * 2 + 1] = (H == F && D != H && B != F) ? F : E;
+    }
+}
+
+static void scale3x_row(const Uint32 *b, const Uint32 *e, const Uint32 *h, Uint32 *out0, Uint32 *out1,
+                        Uint32 *out2, int width)
+{
+    int x = 0;
+
+#if defined(SDL_SSE2_INTRINSICS)
+    for (; x + 4 <= width; x += 4) {
+        const __m128i A = _mm_loadu_si128((const __m128i *)(b + x - 1));
+        const __m128i B = _mm_loadu_si128((const __m128i *)(b + x));
+        const __m128i C = _mm_loadu_si128((const __m128i *)(b + x + 1));
+        const __m128i D = _mm_loadu_si128((const __m128i *)(e + x - 1));
+        const __m128i E = _mm_loadu_si128((const __m128i *)(e + x));
+        const __m128i F = _mm_loadu_si128((const __m128i *)(e + x + 1));
+        const __m128i G = _mm_loadu_si128((const __m128i *)(h + x - 1));
+        const __m128i H = _mm_loadu_si128((const __m128i *)(h + x));
+        const __m128i I = _mm_loadu_si128((const __m128i *)(h + x + 1));
+        const __m128i db = _mm_cmpeq_epi32(D, B), bf = _mm_cmpeq_epi32(B, F);
+        const __m128i dh = _mm_cmpeq_epi32(D, H), hf = _mm_cmpeq_epi32(H, F);
+        const __m128i ea = _mm_cmpeq_epi32(E, A), ec = _mm_cmpeq_epi32(E, C);
+        const __m128i eg = _mm_cmpeq_epi32(E, G), ei = _mm_cmpeq_epi32(E, I);
+        /* the four corner conditions */
+        const __m128i k0 = _mm_andnot_si128(_mm_or_si128(bf, dh), db);
+        const __m128i k2 = _mm_andnot_si128(_mm_or_si128(db, hf), bf);
+        const __m128i k6 = _mm_andnot_si128(_mm_or_si128(db, hf), dh);
+        const __m128i k8 = _mm_andnot_si128(_mm_or_si128(dh, bf), hf);
+
+        store3_sse2(out0 + x * 3, select_sse2(k0, D, E),
+                    select_sse2(_mm_or_si128(_mm_andnot_si128(ec, k0), _mm_andnot_si128(ea, k2)), B, E),
+                    select_sse2(k2, F, E));
+        store3_sse2(out1 + x * 3, select_sse2(_mm_or_si128(_mm_andnot_si128(eg, k0), _mm_andnot_si128(ea, k6)), D, E),
+                    E, select_sse2(_mm_or_si128(_mm_andnot_si128(ei, k2), _mm_andnot_si128(ec, k8)), F, E));
+        store3_sse2(out2 + x * 3, select_sse2(k6, D, E),
+                    select_sse2(_mm_or_si128(_mm_andnot_si128(ei, k6), _mm_andnot_si128(eg, k8)), H, E),
+                    select_sse2(k8, F, E));
+    }
+#elif defined(SDL_NEON_INTRINSICS)
+    for (; x + 4 <= width; x += 4) {
+        const uint32x4_t A = vld1q_u32(b + x - 1), B = vld1q_u32(b + x), C = vld1q_u32(b + x + 1);
+        const uint32x4_t D = vld1q_u32(e + x - 1), E = vld1q_u32(e + x), F = vld1q_u32(e + x + 1);
+        const uint32x4_t G = vld1q_u32(h + x - 1), H = vld1q_u32(h + x), I = vld1q_u32(h + x + 1);
+        const uint32x4_t db = vceqq_u32(D, B), bf = vceqq_u32(B, F), dh = vceqq_u32(D, H), hf = vceqq_u32(H, F);
+        const uint32x4_t ea = vceqq_u32(E, A), ec = vceqq_u32(E, C), eg = vceqq_u32(E, G), ei = vceqq_u32(E, I);
+        const uint32x4_t k0 = vbicq_u32(db, vorrq_u32(bf, dh)), k2 = vbicq_u32(bf, vorrq_u32(db, hf));
+        const uint32x4_t k6 = vbicq_u32(dh, vorrq_u32(db, hf)), k8 = vbicq_u32(hf, vorrq_u32(dh, bf));
+        uint32x4x3_t row;
+
+        row.val[0] = vbslq_u32(k0, D, E);
+        row.val[1] = vbslq_u32(vorrq_u32(vbicq_u32(k0, ec), vbicq_u32(k2, ea)), B, E);
+        row.val[2] = vbslq_u32(k2, F, E);
+        vst3q_u32(out0 + x * 3, row);
+        row.val[0] = vbslq_u32(vorrq_u32(vbicq_u32(k0, eg), vbicq_u32(k6, ea)), D, E);
+        row.val[1] = E;
+        row.val[2] = vbslq_u32(vorrq_u32(vbicq_u32(k2, ei), vbicq_u32(k8, ec)), F, E);
+        vst3q_u32(out1 + x * 3, row);
+        row.val[0] = vbslq_u32(k6, D, E);
+        row.val[1] = vbslq_u32(vorrq_u32(vbicq_u32(k6, ei), vbicq_u32(k8, eg)), H, E);
+        row.val[2] = vbslq_u32(k8, F, E);
+        vst3q_u32(out2 + x * 3, row);
+    }
+#endif
+
+    for (; x < width; x++) {
+        const Uint32 A = b[x - 1], B = b[x], C = b[x + 1];
+        const Uint32 D = e[x - 1], E = e[x], F = e[x + 1];
+        const Uint32 G = h[x - 1], H = h[x], I = h[x + 1];
+        const bool k0 = D == B && B != F && D != H, k2 = B == F && B != D && F != H;
+        const bool k6 = D == H && D != B && H != F, k8 = H == F && D != H && B != F;
+
+        out0[x * 3] = k0 ? D : E;
+        out0[x * 3 + 1] = ((k0 && E != C) || (k2 && E != A)) ? B : E;
+        out0[x * 3 + 2] = k2 ? F : E;
+        out1[x * 3] = ((k0 && E != G) || (k6 && E != A)) ? D : E;
+        out1[x * 3 + 1] = E;
+        out1[x * 3 + 2] = ((k2 && E != I) || (k8 && E != C)) ? F : E;
+        out2[x * 3] = k6 ? D : E;
+        out2[x * 3 + 1] = ((k6 && E != I) || (k8 && E != G)) ? H : E;
+        out2[x * 3 + 2] = k8 ? F : E;
+    }
+}
+
+/* filters `width` x `height` pixels into `factor` times as many in `dst` */
+static void filter(const Uint32 *pixels, int pitch, int width, int height, int factor, Uint32 *dst)
+{
+    const size_t out_pitch = (size_t)width * factor;
+    int y;
+
+    for (y = 0; y < height; y++) {
+        const Uint32 *b = pad_row(0, pixels, pitch, width, height, y - 1);
+        const Uint32 *e = pad_row(1, pixels, pitch, width, height, y);
+        const Uint32 *h = pad_row(2, pixels, pitch, width, height, y + 1);
+        Uint32 *out = dst + (size_t)y * factor * out_pitch;
+
+        if (factor == 2) {
+            scale2x_row(b, e, h, out, out + out_pitch, width);
+        } else {
+            scale3x_row(b, e, h, out, out + out_pitch, out + out_pitch * 2, width);
+        }
+    }
+}
+
+
+/* presenting */
+
+/* the filtered canvas as a texture, or NULL */
+static SDL_Texture *filter_frame(SDL_Renderer *renderer, int width, int height, const Uint32 *pixels, int pitch,
+                                 int factor)
+{
+    SDL_Surface *shot = NULL, *rgba = NULL;
+    const int w = width * factor, h = height * factor;
+    bool ok;
+
+    if (w != filtered_w || h != filtered_h) {
+        SDL_free(filtered);
+        SDL_DestroyTexture(filtered_texture);
+        filtered = (Uint32 *)SDL_malloc((size_t)w * h * sizeof(Uint32));
+        filtered_texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STREAMING, w, h);
+        if (!filtered || !filtered_texture) {
+            upscale_quit();
+            return NULL;
+        }
+        SDL_SetTextureBlendMode(filtered_texture, SDL_BLENDMODE_NONE);
+        SDL_SetTextureScaleMode(filtered_texture, SDL_SCALEMODE_NEAREST);
+        filtered_w = w;
+        filtered_h = h;
+    }
+
+    /* a GPU canvas has to come back to RAM, which waits for it to finish drawing */
+    if (!pixels) {
+        shot = SDL_RenderReadPixels(renderer, NULL);
+        rgba = shot ? SDL_ConvertSurface(shot, SDL_PIXELFORMAT_RGBA32) : NULL;
+        SDL_DestroySurface(shot);
+        if (!rgba || rgba->w != width || rgba->h != height) {
+            SDL_DestroySurface(rgba);
+            return NULL;
+        }
+        pixels = (const Uint32 *)rgba->pixels;
+        pitch = rgba->pitch / 4;
+    }
+    filter(pixels, pitch, width, height, factor, filtered);
+    SDL_DestroySurface(rgba);
+    ok = SDL_UpdateTexture(filtered_texture, NULL, filtered, w * 4);
+    return ok ? filtered_texture : NULL;
+}
+
+/* `frame` drawn `factor` times as large with nearest sampling, to be scaled down smoothly */
+static SDL_Texture *prescale_frame(SDL_Renderer *renderer, SDL_Texture *frame, int width, int height, int factor)
+{
+    const int w = width * factor, h = height * factor;
+
+    if (w != prescaled_w || h != prescaled_h) {
+        SDL_DestroyTexture(prescaled);
+        prescaled = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_TARGET, w, h);
+        if (!prescaled) {
+            prescaled_w = prescaled_h = 0;
+            return NULL;
+        }
+        SDL_SetTextureBlendMode(prescaled, SDL_BLENDMODE_NONE);
+        SDL_SetTextureScaleMode(prescaled, SDL_SCALEMODE_LINEAR);
+        prescaled_w = w;
+        prescaled_h = h;
+    }
+    if (!SDL_SetRenderTarget(renderer, prescaled) || !SDL_RenderTexture(renderer, frame, NULL, NULL)) {
+        return NULL;
+    }
+    return prescaled;
+}
+
+bool upscale_present(SDL_Renderer *renderer, SDL_Texture *frame, int width, int height, const Uint32 *pixels,
+                     int pitch, UpscaleMode mode)
+{
+    SDL_Texture *src = frame;
+    SDL_FRect dst;
+    float w = (float)width, h = (float)height, scale;
+    int out_w, out_h;
+
+    if (mode == UPSCALE_SCALE2X || mode == UPSCALE_SCALE3X) {
+        const int factor = mode == UPSCALE_SCALE2X ? 2 : 3;
+
+        src = filter_frame(renderer, width, height, pixels, pitch, factor);
+        if (!src) {
+            SDL_SetRenderTarget(renderer, NULL);
+            return false;
+        }
+        w *= (float)factor;
+        h *= (float)factor;
+    }
+
+    if (!SDL_SetRenderTarget(renderer, NULL) || !SDL_GetCurrentRenderOutputSize(renderer, &out_w, &out_h)) {
+        return false;
+    }
+    scale = SDL_min((float)out_w / w, (float)out_h / h);
+    if (scale >= 1.0f && mode != UPSCALE_FIT && mode != UPSCALE_SHARP) {
+        scale = SDL_floorf(scale);
+    }
+    dst.w = w * scale;
+    dst.h = h * scale;
+    dst.x = SDL_floorf(((float)out_w - dst.w) * 0.5f);
+    dst.y = SDL_floorf(((float)out_h - dst.h) * 0.5f);
+
+    if (mode == UPSCALE_SHARP && scale > 1.0f) {
+        const int max_factor = UPSCALE_MAX_TEXTURE / SDL_max(width, height);
+        const int factor = SDL_clamp((int)SDL_ceilf(scale), 1, max_factor);
+
+        src = prescale_frame(renderer, frame, width, height, factor);
+        if (!src || !SDL_SetRenderTarget(renderer, NULL)) {
+            return false;
+        }
+    }
+
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, SDL_ALPHA_OPAQUE);
+    return SDL_RenderClear(renderer) && SDL_RenderTexture(renderer, src, NULL, &dst);
+}
+
+void upscale_quit(void)
+{
+    SDL_free(filtered);
+    filtered = NULL;
+    SDL_DestroyTexture(filtered_texture);
+    filtered_texture = NULL;
+    filtered_w = filtered_h = 0;
+    SDL_DestroyTexture(prescaled);
+    prescaled = NULL;
+    prescaled_w = prescaled_h = 0;
+}
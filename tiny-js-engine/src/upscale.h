@@ -0,0 +1,31 @@
+#ifndef UPSCALE_H
+#define UPSCALE_H
+
+#include <SDL3/SDL.h>
+
+/* upscaler config */
+#define UPSCALE_MAX_SIZE    1024 /* canvas pixels a side */
+#define UPSCALE_MAX_TEXTURE 4096 /* the sharp prescale stays under this */
+
+typedef enum
+{
+    UPSCALE_INTEGER, /* nearest, the largest whole multiple that fits */
+    UPSCALE_FIT,     /* nearest, filling the window as far as the aspect ratio allows */
+    UPSCALE_SHARP,   /* nearest to a whole multiple above the fit, then linear down to it */
+    UPSCALE_SCALE2X, /* the AdvMAME2x/EPX edge filter, then as UPSCALE_INTEGER */
+    UPSCALE_SCALE3X  /* AdvMAME3x */
+} UpscaleMode;
+
+/*
+ * Puts a frame drawn at a fixed logical resolution on the window, centred
+ * and letterboxed in black. `frame` is the finished canvas, `width` x
+ * `height`. The scale2x/scale3x filters work on CPU pixels, 4 or 8 at a time
+ * with SSE2 or NEON: `pixels` (RGBA32, `pitch` pixels a row) if the frame
+ * is in RAM, otherwise they are read back from the render target, which
+ * must still be the canvas. Leaves the window as the render target.
+ */
+bool upscale_present(SDL_Renderer *renderer, SDL_Texture *frame, int width, int height, const Uint32 *pixels,
+                     int pitch, UpscaleMode mode);
+void upscale_quit(void);
+
+#endif
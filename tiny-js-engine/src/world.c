@@ -0,0 +1,524 @@
+#include "world.h"
+#include "mapfile.h"
+#include "ring.h"
+
+#define CHUNK_TILES (WORLD_CHUNK * WORLD_CHUNK)
+#define CHUNK_BYTES (CHUNK_TILES * sizeof(Uint16))
+#define TABLE_SIZE  (WORLD_MAX_BUDGET * 2)
+#define NO_SLOT     (-1)
+
+typedef enum
+{
+    SLOT_FREE,
+    SLOT_LOADING,
+    SLOT_READY,
+    SLOT_WRITING /* evicted, its tiles still on their way to the file */
+} SlotState;
+
+/* a resident chunk; chunk and tiles don't change while the I/O thread has it */
+typedef struct
+{
+    Uint32 chunk; /* index in the file */
+    Uint32 used;  /* frame it was last in view or touched */
+    SlotState state;
+    bool dirty;
+    Uint16 *tiles;
+} Slot;
+
+typedef enum
+{
+    IO_READ,
+    IO_WRITE,
+    IO_QUIT
+} IoOp;
+
+typedef struct
+{
+    IoOp op;
+    Sint32 slot;
+} IoRequest;
+
+typedef struct
+{
+    Uint32 reads;
+    Uint32 writes;
+} WorldStats;
+
+static MappedFile file;
+static bool writable;
+static Uint32 chunks_w, chunks_h;
+static Slot slots[WORLD_MAX_BUDGET];
+static int budget;
+static Uint16 *storage;
+static Sint16 table[TABLE_SIZE]; /* chunk -> slot, linear probing */
+static Sint32 last_slot = NO_SLOT; /* where the last tile lookup hit */
+static Uint32 frame = 1;
+static WorldStats stats;
+
+/* each slot has at most one request in flight, so neither ring can fill up */
+static SDL_Thread *thread;
+static SDL_Semaphore *pending;
+static IoRequest request_slots[WORLD_MAX_BUDGET * 2];
+static SpscRing requests;
+static Sint32 done_slots[WORLD_MAX_BUDGET];
+static SpscRing completions;
+
+static size_t chunk_offset(Uint32 chunk)
+{
+    return WORLD_DATA_OFFSET + (size_t)chunk * CHUNK_BYTES;
+}
+
+
+/* I/O thread */
+static int SDLCALL io_main(void *userdata)
+{
+    IoRequest req;
+
+    (void)userdata;
+    for (;;) {
+        SDL_WaitSemaphore(pending);
+        if (!ring_pop(&requests, &req) || req.op == IO_QUIT) {
+            break;
+        }
+        {
+            const Slot *s = &slots[req.slot];
+            const size_t offset = chunk_offset(s->chunk);
+
+            /* page faults on the mapping happen here rather than on the game thread */
+            if (req.op == IO_READ) {
+                SDL_memcpy(s->tiles, file.data + offset, CHUNK_BYTES);
+            } else {
+                SDL_memcpy((Uint8 *)file.data + offset, s->tiles, CHUNK_BYTES);
+                map_flush(&file, offset, CHUNK_BYTES);
+            }
+            /* the copy in the slot is the one in use, the pages can go */
+            map_release(&file, offset, CHUNK_BYTES);
+        }
+        ring_push(&completions, &req.slot);
+    }
+    return 0;
+}
+
+static void push_request(IoOp op, Sint32 slot)
+{
+    const IoRequest req = { op, slot };
+
+    ring_push(&requests, &req);
+    SDL_SignalSemaphore(pending);
+    if (op == IO_READ) {
+        stats.reads++;
+    } else if (op == IO_WRITE) {
+        stats.writes++;
+    }
+}
+
+
+/* chunk table */
+static Uint32 table_home(Uint32 chunk)
+{
+    return (chunk * 2654435761U) >> 16 & (TABLE_SIZE - 1);
+}
+
+static Sint32 find_slot(Uint32 chunk)
+{
+    Uint32 pos = table_home(chunk);
+
+    while (table[pos] != NO_SLOT) {
+        if (slots[table[pos]].chunk == chunk) {
+            return table[pos];
+        }
+        pos = (pos + 1) & (TABLE_SIZE - 1);
+    }
+    return NO_SLOT;
+}
+
+static void insert_slot(Sint32 slot)
+{
+    Uint32 pos = table_home(slots[slot].chunk);
+
+    while (table[pos] != NO_SLOT) {
+        pos = (pos + 1) & (TABLE_SIZE - 1);
+    }
+    table[pos] = (Sint16)slot;
+}
+
+/* backward shift deletion, which keeps every probe sequence unbroken */
+static void remove_slot(Sint32 slot)
+{
+    Uint32 pos = table_home(slots[slot].chunk), next;
+
+    while (table[pos] != slot) {
+        pos = (pos + 1) & (TABLE_SIZE - 1);
+    }
+    table[pos] = NO_SLOT;
+    for (next = (pos + 1) & (TABLE_SIZE - 1); table[next] != NO_SLOT; next = (next + 1) & (TABLE_SIZE - 1)) {
+        const Uint32 home = table_home(slots[table[next]].chunk);
+
+        /* move it into the hole unless its home lies cyclically in (pos, next] */
+        if (((next - home) & (TABLE_SIZE - 1)) >= ((next - pos) & (TABLE_SIZE - 1))) {
+            table[pos] = table[next];
+            table[next] = NO_SLOT;
+            pos = next;
+        }
+    }
+}
+
+
+/* residency */
+
+/* a free slot, evicting the least recently used chunk out of view if need be; NO_SLOT if none can go */
+static Sint32 take_slot(void)
+{
+    for (;;) {
+        Sint32 oldest = NO_SLOT, i;
+
+        for (i = 0; i < budget; i++) {
+            if (slots[i].state == SLOT_FREE) {
+                return i;
+            }
+            if (slots[i].state == SLOT_READY && slots[i].used != frame &&
+                (oldest == NO_SLOT || slots[i].used < slots[oldest].used)) {
+                oldest = i;
+            }
+        }
+        if (oldest == NO_SLOT) {
+            return NO_SLOT;
+        }
+        remove_slot(oldest);
+        if (!slots[oldest].dirty) {
+            slots[oldest].state = SLOT_FREE;
+            return oldest;
+        }
+        /* the slot comes back once it is written; look for another */
+        slots[oldest].state = SLOT_WRITING;
+        push_request(IO_WRITE, oldest);
+    }
+}
+
+/* keeps a chunk resident this frame, starting to load it if it isn't */
+static void want_chunk(Uint32 cx, Uint32 cy)
+{
+    const Uint32 chunk = cy * chunks_w + cx;
+    Sint32 slot = find_slot(chunk);
+
+    if (slot == NO_SLOT) {
+        slot = take_slot();
+        if (slot == NO_SLOT) {
+            return; /* the budget is all in view or in flight; try again next frame */
+        }
+        slots[slot].chunk = chunk;
+        slots[slot].state = SLOT_LOADING;
+        slots[slot].dirty = false;
+        insert_slot(slot);
+        push_request(IO_READ, slot);
+    }
+    slots[slot].used = frame;
+}
+
+/* wants every chunk overlapping tiles [x0, x1) x [y0, y1) */
+static void want_area(Sint64 x0, Sint64 y0, Sint64 x1, Sint64 y1)
+{
+    const Sint64 cx0 = SDL_max(x0, 0) / WORLD_CHUNK, cy0 = SDL_max(y0, 0) / WORLD_CHUNK;
+    const Sint64 cx1 = SDL_min((x1 + WORLD_CHUNK - 1) / WORLD_CHUNK, (Sint64)chunks_w);
+    const Sint64 cy1 = SDL_min((y1 + WORLD_CHUNK - 1) / WORLD_CHUNK, (Sint64)chunks_h);
+    Sint64 cx, cy;
+
+    for (cy = cy0; cy < cy1; cy++) {
+        for (cx = cx0; cx < cx1; cx++) {
+            want_chunk((Uint32)cx, (Uint32)cy);
+        }
+    }
+}
+
+/* the resident tile at (x, y), or NULL if it is outside the world or not loaded yet */
+static Uint16 *tile_at(int x, int y)
+{
+    Uint32 chunk;
+    Slot *s;
+
+    if (x < 0 || y < 0 || (Uint32)x >= chunks_w * WORLD_CHUNK || (Uint32)y >= chunks_h * WORLD_CHUNK) {
+        return NULL;
+    }
+    chunk = (Uint32)(y / WORLD_CHUNK) * chunks_w + (Uint32)(x / WORLD_CHUNK);
+    if (last_slot == NO_SLOT || slots[last_slot].chunk != chunk || slots[last_slot].state != SLOT_READY) {
+        last_slot = find_slot(chunk);
+        if (last_slot == NO_SLOT || slots[last_slot].state != SLOT_READY) {
+            return NULL;
+        }
+    }
+    s = &slots[last_slot];
+    s->used = frame;
+    return &s->tiles[(y % WORLD_CHUNK) * WORLD_CHUNK + x % WORLD_CHUNK];
+}
+
+void world_update(void)
+{
+    Sint32 slot;
+
+    while (ring_pop(&completions, &slot)) {
+        slots[slot].state = slots[slot].state == SLOT_LOADING ? SLOT_READY : SLOT_FREE;
+    }
+    frame++;
+}
+
+
+/* open and close */
+static bool check_world(const MappedFile *mf)
+{
+    const WorldHeader *h = (const WorldHeader *)mf->data;
+
+    return mf->size >= sizeof(WorldHeader) && SDL_memcmp(h->magic, WORLD_MAGIC, 4) == 0 &&
+           h->version == WORLD_VERSION && h->chunk_size == WORLD_CHUNK && h->width >= 1 && h->height >= 1 &&
+           h->width <= WORLD_MAX_CHUNKS && h->height <= WORLD_MAX_CHUNKS &&
+           mf->size >= chunk_offset(h->width * h->height);
+}
+
+static void close_world(void)
+{
+    int i;
+
+    if (!thread) {
+        return;
+    }
+    /* dirty chunks are queued behind everything in flight, then the thread finishes them all */
+    for (i = 0; i < budget; i++) {
+        if (slots[i].state == SLOT_READY && slots[i].dirty) {
+            slots[i].state = SLOT_WRITING;
+            push_request(IO_WRITE, i);
+        }
+    }
+    push_request(IO_QUIT, NO_SLOT);
+    SDL_WaitThread(thread, NULL);
+    thread = NULL;
+    SDL_DestroySemaphore(pending);
+    pending = NULL;
+    unmap_file(&file);
+    SDL_free(storage);
+    storage = NULL;
+    budget = 0;
+    last_slot = NO_SLOT;
+}
+
+static bool open_world(const char *path, int slot_count)
+{
+    int i;
+
+    writable = map_file_writable(path, &file);
+    if (!writable && !map_file(path, &file)) {
+        return false;
+    }
+    if (!check_world(&file)) {
+        unmap_file(&file);
+        return SDL_SetError("Not a supported world: %s", path);
+    }
+    chunks_w = ((const WorldHeader *)file.data)->width;
+    chunks_h = ((const WorldHeader *)file.data)->height;
+
+    storage = (Uint16 *)SDL_malloc((size_t)slot_count * CHUNK_BYTES);
+    pending = SDL_CreateSemaphore(0);
+    if (!storage || !pending) {
+        SDL_DestroySemaphore(pending);
+        pending = NULL;
+        SDL_free(storage);
+        storage = NULL;
+        unmap_file(&file);
+        return false;
+    }
+    budget = slot_count;
+    for (i = 0; i < budget; i++) {
+        SDL_zero(slots[i]);
+        slots[i].tiles = storage + (size_t)i * CHUNK_TILES;
+    }
+    for (i = 0; i < TABLE_SIZE; i++) {
+        table[i] = NO_SLOT;
+    }
+    ring_init(&requests, request_slots, SDL_arraysize(request_slots), sizeof(IoRequest));
+    ring_init(&completions, done_slots, SDL_arraysize(done_slots), sizeof(Sint32));
+    SDL_zero(stats);
+
+    thread = SDL_CreateThread(io_main, "world", NULL);
+    if (!thread) {
+        budget = 0;
+        SDL_DestroySemaphore(pending);
+        pending = NULL;
+        SDL_free(storage);
+        storage = NULL;
+        unmap_file(&file);
+        return false;
+    }
+    return true;
+}
+
+/* a world of zeroed tiles; the file is sparse where the system allows */
+static bool create_world(const char *path, Uint32 width, Uint32 height)
+{
+    WorldHeader h;
+    SDL_IOStream *io = SDL_IOFromFile(path, "wb");
+    const Uint8 zero = 0;
+    bool ok;
+
+    if (!io) {
+        return false;
+    }
+    SDL_zero(h);
+    SDL_memcpy(h.magic, WORLD_MAGIC, 4);
+    h.version = WORLD_VERSION;
+    h.chunk_size = WORLD_CHUNK;
+    h.width = width;
+    h.height = height;
+    ok = SDL_WriteIO(io, &h, sizeof(h)) == sizeof(h) &&
+         SDL_SeekIO(io, (Sint64)chunk_offset(width * height) - 1, SDL_IO_SEEK_SET) >= 0 &&
+         SDL_WriteIO(io, &zero, 1) == 1;
+    return SDL_CloseIO(io) && ok;
+}
+
+void world_quit(void)
+{
+    close_world();
+}
+
+
+/* javascript bridge logic */
+static void require_world(duk_context *ctx)
+{
+    if (!thread) {
+        (void)duk_error(ctx, DUK_ERR_ERROR, "no world is open");
+    }
+}
+
+/* world.create(path, width, height) makes an empty world of at least width x height tiles */
+static duk_ret_t native_world_create(duk_context *ctx)
+{
+    const char *path = duk_require_string(ctx, 0);
+    const double width = SDL_ceil(duk_require_number(ctx, 1) / WORLD_CHUNK);
+    const double height = SDL_ceil(duk_require_number(ctx, 2) / WORLD_CHUNK);
+
+    if (!(width >= 1 && height >= 1 && width <= WORLD_MAX_CHUNKS && height <= WORLD_MAX_CHUNKS)) {
+        return duk_error(ctx, DUK_ERR_RANGE_ERROR, "world must be 1-%d tiles a side", WORLD_MAX_CHUNKS * WORLD_CHUNK);
+    }
+    if (!create_world(path, (Uint32)width, (Uint32)height)) {
+        return duk_error(ctx, DUK_ERR_ERROR, "Couldn't create %s: %s", path, SDL_GetError());
+    }
+    return 0;
+}
+
+/* world.open(path, budget) replaces the open world, keeping up to `budget` chunks in RAM */
+static duk_ret_t native_world_open(duk_context *ctx)
+{
+    const char *path = duk_require_string(ctx, 0);
+    const int slot_count = duk_opt_int(ctx, 1, WORLD_DEFAULT_BUDGET);
+
+    if (slot_count < 1 || slot_count > WORLD_MAX_BUDGET) {
+        return duk_error(ctx, DUK_ERR_RANGE_ERROR, "budget must be 1-%d chunks", WORLD_MAX_BUDGET);
+    }
+    close_world();
+    if (!open_world(path, slot_count)) {
+        return duk_error(ctx, DUK_ERR_ERROR, "Couldn't load %s: %s", path, SDL_GetError());
+    }
+    return 0;
+}
+
+static duk_ret_t native_world_close(duk_context *ctx)
+{
+    (void)ctx;
+    close_world();
+    return 0;
+}
+
+/* world.camera(x, y, w, h), in tiles: loads the view first, then a chunk's margin around it */
+static duk_ret_t native_world_camera(duk_context *ctx)
+{
+    const Sint64 x = (Sint64)SDL_floor(duk_require_number(ctx, 0));
+    const Sint64 y = (Sint64)SDL_floor(duk_require_number(ctx, 1));
+    const Sint64 w = SDL_max(duk_require_int(ctx, 2), 1), h = SDL_max(duk_require_int(ctx, 3), 1);
+
+    require_world(ctx);
+    want_area(x, y, x + w, y + h);
+    want_area(x - WORLD_CHUNK, y - WORLD_CHUNK, x + w + WORLD_CHUNK, y + h + WORLD_CHUNK);
+    return 0;
+}
+
+/* world.get(x, y) -> the tile, or -1 if it is outside the world or its chunk isn't loaded yet */
+static duk_ret_t native_world_get(duk_context *ctx)
+{
+    const Uint16 *tile;
+
+    require_world(ctx);
+    tile = tile_at(duk_require_int(ctx, 0), duk_require_int(ctx, 1));
+    duk_push_int(ctx, tile ? *tile : -1);
+    return 1;
+}
+
+/* world.set(x, y, tile) -> false if the tile's chunk isn't loaded */
+static duk_ret_t native_world_set(duk_context *ctx)
+{
+    Uint16 *tile;
+
+    require_world(ctx);
+    if (!writable) {
+        return duk_error(ctx, DUK_ERR_ERROR, "the world is read only");
+    }
+    tile = tile_at(duk_require_int(ctx, 0), duk_require_int(ctx, 1));
+    if (tile) {
+        *tile = (Uint16)duk_require_uint(ctx, 2);
+        slots[last_slot].dirty = true;
+    }
+    duk_push_boolean(ctx, tile != NULL);
+    return 1;
+}
+
+/* world.size() -> { width, height } in tiles */
+static duk_ret_t native_world_size(duk_context *ctx)
+{
+    require_world(ctx);
+    duk_push_object(ctx);
+    duk_push_uint(ctx, chunks_w * WORLD_CHUNK);
+    duk_put_prop_string(ctx, -2, "width");
+    duk_push_uint(ctx, chunks_h * WORLD_CHUNK);
+    duk_put_prop_string(ctx, -2, "height");
+    return 1;
+}
+
+/* world.stats() -> { resident, loading, dirty, reads, writes } */
+static duk_ret_t native_world_stats(duk_context *ctx)
+{
+    Uint32 resident = 0, loading = 0, dirty = 0;
+    int i;
+
+    for (i = 0; i < budget; i++) {
+        resident += slots[i].state == SLOT_READY;
+        loading += slots[i].state == SLOT_LOADING;
+        dirty += slots[i].state == SLOT_READY && slots[i].dirty;
+    }
+    duk_push_object(ctx);
+    duk_push_uint(ctx, resident);
+    duk_put_prop_string(ctx, -2, "resident");
+    duk_push_uint(ctx, loading);
+    duk_put_prop_string(ctx, -2, "loading");
+    duk_push_uint(ctx, dirty);
+    duk_put_prop_string(ctx, -2, "dirty");
+    duk_push_uint(ctx, stats.reads);
+    duk_put_prop_string(ctx, -2, "reads");
+    duk_push_uint(ctx, stats.writes);
+    duk_put_prop_string(ctx, -2, "writes");
+    return 1;
+}
+
+static const duk_function_list_entry world_functions[] = {
+    { "create", native_world_create, 3 },
+    { "open", native_world_open, 2 },
+    { "close", native_world_close, 0 },
+    { "camera", native_world_camera, 4 },
+    { "get", native_world_get, 2 },
+    { "set", native_world_set, 3 },
+    { "size", native_world_size, 0 },
+    { "stats", native_world_stats, 0 },
+    { NULL, NULL, 0 }
+};
+
+void world_bind(duk_context *ctx)
+{
+    duk_push_object(ctx);
+    duk_put_function_list(ctx, -1, world_functions);
+    duk_put_global_string(ctx, "world");
+}
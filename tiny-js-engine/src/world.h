@@ -0,0 +1,47 @@
+#ifndef WORLD_H
+#define WORLD_H
+
+#include <SDL3/SDL.h>
+#include "duktape/duktape.h"
+
+/* world config */
+#define WORLD_CHUNK          64  /* tiles a chunk side, 8 KB of tiles */
+#define WORLD_DEFAULT_BUDGET 64  /* resident chunks */
+#define WORLD_MAX_BUDGET     256 /* power of two */
+#define WORLD_MAX_CHUNKS     65535 /* chunks a side */
+
+/*
+ * Tile world file ("TJSW"), all fields little endian:
+ *
+ *   WorldHeader, padded to WORLD_DATA_OFFSET
+ *   Uint16 tiles[height][width][WORLD_CHUNK * WORLD_CHUNK]
+ *
+ * Chunks are stored row by row, each one's tiles row by row, so a chunk is
+ * one contiguous, page aligned run of the file.
+ */
+#define WORLD_MAGIC       "TJSW"
+#define WORLD_VERSION     1
+#define WORLD_DATA_OFFSET 4096
+
+typedef struct
+{
+    char magic[4];
+    Uint32 version;
+    Uint32 chunk_size; /* WORLD_CHUNK */
+    Uint32 width;      /* in chunks */
+    Uint32 height;
+} WorldHeader;
+
+/*
+ * Streaming tile world. The file is memory mapped and only a fixed budget
+ * of chunks is kept in RAM: world.camera() pages in the chunks in and around
+ * the view on a background thread and evicts the least recently used ones
+ * out of view. Changed chunks are written back into the mapping by the same
+ * thread when they are evicted, and the kernel writes them to disk in its own
+ * time, so worlds much larger than RAM scroll without stalls.
+ */
+void world_bind(duk_context *ctx);
+void world_update(void); /* once a frame: picks up finished reads and writes */
+void world_quit(void);   /* writes back changed chunks */
+
+#endif
@@ -0,0 +1,649 @@
+/*
+ * atlas: packs a directory of sprite images into a TJSA atlas (see
+ * src/atlas.h) and its TJSI page images (see src/image.h).
+ *
+ *   atlas [-r] [-s size] [-p padding] <out.atlas> <dir>
+ *
+ * Every QOI, PPM (P6) or PAM (P7) image under <dir> becomes a region named by its
+ * path relative to <dir> without the extension, so <dir>/hero/run1.pam is
+ * "hero/run1". Pages are at most size x size pixels (default 1024) and are
+ * written next to the atlas as <out>-0.tjsi, <out>-1.tjsi and so on. Images
+ * are packed with a skyline bottom-left packer, tallest first, each one
+ * surrounded by `padding` pixels (default 1) copied from its edges so
+ * filtering never samples a neighbour. Pages with at most 16 or 256 colours
+ * are written with a palette at 4 or 8 bits per pixel unless -r asks for
+ * RGBA throughout.
+ */
+#include <SDL3/SDL.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "atlas.h"
+#include "image.h"
+
+#define MAX_PAGES 0xFFFF
+
+typedef struct
+{
+    char *name;
+    Uint8 *rgba;
+    int w, h;
+    int page, x, y; /* of the padded rectangle */
+} Sprite;
+
+typedef struct
+{
+    int x, y, w;
+} SkylineNode;
+
+typedef struct
+{
+    SkylineNode *nodes;
+    int count;
+    int width, height; /* extent actually used */
+} Page;
+
+static Sprite *sprites;
+static int sprite_count;
+static Page *pages;
+static int page_count;
+static int page_size = 1024;
+static int padding = 1;
+static bool indexed = true;
+
+/* image reading */
+static bool read_token(const Uint8 **p, const Uint8 *end, char *token, size_t size)
+{
+    size_t n = 0;
+
+    for (;;) {
+        while (*p < end && SDL_isspace(**p)) {
+            (*p)++;
+        }
+        if (*p < end && **p == '#') {
+            while (*p < end && **p != '\n') {
+                (*p)++;
+            }
+            continue;
+        }
+        break;
+    }
+    while (*p < end && !SDL_isspace(**p) && n + 1 < size) {
+        token[n++] = (char)*(*p)++;
+    }
+    token[n] = '\0';
+    return n > 0;
+}
+
+static bool fits_page(const Sprite *sprite)
+{
+    if (sprite->w > page_size - 2 * padding || sprite->h > page_size - 2 * padding) {
+        return SDL_SetError("%dx%d doesn't fit on a %d pixel page", sprite->w, sprite->h, page_size);
+    }
+    return true;
+}
+
+static bool read_qoi(Sprite *sprite, const Uint8 *data, size_t size)
+{
+    if (!image_info(data, size, &sprite->w, &sprite->h) || !fits_page(sprite)) {
+        return false;
+    }
+    sprite->rgba = (Uint8 *)SDL_malloc((size_t)sprite->w * sprite->h * 4);
+    return sprite->rgba && image_decode(data, size, sprite->rgba, sprite->w * 4);
+}
+
+/* decodes a binary PPM or PAM with 8 bit samples into sprite->rgba */
+static bool read_image(Sprite *sprite, const Uint8 *data, size_t size)
+{
+    const Uint8 *p = data + 2, *end = data + size;
+    char token[32];
+    int depth = 3, maxval = 0, i;
+
+    if (size < 2 || data[0] != 'P' || (data[1] != '6' && data[1] != '7')) {
+        return SDL_SetError("not a PPM or PAM image");
+    }
+    if (data[1] == '6') {
+        if (!read_token(&p, end, token, sizeof(token)) || (sprite->w = SDL_atoi(token)) <= 0 ||
+            !read_token(&p, end, token, sizeof(token)) || (sprite->h = SDL_atoi(token)) <= 0 ||
+            !read_token(&p, end, token, sizeof(token))) {
+            return SDL_SetError("bad PPM header");
+        }
+        maxval = SDL_atoi(token);
+        p++; /* the single whitespace before the pixels */
+    } else {
+        sprite->w = sprite->h = 0;
+        while (read_token(&p, end, token, sizeof(token)) && SDL_strcmp(token, "ENDHDR") != 0) {
+            char value[32];
+
+            if (!read_token(&p, end, value, sizeof(value))) {
+                return SDL_SetError("bad PAM header");
+            }
+            if (SDL_strcmp(token, "WIDTH") == 0) {
+                sprite->w = SDL_atoi(value);
+            } else if (SDL_strcmp(token, "HEIGHT") == 0) {
+                sprite->h = SDL_atoi(value);
+            } else if (SDL_strcmp(token, "DEPTH") == 0) {
+                depth = SDL_atoi(value);
+            } else if (SDL_strcmp(token, "MAXVAL") == 0) {
+                maxval = SDL_atoi(value);
+            }
+        }
+        if (p < end && *p == '\r') {
+            p++;
+        }
+        p++; /* the newline after ENDHDR */
+    }
+    if (maxval != 255 || depth < 1 || depth > 4 || sprite->w <= 0 || sprite->h <= 0) {
+        return SDL_SetError("only 8 bit gray, RGB or RGBA images are supported");
+    }
+    if (!fits_page(sprite)) {
+        return false;
+    }
+    if (p > end || (size_t)(end - p) / (size_t)depth / (size_t)sprite->w < (size_t)sprite->h) {
+        return SDL_SetError("truncated image");
+    }
+
+    sprite->rgba = (Uint8 *)SDL_malloc((size_t)sprite->w * sprite->h * 4);
+    if (!sprite->rgba) {
+        return false;
+    }
+    for (i = 0; i < sprite->w * sprite->h; i++, p += depth) {
+        Uint8 *out = &sprite->rgba[i * 4];
+        switch (depth) {
+        case 1: /* gray */
+        case 2: /* gray, alpha */
+            out[0] = out[1] = out[2] = p[0];
+            out[3] = depth == 2 ? p[1] : 255;
+            break;
+        default:
+            out[0] = p[0];
+            out[1] = p[1];
+            out[2] = p[2];
+            out[3] = depth == 4 ? p[3] : 255;
+            break;
+        }
+    }
+    return true;
+}
+
+static int compare_sprites(const void *a, const void *b)
+{
+    const Sprite *sa = (const Sprite *)a, *sb = (const Sprite *)b;
+
+    if (sa->h != sb->h) {
+        return sb->h - sa->h;
+    }
+    if (sa->w != sb->w) {
+        return sb->w - sa->w;
+    }
+    return SDL_strcmp(sa->name, sb->name);
+}
+
+static bool collect(const char *dir)
+{
+    char **paths;
+    int count, i;
+
+    paths = SDL_GlobDirectory(dir, NULL, 0, &count);
+    if (!paths) {
+        fprintf(stderr, "Couldn't list %s: %s\n", dir, SDL_GetError());
+        return false;
+    }
+    sprites = (Sprite *)SDL_calloc((size_t)count + 1, sizeof(Sprite));
+    if (!sprites) {
+        SDL_free(paths);
+        return false;
+    }
+
+    for (i = 0; i < count; i++) {
+        const char *ext = SDL_strrchr(paths[i], '.');
+        Sprite *s = &sprites[sprite_count];
+        char *full, *c;
+        size_t size;
+        Uint8 *data;
+        bool ok;
+
+        if (!ext || (SDL_strcasecmp(ext, ".ppm") != 0 && SDL_strcasecmp(ext, ".pam") != 0 &&
+                     SDL_strcasecmp(ext, ".qoi") != 0)) {
+            continue;
+        }
+        if (SDL_asprintf(&full, "%s/%s", dir, paths[i]) < 0) {
+            SDL_free(paths);
+            return false;
+        }
+        data = (Uint8 *)SDL_LoadFile(full, &size);
+        ok = data && (SDL_strcasecmp(ext, ".qoi") == 0 ? read_qoi(s, data, size) : read_image(s, data, size));
+        SDL_free(data);
+        if (!ok) {
+            fprintf(stderr, "Couldn't read %s: %s\n", full, SDL_GetError());
+            SDL_free(full);
+            SDL_free(paths);
+            return false;
+        }
+        SDL_free(full);
+
+        s->name = SDL_strdup(paths[i]);
+        s->name[ext - paths[i]] = '\0';
+        for (c = s->name; *c; c++) {
+            if (*c == '\\') {
+                *c = '/';
+            }
+        }
+        sprite_count++;
+    }
+    SDL_free(paths);
+
+    SDL_qsort(sprites, (size_t)sprite_count, sizeof(Sprite), compare_sprites);
+    return true;
+}
+
+/* skyline packing */
+static Page *add_page(void)
+{
+    Page *grown = (Page *)SDL_realloc(pages, ((size_t)page_count + 1) * sizeof(Page));
+    Page *page;
+
+    if (!grown || page_count == MAX_PAGES) {
+        return NULL;
+    }
+    pages = grown;
+    page = &pages[page_count];
+    SDL_zerop(page);
+    /* every node is at least a pixel wide */
+    page->nodes = (SkylineNode *)SDL_calloc((size_t)page_size + 1, sizeof(SkylineNode));
+    if (!page->nodes) {
+        return NULL;
+    }
+    page->nodes[0].w = page_size;
+    page->count = 1;
+    page_count++;
+    return page;
+}
+
+/* the lowest y a w x h rectangle can sit at with its left edge on node i, or -1 */
+static int skyline_fit(const Page *page, int i, int w, int h)
+{
+    int x = page->nodes[i].x, y = 0, left = w;
+
+    if (x + w > page_size) {
+        return -1;
+    }
+    while (left > 0) {
+        y = SDL_max(y, page->nodes[i].y);
+        if (y + h > page_size) {
+            return -1;
+        }
+        left -= page->nodes[i].w;
+        i++;
+    }
+    return y;
+}
+
+static void skyline_add(Page *page, int at, int x, int y, int w, int h)
+{
+    int i;
+
+    SDL_memmove(&page->nodes[at + 1], &page->nodes[at], (size_t)(page->count - at) * sizeof(SkylineNode));
+    page->nodes[at].x = x;
+    page->nodes[at].y = y + h;
+    page->nodes[at].w = w;
+    page->count++;
+
+    /* trim or drop the nodes the new one now covers */
+    for (i = at + 1; i < page->count; i++) {
+        SkylineNode *n = &page->nodes[i];
+        const int shrink = page->nodes[i - 1].x + page->nodes[i - 1].w - n->x;
+
+        if (shrink <= 0) {
+            break;
+        }
+        if (shrink < n->w) {
+            n->x += shrink;
+            n->w -= shrink;
+            break;
+        }
+        SDL_memmove(n, n + 1, (size_t)(page->count - i - 1) * sizeof(SkylineNode));
+        page->count--;
+        i--;
+    }
+
+    /* merge neighbours at the same height */
+    for (i = 0; i + 1 < page->count; i++) {
+        if (page->nodes[i].y == page->nodes[i + 1].y) {
+            page->nodes[i].w += page->nodes[i + 1].w;
+            SDL_memmove(&page->nodes[i + 1], &page->nodes[i + 2],
+                        (size_t)(page->count - i - 2) * sizeof(SkylineNode));
+            page->count--;
+            i--;
+        }
+    }
+
+    page->width = SDL_max(page->width, x + w);
+    page->height = SDL_max(page->height, y + h);
+}
+
+/* bottom-left: the position whose top is lowest, then the narrowest node */
+static bool skyline_place(Page *page, int w, int h, int *x, int *y)
+{
+    int best = -1, best_top = 0, best_width = 0, i;
+
+    for (i = 0; i < page->count; i++) {
+        const int fit = skyline_fit(page, i, w, h);
+        if (fit >= 0 && (best < 0 || fit + h < best_top || (fit + h == best_top && page->nodes[i].w < best_width))) {
+            best = i;
+            best_top = fit + h;
+            best_width = page->nodes[i].w;
+            *y = fit;
+        }
+    }
+    if (best < 0) {
+        return false;
+    }
+    *x = page->nodes[best].x;
+    skyline_add(page, best, *x, *y, w, h);
+    return true;
+}
+
+static bool pack_sprites(void)
+{
+    int i, p;
+
+    for (i = 0; i < sprite_count; i++) {
+        Sprite *s = &sprites[i];
+        const int w = s->w + 2 * padding, h = s->h + 2 * padding;
+
+        for (p = 0; p < page_count; p++) {
+            if (skyline_place(&pages[p], w, h, &s->x, &s->y)) {
+                break;
+            }
+        }
+        if (p == page_count && (!add_page() || !skyline_place(&pages[p], w, h, &s->x, &s->y))) {
+            fprintf(stderr, "Couldn't place %s\n", s->name);
+            return false;
+        }
+        s->page = p;
+    }
+    return true;
+}
+
+/* output */
+static Uint8 *page_pixels(int p)
+{
+    const int pw = pages[p].width, ph = pages[p].height;
+    Uint8 *pixels = (Uint8 *)SDL_calloc((size_t)pw * ph, 4);
+    int i, x, y;
+
+    if (!pixels) {
+        return NULL;
+    }
+    for (i = 0; i < sprite_count; i++) {
+        const Sprite *s = &sprites[i];
+
+        if (s->page != p) {
+            continue;
+        }
+        /* each padding pixel repeats the nearest edge pixel */
+        for (y = 0; y < s->h + 2 * padding; y++) {
+            const int sy = SDL_clamp(y - padding, 0, s->h - 1);
+            Uint8 *row = &pixels[((size_t)(s->y + y) * pw + s->x) * 4];
+
+            for (x = 0; x < s->w + 2 * padding; x++) {
+                const int sx = SDL_clamp(x - padding, 0, s->w - 1);
+                SDL_memcpy(&row[x * 4], &s->rgba[((size_t)sy * s->w + sx) * 4], 4);
+            }
+        }
+    }
+    return pixels;
+}
+
+/*
+ * Replaces each pixel with its index in `palette` if the page has at most
+ * 256 colours. Returns the number of colours, or 0 if there are too many.
+ */
+static int index_colors(const Uint8 *pixels, size_t count, Uint32 *palette, Uint8 *indices)
+{
+    Sint16 slots[1024];
+    int colors = 0;
+    size_t i;
+
+    SDL_memset(slots, 0xFF, sizeof(slots));
+    for (i = 0; i < count; i++) {
+        Uint32 color, slot;
+
+        SDL_memcpy(&color, &pixels[i * 4], 4);
+        slot = (color * 0x9E3779B1U) >> 22;
+        while (slots[slot] >= 0 && palette[slots[slot]] != color) {
+            slot = (slot + 1) & 1023;
+        }
+        if (slots[slot] < 0) {
+            if (colors == 256) {
+                return 0;
+            }
+            palette[colors] = color;
+            slots[slot] = (Sint16)colors++;
+        }
+        indices[i] = (Uint8)slots[slot];
+    }
+    return colors;
+}
+
+/* pages with few colours are written indexed, 4 or 8 bits per pixel */
+static bool write_page(const char *path, int p)
+{
+    const size_t count = (size_t)pages[p].width * pages[p].height;
+    Uint8 *pixels = page_pixels(p);
+    Uint8 *indices = (Uint8 *)SDL_malloc(count);
+    Uint32 palette[256];
+    ImageHeader header;
+    FILE *out;
+    int colors = 0;
+    bool ok;
+
+    if (!pixels || !indices) {
+        SDL_free(pixels);
+        SDL_free(indices);
+        return false;
+    }
+    SDL_zeroa(palette);
+    if (indexed) {
+        colors = index_colors(pixels, count, palette, indices);
+    }
+
+    SDL_zero(header);
+    SDL_memcpy(header.magic, IMAGE_MAGIC, 4);
+    header.width = (Uint16)pages[p].width;
+    header.height = (Uint16)pages[p].height;
+    header.format = colors == 0 ? IMAGE_RGBA8 : colors <= 16 ? IMAGE_INDEXED4 : IMAGE_INDEXED8;
+
+    out = fopen(path, "wb");
+    ok = out && fwrite(&header, sizeof(header), 1, out) == 1;
+    if (ok && header.format == IMAGE_RGBA8) {
+        ok = fwrite(pixels, 4, count, out) == count;
+    } else if (ok && header.format == IMAGE_INDEXED8) {
+        ok = fwrite(palette, 4, 256, out) == 256 && fwrite(indices, 1, count, out) == count;
+    } else if (ok) {
+        const size_t row_bytes = ((size_t)header.width + 1) / 2;
+        size_t x, y, at = 0;
+
+        /* pack two indices per byte in place, the packed rows never overtake the source */
+        for (y = 0; y < header.height; y++) {
+            const Uint8 *row = &indices[y * header.width];
+            for (x = 0; x < header.width; x += 2) {
+                indices[at++] = (Uint8)((row[x] << 4) | (x + 1 < header.width ? row[x + 1] : 0));
+            }
+        }
+        ok = fwrite(palette, 4, 16, out) == 16 && fwrite(indices, 1, row_bytes * header.height, out) == row_bytes * header.height;
+    }
+    if (out && fclose(out) != 0) {
+        ok = false;
+    }
+    SDL_free(pixels);
+    SDL_free(indices);
+    if (!ok) {
+        fprintf(stderr, "Couldn't write %s\n", path);
+    }
+    return ok;
+}
+
+static bool write_atlas(const char *path)
+{
+    const char *slash = SDL_strrchr(path, '/');
+    const char *ext = SDL_strrchr(path, '.');
+    const int base_len = ext && (!slash || ext > slash) ? (int)(ext - path) : (int)SDL_strlen(path);
+    const int dir_len = slash ? (int)(slash - path) + 1 : 0;
+    Uint32 table_size = 2, names_size = 0, i;
+    AtlasHeader header;
+    AtlasPage *page_index = (AtlasPage *)SDL_calloc((size_t)page_count + 1, sizeof(AtlasPage));
+    AtlasRegion *regions = (AtlasRegion *)SDL_calloc((size_t)sprite_count + 1, sizeof(AtlasRegion));
+    Uint32 *table;
+    char **page_names = (char **)SDL_calloc((size_t)page_count + 1, sizeof(char *));
+    FILE *out = NULL;
+    bool ok = false;
+    int p;
+
+    while (table_size < 2 * (Uint32)sprite_count) {
+        table_size *= 2;
+    }
+    table = (Uint32 *)SDL_calloc(table_size, sizeof(Uint32));
+    if (!page_index || !regions || !table || !page_names) {
+        goto done;
+    }
+
+    for (p = 0; p < page_count; p++) {
+        char *page_path;
+
+        if (SDL_asprintf(&page_path, "%.*s-%d.tjsi", base_len, path, p) < 0) {
+            goto done;
+        }
+        if (!write_page(page_path, p)) {
+            SDL_free(page_path);
+            goto done;
+        }
+        page_names[p] = SDL_strdup(page_path + dir_len);
+        SDL_free(page_path);
+        page_index[p].name = names_size;
+        page_index[p].width = (Uint16)pages[p].width;
+        page_index[p].height = (Uint16)pages[p].height;
+        names_size += (Uint32)SDL_strlen(page_names[p]) + 1;
+    }
+
+    for (i = 0; i < (Uint32)sprite_count; i++) {
+        const Sprite *s = &sprites[i];
+        const float pw = (float)pages[s->page].width, ph = (float)pages[s->page].height;
+        AtlasRegion *r = &regions[i];
+        Uint32 slot = pack_hash(s->name, 0) & (table_size - 1);
+
+        while (table[slot] != 0) {
+            if (SDL_strcmp(sprites[table[slot] - 1].name, s->name) == 0) {
+                fprintf(stderr, "Two images are named %s\n", s->name);
+                goto done;
+            }
+            slot = (slot + 1) & (table_size - 1);
+        }
+        table[slot] = i + 1;
+
+        r->name = names_size;
+        r->page = (Uint16)s->page;
+        r->x = (Uint16)(s->x + padding);
+        r->y = (Uint16)(s->y + padding);
+        r->w = (Uint16)s->w;
+        r->h = (Uint16)s->h;
+        r->u0 = r->x / pw;
+        r->v0 = r->y / ph;
+        r->u1 = (r->x + r->w) / pw;
+        r->v1 = (r->y + r->h) / ph;
+        names_size += (Uint32)SDL_strlen(s->name) + 1;
+    }
+
+    SDL_zero(header);
+    SDL_memcpy(header.magic, ATLAS_MAGIC, 4);
+    header.version = ATLAS_VERSION;
+    header.pages = (Uint32)page_count;
+    header.regions = (Uint32)sprite_count;
+    header.table_size = table_size;
+    header.names_size = names_size;
+
+    out = fopen(path, "wb");
+    if (!out) {
+        fprintf(stderr, "Couldn't create %s\n", path);
+        goto done;
+    }
+    if (fwrite(&header, sizeof(header), 1, out) != 1 ||
+        (page_count && fwrite(page_index, sizeof(AtlasPage), (size_t)page_count, out) != (size_t)page_count) ||
+        (sprite_count && fwrite(regions, sizeof(AtlasRegion), (size_t)sprite_count, out) != (size_t)sprite_count) ||
+        fwrite(table, sizeof(Uint32), table_size, out) != table_size) {
+        goto write_error;
+    }
+    for (p = 0; p < page_count; p++) {
+        if (fwrite(page_names[p], 1, SDL_strlen(page_names[p]) + 1, out) != SDL_strlen(page_names[p]) + 1) {
+            goto write_error;
+        }
+    }
+    for (i = 0; i < (Uint32)sprite_count; i++) {
+        if (fwrite(sprites[i].name, 1, SDL_strlen(sprites[i].name) + 1, out) != SDL_strlen(sprites[i].name) + 1) {
+            goto write_error;
+        }
+    }
+    if (fclose(out) != 0) {
+        out = NULL;
+        goto write_error;
+    }
+    out = NULL;
+
+    printf("%s: %d sprites on %d page%s\n", path, sprite_count, page_count, page_count == 1 ? "" : "s");
+    ok = true;
+    goto done;
+
+write_error:
+    fprintf(stderr, "Couldn't write %s\n", path);
+done:
+    if (out) {
+        fclose(out);
+    }
+    for (p = 0; p < page_count && page_names; p++) {
+        SDL_free(page_names[p]);
+    }
+    SDL_free(page_names);
+    SDL_free(page_index);
+    SDL_free(regions);
+    SDL_free(table);
+    return ok;
+}
+
+int main(int argc, char *argv[])
+{
+    int arg = 1;
+
+    while (arg < argc && argv[arg][0] == '-') {
+        if (SDL_strcmp(argv[arg], "-r") == 0) {
+            indexed = false;
+            arg++;
+            continue;
+        }
+        if (arg + 1 == argc) {
+            break;
+        }
+        if (SDL_strcmp(argv[arg], "-s") == 0) {
+            page_size = SDL_atoi(argv[arg + 1]);
+        } else if (SDL_strcmp(argv[arg], "-p") == 0) {
+            padding = SDL_atoi(argv[arg + 1]);
+        } else {
+            break;
+        }
+        arg += 2;
+    }
+    if (argc - arg != 2 || page_size <= 0 || page_size > 0xFFFF || padding < 0 || padding > page_size / 4) {
+        fprintf(stderr, "Usage: %s [-r] [-s size] [-p padding] <out.atlas> <dir>\n", argv[0]);
+        return 1;
+    }
+    if (!collect(argv[arg + 1])) {
+        return 1;
+    }
+    if (sprite_count == 0) {
+        fprintf(stderr, "No images in %s\n", argv[arg + 1]);
+        return 1;
+    }
+    if (!pack_sprites()) {
+        return 1;
+    }
+    return write_atlas(argv[arg]) ? 0 : 1;
+}
@@ -0,0 +1,352 @@
+/*
+ * pack: builds a TJSP archive (see src/pack.h) from a directory.
+ *
+ *   pack [-0] <out.pak> <dir>
+ *
+ * Every file under <dir> becomes an entry named by its path relative to
+ * <dir>, so <dir>/main.js is the script the engine runs. Entries are LZ
+ * compressed when that saves at least an eighth of their size; -0 stores
+ * everything as is.
+ */
+#include <SDL3/SDL.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "lz.h"
+#include "pack.h"
+
+#define MAX_SEED 0x1000000U
+
+typedef struct
+{
+    char *name;
+    Uint8 *data;   /* as written to the archive */
+    Uint32 stored;
+    Uint32 size;
+    Uint32 codec;
+    Uint32 bucket;
+} InputFile;
+
+static InputFile *files;
+static Uint32 file_count;
+
+static int compare_names(const void *a, const void *b)
+{
+    return SDL_strcmp(((const InputFile *)a)->name, ((const InputFile *)b)->name);
+}
+
+static bool collect(const char *dir)
+{
+    char **paths;
+    int count, i;
+
+    paths = SDL_GlobDirectory(dir, NULL, 0, &count);
+    if (!paths) {
+        fprintf(stderr, "Couldn't list %s: %s\n", dir, SDL_GetError());
+        return false;
+    }
+    files = (InputFile *)SDL_calloc((size_t)count + 1, sizeof(InputFile));
+    if (!files) {
+        SDL_free(paths);
+        return false;
+    }
+
+    for (i = 0; i < count; i++) {
+        SDL_PathInfo info;
+        char *full, *c;
+        size_t size;
+
+        if (SDL_asprintf(&full, "%s/%s", dir, paths[i]) < 0) {
+            SDL_free(paths);
+            return false;
+        }
+        if (!SDL_GetPathInfo(full, &info) || info.type != SDL_PATHTYPE_FILE) {
+            SDL_free(full);
+            continue;
+        }
+        if (info.size > 0xFFFFFFFFU) {
+            fprintf(stderr, "%s is too large to pack\n", full);
+            SDL_free(full);
+            SDL_free(paths);
+            return false;
+        }
+
+        files[file_count].data = (Uint8 *)SDL_LoadFile(full, &size);
+        if (!files[file_count].data) {
+            fprintf(stderr, "Couldn't read %s: %s\n", full, SDL_GetError());
+            SDL_free(full);
+            SDL_free(paths);
+            return false;
+        }
+        SDL_free(full);
+        files[file_count].name = SDL_strdup(paths[i]);
+        for (c = files[file_count].name; *c; c++) {
+            if (*c == '\\') {
+                *c = '/';
+            }
+        }
+        files[file_count].size = files[file_count].stored = (Uint32)size;
+        files[file_count].codec = PACK_STORED;
+        file_count++;
+    }
+    SDL_free(paths);
+
+    /* sorted input keeps the archive reproducible */
+    SDL_qsort(files, file_count, sizeof(InputFile), compare_names);
+    return true;
+}
+
+static void compress_files(void)
+{
+    Uint32 i;
+
+    for (i = 0; i < file_count; i++) {
+        InputFile *f = &files[i];
+        Uint8 *out = (Uint8 *)SDL_malloc(LZ_BOUND((size_t)f->size));
+        size_t stored;
+
+        if (!out) {
+            continue;
+        }
+        stored = lz_compress(f->data, f->size, out, LZ_BOUND((size_t)f->size));
+        if (stored == 0 || stored > f->size - f->size / 8) {
+            SDL_free(out);
+            continue;
+        }
+        SDL_free(f->data);
+        f->data = out;
+        f->stored = (Uint32)stored;
+        f->codec = PACK_LZ;
+    }
+}
+
+/*
+ * Hash and displace: buckets are placed largest first, each trying seeds
+ * until all of its names land in free slots.
+ */
+static bool build_index(Uint32 buckets, Uint32 *displacement, Uint32 *slots)
+{
+    Uint32 *first, *members, *order, *tried;
+    bool *taken;
+    Uint32 i, j, b;
+    bool ok = true;
+
+    first = (Uint32 *)SDL_calloc(buckets + 1, sizeof(Uint32));
+    members = (Uint32 *)SDL_calloc(file_count + 1, sizeof(Uint32));
+    order = (Uint32 *)SDL_calloc(buckets, sizeof(Uint32));
+    tried = (Uint32 *)SDL_calloc(file_count + 1, sizeof(Uint32));
+    taken = (bool *)SDL_calloc(file_count + 1, sizeof(bool));
+    if (!first || !members || !order || !tried || !taken) {
+        ok = false;
+        goto done;
+    }
+
+    /* members[first[b] .. first[b + 1] - 1] are the files in bucket b */
+    for (i = 0; i < file_count; i++) {
+        files[i].bucket = pack_hash(files[i].name, 0) % buckets;
+        first[files[i].bucket + 1]++;
+    }
+    for (b = 0; b < buckets; b++) {
+        first[b + 1] += first[b];
+    }
+    for (i = 0; i < file_count; i++) {
+        members[first[files[i].bucket] + tried[files[i].bucket]++] = i;
+    }
+
+    /* counting sort of the buckets by size, largest first */
+    {
+        Uint32 largest = 0, at = 0, size;
+        for (b = 0; b < buckets; b++) {
+            largest = SDL_max(largest, first[b + 1] - first[b]);
+        }
+        for (size = largest + 1; size-- > 0;) {
+            for (b = 0; b < buckets; b++) {
+                if (first[b + 1] - first[b] == size) {
+                    order[at++] = b;
+                }
+            }
+        }
+    }
+
+    for (i = 0; i < buckets; i++) {
+        const Uint32 begin = first[order[i]], end = first[order[i] + 1];
+        Uint32 seed;
+
+        b = order[i];
+        displacement[b] = 1;
+        if (begin == end) {
+            continue;
+        }
+        for (seed = 1; seed < MAX_SEED; seed++) {
+            Uint32 placed = 0;
+
+            for (j = begin; j < end; j++) {
+                Uint32 slot = pack_hash(files[members[j]].name, seed) % file_count;
+                if (taken[slot]) {
+                    break;
+                }
+                taken[slot] = true;
+                tried[placed++] = slot;
+            }
+            if (j == end) {
+                break;
+            }
+            while (placed > 0) {
+                taken[tried[--placed]] = false;
+            }
+        }
+        if (seed == MAX_SEED) {
+            ok = false;
+            goto done;
+        }
+        displacement[b] = seed;
+    }
+
+    for (i = 0; i < file_count; i++) {
+        slots[pack_hash(files[i].name, displacement[files[i].bucket]) % file_count] = i;
+    }
+
+done:
+    SDL_free(first);
+    SDL_free(members);
+    SDL_free(order);
+    SDL_free(tried);
+    SDL_free(taken);
+    return ok;
+}
+
+static bool write_padding(FILE *out, Uint64 to)
+{
+    static const Uint8 zeros[PACK_ALIGN];
+    long at = ftell(out);
+
+    if (at < 0) {
+        return false;
+    }
+    return (Uint64)at >= to || fwrite(zeros, 1, (size_t)(to - (Uint64)at), out) == to - (Uint64)at;
+}
+
+static Uint64 align_up(Uint64 v, Uint64 to)
+{
+    return (v + to - 1) & ~(to - 1);
+}
+
+static bool write_pack(const char *path)
+{
+    const Uint32 buckets = file_count > 4 ? (file_count + 3) / 4 : 1;
+    Uint32 *displacement = (Uint32 *)SDL_calloc(buckets, sizeof(Uint32));
+    Uint32 *slots = (Uint32 *)SDL_calloc(file_count + 1, sizeof(Uint32));
+    PackEntry *entries = (PackEntry *)SDL_calloc(file_count + 1, sizeof(PackEntry));
+    PackHeader header;
+    Uint64 offset, total = 0, raw = 0;
+    Uint32 i, names_size = 0;
+    FILE *out = NULL;
+    bool ok = false;
+
+    if (!displacement || !slots || !entries) {
+        goto done;
+    }
+    if (!build_index(buckets, displacement, slots)) {
+        fprintf(stderr, "Couldn't build the pack index\n");
+        goto done;
+    }
+
+    for (i = 0; i < file_count; i++) {
+        entries[i].name = names_size;
+        names_size += (Uint32)SDL_strlen(files[slots[i]].name) + 1;
+    }
+    offset = align_up(sizeof(PackHeader) + align_up(buckets * sizeof(Uint32), 8) +
+                      (Uint64)file_count * sizeof(PackEntry) + names_size, PACK_ALIGN);
+    for (i = 0; i < file_count; i++) {
+        const InputFile *f = &files[slots[i]];
+
+        entries[i].offset = align_up(offset, f->stored >= PACK_ALIGN ? PACK_ALIGN : PACK_SMALL_ALIGN);
+        entries[i].stored = f->stored;
+        entries[i].size = f->size;
+        entries[i].codec = f->codec;
+        offset = entries[i].offset + f->stored;
+        total += f->stored;
+        raw += f->size;
+    }
+
+    SDL_zero(header);
+    SDL_memcpy(header.magic, PACK_MAGIC, 4);
+    header.version = PACK_VERSION;
+    header.count = file_count;
+    header.buckets = buckets;
+    header.names_size = names_size;
+
+    out = fopen(path, "wb");
+    if (!out) {
+        fprintf(stderr, "Couldn't create %s\n", path);
+        goto done;
+    }
+    if (fwrite(&header, sizeof(header), 1, out) != 1 ||
+        fwrite(displacement, sizeof(Uint32), buckets, out) != buckets ||
+        !write_padding(out, sizeof(PackHeader) + align_up(buckets * sizeof(Uint32), 8)) ||
+        (file_count && fwrite(entries, sizeof(PackEntry), file_count, out) != file_count)) {
+        goto write_error;
+    }
+    for (i = 0; i < file_count; i++) {
+        const char *name = files[slots[i]].name;
+        if (fwrite(name, 1, SDL_strlen(name) + 1, out) != SDL_strlen(name) + 1) {
+            goto write_error;
+        }
+    }
+    for (i = 0; i < file_count; i++) {
+        const InputFile *f = &files[slots[i]];
+        if (!write_padding(out, entries[i].offset) || fwrite(f->data, 1, f->stored, out) != f->stored) {
+            goto write_error;
+        }
+    }
+    if (fclose(out) != 0) {
+        out = NULL;
+        goto write_error;
+    }
+    out = NULL;
+
+    printf("%s: %u files, %llu bytes stored from %llu\n", path, file_count,
+           (unsigned long long)total, (unsigned long long)raw);
+    ok = true;
+    goto done;
+
+write_error:
+    fprintf(stderr, "Couldn't write %s\n", path);
+done:
+    if (out) {
+        fclose(out);
+    }
+    SDL_free(displacement);
+    SDL_free(slots);
+    SDL_free(entries);
+    return ok;
+}
+
+int main(int argc, char *argv[])
+{
+    bool compress = true;
+    bool has_main = false;
+    int arg = 1;
+    Uint32 i;
+
+    if (argc > 1 && SDL_strcmp(argv[1], "-0") == 0) {
+        compress = false;
+        arg++;
+    }
+    if (argc - arg != 2) {
+        fprintf(stderr, "Usage: %s [-0] <out.pak> <dir>\n", argv[0]);
+        return 1;
+    }
+    if (!collect(argv[arg + 1])) {
+        return 1;
+    }
+    for (i = 0; i < file_count; i++) {
+        has_main |= SDL_strcmp(files[i].name, PACK_MAIN_SCRIPT) == 0;
+    }
+    if (!has_main) {
+        fprintf(stderr, "Warning: %s has no %s\n", argv[arg + 1], PACK_MAIN_SCRIPT);
+    }
+    if (compress) {
+        compress_files();
+    }
+    return write_pack(argv[arg]) ? 0 : 1;
+}